@@ -0,0 +1,58 @@
+// Benchmarks of the runtime's HashMap, which Malphas code cannot call
+// directly yet (std::collections::HashMap does not compile). Run with
+// malphas bench like the .mal benchmarks.
+#include "runtime.h"
+
+#define KEYS 1024
+
+static String *keys[KEYS];
+
+static void make_keys(void) {
+  if (keys[0]) {
+    return;
+  }
+  for (int i = 0; i < KEYS; i++) {
+    keys[i] = runtime_string_from_i64((int64_t)i * 7919);
+  }
+}
+
+// Inserting into a map that is cleared every KEYS puts, so it stays small
+int64_t bench_hashmap_put(int64_t n) {
+  make_keys();
+  HashMap *map = runtime_hashmap_new();
+  for (int64_t i = 0; i < n; i++) {
+    if (i % KEYS == 0) {
+      runtime_hashmap_clear(map);
+    }
+    runtime_hashmap_put(map, keys[i % KEYS], (void *)i);
+  }
+  return (int64_t)runtime_hashmap_len(map);
+}
+
+// Looking up keys that are all present
+int64_t bench_hashmap_get(int64_t n) {
+  make_keys();
+  HashMap *map = runtime_hashmap_new();
+  for (int i = 0; i < KEYS; i++) {
+    runtime_hashmap_put(map, keys[i], (void *)(intptr_t)i);
+  }
+  int64_t total = 0;
+  for (int64_t i = 0; i < n; i++) {
+    total += (int64_t)(intptr_t)runtime_hashmap_get(map, keys[(i * 7) % KEYS]);
+  }
+  return total;
+}
+
+// Looking up keys that are all missing
+int64_t bench_hashmap_miss(int64_t n) {
+  make_keys();
+  HashMap *map = runtime_hashmap_new();
+  for (int i = 0; i < KEYS / 2; i++) {
+    runtime_hashmap_put(map, keys[i], (void *)(intptr_t)i);
+  }
+  int64_t hits = 0;
+  for (int64_t i = 0; i < n; i++) {
+    hits += runtime_hashmap_contains_key(map, keys[KEYS / 2 + i % (KEYS / 2)]);
+  }
+  return hits;
+}
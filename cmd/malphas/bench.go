@@ -0,0 +1,556 @@
+package main
+
+import (
+	"bufio"
+	"context"
+	"encoding/json"
+	"flag"
+	"fmt"
+	"io"
+	"math"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"regexp"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+
+	"github.com/malphas-lang/malphas-lang/internal/ast"
+	"github.com/malphas-lang/malphas-lang/internal/parser"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// A benchmark is a function named bench_* that performs the operation being
+// measured n times:
+//
+//	fn bench_slice_push(n: int) { ... }
+//	fn bench_sum(n: int) -> int { ... }  // the result is kept alive
+//
+// Benchmarks live in files ending in _bench.mal, or in any .mal file under a
+// bench/ directory. Runtime benchmarks that the language cannot express yet
+// are written in C, in _bench.c files, as int64_t bench_*(int64_t n).
+// A benchmark file has no main: malphas bench generates one that hands each
+// benchmark to runtime_bench, which calibrates n and reports samples.
+
+// BenchSample is one timed run of a benchmark, per operation
+type BenchSample struct {
+	NsPerOp     float64 `json:"ns_per_op"`
+	AllocsPerOp float64 `json:"allocs_per_op"`
+	BytesPerOp  float64 `json:"bytes_per_op"`
+}
+
+// BenchSummary describes the distribution of ns/op over the samples
+type BenchSummary struct {
+	Mean   float64 `json:"mean"`
+	Median float64 `json:"median"`
+	StdDev float64 `json:"stddev"`
+	Min    float64 `json:"min"`
+	Max    float64 `json:"max"`
+}
+
+// BenchResult is the outcome of one benchmark
+type BenchResult struct {
+	File        string        `json:"file"`
+	Name        string        `json:"name"`
+	Iterations  int64         `json:"iterations"` // n of every sample
+	NsPerOp     BenchSummary  `json:"ns_per_op"`
+	AllocsPerOp float64       `json:"allocs_per_op"`
+	BytesPerOp  float64       `json:"bytes_per_op"`
+	Samples     []BenchSample `json:"samples"`
+}
+
+// BenchReport is what -json writes
+type BenchReport struct {
+	Time       string        `json:"time"`
+	BenchTime  string        `json:"benchtime"`
+	Count      int           `json:"count"`
+	Benchmarks []BenchResult `json:"benchmarks"`
+}
+
+// benchFunc is a discovered benchmark; Returns is the LLVM type of its
+// result ("void" or "i64")
+type benchFunc struct {
+	Name    string
+	Returns string
+}
+
+// runBench executes the bench command
+func runBench(args []string) {
+	fs := flag.NewFlagSet("bench", flag.ExitOnError)
+	pattern := fs.String("bench", ".", "run only the benchmarks whose name matches this regular expression")
+	benchTime := fs.Duration("benchtime", time.Second, "target duration of each sample")
+	count := fs.Int("count", 5, "number of samples per benchmark")
+	jsonOut := fs.String("json", "", "write the results as JSON to this file (- for stdout)")
+	fs.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: malphas bench [-bench regexp] [-benchtime d] [-count n] [-json file] [path...]\n")
+		fs.PrintDefaults()
+	}
+	fs.Parse(args)
+
+	filter, err := regexp.Compile(*pattern)
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "invalid -bench pattern: %v\n", err)
+		os.Exit(1)
+	}
+	if *count < 1 || *benchTime <= 0 {
+		fmt.Fprintf(os.Stderr, "-count and -benchtime must be positive\n")
+		os.Exit(1)
+	}
+
+	paths := fs.Args()
+	if len(paths) == 0 {
+		paths = []string{"."}
+	}
+	var benchFiles []string
+	for _, path := range paths {
+		files, err := findBenchFiles(path)
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "Error finding benchmark files: %v\n", err)
+			os.Exit(1)
+		}
+		benchFiles = append(benchFiles, files...)
+	}
+	if len(benchFiles) == 0 {
+		fmt.Printf("No benchmark files found in %s\n", strings.Join(paths, " "))
+		return
+	}
+
+	// With -json -, the report is the only thing on stdout
+	out := io.Writer(os.Stdout)
+	if *jsonOut == "-" {
+		out = os.Stderr
+	}
+
+	report := BenchReport{
+		Time:      time.Now().UTC().Format(time.RFC3339),
+		BenchTime: benchTime.String(),
+		Count:     *count,
+	}
+	failed := false
+	for _, file := range benchFiles {
+		results, err := runBenchFile(file, filter, *benchTime, *count, out)
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "%s: %v\n", file, err)
+			failed = true
+		}
+		report.Benchmarks = append(report.Benchmarks, results...)
+	}
+
+	if *jsonOut != "" {
+		data, err := json.MarshalIndent(report, "", "  ")
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "error encoding results: %v\n", err)
+			os.Exit(1)
+		}
+		data = append(data, '\n')
+		if *jsonOut == "-" {
+			os.Stdout.Write(data)
+		} else if err := os.WriteFile(*jsonOut, data, 0644); err != nil {
+			fmt.Fprintf(os.Stderr, "error writing %s: %v\n", *jsonOut, err)
+			os.Exit(1)
+		}
+	}
+	if failed {
+		os.Exit(1)
+	}
+}
+
+// findBenchFiles finds the benchmark files in a directory, or returns the
+// path itself if it is a file
+func findBenchFiles(path string) ([]string, error) {
+	info, err := os.Stat(path)
+	if err != nil {
+		return nil, err
+	}
+	if !info.IsDir() {
+		return []string{path}, nil
+	}
+
+	var files []string
+	err = filepath.Walk(path, func(p string, info os.FileInfo, err error) error {
+		if err != nil {
+			return err
+		}
+		if info.IsDir() {
+			if p != path && strings.HasPrefix(info.Name(), ".") {
+				return filepath.SkipDir
+			}
+			return nil
+		}
+		switch {
+		case strings.HasSuffix(p, "_bench.mal"), strings.HasSuffix(p, "_bench.c"):
+			files = append(files, p)
+		case strings.HasSuffix(p, ".mal") && filepath.Base(filepath.Dir(p)) == "bench":
+			files = append(files, p)
+		}
+		return nil
+	})
+	return files, err
+}
+
+// runBenchFile builds one benchmark file with a generated main and runs the
+// benchmarks in it that match filter
+func runBenchFile(filename string, filter *regexp.Regexp, benchTime time.Duration, count int, out io.Writer) ([]BenchResult, error) {
+	var objects []string
+	var funcs []benchFunc
+	var err error
+	defer func() {
+		for _, obj := range objects {
+			os.Remove(obj)
+		}
+	}()
+
+	runtimeDir := findRuntimeDir(filename)
+	if runtimeDir == "" {
+		return nil, fmt.Errorf("runtime/runtime.c not found")
+	}
+	lib, err := prepareRuntime(runtimeDir)
+	if err != nil {
+		return nil, err
+	}
+
+	if strings.HasSuffix(filename, ".c") {
+		funcs, err = findCBenchFunctions(filename)
+		if err != nil {
+			return nil, err
+		}
+		funcs = filterBenchFuncs(funcs, filter)
+		if len(funcs) == 0 {
+			return nil, nil
+		}
+		obj, err := compileC(filename, runtimeDir)
+		if err != nil {
+			return nil, err
+		}
+		objects = append(objects, obj)
+	} else {
+		var irFiles []string
+		irFiles, funcs, err = compileBenchSource(filename)
+		if err != nil {
+			return nil, err
+		}
+		defer removeFiles(irFiles)
+		funcs = filterBenchFuncs(funcs, filter)
+		if len(funcs) == 0 {
+			return nil, nil
+		}
+		// Benchmarks are always measured at -O2, whatever MALPHAS_OPT says
+		objs, err := compileUnits(irFiles, "2", lib)
+		if err != nil {
+			return nil, err
+		}
+		objects = append(objects, objs...)
+	}
+
+	// Generated main
+	harness, err := os.CreateTemp("", "malphas_bench_*.ll")
+	if err != nil {
+		return nil, err
+	}
+	defer os.Remove(harness.Name())
+	if _, err := harness.WriteString(benchHarnessIR(funcs)); err != nil {
+		harness.Close()
+		return nil, err
+	}
+	harness.Close()
+	obj, err := compileIR(harness.Name(), "2", nil)
+	if err != nil {
+		return nil, fmt.Errorf("benchmark main: %v", err)
+	}
+	objects = append(objects, obj)
+
+	exe, err := os.CreateTemp("", "malphas_bench_*")
+	if err != nil {
+		return nil, err
+	}
+	exe.Close()
+	defer os.Remove(exe.Name())
+	if err := linkProgram(exe.Name(), objects, lib); err != nil {
+		return nil, err
+	}
+
+	fmt.Fprintf(out, "%s\n", filename)
+	cmd := exec.Command(exe.Name())
+	cmd.Env = append(os.Environ(),
+		fmt.Sprintf("MALPHAS_BENCHTIME=%d", benchTime.Nanoseconds()),
+		fmt.Sprintf("MALPHAS_BENCHCOUNT=%d", count))
+	cmd.Stderr = os.Stderr
+	stdout, err := cmd.StdoutPipe()
+	if err != nil {
+		return nil, err
+	}
+	if err := cmd.Start(); err != nil {
+		return nil, err
+	}
+
+	var results []BenchResult
+	var current *BenchResult
+	scanner := bufio.NewScanner(stdout)
+	for scanner.Scan() {
+		line := scanner.Text()
+		name, n, sample, ok := parseBenchLine(line)
+		if !ok {
+			// Output of the benchmark itself
+			fmt.Fprintln(os.Stderr, line)
+			continue
+		}
+		if current == nil || current.Name != name {
+			results = append(results, BenchResult{File: filename, Name: name, Iterations: n})
+			current = &results[len(results)-1]
+		}
+		current.Samples = append(current.Samples, sample)
+		if len(current.Samples) == count {
+			summarizeBench(current)
+			fmt.Fprintln(out, formatBenchResult(current))
+		}
+	}
+	if err := cmd.Wait(); err != nil {
+		return results, fmt.Errorf("benchmark binary failed: %v", err)
+	}
+	if len(results) < len(funcs) || (current != nil && len(current.Samples) < count) {
+		return results, fmt.Errorf("benchmark binary exited before reporting every benchmark")
+	}
+	return results, nil
+}
+
+// compileBenchSource parses, checks and compiles a .mal benchmark file to
+// LLVM IR, and returns its benchmarks
+func compileBenchSource(filename string) ([]string, []benchFunc, error) {
+	src, err := os.ReadFile(filename)
+	if err != nil {
+		return nil, nil, fmt.Errorf("failed to read file: %v", err)
+	}
+
+	p := parser.New(string(src), parser.WithFilename(filename))
+	file := p.ParseFile()
+	if len(p.Errors()) > 0 {
+		return nil, nil, fmt.Errorf("parse errors: %v", p.Errors())
+	}
+
+	checker := types.NewChecker()
+	absFilename, err := filepath.Abs(filename)
+	if err != nil {
+		absFilename = filename
+	}
+	checker.CheckWithFilename(file, absFilename)
+	if len(checker.Errors) > 0 {
+		for _, e := range checker.Errors {
+			formatDiagnostic(e)
+		}
+		return nil, nil, fmt.Errorf("type check failed")
+	}
+
+	funcs, err := findBenchFunctions(file)
+	if err != nil {
+		return nil, nil, err
+	}
+
+	irFiles, err := compileToLLVM(file, checker)
+	if err != nil {
+		return nil, nil, err
+	}
+	return irFiles, funcs, nil
+}
+
+// findBenchFunctions finds the bench_* functions of a file and checks their
+// signatures
+func findBenchFunctions(file *ast.File) ([]benchFunc, error) {
+	var funcs []benchFunc
+	for _, decl := range file.Decls {
+		fnDecl, ok := decl.(*ast.FnDecl)
+		if !ok || fnDecl.Name == nil {
+			continue
+		}
+		name := fnDecl.Name.Name
+		if name == "main" {
+			return nil, fmt.Errorf("benchmark files must not define main (malphas bench generates it)")
+		}
+		if !strings.HasPrefix(name, "bench_") {
+			continue
+		}
+		if len(fnDecl.TypeParams) > 0 || len(fnDecl.Params) != 1 || !isNamedType(fnDecl.Params[0].Type, "int") {
+			return nil, fmt.Errorf("benchmark %s must have the signature fn %s(n: int) or fn %s(n: int) -> int", name, name, name)
+		}
+		returns := "void"
+		if fnDecl.ReturnType != nil {
+			if !isNamedType(fnDecl.ReturnType, "int") {
+				return nil, fmt.Errorf("benchmark %s must return nothing or int", name)
+			}
+			returns = "i64"
+		}
+		funcs = append(funcs, benchFunc{Name: name, Returns: returns})
+	}
+	return funcs, nil
+}
+
+func isNamedType(t ast.TypeExpr, name string) bool {
+	named, ok := t.(*ast.NamedType)
+	return ok && named.Name != nil && named.Name.Name == name
+}
+
+var cBenchFunc = regexp.MustCompile(`(?m)^int64_t\s+(bench_\w+)\s*\(\s*int64_t\s+\w+\s*\)\s*\{`)
+
+// findCBenchFunctions finds the int64_t bench_*(int64_t n) definitions of a
+// C benchmark file
+func findCBenchFunctions(filename string) ([]benchFunc, error) {
+	src, err := os.ReadFile(filename)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read file: %v", err)
+	}
+	var funcs []benchFunc
+	for _, m := range cBenchFunc.FindAllSubmatch(src, -1) {
+		funcs = append(funcs, benchFunc{Name: string(m[1]), Returns: "i64"})
+	}
+	return funcs, nil
+}
+
+func filterBenchFuncs(funcs []benchFunc, filter *regexp.Regexp) []benchFunc {
+	var kept []benchFunc
+	for _, fn := range funcs {
+		if filter.MatchString(fn.Name) {
+			kept = append(kept, fn)
+		}
+	}
+	return kept
+}
+
+// benchHarnessIR generates the main of a benchmark binary. Benchmarks that
+// return nothing are called through a wrapper, so runtime_bench sees one
+// signature.
+func benchHarnessIR(funcs []benchFunc) string {
+	var b strings.Builder
+	b.WriteString("; malphas bench main\n")
+	b.WriteString("declare void @runtime_gc_init()\n")
+	b.WriteString("declare void @runtime_bench(i8*, i64 (i64)*)\n\n")
+	for i, fn := range funcs {
+		fmt.Fprintf(&b, "@bench.name.%d = private unnamed_addr constant [%d x i8] c\"%s\\00\"\n", i, len(fn.Name)+1, fn.Name)
+		fmt.Fprintf(&b, "declare %s @%s(i64)\n", fn.Returns, fn.Name)
+		if fn.Returns == "void" {
+			fmt.Fprintf(&b, "define internal i64 @bench.run.%d(i64 %%n) {\n", i)
+			b.WriteString("entry:\n")
+			fmt.Fprintf(&b, "  call void @%s(i64 %%n)\n", fn.Name)
+			b.WriteString("  ret i64 0\n")
+			b.WriteString("}\n")
+		}
+		b.WriteString("\n")
+	}
+
+	b.WriteString("define i32 @main() {\n")
+	b.WriteString("entry:\n")
+	b.WriteString("  call void @runtime_gc_init()\n")
+	for i, fn := range funcs {
+		target := "@" + fn.Name
+		if fn.Returns == "void" {
+			target = fmt.Sprintf("@bench.run.%d", i)
+		}
+		fmt.Fprintf(&b, "  call void @runtime_bench(i8* getelementptr inbounds ([%d x i8], [%d x i8]* @bench.name.%d, i64 0, i64 0), i64 (i64)* %s)\n",
+			len(fn.Name)+1, len(fn.Name)+1, i, target)
+	}
+	b.WriteString("  ret i32 0\n")
+	b.WriteString("}\n")
+	return b.String()
+}
+
+// parseBenchLine parses a sample line printed by runtime_bench:
+// BENCH <name> <n> <ns> <allocs> <bytes>
+func parseBenchLine(line string) (string, int64, BenchSample, bool) {
+	fields := strings.Split(line, "\t")
+	if len(fields) != 6 || fields[0] != "BENCH" {
+		return "", 0, BenchSample{}, false
+	}
+	var nums [4]int64
+	for i := range nums {
+		v, err := strconv.ParseInt(fields[i+2], 10, 64)
+		if err != nil {
+			return "", 0, BenchSample{}, false
+		}
+		nums[i] = v
+	}
+	n := nums[0]
+	if n <= 0 {
+		return "", 0, BenchSample{}, false
+	}
+	return fields[1], n, BenchSample{
+		NsPerOp:     float64(nums[1]) / float64(n),
+		AllocsPerOp: float64(nums[2]) / float64(n),
+		BytesPerOp:  float64(nums[3]) / float64(n),
+	}, true
+}
+
+// summarizeBench fills in the statistics of a result from its samples
+func summarizeBench(r *BenchResult) {
+	if len(r.Samples) == 0 {
+		return
+	}
+	ns := make([]float64, len(r.Samples))
+	var allocs, bytes float64
+	for i, s := range r.Samples {
+		ns[i] = s.NsPerOp
+		allocs += s.AllocsPerOp
+		bytes += s.BytesPerOp
+	}
+	sort.Float64s(ns)
+
+	count := float64(len(ns))
+	var sum float64
+	for _, v := range ns {
+		sum += v
+	}
+	mean := sum / count
+	var sq float64
+	for _, v := range ns {
+		sq += (v - mean) * (v - mean)
+	}
+	stddev := 0.0
+	if len(ns) > 1 {
+		stddev = math.Sqrt(sq / (count - 1))
+	}
+	median := ns[len(ns)/2]
+	if len(ns)%2 == 0 {
+		median = (ns[len(ns)/2-1] + ns[len(ns)/2]) / 2
+	}
+
+	r.NsPerOp = BenchSummary{
+		Mean:   mean,
+		Median: median,
+		StdDev: stddev,
+		Min:    ns[0],
+		Max:    ns[len(ns)-1],
+	}
+	r.AllocsPerOp = allocs / count
+	r.BytesPerOp = bytes / count
+}
+
+// formatBenchResult formats a result as one line of the report
+func formatBenchResult(r *BenchResult) string {
+	spread := ""
+	if r.NsPerOp.Mean > 0 && len(r.Samples) > 1 {
+		spread = fmt.Sprintf(" ±%2.0f%%", 100*r.NsPerOp.StdDev/r.NsPerOp.Mean)
+	}
+	return fmt.Sprintf("  %-32s %12d %12.1f ns/op%s %10.2f allocs/op %10.1f B/op",
+		r.Name, r.Iterations, r.NsPerOp.Median, spread, r.AllocsPerOp, r.BytesPerOp)
+}
+
+// compileC compiles a C benchmark, which includes runtime.h, with the
+// runtime's flags
+func compileC(cFile string, runtimeDir string) (string, error) {
+	obj, err := os.CreateTemp("", "malphas_bench_*.o")
+	if err != nil {
+		return "", err
+	}
+	obj.Close()
+
+	args := append(runtimeCompileArgs(runtimeDir), "-c", "-o", obj.Name(), cFile)
+	ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
+	defer cancel()
+	cmd := exec.CommandContext(ctx, "clang", args...)
+	var stderrBuf strings.Builder
+	cmd.Stderr = &stderrBuf
+	if err := cmd.Run(); err != nil {
+		os.Remove(obj.Name())
+		return "", fmt.Errorf("compiling %s failed: %v\n%s", cFile, err, stderrBuf.String())
+	}
+	return obj.Name(), nil
+}
@@ -0,0 +1,155 @@
+package main
+
+import (
+	"math"
+	"testing"
+)
+
+func TestParseBenchLine(t *testing.T) {
+	tests := []struct {
+		name       string
+		line       string
+		wantOK     bool
+		wantName   string
+		wantN      int64
+		wantSample BenchSample
+	}{
+		{
+			name:       "sample",
+			line:       "BENCH\tbench_slice_push\t1000\t25000\t2000\t64000",
+			wantOK:     true,
+			wantName:   "bench_slice_push",
+			wantN:      1000,
+			wantSample: BenchSample{NsPerOp: 25, AllocsPerOp: 2, BytesPerOp: 64},
+		},
+		{
+			name:       "no allocations",
+			line:       "BENCH\tbench_add\t4\t2\t0\t0",
+			wantOK:     true,
+			wantName:   "bench_add",
+			wantN:      4,
+			wantSample: BenchSample{NsPerOp: 0.5},
+		},
+		{name: "program output", line: "hello", wantOK: false},
+		{name: "wrong tag", line: "BENCHX\tbench_add\t4\t2\t0\t0", wantOK: false},
+		{name: "missing field", line: "BENCH\tbench_add\t4\t2\t0", wantOK: false},
+		{name: "spaces instead of tabs", line: "BENCH bench_add 4 2 0 0", wantOK: false},
+		{name: "not a number", line: "BENCH\tbench_add\tfour\t2\t0\t0", wantOK: false},
+		{name: "zero iterations", line: "BENCH\tbench_add\t0\t2\t0\t0", wantOK: false},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			name, n, sample, ok := parseBenchLine(tt.line)
+			if ok != tt.wantOK {
+				t.Fatalf("expected ok=%v, got %v", tt.wantOK, ok)
+			}
+			if !ok {
+				return
+			}
+			if name != tt.wantName || n != tt.wantN {
+				t.Errorf("expected %s with n=%d, got %s with n=%d", tt.wantName, tt.wantN, name, n)
+			}
+			if sample != tt.wantSample {
+				t.Errorf("expected sample %+v, got %+v", tt.wantSample, sample)
+			}
+		})
+	}
+}
+
+func TestSummarizeBench(t *testing.T) {
+	tests := []struct {
+		name       string
+		samples    []BenchSample
+		want       BenchSummary
+		wantAllocs float64
+		wantBytes  float64
+	}{
+		{
+			name:    "no samples",
+			samples: nil,
+			want:    BenchSummary{},
+		},
+		{
+			name:       "one sample",
+			samples:    []BenchSample{{NsPerOp: 10, AllocsPerOp: 1, BytesPerOp: 16}},
+			want:       BenchSummary{Mean: 10, Median: 10, StdDev: 0, Min: 10, Max: 10},
+			wantAllocs: 1,
+			wantBytes:  16,
+		},
+		{
+			name: "odd count",
+			samples: []BenchSample{
+				{NsPerOp: 30, AllocsPerOp: 3},
+				{NsPerOp: 10, AllocsPerOp: 1},
+				{NsPerOp: 20, AllocsPerOp: 2},
+			},
+			want:       BenchSummary{Mean: 20, Median: 20, StdDev: 10, Min: 10, Max: 30},
+			wantAllocs: 2,
+		},
+		{
+			name: "even count",
+			samples: []BenchSample{
+				{NsPerOp: 4, BytesPerOp: 8},
+				{NsPerOp: 1, BytesPerOp: 8},
+				{NsPerOp: 3, BytesPerOp: 8},
+				{NsPerOp: 2, BytesPerOp: 8},
+			},
+			want:      BenchSummary{Mean: 2.5, Median: 2.5, StdDev: math.Sqrt(5.0 / 3), Min: 1, Max: 4},
+			wantBytes: 8,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			r := &BenchResult{Samples: tt.samples}
+			summarizeBench(r)
+			if r.NsPerOp != tt.want {
+				t.Errorf("expected %+v, got %+v", tt.want, r.NsPerOp)
+			}
+			if r.AllocsPerOp != tt.wantAllocs || r.BytesPerOp != tt.wantBytes {
+				t.Errorf("expected %v allocs/op and %v B/op, got %v and %v",
+					tt.wantAllocs, tt.wantBytes, r.AllocsPerOp, r.BytesPerOp)
+			}
+		})
+	}
+}
+
+func TestFormatBenchResult(t *testing.T) {
+	tests := []struct {
+		name   string
+		result BenchResult
+		want   string
+	}{
+		{
+			name: "several samples",
+			result: BenchResult{
+				Name:        "bench_slice_push",
+				Iterations:  1000000,
+				NsPerOp:     BenchSummary{Mean: 12.5, Median: 12, StdDev: 1.25},
+				AllocsPerOp: 0.5,
+				BytesPerOp:  24,
+				Samples:     make([]BenchSample, 5),
+			},
+			want: "  bench_slice_push                      1000000         12.0 ns/op ±10%       0.50 allocs/op       24.0 B/op",
+		},
+		{
+			name: "one sample has no spread",
+			result: BenchResult{
+				Name:       "bench_add",
+				Iterations: 10,
+				NsPerOp:    BenchSummary{Mean: 3, Median: 3},
+				Samples:    make([]BenchSample, 1),
+			},
+			want: "  bench_add                                  10          3.0 ns/op       0.00 allocs/op        0.0 B/op",
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if got := formatBenchResult(&tt.result); got != tt.want {
+				t.Errorf("expected\n%q\ngot\n%q", tt.want, got)
+			}
+		})
+	}
+}
@@ -0,0 +1,204 @@
+package main
+
+import (
+	"context"
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"sync"
+	"time"
+)
+
+// A program is generated as one LLVM unit per file module (see
+// mir2llvm.GenerateUnits). Each unit is optimized and compiled on its own, in
+// parallel, and the object files are kept in $MALPHAS_CACHE/objects (or
+// malphas/objects under the user cache directory) under a hash of the unit's
+// IR, the optimization level, the runtime bitcode linked into it and the LLVM
+// tools. A unit's IR only changes when its module, or an interface it uses,
+// does, so an unchanged module is never compiled twice. MALPHAS_NOCACHE=1
+// turns the cache off.
+
+// cacheDir returns the directory the cache of one kind (runtime, objects) is
+// kept in
+func cacheDir(kind string) (string, error) {
+	if dir := os.Getenv("MALPHAS_CACHE"); dir != "" {
+		return filepath.Join(dir, kind), nil
+	}
+	dir, err := os.UserCacheDir()
+	if err != nil {
+		return "", err
+	}
+	return filepath.Join(dir, "malphas", kind), nil
+}
+
+// unitError is a failure to compile one unit
+type unitError struct {
+	IRFile string
+	Err    error
+}
+
+func (e *unitError) Error() string {
+	return e.Err.Error()
+}
+
+// compileUnits compiles the units of a program to object files, in
+// parallel, reusing cached objects. The caller owns the returned files.
+func compileUnits(irFiles []string, optLevel string, lib *runtimeLib) ([]string, error) {
+	objects := make([]string, len(irFiles))
+	errs := make([]error, len(irFiles))
+	sem := make(chan struct{}, runtime.NumCPU())
+	var wg sync.WaitGroup
+	for i, irFile := range irFiles {
+		wg.Add(1)
+		go func(i int, irFile string) {
+			defer wg.Done()
+			sem <- struct{}{}
+			defer func() { <-sem }()
+			objects[i], errs[i] = compileUnit(irFile, optLevel, lib)
+		}(i, irFile)
+	}
+	wg.Wait()
+	for i, err := range errs {
+		if err != nil {
+			removeFiles(objects)
+			return nil, &unitError{IRFile: irFiles[i], Err: err}
+		}
+	}
+	return objects, nil
+}
+
+// compileUnit compiles one unit, or copies its object out of the cache
+func compileUnit(irFile string, optLevel string, lib *runtimeLib) (string, error) {
+	if os.Getenv("MALPHAS_NOCACHE") != "" {
+		return compileIR(irFile, optLevel, lib)
+	}
+	ir, err := os.ReadFile(irFile)
+	if err != nil {
+		return "", err
+	}
+	dir, err := cacheDir("objects")
+	if err != nil {
+		return compileIR(irFile, optLevel, lib)
+	}
+	key := objectKey(ir, optLevel, lib)
+	cached := filepath.Join(dir, key[:2], key+".o")
+	objFile := irFile + ".o"
+	if err := copyFile(cached, objFile); err == nil {
+		debugLog("Using cached object for %s\n", irFile)
+		return objFile, nil
+	}
+
+	obj, err := compileIR(irFile, optLevel, lib)
+	if err != nil {
+		return "", err
+	}
+	// The cache is best effort: a failure to fill it is not a failure to build
+	if err := os.MkdirAll(filepath.Dir(cached), 0755); err == nil {
+		tmp := fmt.Sprintf("%s.tmp%d", cached, os.Getpid())
+		if err := copyFile(obj, tmp); err == nil {
+			if err := os.Rename(tmp, cached); err != nil {
+				os.Remove(tmp)
+			}
+		}
+	}
+	return obj, nil
+}
+
+// objectKey hashes everything the object file for a unit depends on
+func objectKey(ir []byte, optLevel string, lib *runtimeLib) string {
+	h := sha256.New()
+	fmt.Fprintf(h, "opt %s\n", optLevel)
+	if lib != nil && lib.Bitcode != "" {
+		// The runtime's cache entry is named by its own key
+		fmt.Fprintf(h, "runtime %s\n", filepath.Base(filepath.Dir(lib.Bitcode)))
+	}
+	h.Write([]byte(llvmToolsVersion()))
+	h.Write(ir)
+	return hex.EncodeToString(h.Sum(nil))
+}
+
+var (
+	llvmVersionOnce sync.Once
+	llvmVersion     string
+)
+
+// llvmToolsVersion identifies the opt and llc a build uses
+func llvmToolsVersion() string {
+	llvmVersionOnce.Do(func() {
+		var b strings.Builder
+		if llcPath, err := findLLC(); err == nil {
+			out, _ := exec.Command(llcPath, "--version").Output()
+			fmt.Fprintf(&b, "llc %s\n%s", llcPath, out)
+		}
+		if optPath, err := findOpt(); err == nil {
+			fmt.Fprintf(&b, "opt %s\n", optPath)
+		}
+		llvmVersion = b.String()
+	})
+	return llvmVersion
+}
+
+// compileIR compiles an LLVM IR file to an object file: it links in the
+// runtime's leaf helpers (when lib has them and optimization is on), runs opt
+// at optLevel and then llc
+func compileIR(irFile string, optLevel string, lib *runtimeLib) (string, error) {
+	llcPath, err := findLLC()
+	if err != nil {
+		return "", err
+	}
+	objFile := irFile + ".o"
+	if optLevel != "0" && optLevel != "none" {
+		if linked := linkRuntimeBitcode(irFile, lib); linked != irFile {
+			defer os.Remove(linked)
+			irFile = linked
+		}
+	}
+	optimized, err := optimizeLLVM(irFile, optLevel)
+	if err == nil && optimized != irFile {
+		defer os.Remove(optimized)
+		irFile = optimized
+	}
+
+	ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
+	defer cancel()
+	args := []string{"-filetype=obj", "-relocation-model=pic", "-o", objFile, irFile}
+	if optLevel != "0" && optLevel != "none" {
+		args = append([]string{"-O2"}, args...)
+	}
+	if err := runTool(ctx, llcPath, args...); err != nil {
+		return "", fmt.Errorf("llc failed: %v", err)
+	}
+	return objFile, nil
+}
+
+func copyFile(src, dst string) error {
+	in, err := os.Open(src)
+	if err != nil {
+		return err
+	}
+	defer in.Close()
+	out, err := os.Create(dst)
+	if err != nil {
+		return err
+	}
+	if _, err := io.Copy(out, in); err != nil {
+		out.Close()
+		os.Remove(dst)
+		return err
+	}
+	return out.Close()
+}
+
+func removeFiles(files []string) {
+	for _, f := range files {
+		if f != "" {
+			os.Remove(f)
+		}
+	}
+}
@@ -15,6 +15,7 @@ import (
 	"github.com/malphas-lang/malphas-lang/internal/diag"
 	"github.com/malphas-lang/malphas-lang/internal/lsp"
 	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/mir/optimize"
 	"github.com/malphas-lang/malphas-lang/internal/parser"
 	"github.com/malphas-lang/malphas-lang/internal/types"
 )
@@ -167,6 +168,10 @@ func formatDiagnostic(d diag.Diagnostic) {
 	formatter.Format(d)
 }
 
+// reportEscapes makes compileToLLVM print the escape analysis notes of the
+// program's own functions to stderr (malphas build -m)
+var reportEscapes bool
+
 func debugLog(format string, a ...interface{}) {
 	if os.Getenv("MALPHAS_DEBUG") != "" {
 		fmt.Fprintf(os.Stderr, "[DEBUG] "+format, a...)
@@ -178,10 +183,11 @@ func main() {
 	flag.Usage = func() {
 		fmt.Fprintf(os.Stderr, "Usage: malphas [flags] <command> [arguments]\n")
 		fmt.Fprintf(os.Stderr, "\nCommands:\n")
-		fmt.Fprintf(os.Stderr, "  build <file>    Compile a Malphas source file\n")
-		fmt.Fprintf(os.Stderr, "  run <file>      Compile and run a Malphas source file\n")
+		fmt.Fprintf(os.Stderr, "  build <file>    Compile a Malphas source file (-m: report escaping allocations)\n")
+		fmt.Fprintf(os.Stderr, "  run <file>      Compile and run a Malphas source file (-trace, -stats: see run -h)\n")
 		fmt.Fprintf(os.Stderr, "  fmt <file>      Format a Malphas source file\n")
 		fmt.Fprintf(os.Stderr, "  test [path]     Run tests in the specified path (default: current directory)\n")
+		fmt.Fprintf(os.Stderr, "  bench [path]    Run the bench_* benchmarks in the specified path (see bench -h)\n")
 		fmt.Fprintf(os.Stderr, "  lsp             Start the Language Server Protocol server\n")
 		fmt.Fprintf(os.Stderr, "  version         Show version information\n")
 	}
@@ -204,6 +210,8 @@ func main() {
 		runFmt(args)
 	case "test":
 		// runTest(args)
+	case "bench":
+		runBench(args)
 	case "lsp":
 		runLSP()
 	case "version", "-v", "--version":
@@ -215,11 +223,11 @@ func main() {
 	}
 }
 
-func compileToTemp(filename string) (string, error) {
+func compileToTemp(filename string) ([]string, error) {
 	// Read file
 	src, err := os.ReadFile(filename)
 	if err != nil {
-		return "", fmt.Errorf("error reading file: %v", err)
+		return nil, fmt.Errorf("error reading file: %v", err)
 	}
 
 	// Parse
@@ -278,7 +286,7 @@ func compileToTemp(filename string) (string, error) {
 
 			formatDiagnostic(diagErr)
 		}
-		return "", fmt.Errorf("parse failed")
+		return nil, fmt.Errorf("parse failed")
 	}
 
 	// Type Check
@@ -297,34 +305,48 @@ func compileToTemp(filename string) (string, error) {
 			}
 			formatDiagnostic(err)
 		}
-		return "", fmt.Errorf("type check failed")
+		return nil, fmt.Errorf("type check failed")
 	}
 
 	// Compile to LLVM IR (via MIR)
 	return compileToLLVM(file, checker)
 }
 
-// compileToLLVM generates LLVM IR and returns the path to the .ll file.
+// compileToLLVM generates LLVM IR and returns the paths to the .ll files,
+// one per unit (see build_cache.go).
 // Uses MIR as an intermediate representation (AST -> MIR -> LLVM).
-func compileToLLVM(file *ast.File, checker *types.Checker) (string, error) {
+func compileToLLVM(file *ast.File, checker *types.Checker) ([]string, error) {
 	debugLog("Using MIR-to-LLVM codegen\n")
 
 	// Step 1: Lower AST to MIR
 	lowerer := mir.NewLowerer(checker.ExprTypes, checker.CallTypeArgs, checker.GlobalScope, checker.MethodTable, checker.Modules)
 	mirModule, err := lowerer.LowerModule(file)
 	if err != nil {
-		return "", fmt.Errorf("MIR lowering error: %v", err)
+		return nil, fmt.Errorf("MIR lowering error: %v", err)
 	}
 
 	// Step 2: Monomorphize generic functions
 	monomorphizer := mir.NewMonomorphizer(mirModule)
 	if err := monomorphizer.Monomorphize(); err != nil {
-		return "", fmt.Errorf("MIR monomorphization error: %v", err)
+		return nil, fmt.Errorf("MIR monomorphization error: %v", err)
+	}
+
+	// Step 3: Drop bounds checks proven by loop ranges
+	mirModule = optimize.EliminateBoundsChecks(mirModule)
+
+	// Step 4: Allocate the values that do not escape on the stack
+	mirModule, escapes := optimize.StackAllocate(mirModule)
+	if reportEscapes {
+		for _, note := range escapes {
+			if note.Func.Module == "" {
+				fmt.Fprintln(os.Stderr, note)
+			}
+		}
 	}
 
-	// Step 3: Generate LLVM IR from MIR
+	// Step 5: Generate LLVM IR from MIR, one unit per file module
 	llvmGen := mir2llvm.NewGenerator()
-	llvmIR, err := llvmGen.Generate(mirModule)
+	units, err := llvmGen.GenerateUnits(mirModule)
 	if err != nil {
 		// Report LLVM codegen errors
 		if len(llvmGen.Errors) > 0 {
@@ -335,7 +357,7 @@ func compileToLLVM(file *ast.File, checker *types.Checker) (string, error) {
 				formatDiagnostic(diagErr)
 			}
 		}
-		return "", fmt.Errorf("MIR-to-LLVM codegen error: %v", err)
+		return nil, fmt.Errorf("MIR-to-LLVM codegen error: %v", err)
 	}
 
 	// Check for errors even if Generate didn't return an error
@@ -346,42 +368,61 @@ func compileToLLVM(file *ast.File, checker *types.Checker) (string, error) {
 			}
 			formatDiagnostic(diagErr)
 		}
-		return "", fmt.Errorf("MIR-to-LLVM codegen failed with %d error(s)", len(llvmGen.Errors))
+		return nil, fmt.Errorf("MIR-to-LLVM codegen failed with %d error(s)", len(llvmGen.Errors))
 	}
 
-	// Create temp file for LLVM IR
-	tmpFile, err := os.CreateTemp("", "malphas_*.ll")
-	if err != nil {
-		return "", fmt.Errorf("error creating temp file: %v", err)
-	}
-	defer tmpFile.Close()
-
-	if _, err := tmpFile.WriteString(llvmIR); err != nil {
-		return "", fmt.Errorf("error writing LLVM IR: %v", err)
-	}
+	// Create temp files for LLVM IR
+	var irFiles []string
+	for _, unit := range units {
+		tmpFile, err := os.CreateTemp("", "malphas_*.ll")
+		if err != nil {
+			removeFiles(irFiles)
+			return nil, fmt.Errorf("error creating temp file: %v", err)
+		}
+		irFiles = append(irFiles, tmpFile.Name())
+		_, err = tmpFile.WriteString(unit.IR)
+		tmpFile.Close()
+		if err != nil {
+			removeFiles(irFiles)
+			return nil, fmt.Errorf("error writing LLVM IR: %v", err)
+		}
 
-	// Debug: print IR to stderr for inspection
-	if os.Getenv("MALPHAS_DEBUG_IR") != "" {
-		fmt.Fprintf(os.Stderr, "Generated LLVM IR:\n%s\n", llvmIR)
+		// Debug: print IR to stderr for inspection
+		if os.Getenv("MALPHAS_DEBUG_IR") != "" {
+			name := unit.Module
+			if name == "" {
+				name = "main"
+			}
+			fmt.Fprintf(os.Stderr, "Generated LLVM IR (%s):\n%s\n", name, unit.IR)
+		}
 	}
 
-	return tmpFile.Name(), nil
+	return irFiles, nil
 }
 
 func runBuild(args []string) {
+	fs := flag.NewFlagSet("build", flag.ExitOnError)
+	fs.BoolVar(&reportEscapes, "m", false, "print which allocations escape to the heap, and why")
+	fs.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: malphas build [-m] <file>\n")
+		fs.PrintDefaults()
+	}
+	fs.Parse(args)
+	args = fs.Args()
+
 	if len(args) < 1 {
-		fmt.Fprintf(os.Stderr, "Usage: malphas build <file>\n")
+		fs.Usage()
 		os.Exit(1)
 	}
 	filename := args[0]
 	fmt.Printf("Building %s...\n", filename)
 
-	tmpFile, err := compileToTemp(filename)
+	irFiles, err := compileToTemp(filename)
 	if err != nil {
 		fmt.Fprintf(os.Stderr, "%v\n", err)
 		os.Exit(1)
 	}
-	defer os.Remove(tmpFile)
+	defer removeFiles(irFiles)
 
 	// Determine output binary name
 	base := filepath.Base(filename)
@@ -389,8 +430,7 @@ func runBuild(args []string) {
 	outName := strings.TrimSuffix(base, ext)
 
 	// Find llc executable
-	llcPath, err := findLLC()
-	if err != nil {
+	if _, err := findLLC(); err != nil {
 		fmt.Fprintf(os.Stderr, "error: %v\n", err)
 		fmt.Fprintf(os.Stderr, "Note: LLVM backend requires 'llc' (LLVM compiler) to be installed\n")
 		fmt.Fprintf(os.Stderr, "  Install with: brew install llvm\n")
@@ -398,150 +438,8 @@ func runBuild(args []string) {
 		os.Exit(1)
 	}
 
-	// Apply LLVM optimizations if requested
-	optimizationLevel := os.Getenv("MALPHAS_OPT")
-	if optimizationLevel == "" {
-		optimizationLevel = "2" // Default to -O2
-	}
-	optimizedIRFile, err := optimizeLLVM(tmpFile, optimizationLevel)
-	if err == nil && optimizedIRFile != tmpFile {
-		// Use optimized IR file
-		defer os.Remove(optimizedIRFile)
-		tmpFile = optimizedIRFile
-	}
-
-	// Compile LLVM IR to object file
-	objFile := tmpFile + ".o"
-
-	// Add timeout for compilation
-	ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
-	defer cancel()
-
-	fmt.Fprintf(os.Stderr, "[DEBUG] Compiling LLVM IR to object file: %s -> %s\n", tmpFile, objFile)
-	cmd := exec.CommandContext(ctx, llcPath, "-filetype=obj", "-mtriple=arm64-apple-darwin", "-o", objFile, tmpFile)
-	var stderrBuf strings.Builder
-	cmd.Stdout = os.Stdout
-	cmd.Stderr = &stderrBuf
-	if err := cmd.Run(); err != nil {
-		if ctx.Err() == context.DeadlineExceeded {
-			fmt.Fprintf(os.Stderr, "LLVM compilation timed out after 60s\n")
-			os.Exit(1)
-		}
-		fmt.Fprintf(os.Stderr, "LLVM compilation failed: %v\n", err)
-		fmt.Fprintf(os.Stderr, "  llc path: %s\n", llcPath)
-		if stderrBuf.Len() > 0 {
-			fmt.Fprintf(os.Stderr, "\nllc error output:\n%s\n", stderrBuf.String())
-		}
-		// Also print the LLVM IR for debugging if it's small enough
-		if irContent, err := os.ReadFile(tmpFile); err == nil && len(irContent) < 10000 {
-			fmt.Fprintf(os.Stderr, "\nGenerated LLVM IR (for debugging):\n%s\n", string(irContent))
-		}
-		os.Exit(1)
-	}
-	fmt.Fprintf(os.Stderr, "[DEBUG] LLVM compilation successful\n")
-	defer os.Remove(objFile)
-
-	// Compile runtime library
-	runtimeDir := filepath.Join(filepath.Dir(filename), "..", "runtime")
-	if _, err := os.Stat(runtimeDir); os.IsNotExist(err) {
-		// Try relative to current directory
-		runtimeDir = "runtime"
-	}
-	runtimeC := filepath.Join(runtimeDir, "runtime.c")
-	runtimeObj := runtimeC + ".o"
-
-	// Check if runtime.c exists
-	if _, err := os.Stat(runtimeC); os.IsNotExist(err) {
-		// Try to find runtime directory relative to executable
-		exePath, _ := os.Executable()
-		if exePath != "" {
-			exeDir := filepath.Dir(exePath)
-			runtimeC = filepath.Join(exeDir, "..", "runtime", "runtime.c")
-			runtimeObj = runtimeC + ".o"
-		}
-	}
-
-	// Compile runtime if it exists
-	if _, err := os.Stat(runtimeC); err == nil {
-		// Compile runtime with GC support
-		// Note: Requires Boehm GC to be installed (libgc-dev on Ubuntu, bdw-gc on Homebrew)
-		// Try to find GC include path
-		gcIncludePath := ""
-		if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
-			// Check standard Homebrew location for bdw-gc
-			if _, err := os.Stat(brewPrefix + "/opt/bdw-gc/include/gc/gc.h"); err == nil {
-				gcIncludePath = brewPrefix + "/opt/bdw-gc/include"
-			} else if _, err := os.Stat(brewPrefix + "/include/gc/gc.h"); err == nil {
-				gcIncludePath = brewPrefix + "/include"
-			}
-		} else {
-			// Try common Homebrew locations
-			for _, prefix := range []string{"/opt/homebrew", "/usr/local"} {
-				if _, err := os.Stat(prefix + "/opt/bdw-gc/include/gc/gc.h"); err == nil {
-					gcIncludePath = prefix + "/opt/bdw-gc/include"
-					break
-				} else if _, err := os.Stat(prefix + "/include/gc/gc.h"); err == nil {
-					gcIncludePath = prefix + "/include"
-					break
-				}
-			}
-		}
-
-		compileArgs := []string{"-c", "-o", runtimeObj, runtimeC}
-		if gcIncludePath != "" {
-			compileArgs = append(compileArgs, "-I"+gcIncludePath)
-		}
-
-		// Use same context/timeout
-		debugLog("Compiling runtime: %s\n", runtimeC)
-		cmd = exec.CommandContext(ctx, "clang", compileArgs...)
-		cmd.Stdout = os.Stdout
-		cmd.Stderr = os.Stderr
-		if err := cmd.Run(); err != nil {
-			if ctx.Err() == context.DeadlineExceeded {
-				fmt.Fprintf(os.Stderr, "Runtime compilation timed out\n")
-				os.Exit(1)
-			}
-			fmt.Fprintf(os.Stderr, "Runtime compilation failed: %v\n", err)
-			fmt.Fprintf(os.Stderr, "Note: Boehm GC must be installed (libgc-dev on Ubuntu, bdw-gc on Homebrew)\n")
-			os.Exit(1)
-		}
-		debugLog("Runtime compilation successful\n")
-		defer os.Remove(runtimeObj)
-
-		// Link with runtime and Boehm GC library
-		linkArgs := []string{"-o", outName, objFile, runtimeObj, "-lgc"}
-		// Add library path if needed
-		if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
-			linkArgs = append(linkArgs, "-L"+brewPrefix+"/lib")
-		} else {
-			for _, prefix := range []string{"/opt/homebrew", "/usr/local"} {
-				if _, err := os.Stat(prefix + "/lib/libgc.a"); err == nil {
-					linkArgs = append(linkArgs, "-L"+prefix+"/lib")
-					break
-				}
-			}
-		}
-		linkArgs = append(linkArgs, "-pthread")
-		debugLog("Linking binary: %s\n", outName)
-		cmd = exec.CommandContext(ctx, "clang", linkArgs...)
-	} else {
-		// Link without runtime (will fail if runtime functions are called)
-		fmt.Fprintf(os.Stderr, "Warning: runtime.c not found, linking without runtime library\n")
-		// Still link with GC even if runtime.c is missing (in case it's needed)
-		debugLog("Linking binary without runtime: %s\n", outName)
-		cmd = exec.CommandContext(ctx, "clang", "-o", outName, objFile, "-lgc")
-	}
-
-	cmd.Stdout = os.Stdout
-	cmd.Stderr = os.Stderr
-	if err := cmd.Run(); err != nil {
-		if ctx.Err() == context.DeadlineExceeded {
-			fmt.Fprintf(os.Stderr, "Linking timed out\n")
-			os.Exit(1)
-		}
-		fmt.Fprintf(os.Stderr, "Linking failed: %v\n", err)
-		fmt.Fprintf(os.Stderr, "Note: LLVM backend requires 'clang' to be installed\n")
+	if err := buildExecutable(filename, irFiles, outName); err != nil {
+		fmt.Fprintf(os.Stderr, "%v\n", err)
 		os.Exit(1)
 	}
 	debugLog("Linking successful\n")
@@ -550,16 +448,26 @@ func runBuild(args []string) {
 }
 
 func runRun(args []string) {
+	fs := flag.NewFlagSet("run", flag.ExitOnError)
+	trace := fs.Bool("trace", false, "record a scheduler event trace (Chrome trace format)")
+	traceOut := fs.String("trace-out", "malphas-trace.json", "file the -trace output is written to")
+	stats := fs.Bool("stats", false, "print runtime statistics when the program exits")
+	fs.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: malphas run [-trace] [-trace-out file] [-stats] <file>\n")
+		fs.PrintDefaults()
+	}
+	fs.Parse(args)
+	args = fs.Args()
+
 	if len(args) < 1 {
-		fmt.Fprintf(os.Stderr, "Usage: malphas run <file>\n")
+		fs.Usage()
 		os.Exit(1)
 	}
 	filename := args[0]
 	debugLog("runRun started for file: %s\n", filename)
 
 	// Find llc executable
-	llcPath, err := findLLC()
-	if err != nil {
+	if _, err := findLLC(); err != nil {
 		fmt.Fprintf(os.Stderr, "error: %v\n", err)
 		fmt.Fprintf(os.Stderr, "Note: LLVM backend requires 'llc' (LLVM compiler) to be installed\n")
 		fmt.Fprintf(os.Stderr, "  Install with: brew install llvm\n")
@@ -569,76 +477,13 @@ func runRun(args []string) {
 
 	// For LLVM backend, build and run the binary
 	debugLog("Compiling to temp file...\n")
-	tmpFile, err := compileToTemp(filename)
+	irFiles, err := compileToTemp(filename)
 	if err != nil {
 		fmt.Fprintf(os.Stderr, "%v\n", err)
 		os.Exit(1)
 	}
-	debugLog("Compiled to temp file: %s\n", tmpFile)
-	defer os.Remove(tmpFile)
-
-	// Apply LLVM optimizations if requested
-	optimizationLevel := os.Getenv("MALPHAS_OPT")
-	if optimizationLevel == "" {
-		optimizationLevel = "2" // Default to -O2
-	}
-	debugLog("Applying optimizations (level %s)...\n", optimizationLevel)
-	optimizedIRFile, err := optimizeLLVM(tmpFile, optimizationLevel)
-	if err == nil && optimizedIRFile != tmpFile {
-		// Use optimized IR file
-		defer os.Remove(optimizedIRFile)
-		tmpFile = optimizedIRFile
-	}
-	debugLog("Optimization complete (or skipped)\n")
-
-	// Compile LLVM IR to object file
-	objFile := tmpFile + ".o"
-
-	// Add timeout for compilation
-	ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
-	defer cancel()
-
-	fmt.Fprintf(os.Stderr, "[DEBUG] Compiling LLVM IR to object file: %s -> %s\n", tmpFile, objFile)
-	cmd := exec.CommandContext(ctx, llcPath, "-filetype=obj", "-mtriple=arm64-apple-darwin", "-o", objFile, tmpFile)
-	var stderrBuf strings.Builder
-	cmd.Stdout = os.Stdout
-	cmd.Stderr = &stderrBuf
-	if err := cmd.Run(); err != nil {
-		if ctx.Err() == context.DeadlineExceeded {
-			fmt.Fprintf(os.Stderr, "LLVM compilation timed out after 60s\n")
-			os.Exit(1)
-		}
-		fmt.Fprintf(os.Stderr, "LLVM compilation failed: %v\n", err)
-		fmt.Fprintf(os.Stderr, "  llc path: %s\n", llcPath)
-		if stderrBuf.Len() > 0 {
-			fmt.Fprintf(os.Stderr, "\nllc error output:\n%s\n", stderrBuf.String())
-		}
-		// Also print the LLVM IR for debugging if it's small enough
-		if irContent, err := os.ReadFile(tmpFile); err == nil && len(irContent) < 10000 {
-			fmt.Fprintf(os.Stderr, "\nGenerated LLVM IR (for debugging):\n%s\n", string(irContent))
-		}
-		os.Exit(1)
-	}
-	fmt.Fprintf(os.Stderr, "[DEBUG] LLVM compilation successful\n")
-	defer os.Remove(objFile)
-
-	// Compile runtime library
-	runtimeDir := filepath.Join(filepath.Dir(filename), "..", "runtime")
-	if _, err := os.Stat(runtimeDir); os.IsNotExist(err) {
-		runtimeDir = "runtime"
-	}
-	runtimeC := filepath.Join(runtimeDir, "runtime.c")
-	runtimeObj := runtimeC + ".o"
-
-	// Check if runtime.c exists
-	if _, err := os.Stat(runtimeC); os.IsNotExist(err) {
-		exePath, _ := os.Executable()
-		if exePath != "" {
-			exeDir := filepath.Dir(exePath)
-			runtimeC = filepath.Join(exeDir, "..", "runtime", "runtime.c")
-			runtimeObj = runtimeC + ".o"
-		}
-	}
+	debugLog("Compiled to temp files: %v\n", irFiles)
+	defer removeFiles(irFiles)
 
 	// Create temporary binary
 	tmpBinary, err := os.CreateTemp("", "malphas_bin_*")
@@ -649,85 +494,8 @@ func runRun(args []string) {
 	tmpBinary.Close()
 	defer os.Remove(tmpBinary.Name())
 
-	// Compile runtime if it exists
-	if _, err := os.Stat(runtimeC); err == nil {
-		// Compile runtime with GC support
-		// Note: Requires Boehm GC to be installed (libgc-dev on Ubuntu, bdw-gc on Homebrew)
-		// Try to find GC include path
-		gcIncludePath := ""
-		if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
-			// Check standard Homebrew location for bdw-gc
-			if _, err := os.Stat(brewPrefix + "/opt/bdw-gc/include/gc/gc.h"); err == nil {
-				gcIncludePath = brewPrefix + "/opt/bdw-gc/include"
-			} else if _, err := os.Stat(brewPrefix + "/include/gc/gc.h"); err == nil {
-				gcIncludePath = brewPrefix + "/include"
-			}
-		} else {
-			// Try common Homebrew locations
-			for _, prefix := range []string{"/opt/homebrew", "/usr/local"} {
-				if _, err := os.Stat(prefix + "/opt/bdw-gc/include/gc/gc.h"); err == nil {
-					gcIncludePath = prefix + "/opt/bdw-gc/include"
-					break
-				} else if _, err := os.Stat(prefix + "/include/gc/gc.h"); err == nil {
-					gcIncludePath = prefix + "/include"
-					break
-				}
-			}
-		}
-
-		compileArgs := []string{"-c", "-o", runtimeObj, runtimeC}
-		if gcIncludePath != "" {
-			compileArgs = append(compileArgs, "-I"+gcIncludePath)
-		}
-
-		// Use same context/timeout
-		debugLog("Compiling runtime: %s\n", runtimeC)
-		cmd = exec.CommandContext(ctx, "clang", compileArgs...)
-		cmd.Stdout = os.Stdout
-		cmd.Stderr = os.Stderr
-		if err := cmd.Run(); err != nil {
-			if ctx.Err() == context.DeadlineExceeded {
-				fmt.Fprintf(os.Stderr, "Runtime compilation timed out\n")
-				os.Exit(1)
-			}
-			fmt.Fprintf(os.Stderr, "Runtime compilation failed: %v\n", err)
-			fmt.Fprintf(os.Stderr, "Note: Boehm GC must be installed (libgc-dev on Ubuntu, bdw-gc on Homebrew)\n")
-			os.Exit(1)
-		}
-		debugLog("Runtime compilation successful\n")
-		defer os.Remove(runtimeObj)
-
-		// Link with runtime and Boehm GC library
-		linkArgs := []string{"-o", tmpBinary.Name(), objFile, runtimeObj, "-lgc"}
-		// Add library path if needed
-		if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
-			linkArgs = append(linkArgs, "-L"+brewPrefix+"/lib")
-		} else {
-			for _, prefix := range []string{"/opt/homebrew", "/usr/local"} {
-				if _, err := os.Stat(prefix + "/lib/libgc.a"); err == nil {
-					linkArgs = append(linkArgs, "-L"+prefix+"/lib")
-					break
-				}
-			}
-		}
-		linkArgs = append(linkArgs, "-pthread")
-		debugLog("Linking binary: %s\n", tmpBinary.Name())
-		cmd = exec.CommandContext(ctx, "clang", linkArgs...)
-	} else {
-		fmt.Fprintf(os.Stderr, "Warning: runtime.c not found, linking without runtime library\n")
-		// Still link with GC even if runtime.c is missing (in case it's needed)
-		debugLog("Linking binary without runtime: %s\n", tmpBinary.Name())
-		cmd = exec.CommandContext(ctx, "clang", "-o", tmpBinary.Name(), objFile, "-lgc")
-	}
-
-	cmd.Stdout = os.Stdout
-	cmd.Stderr = os.Stderr
-	if err := cmd.Run(); err != nil {
-		if ctx.Err() == context.DeadlineExceeded {
-			fmt.Fprintf(os.Stderr, "Linking timed out\n")
-			os.Exit(1)
-		}
-		fmt.Fprintf(os.Stderr, "Linking failed: %v\n", err)
+	if err := buildExecutable(filename, irFiles, tmpBinary.Name()); err != nil {
+		fmt.Fprintf(os.Stderr, "%v\n", err)
 		os.Exit(1)
 	}
 	debugLog("Linking successful\n")
@@ -738,9 +506,17 @@ func runRun(args []string) {
 	defer runCancel()
 
 	debugLog("Running binary: %s\n", tmpBinary.Name())
-	cmd = exec.CommandContext(runCtx, tmpBinary.Name())
+	cmd := exec.CommandContext(runCtx, tmpBinary.Name())
 	cmd.Stdout = os.Stdout
 	cmd.Stderr = os.Stderr
+	cmd.Env = os.Environ()
+	if *trace {
+		os.Remove(*traceOut)
+		cmd.Env = append(cmd.Env, "MALPHAS_TRACE="+*traceOut)
+	}
+	if *stats {
+		cmd.Env = append(cmd.Env, "MALPHAS_STATS=1")
+	}
 	if err := cmd.Run(); err != nil {
 		if runCtx.Err() == context.DeadlineExceeded {
 			fmt.Fprintf(os.Stderr, "Execution timed out after 60s\n")
@@ -749,6 +525,55 @@ func runRun(args []string) {
 		os.Exit(1)
 	}
 	debugLog("Execution successful\n")
+	if *trace {
+		// The runtime only writes a trace once the scheduler has started
+		if _, err := os.Stat(*traceOut); err == nil {
+			fmt.Fprintf(os.Stderr, "Trace written to %s (open it in chrome://tracing or ui.perfetto.dev)\n", *traceOut)
+		} else {
+			fmt.Fprintf(os.Stderr, "No trace written: the program did not start any legions\n")
+		}
+	}
+}
+
+// buildExecutable compiles the LLVM IR units of a program and links them
+// with the runtime found for it. The runtime and unchanged units come from
+// the cache (see runtime_lib.go and build_cache.go).
+func buildExecutable(filename string, irFiles []string, outName string) error {
+	var lib *runtimeLib
+	if runtimeDir := findRuntimeDir(filename); runtimeDir != "" {
+		var err error
+		if lib, err = prepareRuntime(runtimeDir); err != nil {
+			return err
+		}
+	} else {
+		// Link without runtime (will fail if runtime functions are called)
+		fmt.Fprintf(os.Stderr, "Warning: runtime.c not found, linking without runtime library\n")
+	}
+
+	// Apply LLVM optimizations if requested
+	optimizationLevel := os.Getenv("MALPHAS_OPT")
+	if optimizationLevel == "" {
+		optimizationLevel = "2" // Default to -O2
+	}
+	debugLog("Compiling %v (optimization level %s)\n", irFiles, optimizationLevel)
+	objects, err := compileUnits(irFiles, optimizationLevel, lib)
+	if err != nil {
+		msg := fmt.Sprintf("LLVM compilation failed: %v", err)
+		// Also print the LLVM IR for debugging if it's small enough
+		if ue, ok := err.(*unitError); ok {
+			if irContent, err := os.ReadFile(ue.IRFile); err == nil && len(irContent) < 10000 {
+				msg += fmt.Sprintf("\nGenerated LLVM IR (for debugging):\n%s", string(irContent))
+			}
+		}
+		return fmt.Errorf("%s", msg)
+	}
+	defer removeFiles(objects)
+
+	debugLog("Linking binary: %s\n", outName)
+	if err := linkProgram(outName, objects, lib); err != nil {
+		return fmt.Errorf("%v\nNote: LLVM backend requires 'clang' to be installed", err)
+	}
+	return nil
 }
 
 func runFmt(args []string) {
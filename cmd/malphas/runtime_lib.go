@@ -0,0 +1,318 @@
+package main
+
+import (
+	"context"
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"regexp"
+	"strings"
+	"time"
+)
+
+// The runtime is compiled once per version of its sources and kept in a
+// cache directory ($MALPHAS_CACHE, or malphas/ under the user cache
+// directory), keyed by a hash of runtime.c, runtime.h, the C compiler and
+// the flags, so a build only compiles the user's code. Each entry holds
+//
+//   - libmalphas_rt.a: the whole runtime, linked into every program
+//   - runtime_inline.bc (when clang and the LLVM tools can make it): bitcode
+//     of the runtime's small leaf helpers, linked into the user's module
+//     before opt so that calls like runtime_string_equal can be inlined
+//
+// The helpers are linked as internal copies, so the archive's definitions
+// stay the ones the rest of the runtime (and other callers) use. That is only
+// sound for a helper that touches no runtime-private state, which is checked
+// when the entry is built: a helper whose code refers to a static global of
+// runtime.c (a scheduler pointer, a thread-local allocation buffer) is left out.
+
+// runtimeCFlags are the flags the runtime is compiled with
+var runtimeCFlags = []string{"-O2", "-fPIC"}
+
+// runtimeLeafHelpers are the runtime functions worth inlining into compiled
+// code, if they pass the check above
+var runtimeLeafHelpers = []string{
+	"runtime_string_cstr",
+	"runtime_string_equal",
+	"runtime_string_builder_len",
+	"runtime_slice_len",
+	"runtime_slice_get",
+	"runtime_slice_is_empty",
+	"runtime_hashmap_get",
+	"runtime_hashmap_contains_key",
+	"runtime_hashmap_len",
+	"runtime_hashmap_is_empty",
+	"runtime_channel_is_closed",
+}
+
+// runtimeLib is a prepared runtime, ready to link
+type runtimeLib struct {
+	Dir     string // Directory holding runtime.c and runtime.h
+	Archive string // libmalphas_rt.a
+	Bitcode string // runtime_inline.bc, or "" when there is none
+}
+
+// findRuntimeDir finds the runtime sources: next to the program (or up to a
+// few directories above it), in the current directory, or next to the
+// malphas executable
+func findRuntimeDir(filename string) string {
+	var candidates []string
+	dir := filepath.Dir(filename)
+	for i := 0; i < 4; i++ {
+		candidates = append(candidates, filepath.Join(dir, "runtime"))
+		parent := filepath.Dir(dir)
+		if parent == dir {
+			break
+		}
+		dir = parent
+	}
+	candidates = append(candidates, "runtime")
+	if exePath, err := os.Executable(); err == nil {
+		candidates = append(candidates, filepath.Join(filepath.Dir(exePath), "..", "runtime"))
+	}
+	for _, c := range candidates {
+		if _, err := os.Stat(filepath.Join(c, "runtime.c")); err == nil {
+			return c
+		}
+	}
+	return ""
+}
+
+// gcPrefix returns the prefix Boehm GC is installed under when it is not in
+// the compiler's default search paths (Homebrew), or ""
+func gcPrefix() string {
+	prefixes := []string{"/opt/homebrew", "/usr/local"}
+	if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
+		prefixes = []string{brewPrefix}
+	}
+	for _, prefix := range prefixes {
+		if _, err := os.Stat(prefix + "/opt/bdw-gc/include/gc/gc.h"); err == nil {
+			return prefix + "/opt/bdw-gc"
+		}
+		if _, err := os.Stat(prefix + "/include/gc/gc.h"); err == nil {
+			return prefix
+		}
+	}
+	return ""
+}
+
+// runtimeCompileArgs returns the clang arguments for compiling a C file
+// against the runtime
+func runtimeCompileArgs(runtimeDir string) []string {
+	args := append([]string{}, runtimeCFlags...)
+	args = append(args, "-I"+runtimeDir)
+	if prefix := gcPrefix(); prefix != "" {
+		args = append(args, "-I"+prefix+"/include")
+	}
+	return args
+}
+
+// runtimeLinkArgs returns the clang arguments that link a program with the
+// runtime and Boehm GC
+func runtimeLinkArgs(lib *runtimeLib) []string {
+	args := []string{lib.Archive}
+	if prefix := gcPrefix(); prefix != "" {
+		args = append(args, "-L"+prefix+"/lib")
+	}
+	return append(args, "-lgc", "-pthread", "-lm")
+}
+
+// runtimeKey hashes everything a prepared runtime depends on
+func runtimeKey(runtimeDir string) (string, error) {
+	h := sha256.New()
+	for _, name := range []string{"runtime.c", "runtime.h"} {
+		data, err := os.ReadFile(filepath.Join(runtimeDir, name))
+		if err != nil {
+			return "", err
+		}
+		fmt.Fprintf(h, "%s %d\n", name, len(data))
+		h.Write(data)
+	}
+	fmt.Fprintf(h, "flags %s\n", strings.Join(runtimeCompileArgs("."), " "))
+	if out, err := exec.Command("clang", "--version").Output(); err == nil {
+		h.Write(out)
+	}
+	return hex.EncodeToString(h.Sum(nil))[:24], nil
+}
+
+// preparedRuntimes memoizes prepareRuntime within one malphas invocation
+// (malphas test links every test function separately)
+var preparedRuntimes = map[string]*runtimeLib{}
+
+// prepareRuntime returns the cached runtime for the sources in runtimeDir,
+// building it first if this version has not been built yet
+func prepareRuntime(runtimeDir string) (*runtimeLib, error) {
+	if lib, ok := preparedRuntimes[runtimeDir]; ok {
+		return lib, nil
+	}
+	key, err := runtimeKey(runtimeDir)
+	if err != nil {
+		return nil, fmt.Errorf("reading the runtime sources: %v", err)
+	}
+	root, err := cacheDir("runtime")
+	if err != nil {
+		return nil, err
+	}
+	entry := filepath.Join(root, key)
+	lib := &runtimeLib{Dir: runtimeDir, Archive: filepath.Join(entry, "libmalphas_rt.a")}
+	if _, err := os.Stat(lib.Archive); err != nil {
+		debugLog("Building runtime into %s\n", entry)
+		if err := buildRuntime(runtimeDir, root, entry); err != nil {
+			return nil, err
+		}
+	} else {
+		debugLog("Using cached runtime %s\n", entry)
+	}
+	if bc := filepath.Join(entry, "runtime_inline.bc"); fileExists(bc) {
+		lib.Bitcode = bc
+	}
+	preparedRuntimes[runtimeDir] = lib
+	return lib, nil
+}
+
+func fileExists(path string) bool {
+	_, err := os.Stat(path)
+	return err == nil
+}
+
+// buildRuntime builds a cache entry in a scratch directory and moves it into
+// place, so concurrent builds never see half of one
+func buildRuntime(runtimeDir, cacheDir, entry string) error {
+	if err := os.MkdirAll(cacheDir, 0755); err != nil {
+		return err
+	}
+	scratch, err := os.MkdirTemp(cacheDir, "build-")
+	if err != nil {
+		return err
+	}
+	defer os.RemoveAll(scratch)
+
+	ctx, cancel := context.WithTimeout(context.Background(), 120*time.Second)
+	defer cancel()
+
+	runtimeC := filepath.Join(runtimeDir, "runtime.c")
+	obj := filepath.Join(scratch, "runtime.o")
+	args := append(runtimeCompileArgs(runtimeDir), "-c", "-o", obj, runtimeC)
+	if err := runTool(ctx, "clang", args...); err != nil {
+		return fmt.Errorf("runtime compilation failed: %v\nNote: Boehm GC must be installed (libgc-dev on Ubuntu, bdw-gc on Homebrew)", err)
+	}
+	ar := "ar"
+	if path, err := exec.LookPath("llvm-ar"); err == nil {
+		ar = path
+	}
+	if err := runTool(ctx, ar, "rcs", filepath.Join(scratch, "libmalphas_rt.a"), obj); err != nil {
+		return fmt.Errorf("archiving the runtime failed: %v", err)
+	}
+	os.Remove(obj)
+
+	// The bitcode is an optimization: without it programs still link
+	if err := buildRuntimeBitcode(ctx, runtimeDir, scratch); err != nil {
+		debugLog("No runtime bitcode: %v\n", err)
+	}
+
+	if err := os.Rename(scratch, entry); err != nil && !fileExists(filepath.Join(entry, "libmalphas_rt.a")) {
+		return fmt.Errorf("installing the runtime into %s: %v", entry, err)
+	}
+	return nil
+}
+
+// runtimePrivateGlobal matches, in a module extracted from the runtime, the
+// declaration llvm-extract leaves for a global that was internal to the
+// runtime (static in runtime.c). A helper that uses one cannot be copied out.
+var runtimePrivateGlobal = regexp.MustCompile(`(?m)^@[^=]+= external hidden\b`)
+
+// buildRuntimeBitcode writes runtime_inline.bc into dir: the leaf helpers
+// that pass the state check, with whatever runtime functions they call
+func buildRuntimeBitcode(ctx context.Context, runtimeDir, dir string) error {
+	extract, err := exec.LookPath("llvm-extract")
+	if err != nil {
+		return err
+	}
+	bc := filepath.Join(dir, "runtime.bc")
+	args := append(runtimeCompileArgs(runtimeDir), "-c", "-emit-llvm", "-o", bc, filepath.Join(runtimeDir, "runtime.c"))
+	if err := runTool(ctx, "clang", args...); err != nil {
+		return err
+	}
+	defer os.Remove(bc)
+
+	var funcArgs []string
+	for _, fn := range runtimeLeafHelpers {
+		out, err := exec.CommandContext(ctx, extract, "--recursive", "-S", "--func="+fn, "-o", "-", bc).Output()
+		if err != nil {
+			continue // Not defined by this runtime
+		}
+		if runtimePrivateGlobal.Match(out) {
+			debugLog("Not inlining %s: it uses runtime state\n", fn)
+			continue
+		}
+		funcArgs = append(funcArgs, "--func="+fn)
+	}
+	if len(funcArgs) == 0 {
+		return fmt.Errorf("no runtime helper can be inlined")
+	}
+	args = append([]string{"--recursive"}, funcArgs...)
+	args = append(args, "-o", filepath.Join(dir, "runtime_inline.bc"), bc)
+	return runTool(ctx, extract, args...)
+}
+
+// linkRuntimeBitcode links the runtime's leaf helpers into an IR file and
+// returns the linked file, or irFile itself if there is nothing to link or
+// linking fails
+func linkRuntimeBitcode(irFile string, lib *runtimeLib) string {
+	if lib == nil || lib.Bitcode == "" {
+		return irFile
+	}
+	llvmLink, err := exec.LookPath("llvm-link")
+	if err != nil {
+		return irFile
+	}
+	linked := strings.TrimSuffix(irFile, ".ll") + ".linked.ll"
+	ctx, cancel := context.WithTimeout(context.Background(), 30*time.Second)
+	defer cancel()
+	// --only-needed takes just the helpers the program calls; --internalize
+	// makes them private copies, leaving the archive's definitions alone
+	if err := runTool(ctx, llvmLink, "-S", "--only-needed", "--internalize", "-o", linked, irFile, lib.Bitcode); err != nil {
+		debugLog("Not linking runtime bitcode: %v\n", err)
+		os.Remove(linked)
+		return irFile
+	}
+	return linked
+}
+
+// linkProgram links object files into an executable with the runtime, or
+// with just Boehm GC when lib is nil
+func linkProgram(exe string, objects []string, lib *runtimeLib) error {
+	args := append([]string{"-o", exe}, objects...)
+	if lib != nil {
+		args = append(args, runtimeLinkArgs(lib)...)
+	} else {
+		args = append(args, "-lgc")
+	}
+	ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
+	defer cancel()
+	if err := runTool(ctx, "clang", args...); err != nil {
+		return fmt.Errorf("linking failed: %v", err)
+	}
+	return nil
+}
+
+// runTool runs a command, returning its stderr in the error if it fails
+func runTool(ctx context.Context, name string, args ...string) error {
+	debugLog("Running %s %v\n", name, args)
+	cmd := exec.CommandContext(ctx, name, args...)
+	var stderrBuf strings.Builder
+	cmd.Stderr = &stderrBuf
+	if err := cmd.Run(); err != nil {
+		if ctx.Err() == context.DeadlineExceeded {
+			return fmt.Errorf("%s timed out", name)
+		}
+		if stderrBuf.Len() > 0 {
+			return fmt.Errorf("%v\n%s", err, stderrBuf.String())
+		}
+		return err
+	}
+	return nil
+}
@@ -0,0 +1,81 @@
+package main
+
+import (
+	"bytes"
+	"context"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strings"
+	"testing"
+	"time"
+)
+
+// TestRuntimeC builds each tests/runtime/*_test.c against the runtime and
+// checks what it prints against the .out file next to it. The programs drive
+// the scheduler, channels and poller directly, with the worker counts and
+// timeouts the language does not expose.
+func TestRuntimeC(t *testing.T) {
+	if _, err := exec.LookPath("clang"); err != nil {
+		t.Skip("clang is not installed")
+	}
+	tests, err := filepath.Glob(filepath.Join("..", "..", "tests", "runtime", "*_test.c"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(tests) == 0 {
+		t.Fatal("no tests in tests/runtime")
+	}
+
+	// Build the runtime into this test's own cache, past the per-process memo
+	// (which may point at the cache of an earlier run)
+	runtimeDir := filepath.Join("..", "..", "runtime")
+	t.Setenv("MALPHAS_CACHE", t.TempDir())
+	delete(preparedRuntimes, runtimeDir)
+	t.Cleanup(func() { delete(preparedRuntimes, runtimeDir) })
+	lib, err := prepareRuntime(runtimeDir)
+	if err != nil {
+		if strings.Contains(err.Error(), "gc.h") {
+			t.Skip("Boehm GC is not installed")
+		}
+		t.Fatal(err)
+	}
+
+	dir := t.TempDir()
+	for _, test := range tests {
+		name := strings.TrimSuffix(filepath.Base(test), ".c")
+		t.Run(name, func(t *testing.T) {
+			want, err := os.ReadFile(strings.TrimSuffix(test, ".c") + ".out")
+			if err != nil {
+				t.Fatal(err)
+			}
+
+			exe := filepath.Join(dir, name)
+			args := append(runtimeCompileArgs(lib.Dir), "-o", exe, test)
+			args = append(args, runtimeLinkArgs(lib)...)
+			ctx, cancel := context.WithTimeout(context.Background(), 60*time.Second)
+			defer cancel()
+			if err := runTool(ctx, "clang", args...); err != nil {
+				t.Fatalf("compiling %s failed: %v", test, err)
+			}
+
+			// A scheduler bug usually shows up as a hang, so the program gets a
+			// deadline rather than the whole test binary's
+			ctx, cancel = context.WithTimeout(context.Background(), 30*time.Second)
+			defer cancel()
+			cmd := exec.CommandContext(ctx, exe)
+			var stderr bytes.Buffer
+			cmd.Stderr = &stderr
+			got, err := cmd.Output()
+			if ctx.Err() == context.DeadlineExceeded {
+				t.Fatalf("timed out after printing:\n%s", got)
+			}
+			if err != nil {
+				t.Fatalf("%v\n%s", err, stderr.String())
+			}
+			if !bytes.Equal(got, want) {
+				t.Errorf("output mismatch\ngot:\n%s\nwant:\n%s", got, want)
+			}
+		})
+	}
+}
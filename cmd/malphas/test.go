@@ -272,7 +272,7 @@ func findTestFunctions(file *ast.File) []*ast.FnDecl {
 // runSingleTest runs a single test by compiling and executing it
 func runSingleTest(filename string, file *ast.File, checker *types.Checker, testName string) TestResult {
 	// Compile the test file to LLVM IR (file and checker are already parsed/checked)
-	irFile, err := compileToLLVM(file, checker)
+	irFiles, err := compileToLLVM(file, checker)
 	if err != nil {
 		return TestResult{
 			Name:   testName,
@@ -280,31 +280,29 @@ func runSingleTest(filename string, file *ast.File, checker *types.Checker, test
 			Error:  fmt.Errorf("compilation failed: %v", err),
 		}
 	}
-	defer os.Remove(irFile) // Clean up temp file
+	defer removeFiles(irFiles) // Clean up temp files
 
-	// Find llc
-	llcPath, err := findLLC()
-	if err != nil {
-		return TestResult{
-			Name:   testName,
-			Passed: false,
-			Error:  fmt.Errorf("llc not found: %v", err),
+	var lib *runtimeLib
+	if runtimeDir := findRuntimeDir(filename); runtimeDir != "" {
+		if lib, err = prepareRuntime(runtimeDir); err != nil {
+			return TestResult{
+				Name:   testName,
+				Passed: false,
+				Error:  err,
+			}
 		}
 	}
 
-	// Compile to object file
-	objFile := irFile + ".o"
-	cmd := exec.Command(llcPath, "-filetype=obj", "-mtriple=arm64-apple-darwin", "-o", objFile, irFile)
-	var llcStderr strings.Builder
-	cmd.Stderr = &llcStderr
-	if err := cmd.Run(); err != nil {
+	// Compile to object file (tests are not optimized)
+	objects, err := compileUnits(irFiles, "0", lib)
+	if err != nil {
 		return TestResult{
 			Name:   testName,
 			Passed: false,
-			Error:  fmt.Errorf("llc failed: %v\n%s", err, llcStderr.String()),
+			Error:  err,
 		}
 	}
-	defer os.Remove(objFile)
+	defer removeFiles(objects)
 
 	// Create temp executable
 	exeFile, err := os.CreateTemp("", "malphas_test_*.exe")
@@ -319,44 +317,12 @@ func runSingleTest(filename string, file *ast.File, checker *types.Checker, test
 	exePath := exeFile.Name()
 	defer os.Remove(exePath)
 
-	// Find runtime object file
-	runtimeObj := filepath.Join("runtime", "runtime.o")
-	if _, err := os.Stat(runtimeObj); os.IsNotExist(err) {
-		// Try alternative paths
-		runtimeObj = filepath.Join(filepath.Dir(filename), "..", "runtime", "runtime.o")
-		if _, err := os.Stat(runtimeObj); os.IsNotExist(err) {
-			runtimeObj = filepath.Join("..", "runtime", "runtime.o")
-		}
-	}
-
 	// Link with runtime
-	linkArgs := []string{"-o", exePath, objFile}
-	if _, err := os.Stat(runtimeObj); err == nil {
-		linkArgs = append(linkArgs, runtimeObj)
-	}
-
-	// Add library path for libgc if needed
-	if brewPrefix := os.Getenv("HOMEBREW_PREFIX"); brewPrefix != "" {
-		linkArgs = append(linkArgs, "-L"+brewPrefix+"/lib")
-	} else {
-		for _, prefix := range []string{"/opt/homebrew", "/usr/local"} {
-			if _, err := os.Stat(prefix + "/lib/libgc.a"); err == nil {
-				linkArgs = append(linkArgs, "-L"+prefix+"/lib")
-				break
-			}
-		}
-	}
-
-	linkArgs = append(linkArgs, "-lgc", "-pthread")
-
-	linkCmd := exec.Command("clang", linkArgs...)
-	var linkStderr strings.Builder
-	linkCmd.Stderr = &linkStderr
-	if err := linkCmd.Run(); err != nil {
+	if err := linkProgram(exePath, objects, lib); err != nil {
 		return TestResult{
 			Name:   testName,
 			Passed: false,
-			Error:  fmt.Errorf("linking failed: %v\n%s", err, linkStderr.String()),
+			Error:  err,
 		}
 	}
 
@@ -792,6 +792,54 @@ func NewWhileStmt(condition Expr, body *BlockExpr, span lexer.Span) *WhileStmt {
 // stmtNode marks WhileStmt as a statement.
 func (*WhileStmt) stmtNode() {}
 
+// WithArenaStmt represents a `with arena { ... }` region. Allocations made
+// inside the body come from a region that is released when the body exits.
+type WithArenaStmt struct {
+	Body *BlockExpr
+	span lexer.Span
+}
+
+// Span returns the statement span.
+func (s *WithArenaStmt) Span() lexer.Span { return s.span }
+
+// SetSpan updates the statement span.
+func (s *WithArenaStmt) SetSpan(span lexer.Span) { s.span = span }
+
+// NewWithArenaStmt constructs an arena region node.
+func NewWithArenaStmt(body *BlockExpr, span lexer.Span) *WithArenaStmt {
+	return &WithArenaStmt{
+		Body: body,
+		span: span,
+	}
+}
+
+// stmtNode marks WithArenaStmt as a statement.
+func (*WithArenaStmt) stmtNode() {}
+
+// SpawnScopeStmt represents a `spawn scope { ... }` block. The block does not
+// exit until every legion spawned directly inside it has finished.
+type SpawnScopeStmt struct {
+	Body *BlockExpr
+	span lexer.Span
+}
+
+// Span returns the statement span.
+func (s *SpawnScopeStmt) Span() lexer.Span { return s.span }
+
+// SetSpan updates the statement span.
+func (s *SpawnScopeStmt) SetSpan(span lexer.Span) { s.span = span }
+
+// NewSpawnScopeStmt constructs a spawn scope node.
+func NewSpawnScopeStmt(body *BlockExpr, span lexer.Span) *SpawnScopeStmt {
+	return &SpawnScopeStmt{
+		Body: body,
+		span: span,
+	}
+}
+
+// stmtNode marks SpawnScopeStmt as a statement.
+func (*SpawnScopeStmt) stmtNode() {}
+
 // ForStmt represents a basic for-in loop.
 type ForStmt struct {
 	Iterator *Ident
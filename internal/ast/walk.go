@@ -188,6 +188,16 @@ func Walk(node Node, fn func(Node) bool) {
 			Walk(n.Body, fn)
 		}
 
+	case *WithArenaStmt:
+		if n.Body != nil {
+			Walk(n.Body, fn)
+		}
+
+	case *SpawnScopeStmt:
+		if n.Body != nil {
+			Walk(n.Body, fn)
+		}
+
 	case *ForStmt:
 		if n.Iterator != nil {
 			Walk(n.Iterator, fn)
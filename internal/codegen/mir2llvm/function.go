@@ -7,14 +7,31 @@ import (
 	"github.com/malphas-lang/malphas-lang/internal/mir"
 )
 
+// functionAttributes are attached to every generated function. Legion stacks
+// grow on demand below a single guard page (see grow_legion_stack in the
+// runtime), so frames larger than a page must be probed page by page rather
+// than allowed to jump past it.
+const functionAttributes = `"probe-stack"="inline-asm"`
+
 // generateFunction generates LLVM IR for a MIR function
 func (g *Generator) generateFunction(fn *mir.Function) error {
 	// Set current function
 	g.currentFunc = fn
 	g.localRegs = make(map[int]string)
 	g.blockLabels = make(map[*mir.BasicBlock]string)
+	g.blockOrder = make(map[*mir.BasicBlock]int)
 	g.regCounter = 0
 
+	// The function is generated on its own, so that the allocas emitAlloca
+	// collects can be put in the entry block once all blocks are done
+	g.fnBody = &strings.Builder{}
+	g.entryAllocas = nil
+	entryEnd := 0
+	defer func() {
+		g.fnBody = nil
+		g.entryAllocas = nil
+	}()
+
 	// Map return type
 	retLLVM, err := g.mapType(fn.ReturnType)
 	if err != nil {
@@ -42,7 +59,7 @@ func (g *Generator) generateFunction(fn *mir.Function) error {
 
 	// Emit function signature
 	paramsStr := strings.Join(paramParts, ", ")
-	g.emit(fmt.Sprintf("define %s @%s(%s) {", retLLVM, sanitizeName(fn.Name), paramsStr))
+	g.emit(fmt.Sprintf("define %s @%s(%s) %s {", retLLVM, sanitizeName(fn.Name), paramsStr, functionAttributes))
 
 	// Map parameters to their initial register names (they're in SSA registers)
 	// We'll allocate space for them after emitting the entry label
@@ -84,10 +101,15 @@ func (g *Generator) generateFunction(fn *mir.Function) error {
 		g.blockLabels[block] = label
 	}
 
+	for i, block := range fn.Blocks {
+		g.blockOrder[block] = i
+	}
+
 	// Generate blocks in order
-	for _, block := range fn.Blocks {
+	for i, block := range fn.Blocks {
 		// Use mapped label
 		llvmLabel := g.blockLabels[block]
+		g.currentOrder = i
 
 		// Emit label (use "entry" for entry block, otherwise use the label)
 		if block == fn.Entry {
@@ -140,6 +162,7 @@ func (g *Generator) generateFunction(fn *mir.Function) error {
 				// (e.g., AccessVariantPayload), but we want to ensure allocas are treated correctly
 				g.localIsValue[local.ID] = false
 			}
+			entryEnd = g.fnBody.Len()
 		} else {
 			g.emit(fmt.Sprintf("%s:", llvmLabel))
 		}
@@ -152,6 +175,14 @@ func (g *Generator) generateFunction(fn *mir.Function) error {
 	g.emit("}")
 	g.emit("")
 
+	body := g.fnBody.String()
+	g.builder.WriteString(body[:entryEnd])
+	for _, line := range g.entryAllocas {
+		g.builder.WriteString(line)
+		g.builder.WriteString("\n")
+	}
+	g.builder.WriteString(body[entryEnd:])
+
 	return nil
 }
 
@@ -25,6 +25,11 @@ type Generator struct {
 	// Block label mapping (MIR BasicBlock -> LLVM label)
 	blockLabels map[*mir.BasicBlock]string
 
+	// Position of each block in the current function, and of the block being
+	// generated (a jump to the same or an earlier position is a back-edge)
+	blockOrder   map[*mir.BasicBlock]int
+	currentOrder int
+
 	// Register counter for generating unique register names
 	regCounter int
 
@@ -46,11 +51,18 @@ type Generator struct {
 	// Error collection
 	Errors []diag.Diagnostic
 
-	// String constants (content -> global name)
-	stringConstants map[string]string
+	// String constants (content -> global name), and their contents in
+	// creation order
+	stringConstants     map[string]string
+	stringConstantOrder []string
 
 	// Spawn wrapper functions (collected during generation)
 	spawnWrappers []string
+
+	// Body of the function being generated, and the allocas hoisted into its
+	// entry block (see emitAlloca)
+	fnBody       *strings.Builder
+	entryAllocas []string
 }
 
 // NewGenerator creates a new MIR-to-LLVM generator
@@ -59,6 +71,7 @@ func NewGenerator() *Generator {
 		localRegs:       make(map[int]string),
 		localIsValue:    make(map[int]bool),
 		blockLabels:     make(map[*mir.BasicBlock]string),
+		blockOrder:      make(map[*mir.BasicBlock]int),
 		regCounter:      0,
 		structTypes:     make(map[string]bool),
 		structFields:    make(map[string]map[string]int),
@@ -76,12 +89,28 @@ func (g *Generator) Generate(module *mir.Module) (string, error) {
 	g.localRegs = make(map[int]string)
 	g.localIsValue = make(map[int]bool)
 	g.blockLabels = make(map[*mir.BasicBlock]string)
+	g.blockOrder = make(map[*mir.BasicBlock]int)
 	g.regCounter = 0
 	g.Errors = make([]diag.Diagnostic, 0)
 	g.stringConstants = make(map[string]string)
+	g.stringConstantOrder = nil
 	g.spawnWrappers = make([]string, 0)
 	g.currentModule = module // Store current module for struct lookups
 
+	// Skip generic functions - only generate specialized (monomorphized) versions
+	var fns []*mir.Function
+	for _, fn := range module.Functions {
+		if len(fn.TypeParams) == 0 {
+			fns = append(fns, fn)
+		}
+	}
+	return g.generateUnit(module, fns, nil, true)
+}
+
+// generateUnit generates one LLVM module holding fns, with declarations for
+// the functions in extern (defined in other units). Only the unit holding
+// main initializes the GC.
+func (g *Generator) generateUnit(module *mir.Module, fns, extern []*mir.Function, hasMain bool) (string, error) {
 	// Emit module header
 	g.emitModuleHeader()
 
@@ -92,7 +121,9 @@ func (g *Generator) Generate(module *mir.Module) (string, error) {
 	g.emitCommonTypeDeclarations()
 
 	// Emit GC initialization
-	g.emitGCInitialization()
+	if hasMain {
+		g.emitGCInitialization()
+	}
 
 	// Emit struct definitions
 	g.emitStructDefinitions(module)
@@ -100,12 +131,15 @@ func (g *Generator) Generate(module *mir.Module) (string, error) {
 	// Emit enum definitions
 	g.emitEnumDefinitions(module)
 
-	// Generate functions
-	for _, fn := range module.Functions {
-		// Skip generic functions - only generate specialized (monomorphized) versions
-		if len(fn.TypeParams) > 0 {
-			continue
+	// Declare the functions of other units
+	for _, fn := range extern {
+		if err := g.emitFunctionDeclaration(fn); err != nil {
+			return "", fmt.Errorf("error declaring function %s: %w", fn.Name, err)
 		}
+	}
+
+	// Generate functions
+	for _, fn := range fns {
 		if err := g.generateFunction(fn); err != nil {
 			return "", fmt.Errorf("error generating function %s: %w", fn.Name, err)
 		}
@@ -124,8 +158,31 @@ func (g *Generator) Generate(module *mir.Module) (string, error) {
 
 // emit writes a line to the output buffer
 func (g *Generator) emit(line string) {
-	g.builder.WriteString(line)
-	g.builder.WriteString("\n")
+	out := &g.builder
+	if g.fnBody != nil {
+		out = g.fnBody
+	}
+	out.WriteString(line)
+	out.WriteString("\n")
+}
+
+// emitAlloca allocates stack space for a temporary. Inside a function the
+// alloca goes to the entry block: one in a later block would grow the stack
+// each time a loop passed through it, and LLVM only promotes entry allocas.
+func (g *Generator) emitAlloca(reg, llvmType string) {
+	line := fmt.Sprintf("  %s = alloca %s", reg, llvmType)
+	if g.fnBody == nil {
+		g.emit(line)
+		return
+	}
+	g.entryAllocas = append(g.entryAllocas, line)
+}
+
+// emitStackObject allocates an object that does not escape (Stack) in the
+// entry block, and zeroes it where it is made, as runtime_alloc would
+func (g *Generator) emitStackObject(reg, llvmType string) {
+	g.emitAlloca(reg, llvmType)
+	g.emit(fmt.Sprintf("  store %s zeroinitializer, %s* %s", llvmType, llvmType, reg))
 }
 
 // emitModuleHeader emits the LLVM module header
@@ -147,6 +204,9 @@ func (g *Generator) emitRuntimeDeclarations() {
 
 	// Memory allocation
 	g.emit("declare i8* @runtime_alloc(i64)")
+	g.emit("declare i8* @runtime_alloc_atomic(i64)")
+	g.emit("declare i8* @runtime_arena_begin()")
+	g.emit("declare void @runtime_arena_end(i8*)")
 	g.emit("")
 
 	// String operations
@@ -158,6 +218,18 @@ func (g *Generator) emitRuntimeDeclarations() {
 	g.emit("declare %String* @runtime_string_from_double(double)")
 	g.emit("declare %String* @runtime_string_from_bool(i1)")
 	g.emit("declare %String* @runtime_string_format(%String*, %String*, %String*, %String*, %String*)")
+	g.emit("declare %String* @runtime_string_formatv(%String*, i64, ...)")
+	g.emit("declare %String* @runtime_string_intern(%String*)")
+	g.emit("declare i64 @runtime_string_find(%String*, %String*)")
+	g.emit("declare i1 @runtime_string_contains(%String*, %String*)")
+	g.emit("declare %struct.Slice* @runtime_string_split(%String*, %String*)")
+	g.emit("declare i8* @runtime_string_builder_new(i64)")
+	g.emit("declare void @runtime_string_builder_append(i8*, %String*)")
+	g.emit("declare void @runtime_string_builder_append_i64(i8*, i64)")
+	g.emit("declare void @runtime_string_builder_append_double(i8*, double)")
+	g.emit("declare void @runtime_string_builder_append_bool(i8*, i8)")
+	g.emit("declare i64 @runtime_string_builder_len(i8*)")
+	g.emit("declare %String* @runtime_string_builder_finish(i8*)")
 	g.emit("")
 
 	// Print functions
@@ -170,7 +242,7 @@ func (g *Generator) emitRuntimeDeclarations() {
 	g.emit("")
 
 	// Slice/Vec operations
-	g.emit("declare %struct.Slice* @runtime_slice_new(i64, i64, i64)")
+	g.emit("declare %struct.Slice* @runtime_slice_new(i64, i64, i64, i8)")
 	g.emit("declare i8* @runtime_slice_get(%struct.Slice*, i64)")
 	g.emit("declare void @runtime_slice_set(%struct.Slice*, i64, i8*)")
 	g.emit("declare void @runtime_slice_push(%struct.Slice*, i8*)")
@@ -184,6 +256,9 @@ func (g *Generator) emitRuntimeDeclarations() {
 	g.emit("declare void @runtime_slice_insert(%struct.Slice*, i64, i8*)")
 	g.emit("declare %struct.Slice* @runtime_slice_copy(%struct.Slice*)")
 	g.emit("declare %struct.Slice* @runtime_slice_subslice(%struct.Slice*, i64, i64)")
+	g.emit("declare void @runtime_slice_make_writable(%struct.Slice*)")
+	g.emit("declare void @runtime_slice_grow(%struct.Slice*) cold")
+	g.emit("declare void @runtime_slice_index_panic(i64, i64) cold noreturn")
 	g.emit("")
 
 	// HashMap operations
@@ -191,22 +266,43 @@ func (g *Generator) emitRuntimeDeclarations() {
 	g.emit("declare void @runtime_hashmap_put(%HashMap*, %String*, i8*)")
 	g.emit("declare i8* @runtime_hashmap_get(%HashMap*, %String*)")
 	g.emit("declare i8 @runtime_hashmap_contains_key(%HashMap*, %String*)")
+	g.emit("declare i8 @runtime_hashmap_remove(%HashMap*, %String*)")
+	g.emit("declare void @runtime_hashmap_clear(%HashMap*)")
+	g.emit("declare i8 @runtime_hashmap_iter_next(%HashMap*, i64*, %String**, i8**)")
 	g.emit("declare i64 @runtime_hashmap_len(%HashMap*)")
 	g.emit("declare i8 @runtime_hashmap_is_empty(%HashMap*)")
 	g.emit("declare void @runtime_hashmap_free(%HashMap*)")
 	g.emit("")
 
 	// Channel operations
-	g.emit("declare %Channel* @runtime_channel_new(i64, i64)")
+	g.emit("declare %Channel* @runtime_channel_new(i64, i64, i8)")
 	g.emit("declare void @runtime_channel_send(%Channel*, i8*)")
 	g.emit("declare i8* @runtime_channel_recv(%Channel*)")
+	g.emit("declare i8 @runtime_channel_recv_into(%Channel*, i8*)")
 	g.emit("declare void @runtime_channel_close(%Channel*)")
 	g.emit("declare i8 @runtime_channel_is_closed(%Channel*)")
 	g.emit("declare i8 @runtime_channel_try_send(%Channel*, i8*)")
 	g.emit("declare i8 @runtime_channel_try_recv(%Channel*, i8**)")
-	g.emit("declare void @runtime_channel_wait_for_send(%Channel*)")
-	g.emit("declare void @runtime_channel_wait_for_recv(%Channel*)")
+	g.emit("declare i8 @runtime_channel_try_recv_into(%Channel*, i8*)")
+	g.emit("declare i64 @runtime_channel_send_many(%Channel*, %struct.Slice*)")
+	g.emit("declare i64 @runtime_channel_recv_many(%Channel*, %struct.Slice*, i64)")
+	g.emit("declare i64 @runtime_select(%SelectCase*, i64, i8)")
+	g.emit("declare i64 @runtime_select_timeout(%SelectCase*, i64, i64)")
+	g.emit("declare i8 @runtime_channel_send_timeout(%Channel*, i8*, i64)")
+	g.emit("declare i8 @runtime_channel_recv_into_timeout(%Channel*, i8*, i64)")
 	g.emit("declare void @runtime_nanosleep(i64)")
+	g.emit("declare i64 @runtime_nanotime()")
+	g.emit("")
+
+	// Non-blocking I/O through the network poller
+	g.emit("declare i64 @runtime_io_open(i64)")
+	g.emit("declare i64 @runtime_io_wait(i64, i32, i64)")
+	g.emit("declare i64 @runtime_io_read(i64, i8*, i64)")
+	g.emit("declare i64 @runtime_io_write(i64, i8*, i64)")
+	g.emit("declare i64 @runtime_io_accept(i64)")
+	g.emit("declare i64 @runtime_io_close(i64)")
+	g.emit("declare i64 @runtime_tcp_listen(%String*, i64)")
+	g.emit("declare i64 @runtime_tcp_connect(%String*, i64)")
 	g.emit("")
 
 	// Pthread operations for spawn
@@ -223,7 +319,13 @@ func (g *Generator) emitRuntimeDeclarations() {
 	g.emit("declare %Legion* @runtime_legion_spawn(void (i8*)*, i8*, i64)")
 	g.emit("declare void @runtime_legion_start(%Legion*)")
 	g.emit("declare void @runtime_legion_yield()")
+	g.emit("declare i8* @runtime_waitgroup_new()")
+	g.emit("declare void @runtime_waitgroup_wait(i8*)")
+	g.emit("declare void @runtime_waitgroup_track(i8*, %Legion*)")
+	g.emit("declare void @runtime_safepoint() cold")
+	g.emit("@runtime_preempt_requested = external global i32")
 	g.emit("declare void @runtime_scheduler_shutdown()")
+	g.emit("declare i64 @runtime_scheduler_set_workers(i64)")
 	g.emit("")
 }
 
@@ -232,10 +334,12 @@ func (g *Generator) emitCommonTypeDeclarations() {
 	g.emit("; Common type declarations (runtime types)")
 	g.emit("%String = type opaque")
 	g.emit("%HashMap = type opaque")
-	// Define Slice struct: { data, len, cap, elem_size }
-	g.emit("%struct.Slice = type { i8*, i64, i64, i64 }")
+	// Define Slice struct: { data, len, cap, elem_size, flags }
+	g.emit("%struct.Slice = type { i8*, i64, i64, i64, i64, i8* }")
 	g.structTypes["Slice"] = true
 	g.emit("%Channel = type opaque")
+	// Select case: { channel, elem, kind, received } (see runtime.h)
+	g.emit("%SelectCase = type { %Channel*, i8*, i32, i32 }")
 	g.emit("")
 	g.emit("; Closure type for closures/lambda expressions")
 	g.emit("%Closure = type { i8* (i8*)*, i8* }")
@@ -263,7 +367,12 @@ func (g *Generator) nextReg() string {
 	return reg
 }
 
-// emitStringConstants emits the global string constants
+// stringConstantType is the layout of the runtime's String ({ size_t len; char *data; })
+const stringConstantType = "{ i64, i8* }"
+
+// emitStringConstants emits the global string constants: the bytes (NUL
+// terminated, as runtime_string_cstr expects) and a String header pointing
+// at them
 func (g *Generator) emitStringConstants() {
 	if len(g.stringConstants) == 0 {
 		return
@@ -271,17 +380,16 @@ func (g *Generator) emitStringConstants() {
 
 	g.emit("")
 	g.emit("; String constants")
-	for content, name := range g.stringConstants {
-		// Calculate length including null terminator?
-		// Malphas strings might not be null-terminated internally, but let's follow C style for now
-		// or just raw bytes. runtime_string_new takes length.
-		// Let's emit as [N x i8]
+	for _, content := range g.stringConstantOrder {
+		name := g.stringConstants[content]
 
 		// Escape string content for LLVM
 		escaped := escapeStringForLLVM(content)
-		length := len(content)
+		size := len(content) + 1
 
-		g.emit(fmt.Sprintf("%s = private unnamed_addr constant [%d x i8] c\"%s\", align 1", name, length, escaped))
+		g.emit(fmt.Sprintf("%s = private unnamed_addr constant [%d x i8] c\"%s\\00\", align 1", name, size, escaped))
+		g.emit(fmt.Sprintf("%s.obj = private unnamed_addr constant %s { i64 %d, i8* getelementptr inbounds ([%d x i8], [%d x i8]* %s, i64 0, i64 0) }, align 8",
+			name, stringConstantType, len(content), size, size, name))
 	}
 	g.emit("")
 }
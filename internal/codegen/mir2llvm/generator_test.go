@@ -374,11 +374,24 @@ func TestGenerate_RuntimeDeclarations(t *testing.T) {
 	expectedDecls := []string{
 		"declare void @runtime_gc_init()",
 		"declare i8* @runtime_alloc(i64)",
+		"declare i8* @runtime_arena_begin()",
+		"declare void @runtime_arena_end(i8*)",
 		"declare %String* @runtime_string_new(i8*, i64)",
 		"declare void @runtime_println_i64(i64)",
-		"declare %struct.Slice* @runtime_slice_new(i64, i64, i64)",
+		"declare %struct.Slice* @runtime_slice_new(i64, i64, i64, i8)",
 		"declare %HashMap* @runtime_hashmap_new()",
-		"declare %Channel* @runtime_channel_new(i64, i64)",
+		"declare i8 @runtime_hashmap_remove(%HashMap*, %String*)",
+		"declare i8 @runtime_hashmap_iter_next(%HashMap*, i64*, %String**, i8**)",
+		"declare %Channel* @runtime_channel_new(i64, i64, i8)",
+		"declare i8 @runtime_channel_recv_into(%Channel*, i8*)",
+		"declare i64 @runtime_select(%SelectCase*, i64, i8)",
+		"declare i64 @runtime_select_timeout(%SelectCase*, i64, i64)",
+		"declare i8 @runtime_channel_recv_into_timeout(%Channel*, i8*, i64)",
+		"declare i64 @runtime_nanotime()",
+		"declare i64 @runtime_io_read(i64, i8*, i64)",
+		"declare i64 @runtime_tcp_connect(%String*, i64)",
+		"declare %String* @runtime_string_formatv(%String*, i64, ...)",
+		"declare %String* @runtime_string_builder_finish(i8*)",
 	}
 
 	for _, decl := range expectedDecls {
@@ -423,7 +436,7 @@ func TestGenerateFunction_SimpleVoid(t *testing.T) {
 		t.Fatalf("Generate() error = %v", err)
 	}
 
-	expected := "define void @test() {"
+	expected := "define void @test() \"probe-stack\"=\"inline-asm\" {"
 	if !strings.Contains(result, expected) {
 		t.Errorf("Generate() should contain function signature, got:\n%s", result)
 	}
@@ -677,10 +690,40 @@ func TestGenerateOperand_LiteralString(t *testing.T) {
 		t.Fatalf("generateOperand() error = %v", err)
 	}
 
-	// Should generate a call to runtime_string_new
+	// Should refer to a static String constant instead of allocating
 	output := gen.builder.String()
-	if !strings.Contains(output, "call %String* @runtime_string_new") {
-		t.Errorf("generateOperand() should generate string runtime call, got:\n%s", output)
+	if !strings.Contains(output, "bitcast { i64, i8* }* @.str.0.obj to %String*") {
+		t.Errorf("generateOperand() should use a static string constant, got:\n%s", output)
+	}
+	if strings.Contains(output, "@runtime_string_new") {
+		t.Errorf("generateOperand() should not allocate string literals, got:\n%s", output)
+	}
+}
+
+func TestEmitStringConstants(t *testing.T) {
+	gen := newTestGenerator()
+
+	for _, v := range []string{"hi", "", "hi"} {
+		if _, err := gen.generateOperand(&mir.Literal{Type: types.TypeString, Value: v}); err != nil {
+			t.Fatalf("generateOperand() error = %v", err)
+		}
+	}
+	gen.builder.Reset()
+	gen.emitStringConstants()
+
+	output := gen.builder.String()
+	want := []string{
+		`@.str.0 = private unnamed_addr constant [3 x i8] c"hi\00", align 1`,
+		"@.str.0.obj = private unnamed_addr constant { i64, i8* } { i64 2, i8* getelementptr inbounds ([3 x i8], [3 x i8]* @.str.0, i64 0, i64 0) }, align 8",
+		`@.str.1 = private unnamed_addr constant [1 x i8] c"\00", align 1`,
+	}
+	for _, line := range want {
+		if !strings.Contains(output, line) {
+			t.Errorf("emitStringConstants() should contain %q, got:\n%s", line, output)
+		}
+	}
+	if strings.Contains(output, "@.str.2") {
+		t.Errorf("identical literals should share one constant, got:\n%s", output)
 	}
 }
 
@@ -784,6 +827,38 @@ func TestGenerateTerminator_Goto(t *testing.T) {
 	}
 }
 
+func TestGenerateTerminator_GotoBackEdgePolls(t *testing.T) {
+	gen := newTestGenerator()
+
+	header := &mir.BasicBlock{Label: "loop.header"}
+	body := &mir.BasicBlock{Label: "loop.body"}
+	end := &mir.BasicBlock{Label: "loop.end"}
+	for i, block := range []*mir.BasicBlock{header, body, end} {
+		gen.blockLabels[block] = block.Label
+		gen.blockOrder[block] = i
+	}
+
+	// body -> header closes the loop
+	gen.currentOrder = 1
+	if err := gen.generateGoto(&mir.Goto{Target: header}); err != nil {
+		t.Fatalf("generateGoto() error = %v", err)
+	}
+	output := gen.builder.String()
+	if !strings.Contains(output, "load atomic i32, i32* @runtime_preempt_requested monotonic") ||
+		!strings.Contains(output, "call void @runtime_safepoint()") {
+		t.Errorf("a back-edge should poll for preemption, got:\n%s", output)
+	}
+
+	// body -> end does not
+	gen.builder.Reset()
+	if err := gen.generateGoto(&mir.Goto{Target: end}); err != nil {
+		t.Fatalf("generateGoto() error = %v", err)
+	}
+	if output := gen.builder.String(); strings.Contains(output, "runtime_safepoint") {
+		t.Errorf("a forward jump should not poll for preemption, got:\n%s", output)
+	}
+}
+
 func TestGenerateTerminator_Branch(t *testing.T) {
 	gen := newTestGenerator()
 
@@ -815,6 +890,81 @@ func TestGenerateTerminator_Branch(t *testing.T) {
 	}
 }
 
+func TestGenerateTerminator_Select(t *testing.T) {
+	gen := newTestGenerator()
+
+	chanType := &types.Channel{Elem: types.TypeInt, Dir: types.SendRecv}
+	chLocal := mir.Local{ID: 1, Name: "ch", Type: chanType}
+	resultLocal := &mir.Local{ID: 2, Name: "v", Type: types.TypeInt}
+
+	gen.localRegs[1] = "%reg0"
+	gen.localRegs[2] = "%reg1"
+	gen.emit("  %reg0 = alloca %Channel*")
+	gen.emit("  %reg1 = alloca i64")
+
+	recvBlock := &mir.BasicBlock{Label: "recv_block"}
+	sendBlock := &mir.BasicBlock{Label: "send_block"}
+	defaultBlock := &mir.BasicBlock{Label: "default_block"}
+	gen.blockLabels[recvBlock] = "recv_block"
+	gen.blockLabels[sendBlock] = "send_block"
+	gen.blockLabels[defaultBlock] = "default_block"
+
+	sel := &mir.Select{
+		Cases: []mir.SelectCase{
+			{Kind: "recv", Channel: &mir.LocalRef{Local: chLocal}, Result: resultLocal, Target: recvBlock},
+			{Kind: "send", Channel: &mir.LocalRef{Local: chLocal}, Value: &mir.Literal{Type: types.TypeInt, Value: int64(1)}, Target: sendBlock},
+			{Kind: "default", Target: defaultBlock},
+		},
+	}
+
+	if err := gen.generateSelect(sel); err != nil {
+		t.Fatalf("generateSelect() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "alloca [2 x %SelectCase]") {
+		t.Errorf("generateSelect() should allocate one case per channel operation, got:\n%s", output)
+	}
+	if !strings.Contains(output, "call i64 @runtime_select(%SelectCase*") || !strings.Contains(output, "i64 2, i8 0)") {
+		t.Errorf("generateSelect() should make a single non-blocking runtime_select call, got:\n%s", output)
+	}
+	if !strings.Contains(output, "label %default_block") {
+		t.Errorf("generateSelect() should route -1 to the default case, got:\n%s", output)
+	}
+	if strings.Contains(output, "runtime_nanosleep") || strings.Contains(output, "runtime_channel_try_recv") {
+		t.Errorf("generateSelect() should not poll, got:\n%s", output)
+	}
+}
+
+func TestGenerateStatement_Receive(t *testing.T) {
+	gen := newTestGenerator()
+
+	chanType := &types.Channel{Elem: types.TypeInt, Dir: types.SendRecv}
+	chLocal := mir.Local{ID: 1, Name: "ch", Type: chanType}
+
+	gen.localRegs[1] = "%reg0"
+	gen.localRegs[2] = "%reg1"
+	gen.emit("  %reg0 = alloca %Channel*")
+	gen.emit("  %reg1 = alloca i64")
+
+	recv := &mir.Receive{
+		Result:  mir.Local{ID: 2, Name: "v", Type: types.TypeInt},
+		Channel: &mir.LocalRef{Local: chLocal},
+	}
+
+	if err := gen.generateReceive(recv); err != nil {
+		t.Fatalf("generateReceive() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "bitcast i64* %reg1 to i8*") || !strings.Contains(output, "call i8 @runtime_channel_recv_into(%Channel*") {
+		t.Errorf("generateReceive() should receive into the result local's slot, got:\n%s", output)
+	}
+	if strings.Contains(output, "runtime_alloc") {
+		t.Errorf("generateReceive() should not allocate for a primitive element, got:\n%s", output)
+	}
+}
+
 func TestGenerateStatement_LoadField(t *testing.T) {
 	gen := newTestGenerator()
 
@@ -909,7 +1059,98 @@ func TestGenerateStatement_LoadIndex(t *testing.T) {
 	}
 
 	output := gen.builder.String()
-	if !strings.Contains(output, "call i8* @runtime_slice_get") {
+	for _, want := range []string{
+		"icmp ult i64 0,",
+		"call void @runtime_slice_index_panic(i64 0,",
+		"getelementptr inbounds i64, i64* %",
+		"= load i64, i64* %",
+	} {
+		if !strings.Contains(output, want) {
+			t.Errorf("generateLoadIndex() should index inline (missing %q), got:\n%s", want, output)
+		}
+	}
+	if strings.Contains(output, "@runtime_slice_get") {
+		t.Errorf("generateLoadIndex() should not call runtime_slice_get, got:\n%s", output)
+	}
+}
+
+func TestGenerateStatement_LoadIndex_InBounds(t *testing.T) {
+	gen := newTestGenerator()
+
+	targetLocal := mir.Local{ID: 1, Name: "arr", Type: &types.Slice{Elem: types.TypeInt}}
+	indexLocal := mir.Local{ID: 2, Name: "i", Type: types.TypeInt}
+	gen.localRegs[1] = "%arr"
+	gen.localIsValue[1] = true
+	gen.localRegs[2] = "%i"
+	gen.localIsValue[2] = true
+
+	err := gen.generateLoadIndex(&mir.LoadIndex{
+		Result:   mir.Local{ID: 3, Name: "elem", Type: types.TypeInt},
+		Target:   &mir.LocalRef{Local: targetLocal},
+		Indices:  []mir.Operand{&mir.LocalRef{Local: indexLocal}},
+		InBounds: true,
+	})
+	if err != nil {
+		t.Fatalf("generateLoadIndex() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "icmp ult") || strings.Contains(output, "runtime_slice_index_panic") {
+		t.Errorf("generateLoadIndex() should not check an index proven in bounds, got:\n%s", output)
+	}
+	if !strings.Contains(output, "getelementptr inbounds i64, i64* %reg2, i64 %i") {
+		t.Errorf("generateLoadIndex() should index the data directly, got:\n%s", output)
+	}
+}
+
+func TestGenerateStatement_LoadIndex_InnerSlice(t *testing.T) {
+	gen := newTestGenerator()
+
+	row := &types.Slice{Elem: types.TypeInt}
+	targetLocal := mir.Local{ID: 1, Name: "m", Type: &types.Slice{Elem: row}}
+	gen.localRegs[1] = "%m"
+	gen.localIsValue[1] = true
+
+	err := gen.generateLoadIndex(&mir.LoadIndex{
+		Result:  mir.Local{ID: 2, Name: "row", Type: row},
+		Target:  &mir.LocalRef{Local: targetLocal},
+		Indices: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(1)}},
+	})
+	if err != nil {
+		t.Fatalf("generateLoadIndex() error = %v", err)
+	}
+
+	// Inner slices are stored in place, so m[1] is the address of the element
+	output := gen.builder.String()
+	elemPtr := gen.localRegs[2]
+	if !strings.Contains(output, elemPtr+" = getelementptr inbounds %struct.Slice, %struct.Slice*") {
+		t.Errorf("generateLoadIndex() should return the element address, got:\n%s", output)
+	}
+	if strings.Contains(output, "load %struct.Slice*") {
+		t.Errorf("generateLoadIndex() should not load a pointer from the element, got:\n%s", output)
+	}
+}
+
+func TestGenerateStatement_LoadIndex_Runtime(t *testing.T) {
+	gen := newTestGenerator()
+
+	// Elements that are stored in place (structs) still go through the runtime
+	elemType := &types.Struct{Name: "Point"}
+	targetLocal := mir.Local{ID: 1, Name: "arr", Type: &types.Slice{Elem: elemType}}
+	gen.localRegs[1] = "%arr"
+	gen.localIsValue[1] = true
+
+	err := gen.generateLoadIndex(&mir.LoadIndex{
+		Result:  mir.Local{ID: 2, Name: "elem", Type: elemType},
+		Target:  &mir.LocalRef{Local: targetLocal},
+		Indices: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(0)}},
+	})
+	if err != nil {
+		t.Fatalf("generateLoadIndex() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "call i8* @runtime_slice_get(%struct.Slice* %arr, i64 0)") {
 		t.Errorf("generateLoadIndex() should generate runtime_slice_get call, got:\n%s", output)
 	}
 }
@@ -939,8 +1180,185 @@ func TestGenerateStatement_StoreIndex(t *testing.T) {
 	}
 
 	output := gen.builder.String()
-	if !strings.Contains(output, "call void @runtime_slice_set") {
-		t.Errorf("generateStoreIndex() should generate runtime_slice_set call, got:\n%s", output)
+	for _, want := range []string{
+		"icmp ult i64 0,",
+		"and i64 %",
+		"call void @runtime_slice_make_writable(%struct.Slice* %",
+		"store i64 42, i64* %",
+	} {
+		if !strings.Contains(output, want) {
+			t.Errorf("generateStoreIndex() should store inline (missing %q), got:\n%s", want, output)
+		}
+	}
+	if strings.Contains(output, "@runtime_slice_set") {
+		t.Errorf("generateStoreIndex() should not call runtime_slice_set, got:\n%s", output)
+	}
+}
+
+func TestGenerateStatement_StoreIndex_Runtime(t *testing.T) {
+	gen := newTestGenerator()
+
+	targetLocal := mir.Local{ID: 1, Name: "arr", Type: &types.Slice{Elem: &types.Tuple{Elements: []types.Type{types.TypeInt, types.TypeInt}}}}
+	valueLocal := mir.Local{ID: 2, Name: "v", Type: &types.Tuple{Elements: []types.Type{types.TypeInt, types.TypeInt}}}
+	gen.localRegs[1] = "%arr"
+	gen.localIsValue[1] = true
+	gen.localRegs[2] = "%v"
+	gen.localIsValue[2] = true
+
+	err := gen.generateStoreIndex(&mir.StoreIndex{
+		Target:  &mir.LocalRef{Local: targetLocal},
+		Indices: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(1)}},
+		Value:   &mir.LocalRef{Local: valueLocal},
+	})
+	if err != nil {
+		t.Fatalf("generateStoreIndex() error = %v", err)
+	}
+
+	// runtime_slice_set copies the value from memory
+	output := gen.builder.String()
+	if !strings.Contains(output, "} %v, {") ||
+		!strings.Contains(output, "call void @runtime_slice_set(%struct.Slice* %arr, i64 1, i8* %") {
+		t.Errorf("generateStoreIndex() should pass the value to runtime_slice_set by pointer, got:\n%s", output)
+	}
+}
+
+func TestGenerateCall_SliceLenInline(t *testing.T) {
+	gen := newTestGenerator()
+
+	sliceLocal := mir.Local{ID: 1, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	gen.localRegs[1] = "%xs"
+	gen.localIsValue[1] = true
+
+	err := gen.generateCall(&mir.Call{
+		Result: mir.Local{ID: 2, Name: "n", Type: &types.Primitive{Kind: types.Int64}},
+		Func:   "runtime_slice_len",
+		Args:   []mir.Operand{&mir.LocalRef{Local: sliceLocal}},
+	})
+	if err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "@runtime_slice_len") {
+		t.Errorf("runtime_slice_len should be inlined, got:\n%s", output)
+	}
+	if !strings.Contains(output, "getelementptr inbounds %struct.Slice, %struct.Slice* %xs, i32 0, i32 1") {
+		t.Errorf("runtime_slice_len should load the len field, got:\n%s", output)
+	}
+}
+
+func TestGenerateCall_SlicePushSpecialized(t *testing.T) {
+	gen := newTestGenerator()
+
+	sliceLocal := mir.Local{ID: 1, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	gen.localRegs[1] = "%xs"
+	gen.localIsValue[1] = true
+
+	err := gen.generateCall(&mir.Call{
+		Result: mir.Local{ID: 2, Type: types.TypeVoid},
+		Func:   "runtime_slice_push",
+		Args:   []mir.Operand{&mir.LocalRef{Local: sliceLocal}, &mir.Literal{Type: types.TypeInt, Value: int64(7)}},
+	})
+	if err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "@runtime_slice_push") {
+		t.Errorf("push of an int should not call the generic runtime, got:\n%s", output)
+	}
+	if !strings.Contains(output, "call void @runtime_slice_grow(%struct.Slice* %xs)") {
+		t.Errorf("push should grow the slice on the slow path, got:\n%s", output)
+	}
+	if !strings.Contains(output, "store i64 7, i64* ") {
+		t.Errorf("push should store the value with its own type, got:\n%s", output)
+	}
+}
+
+func TestGenerateCall_SlicePushGeneric(t *testing.T) {
+	gen := newTestGenerator()
+
+	// Values passed through a pointer keep the elem_size-generic runtime call
+	elemType := &types.Struct{Name: "Point"}
+	sliceLocal := mir.Local{ID: 1, Name: "xs", Type: &types.Slice{Elem: elemType}}
+	valueLocal := mir.Local{ID: 2, Name: "p", Type: &types.Primitive{Kind: types.Nil}}
+	gen.localRegs[1] = "%xs"
+	gen.localIsValue[1] = true
+	gen.localRegs[2] = "%p"
+	gen.localIsValue[2] = true
+
+	err := gen.generateCall(&mir.Call{
+		Result: mir.Local{ID: 3, Type: types.TypeVoid},
+		Func:   "runtime_slice_push",
+		Args:   []mir.Operand{&mir.LocalRef{Local: sliceLocal}, &mir.LocalRef{Local: valueLocal}},
+	})
+	if err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "call void @runtime_slice_push(%struct.Slice* %xs, i8* %p)") {
+		t.Errorf("push through a pointer should call the runtime, got:\n%s", output)
+	}
+}
+
+func TestGenerateCall_SlicePopSpecialized(t *testing.T) {
+	gen := newTestGenerator()
+
+	sliceLocal := mir.Local{ID: 1, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	gen.localRegs[1] = "%xs"
+	gen.localIsValue[1] = true
+
+	err := gen.generateCall(&mir.Call{
+		Result: mir.Local{ID: 2, Name: "last", Type: &types.Optional{Elem: types.TypeInt}},
+		Func:   "runtime_slice_pop",
+		Args:   []mir.Operand{&mir.LocalRef{Local: sliceLocal}},
+	})
+	if err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "@runtime_slice_pop") {
+		t.Errorf("pop of an int should not call the generic runtime, got:\n%s", output)
+	}
+	if !strings.Contains(output, "call i8* @runtime_alloc_atomic(i64 8)") {
+		t.Errorf("pop should box an int without making the GC scan it, got:\n%s", output)
+	}
+	if !strings.Contains(output, "store i64* null, i64** ") {
+		t.Errorf("pop of an empty slice should produce nil, got:\n%s", output)
+	}
+}
+
+func TestGenerateCall_SliceSetSpecialized(t *testing.T) {
+	gen := newTestGenerator()
+
+	sliceLocal := mir.Local{ID: 1, Name: "xs", Type: &types.Slice{Elem: types.TypeFloat}}
+	gen.localRegs[1] = "%xs"
+	gen.localIsValue[1] = true
+
+	err := gen.generateCall(&mir.Call{
+		Result: mir.Local{ID: 2, Type: types.TypeVoid},
+		Func:   "runtime_slice_set",
+		Args: []mir.Operand{
+			&mir.LocalRef{Local: sliceLocal},
+			&mir.Literal{Type: types.TypeInt, Value: int64(3)},
+			&mir.Literal{Type: types.TypeFloat, Value: 1.5},
+		},
+	})
+	if err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "@runtime_slice_set") {
+		t.Errorf("set of a float should not call the generic runtime, got:\n%s", output)
+	}
+	if !strings.Contains(output, "call void @runtime_slice_index_panic(i64 3") {
+		t.Errorf("set should check the index, got:\n%s", output)
+	}
+	if !strings.Contains(output, "@runtime_slice_make_writable") {
+		t.Errorf("set should unshare the buffer before writing, got:\n%s", output)
 	}
 }
 
@@ -978,6 +1396,35 @@ func TestGenerateStatement_ConstructStruct(t *testing.T) {
 	}
 }
 
+func TestGenerateStatement_ConstructStruct_Stack(t *testing.T) {
+	gen := newTestGenerator()
+	gen.structTypes["Point"] = true
+	gen.structFields["Point"] = map[string]int{"x": 0, "y": 1}
+
+	construct := &mir.ConstructStruct{
+		Result: mir.Local{ID: 1, Name: "p", Type: &types.Struct{Name: "Point"}},
+		Type:   &types.Struct{Name: "Point"},
+		Fields: map[string]mir.Operand{
+			"x": &mir.Literal{Type: types.TypeInt, Value: int64(10)},
+		},
+		Stack: true,
+	}
+
+	if err := gen.generateConstructStruct(construct); err != nil {
+		t.Fatalf("generateConstructStruct() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if strings.Contains(output, "@runtime_alloc") {
+		t.Errorf("a Stack struct should not be allocated with runtime_alloc, got:\n%s", output)
+	}
+	for _, want := range []string{"alloca %struct.Point", "store %struct.Point zeroinitializer"} {
+		if !strings.Contains(output, want) {
+			t.Errorf("generateConstructStruct() output missing %q, got:\n%s", want, output)
+		}
+	}
+}
+
 func TestGenerateStatement_ConstructArray(t *testing.T) {
 	gen := newTestGenerator()
 
@@ -998,6 +1445,10 @@ func TestGenerateStatement_ConstructArray(t *testing.T) {
 	if !strings.Contains(output, "call %Slice* @runtime_slice_new") {
 		t.Errorf("generateConstructArray() should generate runtime_slice_new call, got:\n%s", output)
 	}
+	// []int holds no pointers, so its buffer is allocated pointer-free
+	if !strings.Contains(output, ", i8 1)") {
+		t.Errorf("generateConstructArray() should mark []int pointer-free, got:\n%s", output)
+	}
 }
 
 func TestGenerateStatement_ConstructTuple(t *testing.T) {
@@ -1026,6 +1477,44 @@ func TestGenerateStatement_ConstructTuple(t *testing.T) {
 	}
 }
 
+func TestGenerateStatement_ConstructTuple_PointerFree(t *testing.T) {
+	tests := []struct {
+		name     string
+		elements []*mir.Literal
+		alloc    string
+	}{
+		{"scalars", []*mir.Literal{
+			{Type: types.TypeInt, Value: int64(1)},
+			{Type: types.TypeFloat, Value: 2.0},
+		}, "@runtime_alloc_atomic("},
+		{"with string", []*mir.Literal{
+			{Type: types.TypeInt, Value: int64(1)},
+			{Type: types.TypeString, Value: "s"},
+		}, "@runtime_alloc("},
+	}
+
+	for _, tt := range tests {
+		gen := newTestGenerator()
+		var elemTypes []types.Type
+		var elements []mir.Operand
+		for _, lit := range tt.elements {
+			elemTypes = append(elemTypes, lit.Type)
+			elements = append(elements, lit)
+		}
+		construct := &mir.ConstructTuple{
+			Result:   mir.Local{ID: 1, Name: "tup", Type: &types.Tuple{Elements: elemTypes}},
+			Elements: elements,
+		}
+
+		if err := gen.generateConstructTuple(construct); err != nil {
+			t.Fatalf("%s: generateConstructTuple() error = %v", tt.name, err)
+		}
+		if output := gen.builder.String(); !strings.Contains(output, tt.alloc) {
+			t.Errorf("%s: expected %s, got:\n%s", tt.name, tt.alloc, output)
+		}
+	}
+}
+
 func TestGenerate_CompleteFunction(t *testing.T) {
 	gen := newTestGenerator()
 
@@ -1196,6 +1685,275 @@ func TestGenerate_MultipleBlocks(t *testing.T) {
 	}
 }
 
+func TestGenerate_SelectAllocasInEntryBlock(t *testing.T) {
+	gen := newTestGenerator()
+
+	chanType := &types.Channel{Elem: types.TypeInt, Dir: types.SendRecv}
+	ch := mir.Local{ID: 0, Name: "ch", Type: chanType}
+	v := mir.Local{ID: 1, Name: "v", Type: types.TypeInt}
+
+	entryBlock := &mir.BasicBlock{Label: "entry"}
+	loopBlock := &mir.BasicBlock{Label: "loop"}
+	entryBlock.Terminator = &mir.Goto{Target: loopBlock}
+	loopBlock.Terminator = &mir.Select{
+		Cases: []mir.SelectCase{
+			{Kind: "recv", Channel: &mir.LocalRef{Local: ch}, Result: &v, Target: loopBlock},
+			{Kind: "send", Channel: &mir.LocalRef{Local: ch}, Value: &mir.Literal{Type: types.TypeInt, Value: int64(1)}, Target: loopBlock},
+		},
+	}
+
+	fn := &mir.Function{
+		Name:       "test",
+		Params:     []mir.Local{ch},
+		ReturnType: types.TypeVoid,
+		Locals:     []mir.Local{ch, v},
+		Blocks:     []*mir.BasicBlock{entryBlock, loopBlock},
+		Entry:      entryBlock,
+	}
+
+	result, err := gen.Generate(&mir.Module{Functions: []*mir.Function{fn}})
+	if err != nil {
+		t.Fatalf("Generate() error = %v", err)
+	}
+
+	// A parked select in a loop must not grow the stack on every iteration
+	loop := strings.Index(result, "loop:")
+	if loop < 0 {
+		t.Fatalf("Generate() should contain the loop block, got:\n%s", result)
+	}
+	if strings.Contains(result[loop:], "alloca") {
+		t.Errorf("allocas should all be in the entry block, got:\n%s", result)
+	}
+	if !strings.Contains(result[:loop], "alloca [2 x %SelectCase]") {
+		t.Errorf("the case array should be allocated in the entry block, got:\n%s", result)
+	}
+}
+
+func TestGenerate_ReceiveSlotInEntryBlock(t *testing.T) {
+	gen := newTestGenerator()
+
+	chanType := &types.Channel{Elem: types.TypeInt, Dir: types.SendRecv}
+	ch := mir.Local{ID: 0, Name: "ch", Type: chanType}
+
+	entryBlock := &mir.BasicBlock{Label: "entry"}
+	loopBlock := &mir.BasicBlock{
+		Label: "loop",
+		Statements: []mir.Statement{
+			&mir.Receive{
+				Result:  mir.Local{ID: 1, Name: "v", Type: types.TypeInt},
+				Channel: &mir.LocalRef{Local: ch},
+			},
+		},
+	}
+	entryBlock.Terminator = &mir.Goto{Target: loopBlock}
+	loopBlock.Terminator = &mir.Goto{Target: loopBlock}
+
+	fn := &mir.Function{
+		Name:       "test",
+		Params:     []mir.Local{ch},
+		ReturnType: types.TypeVoid,
+		Locals:     []mir.Local{ch},
+		Blocks:     []*mir.BasicBlock{entryBlock, loopBlock},
+		Entry:      entryBlock,
+	}
+
+	result, err := gen.Generate(&mir.Module{Functions: []*mir.Function{fn}})
+	if err != nil {
+		t.Fatalf("Generate() error = %v", err)
+	}
+
+	// The receive slot must not grow the stack on every iteration
+	loop := strings.Index(result, "loop:")
+	if loop < 0 {
+		t.Fatalf("Generate() should contain the loop block, got:\n%s", result)
+	}
+	if strings.Contains(result[loop:], "alloca") {
+		t.Errorf("allocas should all be in the entry block, got:\n%s", result)
+	}
+	if !strings.Contains(result[loop:], "call i8 @runtime_channel_recv_into(%Channel*") {
+		t.Errorf("the loop should receive into the slot, got:\n%s", result)
+	}
+}
+
+func TestGenerate_TemporaryAllocasInEntryBlock(t *testing.T) {
+	gen := newTestGenerator()
+
+	chanType := &types.Channel{Elem: types.TypeInt, Dir: types.SendRecv}
+	ch := mir.Local{ID: 0, Name: "ch", Type: chanType}
+
+	entryBlock := &mir.BasicBlock{Label: "entry"}
+	loopBlock := &mir.BasicBlock{
+		Label: "loop",
+		Statements: []mir.Statement{
+			&mir.Send{
+				Channel: &mir.LocalRef{Local: ch},
+				Value:   &mir.Literal{Type: types.TypeInt, Value: int64(1)},
+			},
+		},
+	}
+	entryBlock.Terminator = &mir.Goto{Target: loopBlock}
+	loopBlock.Terminator = &mir.Goto{Target: loopBlock}
+
+	fn := &mir.Function{
+		Name:       "test",
+		Params:     []mir.Local{ch},
+		ReturnType: types.TypeVoid,
+		Locals:     []mir.Local{ch},
+		Blocks:     []*mir.BasicBlock{entryBlock, loopBlock},
+		Entry:      entryBlock,
+	}
+
+	result, err := gen.Generate(&mir.Module{Functions: []*mir.Function{fn}})
+	if err != nil {
+		t.Fatalf("Generate() error = %v", err)
+	}
+
+	// The send's temporary must not grow the stack on every iteration
+	loop := strings.Index(result, "loop:")
+	if loop < 0 {
+		t.Fatalf("Generate() should contain the loop block, got:\n%s", result)
+	}
+	if strings.Contains(result[loop:], "alloca") {
+		t.Errorf("allocas should all be in the entry block, got:\n%s", result)
+	}
+	if strings.Count(result[:loop], "alloca") < 2 {
+		t.Errorf("the send temporary should be allocated in the entry block, got:\n%s", result)
+	}
+}
+
+func TestGenerateUnits_OneUnitPerModule(t *testing.T) {
+	gen := newTestGenerator()
+
+	a := mir.Local{ID: 0, Name: "a", Type: types.TypeInt}
+	addEntry := &mir.BasicBlock{Label: "entry", Terminator: &mir.Return{Value: &mir.LocalRef{Local: a}}}
+	add := &mir.Function{
+		Name:       "add",
+		Params:     []mir.Local{a},
+		ReturnType: types.TypeInt,
+		Locals:     []mir.Local{a},
+		Blocks:     []*mir.BasicBlock{addEntry},
+		Entry:      addEntry,
+		Module:     "util",
+	}
+
+	result := mir.Local{ID: 0, Name: "r", Type: types.TypeInt}
+	mainEntry := &mir.BasicBlock{
+		Label: "entry",
+		Statements: []mir.Statement{
+			&mir.Call{Result: result, Func: "add", Args: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(1)}}},
+		},
+		Terminator: &mir.Return{Value: nil},
+	}
+	mainFn := &mir.Function{
+		Name:       "main",
+		ReturnType: types.TypeVoid,
+		Locals:     []mir.Local{result},
+		Blocks:     []*mir.BasicBlock{mainEntry},
+		Entry:      mainEntry,
+	}
+
+	units, err := gen.GenerateUnits(&mir.Module{Functions: []*mir.Function{add, mainFn}})
+	if err != nil {
+		t.Fatalf("GenerateUnits() error = %v", err)
+	}
+	if len(units) != 2 || units[0].Module != "" || units[1].Module != "util" {
+		t.Fatalf("GenerateUnits() should return the program's unit and then util's, got %d units", len(units))
+	}
+
+	program, util := units[0].IR, units[1].IR
+	for _, want := range []string{"declare i64 @add(i64)", "define i32 @main(", "@llvm.global_ctors"} {
+		if !strings.Contains(program, want) {
+			t.Errorf("program unit should contain %q, got:\n%s", want, program)
+		}
+	}
+	for _, want := range []string{"define i64 @add(", "declare i32 @main()"} {
+		if !strings.Contains(util, want) {
+			t.Errorf("util unit should contain %q, got:\n%s", want, util)
+		}
+	}
+	if strings.Contains(util, "@llvm.global_ctors") {
+		t.Errorf("only the program unit should initialize the GC, got:\n%s", util)
+	}
+}
+
+func TestGenerate_SpawnWrapper(t *testing.T) {
+	gen := newTestGenerator()
+
+	param := mir.Local{ID: 0, Name: "id", Type: types.TypeInt}
+	workerEntry := &mir.BasicBlock{Label: "entry", Terminator: &mir.Return{Value: nil}}
+	worker := &mir.Function{
+		Name:       "worker",
+		Params:     []mir.Local{param},
+		ReturnType: types.TypeVoid,
+		Locals:     []mir.Local{param},
+		Blocks:     []*mir.BasicBlock{workerEntry},
+		Entry:      workerEntry,
+	}
+
+	entry := &mir.BasicBlock{
+		Label: "entry",
+		Statements: []mir.Statement{
+			&mir.Spawn{Func: "worker", Args: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(7)}}},
+		},
+		Terminator: &mir.Return{Value: nil},
+	}
+	caller := &mir.Function{
+		Name:       "caller",
+		ReturnType: types.TypeVoid,
+		Blocks:     []*mir.BasicBlock{entry},
+		Entry:      entry,
+	}
+
+	result, err := gen.Generate(&mir.Module{Functions: []*mir.Function{worker, caller}})
+	if err != nil {
+		t.Fatalf("Generate() error = %v", err)
+	}
+
+	for _, want := range []string{
+		"define internal void @spawn_wrapper_worker_",
+		"%arg0 = load i64, i64* %cast0",
+		"call void @worker(i64 %arg0)",
+		"store i64 7, i64*",
+		"call %Legion* @runtime_legion_spawn(void (i8*)* @spawn_wrapper_worker_",
+	} {
+		if !strings.Contains(result, want) {
+			t.Errorf("Generate() should contain %q, got:\n%s", want, result)
+		}
+	}
+}
+
+func TestGenerate_MainShutsDownScheduler(t *testing.T) {
+	gen := newTestGenerator()
+
+	entry := &mir.BasicBlock{Label: "entry", Terminator: &mir.Return{Value: nil}}
+	mainFn := &mir.Function{
+		Name:       "main",
+		ReturnType: types.TypeVoid,
+		Blocks:     []*mir.BasicBlock{entry},
+		Entry:      entry,
+	}
+	helperEntry := &mir.BasicBlock{Label: "entry", Terminator: &mir.Return{Value: nil}}
+	helper := &mir.Function{
+		Name:       "helper",
+		ReturnType: types.TypeVoid,
+		Blocks:     []*mir.BasicBlock{helperEntry},
+		Entry:      helperEntry,
+	}
+
+	result, err := gen.Generate(&mir.Module{Functions: []*mir.Function{helper, mainFn}})
+	if err != nil {
+		t.Fatalf("Generate() error = %v", err)
+	}
+
+	// Legions still running when main returns are waited for
+	if !strings.Contains(result, "  call void @runtime_scheduler_shutdown()\n  ret i32 0") {
+		t.Errorf("main should shut the scheduler down before returning, got:\n%s", result)
+	}
+	if strings.Count(result, "call void @runtime_scheduler_shutdown()") != 1 {
+		t.Errorf("only main should shut the scheduler down, got:\n%s", result)
+	}
+}
+
 func TestNextReg(t *testing.T) {
 	gen := newTestGenerator()
 
@@ -1423,3 +2181,53 @@ func TestIntOperatorIntrinsic_Div_StillWorks(t *testing.T) {
 		t.Errorf("Should not contain 'fdiv' for integer operation, got:\n%s", output)
 	}
 }
+
+func TestGenerateCall_VariadicRuntimeFunc(t *testing.T) {
+	gen := newTestGenerator()
+
+	fmtLocal := mir.Local{ID: 1, Name: "fmt", Type: types.TypeString}
+	gen.localRegs[1] = "%reg0"
+	gen.emit("  %reg0 = alloca %String*")
+
+	call := &mir.Call{
+		Result: mir.Local{ID: 2, Name: "s", Type: types.TypeString},
+		Func:   "runtime_string_formatv",
+		Args: []mir.Operand{
+			&mir.LocalRef{Local: fmtLocal},
+			&mir.Literal{Type: types.TypeInt64, Value: int64(1)},
+			&mir.Literal{Type: types.TypeInt32, Value: int64(0)},
+			&mir.Literal{Type: types.TypeInt64, Value: int64(42)},
+		},
+	}
+
+	if err := gen.generateCall(call); err != nil {
+		t.Fatalf("generateCall() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "call %String* (%String*, i64, ...) @runtime_string_formatv(") {
+		t.Errorf("Expected a variadic call to runtime_string_formatv, got:\n%s", output)
+	}
+	if !strings.Contains(output, "i64 1, i32 0, i64 42)") {
+		t.Errorf("Expected kind-tagged arguments, got:\n%s", output)
+	}
+}
+
+func TestGenerateCast_BoolToInt(t *testing.T) {
+	gen := newTestGenerator()
+
+	cast := &mir.Cast{
+		Result:  mir.Local{ID: 1, Name: "b", Type: types.TypeInt64},
+		Operand: &mir.Literal{Type: types.TypeBool, Value: true},
+		Type:    types.TypeInt64,
+	}
+
+	if err := gen.generateCast(cast); err != nil {
+		t.Fatalf("generateCast() error = %v", err)
+	}
+
+	output := gen.builder.String()
+	if !strings.Contains(output, "zext i1") {
+		t.Errorf("Expected 'zext i1', got:\n%s", output)
+	}
+}
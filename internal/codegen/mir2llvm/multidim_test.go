@@ -31,6 +31,7 @@ func TestMultiDimensionalIndexing_2D(t *testing.T) {
 	}
 
 	gen.localRegs[arr.ID] = "%reg0"
+	gen.localIsValue[arr.ID] = true
 
 	err := gen.generateLoadIndex(loadIndex)
 	if err != nil {
@@ -39,25 +40,25 @@ func TestMultiDimensionalIndexing_2D(t *testing.T) {
 
 	output := gen.builder.String()
 
-	// Verify it calls runtime_slice_get twice
-	sliceGetCount := strings.Count(output, "@runtime_slice_get")
-	if sliceGetCount != 2 {
-		t.Errorf("Expected 2 calls to runtime_slice_get for 2D indexing, got %d. Output:\n%s", sliceGetCount, output)
+	// Indexing is inline: no runtime calls, one bounds check per dimension
+	if strings.Contains(output, "@runtime_slice_get") {
+		t.Errorf("Expected inline indexing without runtime_slice_get. Output:\n%s", output)
 	}
-
-	// Verify first call uses index 0
-	if !strings.Contains(output, "runtime_slice_get(%Slice* %reg0, i64 0)") {
-		t.Errorf("Expected first call with index 0. Output:\n%s", output)
+	checkCount := strings.Count(output, "call void @runtime_slice_index_panic")
+	if checkCount != 2 {
+		t.Errorf("Expected 2 bounds checks for 2D indexing, got %d. Output:\n%s", checkCount, output)
 	}
 
-	// Verify second call uses index 1
-	if !strings.Contains(output, ", i64 1)") {
-		t.Errorf("Expected second call with index 1. Output:\n%s", output)
+	// The outer level steps over inline Slice headers, the inner over ints
+	if !strings.Contains(output, "getelementptr inbounds %struct.Slice, %struct.Slice* %reg") ||
+		!strings.Contains(output, ", i64 0\n") {
+		t.Errorf("Expected a GEP over the outer slice with index 0. Output:\n%s", output)
 	}
-
-	// Verify there's a bitcast between the two calls for traversing the nested slice
-	if !strings.Contains(output, "bitcast i8*") && !strings.Contains(output, "to %Slice*") {
-		t.Errorf("Expected bitcast for nested slice traversal. Output:\n%s", output)
+	if !strings.Contains(output, "getelementptr inbounds i64, i64* %") || !strings.Contains(output, ", i64 1\n") {
+		t.Errorf("Expected a GEP over the inner slice with index 1. Output:\n%s", output)
+	}
+	if !strings.Contains(output, "= load i64, i64* %") {
+		t.Errorf("Expected the element to be loaded as i64. Output:\n%s", output)
 	}
 }
 
@@ -87,6 +88,7 @@ func TestMultiDimensionalIndexing_3D(t *testing.T) {
 	}
 
 	gen.localRegs[arr.ID] = "%reg0"
+	gen.localIsValue[arr.ID] = true
 
 	err := gen.generateLoadIndex(loadIndex)
 	if err != nil {
@@ -95,27 +97,22 @@ func TestMultiDimensionalIndexing_3D(t *testing.T) {
 
 	output := gen.builder.String()
 
-	// Verify it calls runtime_slice_get three times
-	sliceGetCount := strings.Count(output, "@runtime_slice_get")
-	if sliceGetCount != 3 {
-		t.Errorf("Expected 3 calls to runtime_slice_get for 3D indexing, got %d. Output:\n%s", sliceGetCount, output)
+	checkCount := strings.Count(output, "call void @runtime_slice_index_panic")
+	if checkCount != 3 {
+		t.Errorf("Expected 3 bounds checks for 3D indexing, got %d. Output:\n%s", checkCount, output)
 	}
 
 	// Verify all three indices are used
-	if !strings.Contains(output, ", i64 0)") {
-		t.Errorf("Expected index 0. Output:\n%s", output)
-	}
-	if !strings.Contains(output, ", i64 1)") {
-		t.Errorf("Expected index 1. Output:\n%s", output)
-	}
-	if !strings.Contains(output, ", i64 2)") {
-		t.Errorf("Expected index 2. Output:\n%s", output)
+	for _, idx := range []string{"0", "1", "2"} {
+		if !strings.Contains(output, "icmp ult i64 "+idx+",") {
+			t.Errorf("Expected index %s to be checked. Output:\n%s", idx, output)
+		}
 	}
 
-	// Verify there are bitcasts for nested slice traversal
-	bitcastCount := strings.Count(output, "bitcast i8*")
-	if bitcastCount < 2 {
-		t.Errorf("Expected at least 2 bitcasts for 3D traversal, got %d. Output:\n%s", bitcastCount, output)
+	// Two levels of inline Slice headers are traversed
+	headerGEPs := strings.Count(output, "bitcast i8* %") - strings.Count(output, "to i64*")
+	if headerGEPs != 2 {
+		t.Errorf("Expected 2 casts to inline slice headers for 3D traversal, got %d. Output:\n%s", headerGEPs, output)
 	}
 }
 
@@ -142,7 +139,9 @@ func TestMultiDimensionalIndexing_Store2D(t *testing.T) {
 	}
 
 	gen.localRegs[arr.ID] = "%reg0"
+	gen.localIsValue[arr.ID] = true
 	gen.localRegs[value.ID] = "%reg1"
+	gen.localIsValue[value.ID] = true
 
 	err := gen.generateStoreIndex(storeIndex)
 	if err != nil {
@@ -151,24 +150,25 @@ func TestMultiDimensionalIndexing_Store2D(t *testing.T) {
 
 	output := gen.builder.String()
 
-	// Verify it calls runtime_slice_get once (for traversal) and runtime_slice_set once (for the store)
-	sliceGetCount := strings.Count(output, "@runtime_slice_get")
-	sliceSetCount := strings.Count(output, "@runtime_slice_set")
-
-	if sliceGetCount != 1 {
-		t.Errorf("Expected 1 call to runtime_slice_get for 2D store traversal, got %d. Output:\n%s", sliceGetCount, output)
+	if strings.Contains(output, "@runtime_slice_get") || strings.Contains(output, "@runtime_slice_set") {
+		t.Errorf("Expected inline indexing without runtime calls. Output:\n%s", output)
 	}
-	if sliceSetCount != 1 {
-		t.Errorf("Expected 1 call to runtime_slice_set for 2D store, got %d. Output:\n%s", sliceSetCount, output)
+
+	// Only the innermost slice is written, so only it is made writable
+	cowCount := strings.Count(output, "call void @runtime_slice_make_writable")
+	if cowCount != 1 {
+		t.Errorf("Expected 1 copy-on-write check for 2D store, got %d. Output:\n%s", cowCount, output)
 	}
 
-	// Verify indices are used correctly
-	if !strings.Contains(output, ", i64 3") {
+	if !strings.Contains(output, "icmp ult i64 3,") {
 		t.Errorf("Expected first index 3. Output:\n%s", output)
 	}
-	if !strings.Contains(output, ", i64 4") {
+	if !strings.Contains(output, "icmp ult i64 4,") {
 		t.Errorf("Expected second index 4. Output:\n%s", output)
 	}
+	if !strings.Contains(output, "store i64 %reg1, i64* %") {
+		t.Errorf("Expected the value to be stored inline. Output:\n%s", output)
+	}
 }
 
 // TestMultiDimensionalIndexing_DynamicIndices tests with variable indices instead of literals
@@ -195,9 +195,12 @@ func TestMultiDimensionalIndexing_DynamicIndices(t *testing.T) {
 		},
 	}
 
-	gen.localRegs[arr.ID] = "%reg0"
-	gen.localRegs[idx1.ID] = "%reg1"
-	gen.localRegs[idx2.ID] = "%reg2"
+	gen.localRegs[arr.ID] = "%arr"
+	gen.localIsValue[arr.ID] = true
+	gen.localRegs[idx1.ID] = "%i"
+	gen.localIsValue[idx1.ID] = true
+	gen.localRegs[idx2.ID] = "%j"
+	gen.localIsValue[idx2.ID] = true
 
 	err := gen.generateLoadIndex(loadIndex)
 	if err != nil {
@@ -206,17 +209,13 @@ func TestMultiDimensionalIndexing_DynamicIndices(t *testing.T) {
 
 	output := gen.builder.String()
 
-	// Verify it calls runtime_slice_get twice
-	sliceGetCount := strings.Count(output, "@runtime_slice_get")
-	if sliceGetCount != 2 {
-		t.Errorf("Expected 2 calls to runtime_slice_get, got %d. Output:\n%s", sliceGetCount, output)
-	}
-
-	// Verify variable indices are used (registers %reg1 and %reg2)
-	if !strings.Contains(output, "%reg1") {
-		t.Errorf("Expected first index register %%reg1. Output:\n%s", output)
-	}
-	if !strings.Contains(output, "%reg2") {
-		t.Errorf("Expected second index register %%reg2. Output:\n%s", output)
+	// Verify variable indices are checked and used in the GEPs
+	for _, reg := range []string{"%i", "%j"} {
+		if !strings.Contains(output, "icmp ult i64 "+reg+",") {
+			t.Errorf("Expected index register %s to be checked. Output:\n%s", reg, output)
+		}
+		if !strings.Contains(output, ", i64 "+reg+"\n") {
+			t.Errorf("Expected index register %s in a GEP. Output:\n%s", reg, output)
+		}
 	}
 }
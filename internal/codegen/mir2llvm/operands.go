@@ -82,21 +82,17 @@ func (g *Generator) generateLiteral(lit *mir.Literal) (string, error) {
 		return "0", nil
 
 	case string:
-		// String literal - use runtime function
-		// Check if already exists
+		// String literal - a static, immortal String constant (strings are
+		// immutable, so every use can share it without allocating)
 		globalName, ok := g.stringConstants[v]
 		if !ok {
 			globalName = fmt.Sprintf("@.str.%d", len(g.stringConstants))
 			g.stringConstants[v] = globalName
+			g.stringConstantOrder = append(g.stringConstantOrder, v)
 		}
 
-		// Get pointer to string data
-		length := len(v)
-		ptrReg := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = getelementptr inbounds [%d x i8], [%d x i8]* %s, i64 0, i64 0", ptrReg, length, length, globalName))
-
 		reg := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = call %%String* @runtime_string_new(i8* %s, i64 %d)", reg, ptrReg, length))
+		g.emit(fmt.Sprintf("  %s = bitcast %s* %s.obj to %%String*", reg, stringConstantType, globalName))
 		return reg, nil
 
 	case nil:
@@ -86,7 +86,7 @@ func (g *Generator) generateMakeChannel(stmt *mir.MakeChannel) error {
 
 	// Call runtime
 	resultReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call %%Channel* @runtime_channel_new(i64 %s, i64 %s)", resultReg, elemSize, capReg))
+	g.emit(fmt.Sprintf("  %s = call %%Channel* @runtime_channel_new(i64 %s, i64 %s, i8 %d)", resultReg, elemSize, capReg, pointerFreeFlag(elemType)))
 
 	// Store result
 	localType, err := g.mapType(stmt.Type)
@@ -95,7 +95,7 @@ func (g *Generator) generateMakeChannel(stmt *mir.MakeChannel) error {
 	}
 
 	localReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = alloca %s", localReg, localType))
+	g.emitAlloca(localReg, localType)
 	g.emit(fmt.Sprintf("  store %s %s, %s* %s", localType, resultReg, localType, localReg))
 	g.localRegs[stmt.Result.ID] = localReg
 	g.localIsValue[stmt.Result.ID] = false
@@ -129,7 +129,7 @@ func (g *Generator) generateSend(stmt *mir.Send) error {
 	if isPrimitive(valType) {
 		// Store in temp alloca
 		tempAlloca := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = alloca %s", tempAlloca, valLLVMType))
+		g.emitAlloca(tempAlloca, valLLVMType)
 		g.emit(fmt.Sprintf("  store %s %s, %s* %s", valLLVMType, valReg, valLLVMType, tempAlloca))
 
 		// Cast to i8*
@@ -146,7 +146,9 @@ func (g *Generator) generateSend(stmt *mir.Send) error {
 	return nil
 }
 
-// generateReceive generates LLVM IR for receiving from a channel
+// generateReceive generates LLVM IR for receiving from a channel.
+// Primitive values are received straight into the result local's stack slot,
+// so steady-state channel traffic does not touch the GC.
 func (g *Generator) generateReceive(recv *mir.Receive) error {
 	// Get channel pointer
 	chanReg, err := g.generateOperand(recv.Channel)
@@ -154,36 +156,41 @@ func (g *Generator) generateReceive(recv *mir.Receive) error {
 		return err
 	}
 
-	// Call runtime_channel_recv
-	// fn runtime_channel_recv(ch: *Channel) -> i64
-	// Note: currently returns i64 (value or pointer), need to cast to result type
-	callReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call i64 @malphas_channel_recv(%%Channel* %s)", callReg, chanReg))
-
-	// Cast result to expected type
-	// If result type is primitive (fits in i64), we might need to cast or truncate
-	// If result type is pointer, inttoptr
 	resultType, err := g.mapType(recv.Result.Type)
 	if err != nil {
 		return err
 	}
 
-	finalReg := g.nextReg()
+	// Allocate local (if not already allocated)
+	localReg, ok := g.localRegs[recv.Result.ID]
+	if !ok || g.localIsValue[recv.Result.ID] {
+		localReg = g.nextReg()
+		g.emitAlloca(localReg, resultType)
+		g.localRegs[recv.Result.ID] = localReg
+	}
+	g.localIsValue[recv.Result.ID] = false
+
 	if isPrimitive(recv.Result.Type) {
-		// For primitives, we assume they are packed into i64
-		// But for now, let's assume simple cast
-		if resultType == "i64" {
-			finalReg = callReg
-		} else {
-			g.emit(fmt.Sprintf("  %s = trunc i64 %s to %s", finalReg, callReg, resultType))
-		}
-	} else {
-		// Pointer type
-		g.emit(fmt.Sprintf("  %s = inttoptr i64 %s to %s", finalReg, callReg, resultType))
+		// fn runtime_channel_recv_into(ch: *Channel, dst: *u8) -> i8
+		// A closed channel yields the zero value
+		slotPtr := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast %s* %s to i8*", slotPtr, resultType, localReg))
+		g.emit(fmt.Sprintf("  call i8 @runtime_channel_recv_into(%%Channel* %s, i8* %s)", chanReg, slotPtr))
+		return nil
 	}
 
-	g.localRegs[recv.Result.ID] = finalReg
-	g.localIsValue[recv.Result.ID] = true
+	// Aggregates are sent by contents but referenced by pointer, so the
+	// received copy needs a heap box of its own
+	sizeReg, err := g.calculateElementSize(recv.Result.Type)
+	if err != nil {
+		return err
+	}
+	boxReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", boxReg, sizeReg))
+	g.emit(fmt.Sprintf("  call i8 @runtime_channel_recv_into(%%Channel* %s, i8* %s)", chanReg, boxReg))
+	castReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", castReg, boxReg, resultType))
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", resultType, castReg, resultType, localReg))
 
 	return nil
 }
@@ -224,7 +231,7 @@ func (g *Generator) generateAddressOf(stmt *mir.AddressOf) error {
 	// Let's check how localRegs is used.
 	// In generateAssign:
 	//   localReg = g.nextReg()
-	//   g.emit(fmt.Sprintf("  %s = alloca %s", localReg, localType))
+	//   g.emitAlloca(localReg, localType)
 	//   g.localRegs[assign.Local.ID] = localReg
 	//   g.localIsValue[assign.Local.ID] = false
 	// So if localIsValue is false, localRegs[id] is the pointer (alloca).
@@ -242,7 +249,7 @@ func (g *Generator) generateAddressOf(stmt *mir.AddressOf) error {
 			return err
 		}
 		allocaReg := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = alloca %s", allocaReg, valType))
+		g.emitAlloca(allocaReg, valType)
 
 		// Store the value
 		g.emit(fmt.Sprintf("  store %s %s, %s* %s", valType, targetReg, valType, allocaReg))
@@ -331,6 +338,9 @@ func (g *Generator) generateCast(cast *mir.Cast) error {
 			} else {
 				castOp = "fptoui"
 			}
+		} else if isBool(srcType) && isInt(dstType) {
+			// Bool to Int (i1 is 0 or 1)
+			castOp = "zext"
 		}
 	} else if isPointer(srcType) && isPointer(dstType) {
 		// Pointer to Pointer
@@ -389,7 +399,7 @@ func (g *Generator) generateAssign(assign *mir.Assign) error {
 	if !ok {
 		// Allocate space for local
 		localReg = g.nextReg()
-		g.emit(fmt.Sprintf("  %s = alloca %s", localReg, localType))
+		g.emitAlloca(localReg, localType)
 		g.localRegs[assign.Local.ID] = localReg
 	}
 
@@ -405,11 +415,22 @@ func (g *Generator) generateAssign(assign *mir.Assign) error {
 }
 
 // generateCall generates LLVM IR for a function call
+// variadicRuntimeFuncs maps variadic runtime functions to their LLVM function types
+var variadicRuntimeFuncs = map[string]string{
+	"runtime_string_formatv": "%String* (%String*, i64, ...)",
+}
+
 func (g *Generator) generateCall(call *mir.Call) error {
 	// Check if this is an operator intrinsic that should be inlined
 	if isOperatorIntrinsic(call.Func) {
 		return g.generateOperatorIntrinsic(call)
 	}
+	if call.Func == "runtime_slice_len" && len(call.Args) == 1 && isSliceLenResult(call.Result.Type) {
+		return g.generateSliceLen(call)
+	}
+	if isSpecializedSliceOp(call) {
+		return g.generateSliceOp(call)
+	}
 
 	// Generate argument registers
 	var argRegs []string
@@ -470,7 +491,7 @@ func (g *Generator) generateCall(call *mir.Call) error {
 			} else {
 				// Allocate space for the result
 				allocaReg = g.nextReg()
-				g.emit(fmt.Sprintf("  %s = alloca %s", allocaReg, retType))
+				g.emitAlloca(allocaReg, retType)
 				g.localRegs[call.Result.ID] = allocaReg
 			}
 
@@ -600,7 +621,10 @@ func (g *Generator) generateCall(call *mir.Call) error {
 		}
 	} else {
 		// Call stores result in resultReg
-		if funcName != "" {
+		if sig, ok := variadicRuntimeFuncs[funcName]; ok {
+			// Variadic callees need their full function type at the call site
+			g.emit(fmt.Sprintf("  %s = call %s @%s(%s)", resultReg, sig, funcName, callArgsStr))
+		} else if funcName != "" {
 			g.emit(fmt.Sprintf("  %s = call %s @%s(%s)", resultReg, retType, funcName, callArgsStr))
 		} else {
 			g.emit(fmt.Sprintf("  %s = call %s %s(%s)", resultReg, retType, funcPtrReg, callArgsStr))
@@ -656,7 +680,7 @@ func (g *Generator) generateOperatorIntrinsic(call *mir.Call) error {
 			} else {
 				// Create new alloca
 				allocaReg = g.nextReg()
-				g.emit(fmt.Sprintf("  %s = alloca %s", allocaReg, retType))
+				g.emitAlloca(allocaReg, retType)
 				g.localRegs[call.Result.ID] = allocaReg
 			}
 			resultReg = g.nextReg()
@@ -934,8 +958,7 @@ func (g *Generator) generateLoadField(load *mir.LoadField) error {
 		fieldPtrReg, structType, structType+"*", targetReg, fieldIndex))
 
 	// Bitcast field pointer to result type pointer
-	castReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast %s* %s to %s*", castReg, structType, fieldPtrReg, resultType))
+	castReg := g.castFieldPtr(fieldPtrReg, load.Target, load.Field, resultType)
 
 	// Load field value
 	g.emit(fmt.Sprintf("  %s = load %s, %s* %s", resultReg, resultType, resultType, castReg))
@@ -1077,8 +1100,7 @@ func (g *Generator) generateStoreField(store *mir.StoreField) error {
 		fieldPtrReg, structType, structType+"*", targetReg, fieldIndex))
 
 	// Bitcast field pointer to value type pointer
-	castReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast %s* %s to %s*", castReg, structType, fieldPtrReg, valueType))
+	castReg := g.castFieldPtr(fieldPtrReg, store.Target, store.Field, valueType)
 
 	// Store value
 	g.emit(fmt.Sprintf("  store %s %s, %s* %s", valueType, valueReg, valueType, castReg))
@@ -1086,136 +1108,465 @@ func (g *Generator) generateStoreField(store *mir.StoreField) error {
 	return nil
 }
 
-// generateLoadIndex generates LLVM IR for loading an array/slice element
-func (g *Generator) generateLoadIndex(load *mir.LoadIndex) error {
-	targetReg, err := g.generateOperand(load.Target)
-	if err != nil {
-		return err
+// castFieldPtr returns the field pointer fieldPtrReg as a valueType*. The
+// getelementptr yields a pointer to the field's own type, so a cast is only
+// needed when the two differ
+func (g *Generator) castFieldPtr(fieldPtrReg string, target mir.Operand, field, valueType string) string {
+	fieldType := valueType
+	if localRef, ok := target.(*mir.LocalRef); ok {
+		if ft, err := g.getFieldType(localRef.Local.Type, field); err == nil {
+			if llvmType, err := g.mapType(ft); err == nil {
+				fieldType = llvmType
+			}
+		}
+	}
+	if fieldType == valueType {
+		return fieldPtrReg
 	}
+	castReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast %s* %s to %s*", castReg, fieldType, fieldPtrReg, valueType))
+	return castReg
+}
 
-	resultType, err := g.mapType(load.Result.Type)
+// Slice header fields (struct Slice in runtime.h)
+const (
+	sliceFieldData  = 0
+	sliceFieldLen   = 1
+	sliceFieldCap   = 2
+	sliceFieldFlags = 4
+
+	sliceFlagShared = 2 // SLICE_SHARED
+)
+
+// resolveSlice returns the slice type behind t, if t is a slice
+func resolveSlice(t types.Type) (*types.Slice, bool) {
+	switch t := t.(type) {
+	case *types.Slice:
+		return t, true
+	case *types.Reference:
+		// References to slices map to the same %struct.Slice*
+		return resolveSlice(t.Elem)
+	case *types.Named:
+		if t.Ref != nil {
+			return resolveSlice(t.Ref)
+		}
+	}
+	return nil, false
+}
+
+// storedByValue checks if values of type t are stored in slice memory as
+// their LLVM value (so a slice element can be loaded and stored directly)
+func storedByValue(t types.Type) bool {
+	switch t := t.(type) {
+	case *types.Primitive:
+		return t.Kind != types.Void && t.Kind != types.Nil
+	case *types.Pointer, *types.Reference, *types.Optional:
+		return true
+	case *types.Named:
+		if t.Ref != nil {
+			return storedByValue(t.Ref)
+		}
+		switch t.Name {
+		case "int", "i8", "i32", "i64", "u8", "u16", "u32", "u64", "u128", "usize", "float", "bool", "string":
+			return true
+		}
+	}
+	return false
+}
+
+// inlineIndexElemType returns the LLVM element type reached by indexing a
+// value of type t with n indices, if the access can be emitted inline: every
+// level must be a slice (inner slices are stored in place in their parent)
+// and the final elements must be stored by value or be slices themselves
+func (g *Generator) inlineIndexElemType(t types.Type, n int) (string, bool) {
+	for i := 0; i < n; i++ {
+		slice, ok := resolveSlice(t)
+		if !ok {
+			return "", false
+		}
+		t = slice.Elem
+	}
+	if _, ok := resolveSlice(t); ok {
+		return "%struct.Slice", true
+	}
+	if !storedByValue(t) {
+		return "", false
+	}
+	elemType, err := g.mapType(t)
 	if err != nil {
-		return fmt.Errorf("failed to map result type: %w", err)
+		return "", false
 	}
+	return elemType, true
+}
 
-	resultReg := g.nextReg()
-	g.localRegs[load.Result.ID] = resultReg
-	g.localIsValue[load.Result.ID] = true // LoadIndex produces a value
+// emitSliceField loads a field of the slice header
+func (g *Generator) emitSliceField(sliceReg string, field int, fieldType string) string {
+	fieldPtr := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = getelementptr inbounds %%struct.Slice, %%struct.Slice* %s, i32 0, i32 %d", fieldPtr, sliceReg, field))
+	valueReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = load %s, %s* %s", valueReg, fieldType, fieldType, fieldPtr))
+	return valueReg
+}
 
-	// Handle multi-dimensional indexing (slice of slices)
-	currentBase := targetReg
+// emitSliceBoundsCheck panics unless 0 <= index < len. The failure path
+// calls a cold noreturn function, so LLVM keeps it out of the hot loop.
+func (g *Generator) emitSliceBoundsCheck(sliceReg, indexReg string) {
+	lenReg := g.emitSliceField(sliceReg, sliceFieldLen, "i64")
+	okReg := g.nextReg()
+	// Unsigned compare: a negative index wraps around and fails as well
+	g.emit(fmt.Sprintf("  %s = icmp ult i64 %s, %s", okReg, indexReg, lenReg))
+
+	// Labels are derived from a fresh register name so they stay unique
+	label := strings.TrimPrefix(g.nextReg(), "%")
+	g.emit(fmt.Sprintf("  br i1 %s, label %%index%s_ok, label %%index%s_fail", okReg, label, label))
+	g.emit(fmt.Sprintf("index%s_fail:", label))
+	g.emit(fmt.Sprintf("  call void @runtime_slice_index_panic(i64 %s, i64 %s)", indexReg, lenReg))
+	g.emit("  unreachable")
+	g.emit(fmt.Sprintf("index%s_ok:", label))
+}
 
-	for i, indexOp := range load.Indices {
+// emitSliceMakeWritable gives the slice a buffer of its own before it is
+// written in place, if its buffer is shared with a subslice view
+func (g *Generator) emitSliceMakeWritable(sliceReg string) {
+	flagsReg := g.emitSliceField(sliceReg, sliceFieldFlags, "i64")
+	sharedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = and i64 %s, %d", sharedReg, flagsReg, sliceFlagShared))
+	isSharedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = icmp ne i64 %s, 0", isSharedReg, sharedReg))
+
+	label := strings.TrimPrefix(g.nextReg(), "%")
+	g.emit(fmt.Sprintf("  br i1 %s, label %%cow%s_copy, label %%cow%s_done", isSharedReg, label, label))
+	g.emit(fmt.Sprintf("cow%s_copy:", label))
+	g.emit(fmt.Sprintf("  call void @runtime_slice_make_writable(%%struct.Slice* %s)", sliceReg))
+	g.emit(fmt.Sprintf("  br label %%cow%s_done", label))
+	g.emit(fmt.Sprintf("cow%s_done:", label))
+}
+
+// generateSliceElementPtr emits the address of base[indices...] as a typed
+// GEP into the slice data, one level per index. Every level is bounds
+// checked except the first when the optimizer proved it in bounds; for
+// writes the innermost slice is made writable first. The outer levels are
+// only read, so writing base[i][j] through a view of base changes the inner
+// slice the view shares with its parent.
+func (g *Generator) generateSliceElementPtr(baseReg string, indices []mir.Operand, elemType string, inBounds, forWrite bool) (string, error) {
+	for i, indexOp := range indices {
 		indexReg, err := g.generateOperand(indexOp)
 		if err != nil {
-			return err
+			return "", err
+		}
+
+		last := i == len(indices)-1
+		if i > 0 || !inBounds {
+			g.emitSliceBoundsCheck(baseReg, indexReg)
+		}
+		if last && forWrite {
+			g.emitSliceMakeWritable(baseReg)
+		}
+
+		// Inner slices are stored in place in their parent's buffer
+		levelType := "%struct.Slice"
+		if last {
+			levelType = elemType
 		}
 
-		// Call runtime_slice_get
-		// returns i8* pointer to the element
+		dataReg := g.emitSliceField(baseReg, sliceFieldData, "i8*")
+		typedReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", typedReg, dataReg, levelType))
 		elemPtrReg := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = call i8* @runtime_slice_get(%%Slice* %s, i64 %s)",
-			elemPtrReg, currentBase, indexReg))
-
-		if i < len(load.Indices)-1 {
-			// Not the last index, so the element must be a Slice
-			// Bitcast i8* to %Slice* for the next iteration
-			// Note: runtime_slice_get returns a pointer to the element.
-			// If the element is a Slice struct, we have a pointer to it.
-			nextBase := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %%Slice*", nextBase, elemPtrReg))
-			currentBase = nextBase
-		} else {
-			// Last index, load the final value
-			// Cast to result type if needed
-			if resultType != "i8*" {
-				castReg := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", castReg, elemPtrReg, resultType))
-				loadReg := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = load %s, %s* %s", loadReg, resultType, resultType, castReg))
-
-				// If resultReg was already allocated (it wasn't, we just reserved the name),
-				// we need to use it. But wait, resultReg is just a name.
-				// We need to assign loadReg to resultReg? No, resultReg IS the register we want to define.
-				// But we defined loadReg.
-				// Actually, we should use resultReg for the final load.
-				// But we can't easily rename loadReg to resultReg if we already emitted it.
-				// So let's use resultReg in the load instruction.
-				// But wait, I used g.nextReg() for loadReg.
-
-				// Let's redo the last part properly:
-				// We want the final value in resultReg.
-				// The load instruction defines a register.
-				// So we should use resultReg as the destination of the load.
-
-				// However, g.localRegs[load.Result.ID] = resultReg was done early.
-				// So resultReg is the name we expect the result to be in.
-
-				// But I emitted "loadReg = load ...".
-				// So I should have used resultReg instead of loadReg.
-
-				// Correct approach:
-				// g.emit(fmt.Sprintf("  %s = load %s, %s* %s", resultReg, resultType, resultType, castReg))
-
-				// But wait, the previous code did:
-				// loadReg := g.nextReg()
-				// g.emit(...)
-				// resultReg = loadReg
-
-				// But resultReg was already assigned to localRegs.
-				// If I change resultReg variable, it doesn't change the map value?
-				// Ah, resultReg is a string.
-				// g.localRegs[...] = resultReg
-				// If I change resultReg later, the map still has the old string.
-				// So I must ensure the register name in the map matches the one defined by the instruction.
-
-				// In the original code:
-				// resultReg := g.nextReg()
-				// g.localRegs[...] = resultReg
-				// ...
-				// loadReg := g.nextReg()
-				// ...
-				// resultReg = loadReg
-
-				// This looks like a bug in the original code if resultReg was used before?
-				// No, resultReg was used in the first call to runtime_slice_get.
-				// But then it was overwritten.
-				// So the map would point to the WRONG register if we just updated the local variable.
-				// But wait, the original code:
-				// resultReg := g.nextReg()
-				// g.localRegs[...] = resultReg
-				// ...
-				// g.emit(..., resultReg, ...)
-				// if resultType != "i8*" {
-				//    ...
-				//    loadReg := g.nextReg()
-				//    g.emit(..., loadReg, ...)
-				//    resultReg = loadReg
-				// }
-
-				// If we update resultReg local var, the map is NOT updated.
-				// So subsequent uses of this local would use the OLD resultReg (from runtime_slice_get).
-				// But we want the loaded value.
-
-				// So I should update the map too.
-				g.localRegs[load.Result.ID] = loadReg
-				g.localIsValue[load.Result.ID] = true
-			} else {
-				// If resultType is i8*, then elemPtrReg is the result.
-				// But we assigned resultReg to the map.
-				// We should emit a bitcast or move?
-				// Or just update the map to point to elemPtrReg.
-				g.localRegs[load.Result.ID] = elemPtrReg
-				g.localIsValue[load.Result.ID] = false // This is a pointer
-			}
+		g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 %s", elemPtrReg, levelType, levelType, typedReg, indexReg))
+		baseReg = elemPtrReg
+	}
+	return baseReg, nil
+}
+
+// isSliceLenResult checks if a slice length result is an i64
+func isSliceLenResult(t types.Type) bool {
+	kind, ok := t.(*types.Primitive)
+	return ok && (kind.Kind == types.Int || kind.Kind == types.Int64 || kind.Kind == types.U64 || kind.Kind == types.Usize)
+}
+
+// generateSliceLen inlines runtime_slice_len as a load of the slice header,
+// so that loop bounds stay visible to LLVM
+func (g *Generator) generateSliceLen(call *mir.Call) error {
+	sliceReg, err := g.generateOperand(call.Args[0])
+	if err != nil {
+		return err
+	}
+	lenReg := g.emitSliceField(sliceReg, sliceFieldLen, "i64")
+
+	allocaReg, hasAlloca := g.localRegs[call.Result.ID]
+	if !hasAlloca {
+		allocaReg = g.nextReg()
+		g.emitAlloca(allocaReg, "i64")
+		g.localRegs[call.Result.ID] = allocaReg
+	}
+	g.emit(fmt.Sprintf("  store i64 %s, i64* %s", lenReg, allocaReg))
+	g.localIsValue[call.Result.ID] = false
+	return nil
+}
+
+// isSpecializedSliceOp checks if a call is a Vec operation that is emitted
+// for its element type instead of going through the elem_size-generic
+// runtime (push and set receive their value directly, not through a pointer)
+func isSpecializedSliceOp(call *mir.Call) bool {
+	switch call.Func {
+	case "runtime_slice_push":
+		return len(call.Args) == 2 && !isVoidPointer(call.Args[1].OperandType())
+	case "runtime_slice_set":
+		return len(call.Args) == 3 && !isVoidPointer(call.Args[2].OperandType())
+	case "runtime_slice_pop":
+		return len(call.Args) == 1
+	}
+	return false
+}
+
+// isVoidPointer checks if t is the untyped pointer (i8*) the generic
+// runtime operations take their values through
+func isVoidPointer(t types.Type) bool {
+	prim, ok := t.(*types.Primitive)
+	return ok && prim.Kind == types.Nil
+}
+
+// generateSliceOp emits push, pop and set for the slice's element type: the
+// common case is a few loads and a typed store, and only growing the buffer
+// (or unsharing it) calls into the runtime. Element types that cannot be
+// handled in registers fall back to the runtime functions.
+func (g *Generator) generateSliceOp(call *mir.Call) error {
+	var elemType string
+	var elem types.Type
+	if slice, ok := resolveSlice(call.Args[0].OperandType()); ok && storedByValue(slice.Elem) {
+		if mapped, err := g.mapType(slice.Elem); err == nil {
+			elemType, elem = mapped, slice.Elem
 		}
 	}
 
+	switch call.Func {
+	case "runtime_slice_push":
+		return g.generateSlicePush(call, elemType)
+	case "runtime_slice_set":
+		return g.generateSliceSet(call, elemType)
+	default:
+		return g.generateSlicePop(call, elemType, elem)
+	}
+}
+
+// generateSliceValue generates a push/set value operand and its LLVM type.
+// Values that do not have the element type go through the runtime, which
+// copies elem_size bytes.
+func (g *Generator) generateSliceValue(op mir.Operand) (string, string, error) {
+	valueReg, err := g.generateOperand(op)
+	if err != nil {
+		return "", "", err
+	}
+	valueType, err := g.mapType(op.OperandType())
+	if err != nil {
+		return "", "", fmt.Errorf("failed to map value type: %w", err)
+	}
+	return valueReg, valueType, nil
+}
+
+// emitSpill stores a value in a fresh stack slot and returns it as i8*,
+// for the runtime functions that copy values from memory
+func (g *Generator) emitSpill(valueReg, valueType string) string {
+	tempReg := g.nextReg()
+	g.emitAlloca(tempReg, valueType)
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", valueType, valueReg, valueType, tempReg))
+	valuePtrReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast %s* %s to i8*", valuePtrReg, valueType, tempReg))
+	return valuePtrReg
+}
+
+// generateSlicePush appends a value, growing the buffer on a cold path
+func (g *Generator) generateSlicePush(call *mir.Call, elemType string) error {
+	sliceReg, err := g.generateOperand(call.Args[0])
+	if err != nil {
+		return err
+	}
+	valueReg, valueType, err := g.generateSliceValue(call.Args[1])
+	if err != nil {
+		return err
+	}
+	if valueType != elemType {
+		valuePtrReg := g.emitSpill(valueReg, valueType)
+		g.emit(fmt.Sprintf("  call void @runtime_slice_push(%%struct.Slice* %s, i8* %s)", sliceReg, valuePtrReg))
+		return nil
+	}
+
+	// The fast path needs room for one more element in a buffer of its own
+	lenReg := g.emitSliceField(sliceReg, sliceFieldLen, "i64")
+	capReg := g.emitSliceField(sliceReg, sliceFieldCap, "i64")
+	flagsReg := g.emitSliceField(sliceReg, sliceFieldFlags, "i64")
+	fullReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = icmp uge i64 %s, %s", fullReg, lenReg, capReg))
+	sharedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = and i64 %s, %d", sharedReg, flagsReg, sliceFlagShared))
+	isSharedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = icmp ne i64 %s, 0", isSharedReg, sharedReg))
+	slowReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = or i1 %s, %s", slowReg, fullReg, isSharedReg))
+
+	label := strings.TrimPrefix(g.nextReg(), "%")
+	g.emit(fmt.Sprintf("  br i1 %s, label %%push%s_grow, label %%push%s_store", slowReg, label, label))
+	g.emit(fmt.Sprintf("push%s_grow:", label))
+	g.emit(fmt.Sprintf("  call void @runtime_slice_grow(%%struct.Slice* %s)", sliceReg))
+	g.emit(fmt.Sprintf("  br label %%push%s_store", label))
+	g.emit(fmt.Sprintf("push%s_store:", label))
+
+	// Growing moves the data, so it is loaded after the branch
+	dataReg := g.emitSliceField(sliceReg, sliceFieldData, "i8*")
+	typedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", typedReg, dataReg, elemType))
+	slotReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 %s", slotReg, elemType, elemType, typedReg, lenReg))
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", elemType, valueReg, elemType, slotReg))
+	g.emitSliceFieldStore(sliceReg, sliceFieldLen, lenReg, 1)
+	return nil
+}
+
+// generateSliceSet stores a value at a checked index
+func (g *Generator) generateSliceSet(call *mir.Call, elemType string) error {
+	sliceReg, err := g.generateOperand(call.Args[0])
+	if err != nil {
+		return err
+	}
+	valueReg, valueType, err := g.generateSliceValue(call.Args[2])
+	if err != nil {
+		return err
+	}
+	if valueType != elemType {
+		indexReg, err := g.generateOperand(call.Args[1])
+		if err != nil {
+			return err
+		}
+		valuePtrReg := g.emitSpill(valueReg, valueType)
+		g.emit(fmt.Sprintf("  call void @runtime_slice_set(%%struct.Slice* %s, i64 %s, i8* %s)", sliceReg, indexReg, valuePtrReg))
+		return nil
+	}
+
+	slotReg, err := g.generateSliceElementPtr(sliceReg, call.Args[1:2], elemType, false, true)
+	if err != nil {
+		return err
+	}
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", elemType, valueReg, elemType, slotReg))
+	return nil
+}
+
+// generateSlicePop removes the last element and returns it as an optional
+// (nil when the slice is empty). Optionals are pointers, so the value is
+// still boxed, but it is loaded and stored with its own type.
+func (g *Generator) generateSlicePop(call *mir.Call, elemType string, elem types.Type) error {
+	sliceReg, err := g.generateOperand(call.Args[0])
+	if err != nil {
+		return err
+	}
+	retType, err := g.mapType(call.Result.Type)
+	if err != nil {
+		return fmt.Errorf("failed to map result type: %w", err)
+	}
+
+	allocaReg, hasAlloca := g.localRegs[call.Result.ID]
+	if !hasAlloca {
+		allocaReg = g.nextReg()
+		g.emitAlloca(allocaReg, retType)
+		g.localRegs[call.Result.ID] = allocaReg
+	}
+	g.localIsValue[call.Result.ID] = false
+
+	if elemType == "" || retType != elemType+"*" {
+		resultReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = call i8* @runtime_slice_pop(%%struct.Slice* %s)", resultReg, sliceReg))
+		castReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", castReg, resultReg, retType))
+		g.emit(fmt.Sprintf("  store %s %s, %s* %s", retType, castReg, retType, allocaReg))
+		return nil
+	}
+
+	elemSize, err := g.calculateElementSize(elem)
+	if err != nil {
+		return err
+	}
+
+	g.emit(fmt.Sprintf("  store %s null, %s* %s", retType, retType, allocaReg))
+	lenReg := g.emitSliceField(sliceReg, sliceFieldLen, "i64")
+	emptyReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = icmp eq i64 %s, 0", emptyReg, lenReg))
+
+	label := strings.TrimPrefix(g.nextReg(), "%")
+	g.emit(fmt.Sprintf("  br i1 %s, label %%pop%s_done, label %%pop%s_some", emptyReg, label, label))
+	g.emit(fmt.Sprintf("pop%s_some:", label))
+	newLenReg := g.emitSliceFieldStore(sliceReg, sliceFieldLen, lenReg, -1)
+	dataReg := g.emitSliceField(sliceReg, sliceFieldData, "i8*")
+	typedReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", typedReg, dataReg, elemType))
+	slotReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 %s", slotReg, elemType, elemType, typedReg, newLenReg))
+	valueReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = load %s, %s* %s", valueReg, elemType, elemType, slotReg))
+
+	// Boxes of scalars hold no pointers, so the GC does not scan them
+	alloc := "runtime_alloc_atomic"
+	if strings.HasSuffix(elemType, "*") {
+		alloc = "runtime_alloc"
+	}
+	boxReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = call i8* @%s(i64 %s)", boxReg, alloc, elemSize))
+	typedBoxReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", typedBoxReg, boxReg, retType))
+	g.emit(fmt.Sprintf("  store %s %s, %s %s", elemType, valueReg, retType, typedBoxReg))
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", retType, typedBoxReg, retType, allocaReg))
+	g.emit(fmt.Sprintf("  br label %%pop%s_done", label))
+	g.emit(fmt.Sprintf("pop%s_done:", label))
+	return nil
+}
+
+// emitSliceFieldStore stores value + delta into a slice header field and
+// returns the stored register
+func (g *Generator) emitSliceFieldStore(sliceReg string, field int, valueReg string, delta int) string {
+	newReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = add i64 %s, %d", newReg, valueReg, delta))
+	fieldPtr := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = getelementptr inbounds %%struct.Slice, %%struct.Slice* %s, i32 0, i32 %d", fieldPtr, sliceReg, field))
+	g.emit(fmt.Sprintf("  store i64 %s, i64* %s", newReg, fieldPtr))
+	return newReg
+}
+
+// generateLoadIndex generates LLVM IR for loading an array/slice element
+func (g *Generator) generateLoadIndex(load *mir.LoadIndex) error {
+	elemType, ok := g.inlineIndexElemType(load.Target.OperandType(), len(load.Indices))
+	if !ok {
+		return g.generateLoadIndexRuntime(load)
+	}
+
+	targetReg, err := g.generateOperand(load.Target)
+	if err != nil {
+		return err
+	}
+	elemPtrReg, err := g.generateSliceElementPtr(targetReg, load.Indices, elemType, load.InBounds, false)
+	if err != nil {
+		return err
+	}
+
+	if elemType == "%struct.Slice" {
+		// An inner slice is stored in place, so its address is the value
+		g.localRegs[load.Result.ID] = elemPtrReg
+		g.localIsValue[load.Result.ID] = true
+		return nil
+	}
+
+	resultReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = load %s, %s* %s", resultReg, elemType, elemType, elemPtrReg))
+	g.localRegs[load.Result.ID] = resultReg
+	g.localIsValue[load.Result.ID] = true // LoadIndex produces a value
 	return nil
 }
 
 // generateStoreIndex generates LLVM IR for storing to an array/slice element
 func (g *Generator) generateStoreIndex(store *mir.StoreIndex) error {
+	elemType, ok := g.inlineIndexElemType(store.Target.OperandType(), len(store.Indices))
+	if !ok {
+		return g.generateStoreIndexRuntime(store)
+	}
+
 	targetReg, err := g.generateOperand(store.Target)
 	if err != nil {
 		return err
@@ -1224,32 +1575,113 @@ func (g *Generator) generateStoreIndex(store *mir.StoreIndex) error {
 	if err != nil {
 		return err
 	}
+	elemPtrReg, err := g.generateSliceElementPtr(targetReg, store.Indices, elemType, store.InBounds, true)
+	if err != nil {
+		return err
+	}
 
-	// Handle multi-dimensional indexing
-	currentBase := targetReg
+	if elemType == "%struct.Slice" {
+		// Copy the slice header into the parent's buffer
+		headerReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = load %%struct.Slice, %%struct.Slice* %s", headerReg, valueReg))
+		valueReg = headerReg
+	}
+	g.emit(fmt.Sprintf("  store %s %s, %s* %s", elemType, valueReg, elemType, elemPtrReg))
+	return nil
+}
 
-	for i, indexOp := range store.Indices {
+// generateRuntimeElementPtr emits the address of base[indices...] through
+// runtime_slice_get (which checks bounds), for the accesses that cannot be
+// emitted inline
+func (g *Generator) generateRuntimeElementPtr(baseReg string, indices []mir.Operand) (string, error) {
+	for i, indexOp := range indices {
 		indexReg, err := g.generateOperand(indexOp)
 		if err != nil {
-			return err
+			return "", err
 		}
 
-		if i < len(store.Indices)-1 {
-			// Not the last index, we need to traverse
-			elemPtrReg := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = call i8* @runtime_slice_get(%%Slice* %s, i64 %s)",
-				elemPtrReg, currentBase, indexReg))
+		elemPtrReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = call i8* @runtime_slice_get(%%struct.Slice* %s, i64 %s)",
+			elemPtrReg, baseReg, indexReg))
+		baseReg = elemPtrReg
 
+		if i < len(indices)-1 {
+			// Not the last index, so the element is a Slice stored in place
 			nextBase := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %%Slice*", nextBase, elemPtrReg))
-			currentBase = nextBase
-		} else {
-			// Last index, perform the store
-			g.emit(fmt.Sprintf("  call void @runtime_slice_set(%%Slice* %s, i64 %s, i8* %s)",
-				currentBase, indexReg, valueReg))
+			g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %%struct.Slice*", nextBase, elemPtrReg))
+			baseReg = nextBase
 		}
 	}
+	return baseReg, nil
+}
+
+// generateLoadIndexRuntime loads an element through runtime_slice_get
+func (g *Generator) generateLoadIndexRuntime(load *mir.LoadIndex) error {
+	targetReg, err := g.generateOperand(load.Target)
+	if err != nil {
+		return err
+	}
+
+	resultType, err := g.mapType(load.Result.Type)
+	if err != nil {
+		return fmt.Errorf("failed to map result type: %w", err)
+	}
+
+	elemPtrReg, err := g.generateRuntimeElementPtr(targetReg, load.Indices)
+	if err != nil {
+		return err
+	}
+
+	if resultType == "i8*" {
+		// The element pointer is the result
+		g.localRegs[load.Result.ID] = elemPtrReg
+		g.localIsValue[load.Result.ID] = false
+		return nil
+	}
 
+	castReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", castReg, elemPtrReg, resultType))
+	loadReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = load %s, %s* %s", loadReg, resultType, resultType, castReg))
+	g.localRegs[load.Result.ID] = loadReg
+	g.localIsValue[load.Result.ID] = true
+	return nil
+}
+
+// generateStoreIndexRuntime stores an element through runtime_slice_set,
+// which copies the value from memory
+func (g *Generator) generateStoreIndexRuntime(store *mir.StoreIndex) error {
+	targetReg, err := g.generateOperand(store.Target)
+	if err != nil {
+		return err
+	}
+	valueReg, err := g.generateOperand(store.Value)
+	if err != nil {
+		return err
+	}
+	valueType, err := g.mapType(store.Value.OperandType())
+	if err != nil {
+		return fmt.Errorf("failed to map value type: %w", err)
+	}
+
+	last := len(store.Indices) - 1
+	baseReg, err := g.generateRuntimeElementPtr(targetReg, store.Indices[:last])
+	if err != nil {
+		return err
+	}
+	if last > 0 {
+		sliceReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %%struct.Slice*", sliceReg, baseReg))
+		baseReg = sliceReg
+	}
+	indexReg, err := g.generateOperand(store.Indices[last])
+	if err != nil {
+		return err
+	}
+
+	valuePtrReg := g.emitSpill(valueReg, valueType)
+	g.emit(fmt.Sprintf("  call void @runtime_slice_set(%%struct.Slice* %s, i64 %s, i8* %s)",
+		baseReg, indexReg, valuePtrReg))
 	return nil
 }
 
@@ -1272,19 +1704,26 @@ func (g *Generator) generateConstructStruct(cons *mir.ConstructStruct) error {
 	}
 	structPtrType := structType + "*"
 
-	// Calculate struct size
-	sizeReg, err := g.calculateElementSize(cons.Result.Type)
-	if err != nil {
-		return fmt.Errorf("failed to calculate struct size: %w", err)
-	}
+	var allocaReg string
+	if cons.Stack {
+		allocaReg = g.nextReg()
+		g.emitStackObject(allocaReg, structType)
+	} else {
+		// Calculate struct size
+		sizeReg, err := g.calculateElementSize(cons.Result.Type)
+		if err != nil {
+			return fmt.Errorf("failed to calculate struct size: %w", err)
+		}
 
-	// Allocate struct on heap
-	memReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", memReg, sizeReg))
+		// Allocate struct on heap
+		memReg := g.nextReg()
+		alloc := allocFunc(structPointerFree(cons.Type, len(cons.Fields)))
+		g.emit(fmt.Sprintf("  %s = call i8* @%s(i64 %s)", memReg, alloc, sizeReg))
 
-	// Cast to struct pointer
-	allocaReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, structPtrType))
+		// Cast to struct pointer
+		allocaReg = g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, structPtrType))
+	}
 
 	resultReg := g.nextReg()
 	g.localRegs[cons.Result.ID] = resultReg
@@ -1385,8 +1824,8 @@ func (g *Generator) generateConstructArray(cons *mir.ConstructArray) error {
 	resultReg := g.nextReg()
 	g.localRegs[cons.Result.ID] = resultReg
 	g.localIsValue[cons.Result.ID] = true // The pointer is the value
-	g.emit(fmt.Sprintf("  %s = call %%Slice* @runtime_slice_new(i64 %s, i64 %d, i64 %d)",
-		resultReg, elemSize, length, capacity))
+	g.emit(fmt.Sprintf("  %s = call %%Slice* @runtime_slice_new(i64 %s, i64 %d, i64 %d, i8 %d)",
+		resultReg, elemSize, length, capacity, pointerFreeFlag(elemType)))
 
 	// Store each element into the slice
 	for i, elem := range cons.Elements {
@@ -1417,7 +1856,7 @@ func (g *Generator) generateConstructArray(cons *mir.ConstructArray) error {
 		// Allocate temporary storage for the element value
 		// runtime_slice_set expects a void* pointer to the value
 		tempAlloca := g.nextReg()
-		g.emit(fmt.Sprintf("  %s = alloca %s", tempAlloca, elemLLVMType))
+		g.emitAlloca(tempAlloca, elemLLVMType)
 
 		// Store the element value into temporary storage
 		// Handle both constant values and register values
@@ -1458,19 +1897,26 @@ func (g *Generator) generateConstructTuple(cons *mir.ConstructTuple) error {
 	tupleStructType := tupleType
 	tuplePtrType := tupleStructType + "*"
 
-	// Calculate tuple size
-	sizeReg, err := g.calculateElementSize(cons.Result.Type)
-	if err != nil {
-		return fmt.Errorf("failed to calculate tuple size: %w", err)
-	}
+	var allocaReg string
+	if cons.Stack {
+		allocaReg = g.nextReg()
+		g.emitStackObject(allocaReg, tupleStructType)
+	} else {
+		// Calculate tuple size
+		sizeReg, err := g.calculateElementSize(cons.Result.Type)
+		if err != nil {
+			return fmt.Errorf("failed to calculate tuple size: %w", err)
+		}
 
-	// Allocate tuple on heap
-	memReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", memReg, sizeReg))
+		// Allocate tuple on heap
+		memReg := g.nextReg()
+		alloc := allocFunc(tuplePointerFree(cons.Result.Type, len(cons.Elements)))
+		g.emit(fmt.Sprintf("  %s = call i8* @%s(i64 %s)", memReg, alloc, sizeReg))
 
-	// Cast to tuple pointer
-	allocaReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, tuplePtrType))
+		// Cast to tuple pointer
+		allocaReg = g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, tuplePtrType))
+	}
 
 	// Get tuple element types from the result type
 	tupleTypeObj, ok := cons.Result.Type.(*types.Tuple)
@@ -1535,19 +1981,25 @@ func (g *Generator) generateConstructEnum(cons *mir.ConstructEnum) error {
 	enumType := "%enum." + sanitizeName(cons.Type)
 	enumPtrType := enumType + "*"
 
-	// Calculate enum size
-	sizeReg, err := g.calculateElementSize(cons.Result.Type)
-	if err != nil {
-		return fmt.Errorf("failed to calculate enum size: %w", err)
-	}
+	var allocaReg string
+	if cons.Stack {
+		allocaReg = g.nextReg()
+		g.emitStackObject(allocaReg, enumType)
+	} else {
+		// Calculate enum size
+		sizeReg, err := g.calculateElementSize(cons.Result.Type)
+		if err != nil {
+			return fmt.Errorf("failed to calculate enum size: %w", err)
+		}
 
-	// Allocate enum on heap
-	memReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", memReg, sizeReg))
+		// Allocate enum on heap
+		memReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", memReg, sizeReg))
 
-	// Cast to enum pointer
-	allocaReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, enumPtrType))
+		// Cast to enum pointer
+		allocaReg = g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", allocaReg, memReg, enumPtrType))
+	}
 
 	// The pointer is the value
 	g.localRegs[cons.Result.ID] = allocaReg
@@ -1853,11 +2305,14 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 	wrapperName := fmt.Sprintf("spawn_wrapper_%s_%d", funcName, g.regCounter)
 	g.regCounter++
 
-	// Generate argument registers and types
+	// Generate argument registers and types. The callee's parameter types
+	// are used when it is known, so the struct layout matches what the
+	// wrapper unpacks.
+	callee := g.findFunction(spawn.Func)
 	var argRegs []string
 	var argTypes []string
 
-	for _, arg := range spawn.Args {
+	for i, arg := range spawn.Args {
 		argReg, err := g.generateOperand(arg)
 		if err != nil {
 			return err
@@ -1866,11 +2321,18 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 
 		// Infer argument type
 		var argType string
+		if callee != nil && i < len(callee.Params) {
+			argType, _ = g.mapType(callee.Params[i].Type)
+		}
 		switch op := arg.(type) {
 		case *mir.Literal:
-			argType, _ = g.mapType(op.Type)
+			if argType == "" {
+				argType, _ = g.mapType(op.Type)
+			}
 		case *mir.LocalRef:
-			argType, _ = g.mapType(op.Local.Type)
+			if argType == "" {
+				argType, _ = g.mapType(op.Local.Type)
+			}
 		}
 		if argType == "" {
 			argType = "i64" // fallback
@@ -1878,51 +2340,34 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 		argTypes = append(argTypes, argType)
 	}
 
-	// Build wrapper function
+	// Build wrapper function: unpack the arguments from the struct below
+	// and call the function, discarding its result
+	retType := "void"
+	if callee != nil && callee.ReturnType != nil {
+		if t, err := g.mapType(callee.ReturnType); err == nil {
+			retType = t
+		}
+	}
+
 	wrapper := strings.Builder{}
+	wrapper.WriteString(fmt.Sprintf("define internal void @%s(i8* %%args) %s {\n", wrapperName, functionAttributes))
+	wrapper.WriteString("entry:\n")
 
 	var argStructPtr string
-	if len(spawn.Args) == 0 {
-		// No arguments - just call the function
-	} else {
-		// Has arguments - unpack from struct and call function
-		var unpackedArgs []string
-		offset := 0
-
-		for i, argType := range argTypes {
-			// Calculate aligned offset
-			alignment := 8 // Assume 8-byte alignment for simplicity
-			if argType == "i32" || argType == "float" {
-				alignment = 4
-			} else if argType == "i8" || argType == "i1" {
-				alignment = 1
-			}
-			offset = (offset + alignment - 1) & ^(alignment - 1)
-
-			// Get pointer to this argument in the struct
-			_ = fmt.Sprintf("%%offset%d", i) // offsetReg unused in incomplete code
-
-			// Cast to argument type pointer
-			_ = fmt.Sprintf("%%cast%d", i) // castReg unused in incomplete code
-
-			// Load the argument value
-			loadReg := fmt.Sprintf("%%arg%d", i)
-
-			unpackedArgs = append(unpackedArgs, fmt.Sprintf("%s %s", argType, loadReg))
-
-			// Update offset
-			size := 8 // Default size
-			if argType == "i32" || argType == "float" {
-				size = 4
-			} else if argType == "i8" || argType == "i1" {
-				size = 1
-			}
-			offset += size
-		}
-
-		// Call the function with unpacked arguments
-		_ = strings.Join(unpackedArgs, ", ") // argsStr unused in incomplete code
-	}
+	var unpackedArgs []string
+	offset := 0
+	for i, argType := range argTypes {
+		size, alignment := spawnArgLayout(argType)
+		offset = (offset + alignment - 1) & ^(alignment - 1)
+		wrapper.WriteString(fmt.Sprintf("  %%offset%d = getelementptr i8, i8* %%args, i64 %d\n", i, offset))
+		wrapper.WriteString(fmt.Sprintf("  %%cast%d = bitcast i8* %%offset%d to %s*\n", i, i, argType))
+		wrapper.WriteString(fmt.Sprintf("  %%arg%d = load %s, %s* %%cast%d\n", i, argType, argType, i))
+		unpackedArgs = append(unpackedArgs, fmt.Sprintf("%s %%arg%d", argType, i))
+		offset += size
+	}
+	wrapper.WriteString(fmt.Sprintf("  call %s @%s(%s)\n", retType, funcName, strings.Join(unpackedArgs, ", ")))
+	wrapper.WriteString("  ret void\n")
+	wrapper.WriteString("}\n\n")
 
 	// Add wrapper to collection
 	g.spawnWrappers = append(g.spawnWrappers, wrapper.String())
@@ -1932,21 +2377,8 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 		// Calculate struct size
 		structSize := 0
 		for _, argType := range argTypes {
-			alignment := 8
-			if argType == "i32" || argType == "float" {
-				alignment = 4
-			} else if argType == "i8" || argType == "i1" {
-				alignment = 1
-			}
-			structSize = (structSize + alignment - 1) & ^(alignment - 1)
-
-			size := 8
-			if argType == "i32" || argType == "float" {
-				size = 4
-			} else if argType == "i8" || argType == "i1" {
-				size = 1
-			}
-			structSize += size
+			size, alignment := spawnArgLayout(argType)
+			structSize = (structSize+alignment-1)&^(alignment-1) + size
 		}
 
 		// Allocate struct
@@ -1958,14 +2390,7 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 		offset := 0
 		for i, argReg := range argRegs {
 			argType := argTypes[i]
-
-			// Calculate aligned offset
-			alignment := 8
-			if argType == "i32" || argType == "float" {
-				alignment = 4
-			} else if argType == "i8" || argType == "i1" {
-				alignment = 1
-			}
+			size, alignment := spawnArgLayout(argType)
 			offset = (offset + alignment - 1) & ^(alignment - 1)
 
 			// Get pointer to this position in struct
@@ -1978,31 +2403,61 @@ func (g *Generator) generateSpawn(spawn *mir.Spawn) error {
 
 			// Store the argument
 			g.emit(fmt.Sprintf("  store %s %s, %s* %s", argType, argReg, argType, castReg))
-
-			// Update offset
-			size := 8
-			if argType == "i32" || argType == "float" {
-				size = 4
-			} else if argType == "i8" || argType == "i1" {
-				size = 1
-			}
 			offset += size
 		}
 	} else {
 		argStructPtr = "null"
 	}
 
-	// Call runtime_legion_spawn with the wrapper
+	// Call runtime_legion_spawn with the wrapper; a stack size of 0 asks for
+	// the runtime's default, which grows on demand
 	legionPtrReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call %%Legion* @runtime_legion_spawn(void (i8*)* @%s, i8* %s, i64 8192)",
+	g.emit(fmt.Sprintf("  %s = call %%Legion* @runtime_legion_spawn(void (i8*)* @%s, i8* %s, i64 0)",
 		legionPtrReg, wrapperName, argStructPtr))
 
+	// A legion spawned in a spawn scope joins its wait group before it can run
+	if spawn.Group != nil {
+		group, err := g.generateOperand(spawn.Group)
+		if err != nil {
+			return fmt.Errorf("failed to generate spawn scope group: %w", err)
+		}
+		g.emit(fmt.Sprintf("  call void @runtime_waitgroup_track(i8* %s, %%Legion* %s)", group, legionPtrReg))
+	}
+
 	// Call runtime_legion_start to begin execution
 	g.emit(fmt.Sprintf("  call void @runtime_legion_start(%%Legion* %s)", legionPtrReg))
 
 	return nil
 }
 
+// findFunction returns the function of the current module with the given
+// name, or nil
+func (g *Generator) findFunction(name string) *mir.Function {
+	if g.currentModule == nil {
+		return nil
+	}
+	for _, fn := range g.currentModule.Functions {
+		if fn.Name == name {
+			return fn
+		}
+	}
+	return nil
+}
+
+// spawnArgLayout returns the size and alignment of a spawn argument of the
+// given LLVM type in the argument struct
+func spawnArgLayout(argType string) (size, alignment int) {
+	switch argType {
+	case "i32", "float":
+		return 4, 4
+	case "i16":
+		return 2, 2
+	case "i8", "i1":
+		return 1, 1
+	}
+	return 8, 8
+}
+
 // generateYield generates LLVM IR for yielding to the legion scheduler
 func (g *Generator) generateYield(yield *mir.Yield) error {
 	// Call runtime_legion_yield()
@@ -2017,11 +2472,17 @@ func (g *Generator) generateMakeClosure(mc *mir.MakeClosure) error {
 	closureType := "%Closure"
 	closurePtrType := "%Closure*"
 
-	closureReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 16)", closureReg)) // 2 pointers = 16 bytes
+	var closurePtrReg string
+	if mc.Stack {
+		closurePtrReg = g.nextReg()
+		g.emitStackObject(closurePtrReg, closureType)
+	} else {
+		closureReg := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 16)", closureReg)) // 2 pointers = 16 bytes
 
-	closurePtrReg := g.nextReg()
-	g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", closurePtrReg, closureReg, closurePtrType))
+		closurePtrReg = g.nextReg()
+		g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", closurePtrReg, closureReg, closurePtrType))
+	}
 
 	// 2. Store function pointer
 	funcPtrReg := g.nextReg()
@@ -12,6 +12,10 @@ import (
 func (g *Generator) generateTerminator(term mir.Terminator, fn *mir.Function, retLLVM string) error {
 	switch t := term.(type) {
 	case *mir.Return:
+		if fn != nil && fn.Name == "main" {
+			// Let the legions main leaves behind finish before the process exits
+			g.emit("  call void @runtime_scheduler_shutdown()")
+		}
 		return g.generateReturn(t, retLLVM)
 	case *mir.Goto:
 		return g.generateGoto(t)
@@ -24,26 +28,40 @@ func (g *Generator) generateTerminator(term mir.Terminator, fn *mir.Function, re
 	}
 }
 
-// generateSelect generates LLVM IR for a select statement
+// generateSelect generates LLVM IR for a select statement.
+// All channel cases are handed to runtime_select in one array; the runtime
+// parks until one of them can proceed (or returns -1 when there is a default
+// case and none is ready), and we switch on the chosen index.
 func (g *Generator) generateSelect(stmt *mir.Select) error {
-	// Generate polling loop
-	loopLabel := g.nextReg()                       // actually label
-	loopLabel = strings.TrimPrefix(loopLabel, "%") // remove %
+	var cases []mir.SelectCase
+	var defaultTarget *mir.BasicBlock
+	for _, c := range stmt.Cases {
+		if c.Kind == "default" {
+			defaultTarget = c.Target
+			continue
+		}
+		if c.Kind != "send" && c.Kind != "recv" {
+			return fmt.Errorf("unsupported select case kind: %s", c.Kind)
+		}
+		cases = append(cases, c)
+	}
 
-	g.emit(fmt.Sprintf("  br label %%%s", loopLabel))
-	g.emit(fmt.Sprintf("%s:", loopLabel))
+	caseArrayType := fmt.Sprintf("[%d x %%SelectCase]", len(cases))
+	caseArray := g.nextReg()
+	g.emitAlloca(caseArray, caseArrayType)
 
-	// For each case
-	for i, c := range stmt.Cases {
-		nextLabel := fmt.Sprintf("%s_next_%d", loopLabel, i)
+	// Non-primitive receive results land in a fresh box whose pointer becomes the result
+	recvBoxes := make(map[int]string)
 
-		if c.Kind == "send" {
-			// Get channel
-			chReg, err := g.generateOperand(c.Channel)
-			if err != nil {
-				return err
-			}
+	for i, c := range cases {
+		chReg, err := g.generateOperand(c.Channel)
+		if err != nil {
+			return err
+		}
 
+		var elemPtr string
+		kind := 0
+		if c.Kind == "send" {
 			// Prepare value pointer
 			valReg, err := g.generateOperand(c.Value)
 			if err != nil {
@@ -56,107 +74,125 @@ func (g *Generator) generateSelect(stmt *mir.Select) error {
 				return err
 			}
 
-			var valPtr string
 			if isPrimitive(valType) {
 				tempAlloca := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = alloca %s", tempAlloca, valLLVMType))
+				g.emitAlloca(tempAlloca, valLLVMType)
 				g.emit(fmt.Sprintf("  store %s %s, %s* %s", valLLVMType, valReg, valLLVMType, tempAlloca))
-				valPtr = g.nextReg()
-				g.emit(fmt.Sprintf("  %s = bitcast %s* %s to i8*", valPtr, valLLVMType, tempAlloca))
+				elemPtr = g.nextReg()
+				g.emit(fmt.Sprintf("  %s = bitcast %s* %s to i8*", elemPtr, valLLVMType, tempAlloca))
 			} else {
-				valPtr = g.nextReg()
-				g.emit(fmt.Sprintf("  %s = bitcast %s %s to i8*", valPtr, valLLVMType, valReg))
-			}
-
-			// Call try_send
-			successReg := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = call i8 @runtime_channel_try_send(%%Channel* %s, i8* %s)", successReg, chReg, valPtr))
-
-			// Branch
-			targetLabel, ok := g.blockLabels[c.Target]
-			if !ok {
-				return fmt.Errorf("target block not found")
+				elemPtr = g.nextReg()
+				g.emit(fmt.Sprintf("  %s = bitcast %s %s to i8*", elemPtr, valLLVMType, valReg))
 			}
-
-			g.emit(fmt.Sprintf("  %s_bool = trunc i8 %s to i1", successReg, successReg))
-			g.emit(fmt.Sprintf("  br i1 %s_bool, label %%%s, label %%%s", successReg, targetLabel, nextLabel))
-
-		} else if c.Kind == "recv" {
-			// Get channel
-			chReg, err := g.generateOperand(c.Channel)
-			if err != nil {
-				return err
-			}
-
-			// Prepare result pointer
-			resPtrAlloca := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = alloca i8*", resPtrAlloca))
-
-			// Call try_recv
-			successReg := g.nextReg()
-			g.emit(fmt.Sprintf("  %s = call i8 @runtime_channel_try_recv(%%Channel* %s, i8** %s)", successReg, chReg, resPtrAlloca))
-
-			// Branch
-			targetLabel, ok := g.blockLabels[c.Target]
-			if !ok {
-				return fmt.Errorf("target block not found")
-			}
-
-			successLabel := fmt.Sprintf("%s_success_%d", loopLabel, i)
-			g.emit(fmt.Sprintf("  %s_bool = trunc i8 %s to i1", successReg, successReg))
-			g.emit(fmt.Sprintf("  br i1 %s_bool, label %%%s, label %%%s", successReg, successLabel, nextLabel))
-
-			g.emit(fmt.Sprintf("%s:", successLabel))
-
+		} else {
+			kind = 1
+			elemPtr = "null"
 			if c.Result != nil {
-				// Load i8* from resPtrAlloca
-				resPtr := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = load i8*, i8** %s", resPtr, resPtrAlloca))
-
-				// Result type
 				resultType := c.Result.Type
 				resultLLVMType, err := g.mapType(resultType)
 				if err != nil {
 					return err
 				}
 
-				// Allocate local (if not already allocated)
-				localReg, ok := g.localRegs[c.Result.ID]
-				if !ok {
-					localReg = g.nextReg()
-					g.emit(fmt.Sprintf("  %s = alloca %s", localReg, resultLLVMType))
-					g.localRegs[c.Result.ID] = localReg
+				if isPrimitive(resultType) {
+					// Receive straight into the result local
+					localReg, ok := g.localRegs[c.Result.ID]
+					if !ok {
+						localReg = g.nextReg()
+						g.emitAlloca(localReg, resultLLVMType)
+						g.localRegs[c.Result.ID] = localReg
+					}
+					g.localIsValue[c.Result.ID] = false
+					elemPtr = g.nextReg()
+					g.emit(fmt.Sprintf("  %s = bitcast %s* %s to i8*", elemPtr, resultLLVMType, localReg))
+				} else {
+					sizeReg, err := g.calculateElementSize(resultType)
+					if err != nil {
+						return err
+					}
+					elemPtr = g.nextReg()
+					g.emit(fmt.Sprintf("  %s = call i8* @runtime_alloc(i64 %s)", elemPtr, sizeReg))
+					recvBoxes[i] = elemPtr
 				}
-				g.localIsValue[c.Result.ID] = false
+			}
+		}
 
-				// Cast and store
-				castPtr := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s*", castPtr, resPtr, resultLLVMType))
+		// Fill in cases[i]
+		chField := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 0, i64 %d, i32 0", chField, caseArrayType, caseArrayType, caseArray, i))
+		g.emit(fmt.Sprintf("  store %%Channel* %s, %%Channel** %s", chReg, chField))
+		elemField := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 0, i64 %d, i32 1", elemField, caseArrayType, caseArrayType, caseArray, i))
+		g.emit(fmt.Sprintf("  store i8* %s, i8** %s", elemPtr, elemField))
+		kindField := g.nextReg()
+		g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 0, i64 %d, i32 2", kindField, caseArrayType, caseArrayType, caseArray, i))
+		g.emit(fmt.Sprintf("  store i32 %d, i32* %s", kind, kindField))
+	}
 
-				valReg := g.nextReg()
-				g.emit(fmt.Sprintf("  %s = load %s, %s* %s", valReg, resultLLVMType, resultLLVMType, castPtr))
+	casesPtr := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = getelementptr inbounds %s, %s* %s, i64 0, i64 0", casesPtr, caseArrayType, caseArrayType, caseArray))
 
-				g.emit(fmt.Sprintf("  store %s %s, %s* %s", resultLLVMType, valReg, resultLLVMType, localReg))
-			}
+	block := 1
+	if defaultTarget != nil {
+		block = 0
+	}
+	chosenReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = call i64 @runtime_select(%%SelectCase* %s, i64 %d, i8 %d)", chosenReg, casesPtr, len(cases), block))
+
+	// Labels are derived from a fresh register name so they stay unique
+	selectLabel := strings.TrimPrefix(g.nextReg(), "%")
 
-			g.emit(fmt.Sprintf("  br label %%%s", targetLabel))
+	var defaultLabel string
+	if defaultTarget != nil {
+		label, ok := g.blockLabels[defaultTarget]
+		if !ok {
+			return fmt.Errorf("target block not found")
+		}
+		defaultLabel = label
+	} else {
+		defaultLabel = fmt.Sprintf("select%s_none", selectLabel)
+	}
+
+	var arms []string
+	for i := range cases {
+		arms = append(arms, fmt.Sprintf("i64 %d, label %%select%s_case_%d", i, selectLabel, i))
+	}
+	g.emit(fmt.Sprintf("  switch i64 %s, label %%%s [%s]", chosenReg, defaultLabel, strings.Join(arms, " ")))
+
+	for i, c := range cases {
+		targetLabel, ok := g.blockLabels[c.Target]
+		if !ok {
+			return fmt.Errorf("target block not found")
+		}
 
-		} else if c.Kind == "default" {
-			// Default case always succeeds
-			targetLabel, ok := g.blockLabels[c.Target]
+		g.emit(fmt.Sprintf("select%s_case_%d:", selectLabel, i))
+		if box, ok := recvBoxes[i]; ok {
+			resultLLVMType, err := g.mapType(c.Result.Type)
+			if err != nil {
+				return err
+			}
+
+			// Allocate local (if not already allocated)
+			localReg, ok := g.localRegs[c.Result.ID]
 			if !ok {
-				return fmt.Errorf("target block not found")
+				localReg = g.nextReg()
+				g.emitAlloca(localReg, resultLLVMType)
+				g.localRegs[c.Result.ID] = localReg
 			}
-			g.emit(fmt.Sprintf("  br label %%%s", targetLabel))
-		}
+			g.localIsValue[c.Result.ID] = false
 
-		g.emit(fmt.Sprintf("%s:", nextLabel))
+			castPtr := g.nextReg()
+			g.emit(fmt.Sprintf("  %s = bitcast i8* %s to %s", castPtr, box, resultLLVMType))
+			g.emit(fmt.Sprintf("  store %s %s, %s* %s", resultLLVMType, castPtr, resultLLVMType, localReg))
+		}
+		g.emit(fmt.Sprintf("  br label %%%s", targetLabel))
 	}
 
-	// If we fall through all cases (and no default), yield and loop
-	g.emit("  call void @runtime_legion_yield()")
-	g.emit("  call void @runtime_nanosleep(i64 100000)") // 100us
-	g.emit(fmt.Sprintf("  br label %%%s", loopLabel))
+	if defaultTarget == nil {
+		// A blocking select always picks one of its cases
+		g.emit(fmt.Sprintf("%s:", defaultLabel))
+		g.emit("  unreachable")
+	}
 
 	return nil
 }
@@ -204,10 +240,36 @@ func (g *Generator) generateGoto(gotoTerm *mir.Goto) error {
 		return fmt.Errorf("block label not found for target %s", gotoTerm.Target.Label)
 	}
 
+	if g.isBackEdge(gotoTerm.Target) {
+		g.emitSafepoint()
+	}
 	g.emit(fmt.Sprintf("  br label %%%s", targetLabel))
 	return nil
 }
 
+// isBackEdge checks if a jump from the current block to target closes a loop
+func (g *Generator) isBackEdge(target *mir.BasicBlock) bool {
+	order, ok := g.blockOrder[target]
+	return ok && order <= g.currentOrder
+}
+
+// emitSafepoint polls for preemption before a loop back-edge, so a legion
+// stuck in a long loop still gives up its worker when the runtime's monitor
+// asks it to. The poll is one load and a branch to a cold call; the load is
+// atomic so that LLVM keeps it inside the loop.
+func (g *Generator) emitSafepoint() {
+	flagReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = load atomic i32, i32* @runtime_preempt_requested monotonic, align 4", flagReg))
+	pendingReg := g.nextReg()
+	g.emit(fmt.Sprintf("  %s = icmp ne i32 %s, 0", pendingReg, flagReg))
+	label := strings.TrimPrefix(g.nextReg(), "%")
+	g.emit(fmt.Sprintf("  br i1 %s, label %%safepoint%s_yield, label %%safepoint%s_resume", pendingReg, label, label))
+	g.emit(fmt.Sprintf("safepoint%s_yield:", label))
+	g.emit("  call void @runtime_safepoint()")
+	g.emit(fmt.Sprintf("  br label %%safepoint%s_resume", label))
+	g.emit(fmt.Sprintf("safepoint%s_resume:", label))
+}
+
 // generateBranch generates LLVM IR for a conditional branch
 func (g *Generator) generateBranch(branch *mir.Branch) error {
 	// Generate condition register
@@ -258,6 +320,9 @@ func (g *Generator) generateBranch(branch *mir.Branch) error {
 		return fmt.Errorf("block label not found for false target %s", branch.False.Label)
 	}
 
+	if g.isBackEdge(branch.True) || g.isBackEdge(branch.False) {
+		g.emitSafepoint()
+	}
 	g.emit(fmt.Sprintf("  br i1 %s, label %%%s, label %%%s", condReg, trueLabel, falseLabel))
 	return nil
 }
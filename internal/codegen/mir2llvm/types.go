@@ -322,7 +322,7 @@ func (g *Generator) calculateElementSize(elemType types.Type) (string, error) {
 		g.emit(fmt.Sprintf("  %s = mul i64 %s, %d", lenReg, elemSize, t.Len))
 		return lenReg, nil
 	case *types.Slice:
-		return "24", nil // Slice struct: data (8) + len (8) + cap (8) + elem_size (8)
+		return "48", nil // Slice struct: data (8) + len (8) + cap (8) + elem_size (8) + flags (8) + arena (8)
 	case *types.Tuple:
 		// For tuples, use a reasonable default (could be improved)
 		return "8", nil
@@ -407,6 +407,14 @@ func isFloat(t types.Type) bool {
 	return false
 }
 
+// isBool checks if a type is a bool
+func isBool(t types.Type) bool {
+	if p, ok := t.(*types.Primitive); ok {
+		return p.Kind == types.Bool
+	}
+	return false
+}
+
 // isSigned checks if an integer type is signed
 func isSigned(t types.Type) bool {
 	if p, ok := t.(*types.Primitive); ok {
@@ -460,3 +468,52 @@ func isPointer(t types.Type) bool {
 	}
 	return false
 }
+
+// allocFunc returns the runtime allocator for an object: memory that will
+// never hold pointers is allocated atomic, so the GC does not scan it
+func allocFunc(pointerFree bool) string {
+	if pointerFree {
+		return "runtime_alloc_atomic"
+	}
+	return "runtime_alloc"
+}
+
+// pointerFreeFlag returns the i8 pointer_free argument for runtime_slice_new
+// and runtime_channel_new
+func pointerFreeFlag(elemType types.Type) int {
+	if types.PointerFree(elemType) {
+		return 1
+	}
+	return 0
+}
+
+// structPointerFree checks if a struct holds no pointers, given the set of
+// fields a constructor initialises (atomic memory is not zeroed, so every
+// field must be stored)
+func structPointerFree(t types.Type, initialised int) bool {
+	st, ok := t.(*types.Struct)
+	if !ok || len(st.Fields) == 0 || initialised != len(st.Fields) {
+		return false
+	}
+	for _, field := range st.Fields {
+		if !types.PointerFree(field.Type) {
+			return false
+		}
+	}
+	return true
+}
+
+// tuplePointerFree checks if a tuple holds no pointers, given the number of
+// elements a constructor initialises
+func tuplePointerFree(t types.Type, initialised int) bool {
+	tuple, ok := t.(*types.Tuple)
+	if !ok || len(tuple.Elements) == 0 || initialised != len(tuple.Elements) {
+		return false
+	}
+	for _, elem := range tuple.Elements {
+		if !types.PointerFree(elem) {
+			return false
+		}
+	}
+	return true
+}
@@ -0,0 +1,101 @@
+package mir2llvm
+
+import (
+	"fmt"
+	"sort"
+	"strings"
+
+	"github.com/malphas-lang/malphas-lang/internal/diag"
+	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// Unit is one LLVM module of a program split by GenerateUnits
+type Unit struct {
+	// Module is the file module the unit's functions come from, or "" for
+	// the unit holding the program's own code (and main)
+	Module string
+	IR     string
+}
+
+// GenerateUnits generates LLVM IR for a MIR module as one unit per file
+// module, so each can be optimized and compiled on its own (and a unit that
+// did not change need not be compiled again). The program's unit comes
+// first; monomorphized instances belong to it, so a module's unit only
+// changes when the module does.
+//
+// The IR of a unit depends only on its contents: functions and type
+// definitions are emitted sorted by name, whatever order lowering (which
+// walks maps) produced them in.
+func (g *Generator) GenerateUnits(module *mir.Module) ([]Unit, error) {
+	g.Errors = make([]diag.Diagnostic, 0)
+
+	byModule := make(map[string][]*mir.Function)
+	names := []string{""}
+	for _, fn := range module.Functions {
+		// Skip generic functions - only generate specialized (monomorphized) versions
+		if len(fn.TypeParams) > 0 {
+			continue
+		}
+		if _, ok := byModule[fn.Module]; !ok && fn.Module != "" {
+			names = append(names, fn.Module)
+		}
+		byModule[fn.Module] = append(byModule[fn.Module], fn)
+	}
+	sort.Strings(names[1:])
+	for _, fns := range byModule {
+		sort.SliceStable(fns, func(i, j int) bool { return fns[i].Name < fns[j].Name })
+	}
+
+	sorted := &mir.Module{
+		Functions: module.Functions,
+		Structs:   append([]*types.Struct(nil), module.Structs...),
+		Enums:     append([]*types.Enum(nil), module.Enums...),
+	}
+	sort.SliceStable(sorted.Structs, func(i, j int) bool { return sorted.Structs[i].Name < sorted.Structs[j].Name })
+	sort.SliceStable(sorted.Enums, func(i, j int) bool { return sorted.Enums[i].Name < sorted.Enums[j].Name })
+
+	units := make([]Unit, 0, len(names))
+	for _, name := range names {
+		var extern []*mir.Function
+		for _, other := range names {
+			if other != name {
+				extern = append(extern, byModule[other]...)
+			}
+		}
+		ug := NewGenerator()
+		ug.currentModule = sorted
+		ir, err := ug.generateUnit(sorted, byModule[name], extern, name == "")
+		g.Errors = append(g.Errors, ug.Errors...)
+		if err != nil {
+			if name != "" {
+				err = fmt.Errorf("module %s: %w", name, err)
+			}
+			return nil, err
+		}
+		units = append(units, Unit{Module: name, IR: ir})
+	}
+	return units, nil
+}
+
+// emitFunctionDeclaration declares a function defined in another unit, with
+// the signature generateFunction gives its definition
+func (g *Generator) emitFunctionDeclaration(fn *mir.Function) error {
+	retLLVM, err := g.mapType(fn.ReturnType)
+	if err != nil {
+		return fmt.Errorf("failed to map return type: %w", err)
+	}
+	if fn.Name == "main" {
+		retLLVM = "i32"
+	}
+	paramTypes := make([]string, 0, len(fn.Params))
+	for i, param := range fn.Params {
+		paramType, err := g.mapType(param.Type)
+		if err != nil {
+			return fmt.Errorf("failed to map parameter %d type: %w", i, err)
+		}
+		paramTypes = append(paramTypes, paramType)
+	}
+	g.emit(fmt.Sprintf("declare %s @%s(%s)", retLLVM, sanitizeName(fn.Name), strings.Join(paramTypes, ", ")))
+	return nil
+}
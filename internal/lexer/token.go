@@ -109,6 +109,7 @@ const (
 	UNSAFE   TokenType = "UNSAFE"
 	EXISTS   TokenType = "EXISTS"
 	FORALL   TokenType = "FORALL"
+	WITH     TokenType = "WITH"
 
 	// Trivia tokens (comments, whitespace, newlines)
 	LINE_COMMENT  TokenType = "LINE_COMMENT"  // //
@@ -153,6 +154,7 @@ var keywords = map[string]TokenType{
 	"unsafe":   UNSAFE,
 	"exists":   EXISTS,
 	"forall":   FORALL,
+	"with":     WITH,
 }
 
 // LookupIdent checks if the identifier is a keyword
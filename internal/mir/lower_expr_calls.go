@@ -94,6 +94,22 @@ func (l *Lowerer) lowerCallExpr(call *ast.CallExpr) (Operand, error) {
 
 				return &LocalRef{Local: resultLocal}, nil
 			}
+
+			// make[[]T](n): a slice of n zero values
+			if sliceType, ok := retType.(*types.Slice); ok {
+				length, err := l.lowerExpr(call.Args[0])
+				if err != nil {
+					return nil, err
+				}
+				pointerFree := int64(0)
+				if types.PointerFree(sliceType.Elem) {
+					pointerFree = 1
+				}
+				// Elements take as many bytes as in a slice literal
+				elemSize := &Literal{Type: &types.Primitive{Kind: types.Int64}, Value: sliceElemSize(sliceType.Elem)}
+				return l.emitRuntimeCall("runtime_slice_new", retType, elemSize, length, length,
+					&Literal{Type: &types.Primitive{Kind: types.Int8}, Value: pointerFree}), nil
+			}
 		}
 	}
 
@@ -132,6 +148,41 @@ func (l *Lowerer) lowerCallExpr(call *ast.CallExpr) (Operand, error) {
 		return &LocalRef{Local: resultLocal}, nil
 	}
 
+	if calleeName == "format" {
+		return l.lowerFormatCall(call)
+	}
+
+	// len(slice) reads the slice header (inlined by the backend)
+	if calleeName == "len" && len(call.Args) == 1 {
+		if _, ok := l.getType(call.Args[0], l.TypeInfo).(*types.Slice); ok {
+			arg, err := l.lowerExpr(call.Args[0])
+			if err != nil {
+				return nil, err
+			}
+			return l.emitRuntimeCall("runtime_slice_len", &types.Primitive{Kind: types.Int64}, arg), nil
+		}
+	}
+
+	// num_workers() queries the scheduler (a count <= 0 changes nothing)
+	if calleeName == "num_workers" && len(call.Args) == 0 {
+		return l.emitRuntimeCall("runtime_scheduler_set_workers", &types.Primitive{Kind: types.Int64},
+			&Literal{Type: &types.Primitive{Kind: types.Int64}, Value: int64(0)}), nil
+	}
+
+	// send_many(ch, xs) and recv_many(ch, xs, max) move whole runs of
+	// elements between a slice and a channel in one runtime call
+	if (calleeName == "send_many" && len(call.Args) == 2) || (calleeName == "recv_many" && len(call.Args) == 3) {
+		args := make([]Operand, len(call.Args))
+		for i, argExpr := range call.Args {
+			arg, err := l.lowerExpr(argExpr)
+			if err != nil {
+				return nil, err
+			}
+			args[i] = arg
+		}
+		return l.emitRuntimeCall("runtime_channel_"+calleeName, &types.Primitive{Kind: types.Int64}, args...), nil
+	}
+
 	// Check for enum variant construction: Enum::Variant(args...)
 	// Check for enum variant construction: Enum::Variant(args...)
 	if infix, ok := call.Callee.(*ast.InfixExpr); ok && infix.Op == lexer.DOUBLE_COLON {
@@ -236,6 +287,22 @@ notEnum:
 			targetType = ptr.Elem
 		}
 
+		// find, contains and split on strings call the runtime's search kernels
+		if prim, ok := targetType.(*types.Primitive); ok && prim.Kind == types.String && len(call.Args) == 1 {
+			switch methodName := fieldExpr.Field.Name; methodName {
+			case "find", "contains", "split":
+				receiverOp, err := l.lowerExpr(fieldExpr.Target)
+				if err != nil {
+					return nil, err
+				}
+				arg, err := l.lowerExpr(call.Args[0])
+				if err != nil {
+					return nil, err
+				}
+				return l.emitRuntimeCall("runtime_string_"+methodName, l.getType(call, l.TypeInfo), receiverOp, arg), nil
+			}
+		}
+
 		if _, ok := targetType.(*types.Slice); ok {
 			methodName := fieldExpr.Field.Name
 			var runtimeFunc string
@@ -243,6 +310,8 @@ notEnum:
 			switch methodName {
 			case "push":
 				runtimeFunc = "runtime_slice_push"
+			case "len":
+				runtimeFunc = "runtime_slice_len"
 			case "pop":
 				runtimeFunc = "runtime_slice_pop"
 			case "insert":
@@ -253,7 +322,7 @@ notEnum:
 				runtimeFunc = "runtime_slice_clear"
 			case "reserve":
 				runtimeFunc = "runtime_slice_reserve"
-			case "copy":
+			case "copy", "to_owned":
 				runtimeFunc = "runtime_slice_copy"
 			case "subslice":
 				runtimeFunc = "runtime_slice_subslice"
@@ -285,48 +354,25 @@ notEnum:
 					isValueArg := (methodName == "push" && i == 0) ||
 						((methodName == "insert" || methodName == "set") && i == 1)
 
+					// push and set take scalars directly: the backend emits them
+					// for the element type instead of calling the runtime
+					_, isPrim := op.OperandType().(*types.Primitive)
+					if isPrim && (methodName == "push" || methodName == "set") {
+						isValueArg = false
+					}
+					// So do values of a type parameter: how to pass one is
+					// only known once the function is specialized
+					if l.isTypeParam(op.OperandType()) && (methodName == "push" || methodName == "set") {
+						isValueArg = false
+					}
+
 					if isValueArg {
 						// We need to pass a pointer to the value
 						valType := op.OperandType()
 
-						// If it's a primitive, we need to take its address
-						_, isPrim := valType.(*types.Primitive)
-						if isPrim {
-							// Create a temporary local to hold the value
-							tempLocal := l.newLocal("", valType)
-							l.currentFunc.Locals = append(l.currentFunc.Locals, tempLocal)
-
-							// Assign value to temp local
-							l.currentBlock.Statements = append(l.currentBlock.Statements, &Assign{
-								Local: tempLocal,
-								RHS:   op,
-							})
-
-							// Create a local for the address
-							addrType := &types.Pointer{Elem: valType}
-							addrLocal := l.newLocal("", addrType)
-							l.currentFunc.Locals = append(l.currentFunc.Locals, addrLocal)
-
-							// Take address
-							l.currentBlock.Statements = append(l.currentBlock.Statements, &AddressOf{
-								Result: addrLocal,
-								Target: tempLocal,
-							})
-
-							// Cast to i8*
-							voidPtrLocal := l.newLocal("", &types.Primitive{Kind: types.Nil}) // i8*
-							l.currentFunc.Locals = append(l.currentFunc.Locals, voidPtrLocal)
-
-							l.currentBlock.Statements = append(l.currentBlock.Statements, &Cast{
-								Result:  voidPtrLocal,
-								Operand: &LocalRef{Local: addrLocal},
-								Type:    &types.Primitive{Kind: types.Nil},
-							})
-
-							op = &LocalRef{Local: voidPtrLocal}
-						} else {
-							// It's already a pointer (or should be treated as one)
-							// Just cast to i8*
+						if _, isSlice := valType.(*types.Slice); isSlice {
+							// Inner slices are stored in place: the runtime
+							// copies the header the pointer points at
 							voidPtrLocal := l.newLocal("", &types.Primitive{Kind: types.Nil})
 							l.currentFunc.Locals = append(l.currentFunc.Locals, voidPtrLocal)
 
@@ -337,6 +383,11 @@ notEnum:
 							})
 
 							op = &LocalRef{Local: voidPtrLocal}
+						} else {
+							// Scalars are stored by value and everything else
+							// as its pointer: either way the runtime copies the
+							// element from the address of a temporary
+							op = l.spillValueArg(op, valType)
 						}
 					}
 
@@ -474,3 +525,30 @@ notEnum:
 
 	return &LocalRef{Local: resultLocal}, nil
 }
+
+// spillValueArg stores op in a temporary and returns the temporary's address
+// as an i8*, for the runtime calls that copy an element from memory
+func (l *Lowerer) spillValueArg(op Operand, valType types.Type) Operand {
+	tempLocal := l.newLocal("", valType)
+	l.currentFunc.Locals = append(l.currentFunc.Locals, tempLocal)
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &Assign{
+		Local: tempLocal,
+		RHS:   op,
+	})
+
+	addrLocal := l.newLocal("", &types.Pointer{Elem: valType})
+	l.currentFunc.Locals = append(l.currentFunc.Locals, addrLocal)
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &AddressOf{
+		Result: addrLocal,
+		Target: tempLocal,
+	})
+
+	voidPtrLocal := l.newLocal("", &types.Primitive{Kind: types.Nil}) // i8*
+	l.currentFunc.Locals = append(l.currentFunc.Locals, voidPtrLocal)
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &Cast{
+		Result:  voidPtrLocal,
+		Operand: &LocalRef{Local: addrLocal},
+		Type:    &types.Primitive{Kind: types.Nil},
+	})
+	return &LocalRef{Local: voidPtrLocal}
+}
@@ -85,9 +85,7 @@ func (l *Lowerer) lowerArrayLiteral(expr *ast.ArrayLiteral) (Operand, error) {
 	// Allocate/create the array or slice
 	if isSlice {
 		// For slices, call runtime_slice_new to create the slice
-		// runtime_slice_new(elem_size, len, cap) -> *Slice
-		// We need to calculate element size - for now, use a placeholder
-		// The actual size calculation will be done in the MIR-to-LLVM backend
+		// runtime_slice_new(elem_size, len, cap, pointer_free) -> *Slice
 		elemSizeLocal := l.newLocal("", &types.Primitive{Kind: types.Int64})
 		l.currentFunc.Locals = append(l.currentFunc.Locals, elemSizeLocal)
 
@@ -113,12 +111,20 @@ func (l *Lowerer) lowerArrayLiteral(expr *ast.ArrayLiteral) (Operand, error) {
 			RHS:   capValue,
 		})
 
-		// Call runtime_slice_new(elem_size, len, cap)
-		// Note: elem_size will need to be calculated in the backend
-		// For now, we pass a placeholder
+		// Buffers of pointer-free elements are not scanned by the GC
+		pointerFree := int64(0)
+		if sliceType, ok := resultType.(*types.Slice); ok && types.PointerFree(sliceType.Elem) {
+			pointerFree = 1
+		}
+
+		// Call runtime_slice_new(elem_size, len, cap, pointer_free)
+		elemSize := int64(8)
+		if sliceType, ok := resultType.(*types.Slice); ok {
+			elemSize = sliceElemSize(sliceType.Elem)
+		}
 		elemSizeValue := &Literal{
 			Type:  &types.Primitive{Kind: types.Int64},
-			Value: int64(8), // Placeholder - will be calculated in backend
+			Value: elemSize,
 		}
 		l.currentBlock.Statements = append(l.currentBlock.Statements, &Assign{
 			Local: elemSizeLocal,
@@ -132,6 +138,7 @@ func (l *Lowerer) lowerArrayLiteral(expr *ast.ArrayLiteral) (Operand, error) {
 				&LocalRef{Local: elemSizeLocal},
 				&LocalRef{Local: lenLocal},
 				&LocalRef{Local: capLocal},
+				&Literal{Type: &types.Primitive{Kind: types.Int8}, Value: pointerFree},
 			},
 		})
 	} else {
@@ -169,6 +176,16 @@ func (l *Lowerer) lowerArrayLiteral(expr *ast.ArrayLiteral) (Operand, error) {
 	return &LocalRef{Local: resultLocal}, nil
 }
 
+// sliceElemSize is the number of bytes a slice element takes in its buffer:
+// inner slices are stored in place as their 48-byte header, everything else
+// in a word
+func sliceElemSize(elem types.Type) int64 {
+	if _, ok := elem.(*types.Slice); ok {
+		return 48
+	}
+	return 8
+}
+
 // lowerTupleLiteral lowers a tuple literal
 func (l *Lowerer) lowerTupleLiteral(expr *ast.TupleLiteral) (Operand, error) {
 	// Lower elements first
@@ -103,6 +103,7 @@ func (l *Lowerer) lowerFunctionLiteral(expr *ast.FunctionLiteral) (Operand, erro
 	oldFunc := l.currentFunc
 	oldBlock := l.currentBlock
 	oldLocals := l.locals
+	oldRegions := l.regions
 
 	// 4. Switch to new function context
 	l.currentFunc = fn
@@ -110,6 +111,7 @@ func (l *Lowerer) lowerFunctionLiteral(expr *ast.FunctionLiteral) (Operand, erro
 	fn.Entry = l.currentBlock
 	fn.Blocks = []*BasicBlock{fn.Entry}
 	l.locals = make(map[string]Local)
+	l.regions = nil
 
 	// 5. Lower parameters
 	// TODO: Handle closure environment (captures) as first parameter
@@ -145,6 +147,7 @@ func (l *Lowerer) lowerFunctionLiteral(expr *ast.FunctionLiteral) (Operand, erro
 	l.currentFunc = oldFunc
 	l.currentBlock = oldBlock
 	l.locals = oldLocals
+	l.regions = oldRegions
 
 	// 8. Add function to module
 	l.Module.Functions = append(l.Module.Functions, fn)
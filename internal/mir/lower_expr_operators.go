@@ -10,6 +10,10 @@ import (
 
 // lowerInfixExpr lowers an infix expression
 func (l *Lowerer) lowerInfixExpr(expr *ast.InfixExpr) (Operand, error) {
+	if l.isStringConcat(expr) {
+		return l.lowerStringConcat(expr)
+	}
+
 	if expr.Op == lexer.DOUBLE_COLON {
 		// Enum variant construction (unit variant)
 		// Left must be Ident (Enum name)
@@ -64,6 +64,24 @@ func (l *Lowerer) getReturnType(decl *ast.FnDecl) types.Type {
 	return nil // void is nil in MIR
 }
 
+// isTypeParam checks if t is one of the current function's type parameters
+func (l *Lowerer) isTypeParam(t types.Type) bool {
+	switch t := t.(type) {
+	case *types.TypeParam:
+		return true
+	case *types.Named:
+		if l.currentFunc == nil {
+			return false
+		}
+		for _, tp := range l.currentFunc.TypeParams {
+			if tp.Name == t.Name {
+				return true
+			}
+		}
+	}
+	return false
+}
+
 func (l *Lowerer) getCalleeName(callee ast.Expr) string {
 	if ident, ok := callee.(*ast.Ident); ok {
 		return ident.Name
@@ -65,6 +65,7 @@ func (l *Lowerer) lowerSpawnStmt(stmt *ast.SpawnStmt) error {
 		Func:     funcName,
 		Args:     args,
 		TypeArgs: typeArgs,
+		Group:    l.spawnGroup(),
 	})
 
 	return nil
@@ -99,11 +100,13 @@ func (l *Lowerer) createBlockWrapper(block *ast.BlockExpr) string {
 	oldFunc := l.currentFunc
 	oldBlock := l.currentBlock
 	oldLocals := l.locals
+	oldRegions := l.regions
 
 	// Set up new context for lowering the block
 	l.currentFunc = mirFunc
 	l.currentBlock = entryBlock
 	l.locals = make(map[string]Local)
+	l.regions = nil
 
 	// Lower the block statements
 	for _, stmt := range block.Stmts {
@@ -113,6 +116,7 @@ func (l *Lowerer) createBlockWrapper(block *ast.BlockExpr) string {
 			l.currentFunc = oldFunc
 			l.currentBlock = oldBlock
 			l.locals = oldLocals
+			l.regions = oldRegions
 			return funcName // Return name anyway for now
 		}
 	}
@@ -126,6 +130,7 @@ func (l *Lowerer) createBlockWrapper(block *ast.BlockExpr) string {
 	l.currentFunc = oldFunc
 	l.currentBlock = oldBlock
 	l.locals = oldLocals
+	l.regions = oldRegions
 
 	// Add the new function to the module
 	l.Module.Functions = append(l.Module.Functions, mirFunc)
@@ -179,11 +184,13 @@ func (l *Lowerer) createFunctionLiteralWrapper(lit *ast.FunctionLiteral) string
 	oldFunc := l.currentFunc
 	oldBlock := l.currentBlock
 	oldLocals := l.locals
+	oldRegions := l.regions
 
 	// Set up new context
 	l.currentFunc = mirFunc
 	l.currentBlock = entryBlock
 	l.locals = make(map[string]Local)
+	l.regions = nil
 
 	// Add parameters to locals
 	for _, param := range params {
@@ -197,6 +204,7 @@ func (l *Lowerer) createFunctionLiteralWrapper(lit *ast.FunctionLiteral) string
 			l.currentFunc = oldFunc
 			l.currentBlock = oldBlock
 			l.locals = oldLocals
+			l.regions = oldRegions
 			return funcName
 		}
 	}
@@ -210,6 +218,7 @@ func (l *Lowerer) createFunctionLiteralWrapper(lit *ast.FunctionLiteral) string
 	l.currentFunc = oldFunc
 	l.currentBlock = oldBlock
 	l.locals = oldLocals
+	l.regions = oldRegions
 
 	// Add function to module
 	l.Module.Functions = append(l.Module.Functions, mirFunc)
@@ -33,6 +33,10 @@ func (l *Lowerer) lowerStmt(stmt ast.Stmt) error {
 		return l.lowerSpawnStmt(s)
 	case *ast.SelectStmt:
 		return l.lowerSelectStmt(s)
+	case *ast.WithArenaStmt:
+		return l.lowerWithArenaStmt(s)
+	case *ast.SpawnScopeStmt:
+		return l.lowerSpawnScopeStmt(s)
 	default:
 		return fmt.Errorf("unsupported statement type: %T", stmt)
 	}
@@ -259,6 +263,7 @@ func (l *Lowerer) lowerReturnStmt(stmt *ast.ReturnStmt) error {
 		}
 	}
 
+	l.endRegions(0)
 	l.currentBlock.Terminator = &Return{Value: value}
 	return nil
 }
@@ -292,8 +297,9 @@ func (l *Lowerer) lowerWhileStmt(stmt *ast.WhileStmt) error {
 
 	// Create loop context
 	loopCtx := &LoopContext{
-		Header: loopHeader,
-		End:    loopEnd,
+		Header:  loopHeader,
+		End:     loopEnd,
+		Regions: len(l.regions),
 	}
 
 	// Push loop context onto stack
@@ -358,8 +364,9 @@ func (l *Lowerer) lowerForStmt(stmt *ast.ForStmt) error {
 
 	// Create loop context
 	loopCtx := &LoopContext{
-		Header: loopHeader,
-		End:    loopEnd,
+		Header:  loopHeader,
+		End:     loopEnd,
+		Regions: len(l.regions),
 	}
 
 	// Push loop context onto stack
@@ -394,8 +401,9 @@ func (l *Lowerer) lowerForStmt(stmt *ast.ForStmt) error {
 
 	// Push loop context
 	l.loopStack = append(l.loopStack, &LoopContext{
-		Header: loopHeader,
-		End:    loopEnd,
+		Header:  loopHeader,
+		End:     loopEnd,
+		Regions: len(l.regions),
 	})
 
 	// Call has_next() on the iterator
@@ -452,6 +460,82 @@ func (l *Lowerer) lowerForStmt(stmt *ast.ForStmt) error {
 	return nil
 }
 
+// region is an open `with arena` or `spawn scope` block: the handle its
+// begin call returned and the runtime function that closes it
+type region struct {
+	Handle Local
+	End    string
+	Scope  bool // A spawn scope, whose handle is a wait group
+}
+
+// lowerWithArenaStmt lowers an arena region
+func (l *Lowerer) lowerWithArenaStmt(stmt *ast.WithArenaStmt) error {
+	return l.lowerRegion(stmt.Body, region{End: "runtime_arena_end"}, "runtime_arena_begin")
+}
+
+// lowerSpawnScopeStmt lowers a spawn scope: a wait group that the legions
+// spawned directly in the body join, waited on when the body exits
+func (l *Lowerer) lowerSpawnScopeStmt(stmt *ast.SpawnScopeStmt) error {
+	return l.lowerRegion(stmt.Body, region{End: "runtime_waitgroup_wait", Scope: true}, "runtime_waitgroup_new")
+}
+
+// lowerRegion lowers a block run inside a region. The region is opened before
+// the body runs and closed on every exit from it, including break, continue
+// and return.
+func (l *Lowerer) lowerRegion(body *ast.BlockExpr, r region, begin string) error {
+	r.Handle = l.newLocal("", &types.Primitive{Kind: types.Nil})
+	l.currentFunc.Locals = append(l.currentFunc.Locals, r.Handle)
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &Call{
+		Result: r.Handle,
+		Func:   begin,
+		Args:   []Operand{},
+	})
+
+	l.regions = append(l.regions, r)
+	defer func() {
+		l.regions = l.regions[:len(l.regions)-1]
+	}()
+
+	if _, err := l.lowerBlock(body); err != nil {
+		return err
+	}
+
+	if l.currentBlock.Terminator == nil {
+		l.endRegions(len(l.regions) - 1)
+	} else {
+		// The body always leaves through break, continue or return: what
+		// follows is unreachable and goes in a block of its own, where it
+		// cannot replace that exit
+		after := l.newBlock("")
+		l.currentFunc.Blocks = append(l.currentFunc.Blocks, after)
+		l.currentBlock = after
+	}
+	return nil
+}
+
+// endRegions closes the open regions above depth, innermost first
+func (l *Lowerer) endRegions(depth int) {
+	for i := len(l.regions) - 1; i >= depth; i-- {
+		unit := l.newLocal("", &types.Primitive{Kind: types.Void})
+		l.currentFunc.Locals = append(l.currentFunc.Locals, unit)
+		l.currentBlock.Statements = append(l.currentBlock.Statements, &Call{
+			Result: unit,
+			Func:   l.regions[i].End,
+			Args:   []Operand{&LocalRef{Local: l.regions[i].Handle}},
+		})
+	}
+}
+
+// spawnGroup returns the wait group of the innermost open spawn scope, or nil
+func (l *Lowerer) spawnGroup() Operand {
+	for i := len(l.regions) - 1; i >= 0; i-- {
+		if l.regions[i].Scope {
+			return &LocalRef{Local: l.regions[i].Handle}
+		}
+	}
+	return nil
+}
+
 // lowerBreakStmt lowers a break statement
 func (l *Lowerer) lowerBreakStmt(stmt *ast.BreakStmt) error {
 	if len(l.loopStack) == 0 {
@@ -462,6 +546,7 @@ func (l *Lowerer) lowerBreakStmt(stmt *ast.BreakStmt) error {
 	loopCtx := l.loopStack[len(l.loopStack)-1]
 
 	// Break jumps to loop end
+	l.endRegions(loopCtx.Regions)
 	l.currentBlock.Terminator = &Goto{Target: loopCtx.End}
 
 	return nil
@@ -477,6 +562,7 @@ func (l *Lowerer) lowerContinueStmt(stmt *ast.ContinueStmt) error {
 	loopCtx := l.loopStack[len(l.loopStack)-1]
 
 	// Continue jumps to loop header
+	l.endRegions(loopCtx.Regions)
 	l.currentBlock.Terminator = &Goto{Target: loopCtx.Header}
 
 	return nil
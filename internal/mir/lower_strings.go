@@ -0,0 +1,185 @@
+package mir
+
+import (
+	"fmt"
+
+	"github.com/malphas-lang/malphas-lang/internal/ast"
+	"github.com/malphas-lang/malphas-lang/internal/lexer"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// Argument kinds for runtime_string_formatv (FORMAT_ARG_* in runtime.h)
+const (
+	formatArgI64    = 0
+	formatArgF64    = 1
+	formatArgBool   = 2
+	formatArgString = 3
+)
+
+// primitiveKind resolves t to a primitive kind, following named types
+func primitiveKind(t types.Type) (types.PrimitiveKind, bool) {
+	switch t := t.(type) {
+	case *types.Primitive:
+		return t.Kind, true
+	case *types.Named:
+		if t.Ref != nil {
+			return primitiveKind(t.Ref)
+		}
+		switch t.Name {
+		case "int", "i64":
+			return types.Int64, true
+		case "i32":
+			return types.Int32, true
+		case "i8":
+			return types.Int8, true
+		case "float", "f64":
+			return types.Float, true
+		case "bool":
+			return types.Bool, true
+		case "string":
+			return types.String, true
+		}
+	}
+	return "", false
+}
+
+// isStringType checks if a type is the string type
+func isStringType(t types.Type) bool {
+	kind, ok := primitiveKind(t)
+	return ok && kind == types.String
+}
+
+// isStringConcat checks if an expression is a + on strings
+func (l *Lowerer) isStringConcat(expr ast.Expr) bool {
+	infix, ok := expr.(*ast.InfixExpr)
+	return ok && infix.Op == lexer.PLUS && isStringType(l.getType(infix, l.TypeInfo))
+}
+
+// collectStringConcat flattens a chain of + on strings into its operands,
+// left to right
+func (l *Lowerer) collectStringConcat(expr ast.Expr, parts []ast.Expr) []ast.Expr {
+	if l.isStringConcat(expr) {
+		infix := expr.(*ast.InfixExpr)
+		parts = l.collectStringConcat(infix.Left, parts)
+		return l.collectStringConcat(infix.Right, parts)
+	}
+	return append(parts, expr)
+}
+
+// emitRuntimeCall appends a call to a runtime function and returns its result
+func (l *Lowerer) emitRuntimeCall(funcName string, retType types.Type, args ...Operand) Operand {
+	resultLocal := l.newLocal("", retType)
+	l.currentFunc.Locals = append(l.currentFunc.Locals, resultLocal)
+
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &Call{
+		Result: resultLocal,
+		Func:   funcName,
+		Args:   args,
+	})
+
+	return &LocalRef{Local: resultLocal}
+}
+
+// lowerStringConcat lowers a chain of + on strings. Two operands become one
+// runtime_string_concat; longer chains append every operand to a single
+// StringBuilder, so the result is copied once instead of once per +.
+func (l *Lowerer) lowerStringConcat(expr *ast.InfixExpr) (Operand, error) {
+	parts := l.collectStringConcat(expr, nil)
+
+	operands := make([]Operand, 0, len(parts))
+	literalLen := 0
+	for _, part := range parts {
+		op, err := l.lowerExpr(part)
+		if err != nil {
+			return nil, err
+		}
+		if lit, ok := op.(*Literal); ok {
+			if s, ok := lit.Value.(string); ok {
+				literalLen += len(s)
+			}
+		}
+		operands = append(operands, op)
+	}
+
+	if len(operands) == 2 {
+		return l.emitRuntimeCall("runtime_string_concat", types.TypeString, operands[0], operands[1]), nil
+	}
+
+	// The builder is opaque to the program (i8*)
+	builder := l.emitRuntimeCall("runtime_string_builder_new", types.TypeNil,
+		&Literal{Type: &types.Primitive{Kind: types.Int64}, Value: int64(literalLen)})
+	for _, op := range operands {
+		l.emitRuntimeCall("runtime_string_builder_append", types.TypeVoid, builder, op)
+	}
+	return l.emitRuntimeCall("runtime_string_builder_finish", types.TypeString, builder), nil
+}
+
+// lowerFormatCall lowers format(fmt, args...) to one runtime_string_formatv
+// call, passing each argument with its kind so that nothing has to be turned
+// into a string first
+func (l *Lowerer) lowerFormatCall(call *ast.CallExpr) (Operand, error) {
+	if len(call.Args) == 0 {
+		return nil, fmt.Errorf("format expects a format string")
+	}
+
+	fmtOp, err := l.lowerExpr(call.Args[0])
+	if err != nil {
+		return nil, err
+	}
+
+	args := []Operand{
+		fmtOp,
+		&Literal{Type: &types.Primitive{Kind: types.Int64}, Value: int64(len(call.Args) - 1)},
+	}
+	for _, arg := range call.Args[1:] {
+		op, err := l.lowerExpr(arg)
+		if err != nil {
+			return nil, err
+		}
+		kind, value, err := l.lowerFormatArg(op)
+		if err != nil {
+			return nil, err
+		}
+		args = append(args, &Literal{Type: &types.Primitive{Kind: types.Int32}, Value: int64(kind)}, value)
+	}
+
+	return l.emitRuntimeCall("runtime_string_formatv", types.TypeString, args...), nil
+}
+
+// lowerFormatArg returns the FORMAT_ARG_* kind for a format argument and the
+// operand to pass (integers and bools widened to i64)
+func (l *Lowerer) lowerFormatArg(op Operand) (int, Operand, error) {
+	typ := op.OperandType()
+	kind, ok := primitiveKind(typ)
+	if !ok {
+		return 0, nil, fmt.Errorf("format: unsupported argument type %s", typ)
+	}
+
+	switch kind {
+	case types.String:
+		return formatArgString, op, nil
+	case types.Float:
+		return formatArgF64, op, nil
+	case types.Int, types.Int64, types.U64, types.Usize:
+		return formatArgI64, op, nil
+	case types.Int8, types.Int32, types.U8, types.U16, types.U32, types.U128:
+		return formatArgI64, l.emitCast(op, &types.Primitive{Kind: types.Int64}), nil
+	case types.Bool:
+		return formatArgBool, l.emitCast(op, &types.Primitive{Kind: types.Int64}), nil
+	}
+	return 0, nil, fmt.Errorf("format: unsupported argument type %s", typ)
+}
+
+// emitCast appends a cast of op to typ and returns the result
+func (l *Lowerer) emitCast(op Operand, typ types.Type) Operand {
+	resultLocal := l.newLocal("", typ)
+	l.currentFunc.Locals = append(l.currentFunc.Locals, resultLocal)
+
+	l.currentBlock.Statements = append(l.currentBlock.Statements, &Cast{
+		Result:  resultLocal,
+		Operand: op,
+		Type:    typ,
+	})
+
+	return &LocalRef{Local: resultLocal}
+}
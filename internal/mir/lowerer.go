@@ -39,6 +39,10 @@ type Lowerer struct {
 	// Loop context stack (for break/continue)
 	loopStack []*LoopContext
 
+	// Open `with arena` and `spawn scope` regions, innermost last (closed on
+	// return/break/continue)
+	regions []region
+
 	// Map of call expressions to type arguments
 	CallTypeArgs map[*ast.CallExpr][]types.Type
 
@@ -113,6 +117,8 @@ func (l *Lowerer) LowerModule(file *ast.File) (*Module, error) {
 	// This makes stdlib methods available for monomorphization
 	// Also collect structs and enums from these modules for codegen
 	if l.Modules != nil {
+		inlineBodies := make(map[*ast.File]bool)
+		collectInlineBodies(file.Mods, inlineBodies)
 		for _, modInfo := range l.Modules {
 			if modInfo.File != nil {
 				// Collect struct and enum declarations from this module
@@ -134,9 +140,19 @@ func (l *Lowerer) LowerModule(file *ast.File) (*Module, error) {
 					}
 				}
 
-				// Process impl declarations from this module
+				// Process function and impl declarations from this module.
+				// Inline modules were lowered above, with mangled names.
+				inline := inlineBodies[modInfo.File]
 				for _, decl := range modInfo.File.Decls {
-					if implDecl, ok := decl.(*ast.ImplDecl); ok {
+					if fnDecl, ok := decl.(*ast.FnDecl); ok && !inline {
+						fn, err := l.LowerFunction(fnDecl)
+						if err != nil {
+							fmt.Printf("warning: failed to lower function %s from module %s: %v\n", fnDecl.Name.Name, modInfo.Name, err)
+							continue
+						}
+						fn.Module = modInfo.Name
+						module.Functions = append(module.Functions, fn)
+					} else if implDecl, ok := decl.(*ast.ImplDecl); ok {
 						fns, err := l.LowerImplDecl(implDecl)
 						if err != nil {
 							// Log error but continue - don't fail the entire build
@@ -144,6 +160,11 @@ func (l *Lowerer) LowerModule(file *ast.File) (*Module, error) {
 							fmt.Printf("warning: failed to lower impl from module %s: %v\n", modInfo.Name, err)
 							continue
 						}
+						if !inline {
+							for _, fn := range fns {
+								fn.Module = modInfo.Name
+							}
+						}
 						module.Functions = append(module.Functions, fns...)
 					}
 				}
@@ -168,6 +189,7 @@ func (l *Lowerer) LowerFunction(decl *ast.FnDecl) (*Function, error) {
 	l.blockCounter = 0
 	l.locals = make(map[string]Local)
 	l.loopStack = make([]*LoopContext, 0)
+	l.regions = nil
 
 	// Get return type
 	returnType := l.getReturnType(decl)
@@ -289,6 +311,16 @@ func (l *Lowerer) LowerFunction(decl *ast.FnDecl) (*Function, error) {
 	return fn, nil
 }
 
+// collectInlineBodies records the bodies of inline modules, recursively
+func collectInlineBodies(mods []*ast.ModDecl, bodies map[*ast.File]bool) {
+	for _, modDecl := range mods {
+		if modDecl.Body != nil {
+			bodies[modDecl.Body] = true
+			collectInlineBodies(modDecl.Body.Mods, bodies)
+		}
+	}
+}
+
 // lowerInlineModule recursively lowers functions from an inline module
 func (l *Lowerer) lowerInlineModule(modDecl *ast.ModDecl, parentPath string) ([]*Function, error) {
 	var functions []*Function
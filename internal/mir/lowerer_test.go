@@ -981,3 +981,352 @@ fn factorial(n: int) -> int {
 		t.Errorf("expected recursive call to 'factorial', got %q", factorialCall.Func)
 	}
 }
+
+// callFuncs returns the names of the functions called by a block, in order
+func callFuncs(block *BasicBlock) []string {
+	var names []string
+	for _, stmt := range block.Statements {
+		if call, ok := stmt.(*Call); ok {
+			names = append(names, call.Func)
+		}
+	}
+	return names
+}
+
+func TestLowerExpression_StringConcatPair(t *testing.T) {
+	src := `
+package test;
+
+fn join(a: string, b: string) -> string {
+	return a + b;
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	got := strings.Join(callFuncs(fn.Entry), ",")
+	if got != "runtime_string_concat" {
+		t.Errorf("expected a single runtime_string_concat, got %q", got)
+	}
+}
+
+func TestLowerExpression_StringConcatChain(t *testing.T) {
+	src := `
+package test;
+
+fn join(a: string, b: string) -> string {
+	return a + ", " + b + "!";
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	want := "runtime_string_builder_new," +
+		"runtime_string_builder_append,runtime_string_builder_append," +
+		"runtime_string_builder_append,runtime_string_builder_append," +
+		"runtime_string_builder_finish"
+	got := strings.Join(callFuncs(fn.Entry), ",")
+	if got != want {
+		t.Fatalf("expected %q, got %q", want, got)
+	}
+
+	// The capacity hint covers the literal parts
+	newCall := fn.Entry.Statements[0].(*Call)
+	hint, ok := newCall.Args[0].(*Literal)
+	if !ok || hint.Value != int64(3) {
+		t.Errorf("expected capacity hint 3, got %v", newCall.Args[0])
+	}
+}
+
+func TestLowerExpression_FormatCall(t *testing.T) {
+	src := `
+package test;
+
+fn describe(name: string, n: int, ok: bool) -> string {
+	return format("{} {} {}", name, n, ok);
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	var call *Call
+	for _, stmt := range fn.Entry.Statements {
+		if c, ok := stmt.(*Call); ok && c.Func == "runtime_string_formatv" {
+			call = c
+		}
+	}
+	if call == nil {
+		t.Fatalf("expected a runtime_string_formatv call, got %v", callFuncs(fn.Entry))
+	}
+
+	// fmt, nargs, then a (kind, value) pair per argument
+	if len(call.Args) != 8 {
+		t.Fatalf("expected 8 arguments, got %d", len(call.Args))
+	}
+	if nargs := call.Args[1].(*Literal); nargs.Value != int64(3) {
+		t.Errorf("expected nargs 3, got %v", nargs.Value)
+	}
+	for i, want := range []int64{formatArgString, formatArgI64, formatArgBool} {
+		kind := call.Args[2+2*i].(*Literal)
+		if kind.Value != want {
+			t.Errorf("argument %d: expected kind %d, got %v", i, want, kind.Value)
+		}
+	}
+}
+
+// countCalls counts the calls to name across the function's blocks
+func countCalls(fn *Function, name string) int {
+	n := 0
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			if call, ok := stmt.(*Call); ok && call.Func == name {
+				n++
+			}
+		}
+	}
+	return n
+}
+
+func TestLowerStatement_WithArena(t *testing.T) {
+	src := `
+package test;
+
+fn test(n: int) -> int {
+	let mut i = 0;
+	while i < n {
+		with arena {
+			if i == 3 {
+				break;
+			}
+			with arena {
+				if i == 5 {
+					return i;
+				}
+			}
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	if got := countCalls(fn, "runtime_arena_begin"); got != 2 {
+		t.Errorf("expected 2 runtime_arena_begin calls, got %d", got)
+	}
+	// One end for each region's fallthrough, one for the break and two for
+	// the return from the inner region
+	if got := countCalls(fn, "runtime_arena_end"); got != 5 {
+		t.Errorf("expected 5 runtime_arena_end calls, got %d", got)
+	}
+}
+
+func TestLowerStatement_SpawnScope(t *testing.T) {
+	src := `
+package test;
+
+fn test(n: int) {
+	spawn worker(0);
+	spawn scope {
+		spawn worker(1);
+		if n == 0 {
+			return;
+		}
+		spawn worker(2);
+	}
+}
+
+fn worker(i: int) {
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	if got := countCalls(fn, "runtime_waitgroup_new"); got != 1 {
+		t.Errorf("expected 1 runtime_waitgroup_new call, got %d", got)
+	}
+	// One wait for the fallthrough and one for the return
+	if got := countCalls(fn, "runtime_waitgroup_wait"); got != 2 {
+		t.Errorf("expected 2 runtime_waitgroup_wait calls, got %d", got)
+	}
+
+	var grouped, ungrouped int
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			if spawn, ok := stmt.(*Spawn); ok {
+				if spawn.Group != nil {
+					grouped++
+				} else {
+					ungrouped++
+				}
+			}
+		}
+	}
+	if grouped != 2 || ungrouped != 1 {
+		t.Errorf("expected 2 spawns in the scope and 1 outside it, got %d and %d", grouped, ungrouped)
+	}
+}
+
+func TestLowerStatement_ReturnFromRegion(t *testing.T) {
+	src := `
+package test;
+
+fn test() -> int {
+	spawn scope {
+		return 1;
+	}
+	return 0;
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	// The return after the scope is unreachable and must not replace the
+	// one inside it
+	var returns []int64
+	for _, block := range fn.Blocks {
+		if ret, ok := block.Terminator.(*Return); ok {
+			if lit, ok := ret.Value.(*Literal); ok {
+				returns = append(returns, lit.Value.(int64))
+			}
+		}
+	}
+	if len(returns) != 2 || returns[0] != 1 || returns[1] != 0 {
+		t.Errorf("expected returns of 1 then 0 in separate blocks, got %v", returns)
+	}
+}
+
+func TestLowerExpression_BatchedChannelCalls(t *testing.T) {
+	src := `
+package test;
+
+fn test(ch: chan int, xs: []int) -> int {
+	let sent = send_many(ch, xs);
+	return sent + recv_many(ch, xs, 64);
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	if got := countCalls(fn, "runtime_channel_send_many"); got != 1 {
+		t.Errorf("expected 1 runtime_channel_send_many call, got %d", got)
+	}
+	if got := countCalls(fn, "runtime_channel_recv_many"); got != 1 {
+		t.Errorf("expected 1 runtime_channel_recv_many call, got %d", got)
+	}
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			if call, ok := stmt.(*Call); ok && call.Func == "runtime_channel_recv_many" && len(call.Args) != 3 {
+				t.Errorf("expected runtime_channel_recv_many to take 3 arguments, got %d", len(call.Args))
+			}
+		}
+	}
+}
+
+func TestLowerExpression_StringSearchMethods(t *testing.T) {
+	src := `
+package test;
+
+fn test(line: string) -> int {
+	let fields = line.split(" ");
+	if line.contains("ERROR") {
+		return line.find("ERROR");
+	}
+	return len(fields);
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	for _, name := range []string{"runtime_string_split", "runtime_string_contains", "runtime_string_find"} {
+		if got := countCalls(fn, name); got != 1 {
+			t.Errorf("expected 1 %s call, got %d", name, got)
+		}
+	}
+}
+
+func TestLowerExpression_SlicePushStruct(t *testing.T) {
+	src := `
+package test;
+
+struct Point {
+	x: int,
+	y: int,
+}
+
+fn test(p: Point) -> []Point {
+	let mut ps: []Point = []Point{};
+	ps.push(p);
+	return ps;
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	// Slices hold struct pointers, so push must get the address of a
+	// temporary holding p rather than p itself
+	addrOf := make(map[int]bool)
+	casts := make(map[int]*Cast)
+	var push *Call
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			switch s := stmt.(type) {
+			case *AddressOf:
+				addrOf[s.Result.ID] = true
+			case *Cast:
+				casts[s.Result.ID] = s
+			case *Call:
+				if s.Func == "runtime_slice_push" {
+					push = s
+				}
+			}
+		}
+	}
+	if push == nil || len(push.Args) != 2 {
+		t.Fatalf("expected a 2-argument runtime_slice_push call, got %v", push)
+	}
+	value, ok := push.Args[1].(*LocalRef)
+	if !ok || casts[value.Local.ID] == nil {
+		t.Fatalf("expected the pushed value to be cast to i8*, got %v", push.Args[1])
+	}
+	src2, ok := casts[value.Local.ID].Operand.(*LocalRef)
+	if !ok || !addrOf[src2.Local.ID] {
+		t.Errorf("expected the pushed value to be the address of a temporary, got %v", casts[value.Local.ID].Operand)
+	}
+}
+
+func TestLowerExpression_SliceOfSlicesElemSize(t *testing.T) {
+	src := `
+package test;
+
+fn test() -> int {
+	let rows: [][]int = [][]int{};
+	return rows.len();
+}
+`
+
+	fn := lowerFunction(t, src)
+
+	// Inner slices are stored in place, so each element is a whole header
+	sizes := make(map[int]Operand)
+	var elemSize Operand
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			switch s := stmt.(type) {
+			case *Assign:
+				sizes[s.Local.ID] = s.RHS
+			case *Call:
+				if s.Func == "runtime_slice_new" {
+					elemSize = s.Args[0]
+				}
+			}
+		}
+	}
+	if ref, ok := elemSize.(*LocalRef); ok {
+		elemSize = sizes[ref.Local.ID]
+	}
+	if lit, ok := elemSize.(*Literal); !ok || lit.Value != int64(48) {
+		t.Errorf("expected [][]int elements to take 48 bytes, got %v", elemSize)
+	}
+}
@@ -29,6 +29,10 @@ type Function struct {
 	Locals     []Local
 	Blocks     []*BasicBlock
 	Entry      *BasicBlock
+	// Module is the file module the function was declared in, or "" for the
+	// program's own file (and for monomorphized instances, which depend on
+	// the program that instantiates them)
+	Module string
 }
 
 // Local represents a local variable or parameter
@@ -109,6 +113,7 @@ type Spawn struct {
 	Func     string    // Function name or wrapper name
 	Args     []Operand // Arguments to pass to the legion
 	TypeArgs []types.Type
+	Group    Operand // Wait group of the enclosing spawn scope, or nil
 }
 
 func (*Spawn) stmtNode() {}
@@ -146,18 +151,20 @@ func (*StoreField) stmtNode() {}
 
 // LoadIndex loads an element from an array/slice/map
 type LoadIndex struct {
-	Result  Local
-	Target  Operand
-	Indices []Operand
+	Result   Local
+	Target   Operand
+	Indices  []Operand
+	InBounds bool // Indices[0] is known to be in bounds (no bounds check needed)
 }
 
 func (*LoadIndex) stmtNode() {}
 
 // StoreIndex stores a value into an array/slice/map
 type StoreIndex struct {
-	Target  Operand
-	Indices []Operand
-	Value   Operand
+	Target   Operand
+	Indices  []Operand
+	Value    Operand
+	InBounds bool // Indices[0] is known to be in bounds (no bounds check needed)
 }
 
 func (*StoreIndex) stmtNode() {}
@@ -167,6 +174,7 @@ type ConstructStruct struct {
 	Result Local
 	Type   types.Type         // Struct type (can be *types.Struct or *types.GenericInstance)
 	Fields map[string]Operand // Field name -> value
+	Stack  bool               // Does not escape: allocated on the stack, not the heap
 }
 
 func (*ConstructStruct) stmtNode() {}
@@ -184,6 +192,7 @@ func (*ConstructArray) stmtNode() {}
 type ConstructTuple struct {
 	Result   Local
 	Elements []Operand
+	Stack    bool // Does not escape: allocated on the stack, not the heap
 }
 
 func (*ConstructTuple) stmtNode() {}
@@ -195,6 +204,7 @@ type ConstructEnum struct {
 	Variant      string    // Variant name
 	VariantIndex int       // Variant index (tag)
 	Values       []Operand // Payload values
+	Stack        bool      // Does not escape: allocated on the stack, not the heap
 }
 
 func (*ConstructEnum) stmtNode() {}
@@ -280,6 +290,7 @@ type MakeClosure struct {
 	Result Local
 	Func   string  // Name of the function to call
 	Env    Operand // Environment struct pointer
+	Stack  bool    // Does not escape: allocated on the stack, not the heap
 }
 
 func (*MakeClosure) stmtNode() {}
@@ -336,6 +347,7 @@ func (*Branch) terminatorNode() {}
 // LoopContext tracks loop information for break/continue
 // This is used internally by the lowerer but can be useful for analysis
 type LoopContext struct {
-	Header *BasicBlock
-	End    *BasicBlock
+	Header  *BasicBlock
+	End     *BasicBlock
+	Regions int // Arena and spawn scope regions already open when the loop was entered
 }
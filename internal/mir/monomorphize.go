@@ -40,6 +40,11 @@ func (m *Monomorphizer) Monomorphize() error {
 		copy(funcs, m.module.Functions)
 
 		for _, fn := range funcs {
+			// A generic function's calls are specialized in its copies, once
+			// its own type arguments are known
+			if len(fn.TypeParams) > 0 {
+				continue
+			}
 			for _, block := range fn.Blocks {
 				for _, stmt := range block.Statements {
 					if call, ok := stmt.(*Call); ok {
@@ -58,6 +63,18 @@ func (m *Monomorphizer) Monomorphize() error {
 							}
 						}
 					}
+					if spawn, ok := stmt.(*Spawn); ok && len(spawn.TypeArgs) > 0 {
+						// spawn of a generic function: start the specialized one
+						specName, err := m.specialize(spawn.Func, spawn.TypeArgs)
+						if err != nil {
+							return err
+						}
+						if spawn.Func != specName {
+							spawn.Func = specName
+							spawn.TypeArgs = nil
+							changed = true
+						}
+					}
 				}
 			}
 		}
@@ -298,6 +315,19 @@ func (m *Monomorphizer) substituteType(t types.Type, subst map[string]types.Type
 		}
 
 		return result
+	case *types.Function:
+		params := make([]types.Type, len(t.Params))
+		for i, param := range t.Params {
+			params[i] = m.substituteType(param, subst)
+		}
+		return &types.Function{
+			Unsafe:     t.Unsafe,
+			TypeParams: t.TypeParams,
+			Params:     params,
+			Variadic:   t.Variadic,
+			Return:     m.substituteType(t.Return, subst),
+			Receiver:   t.Receiver,
+		}
 	default:
 		return t
 	}
@@ -340,11 +370,36 @@ func (m *Monomorphizer) substituteStmt(stmt Statement, subst map[string]types.Ty
 			}
 		}
 
+		var funcOperand Operand
+		if s.FuncOperand != nil {
+			funcOperand = m.substituteOperand(s.FuncOperand, subst)
+		}
+
 		return &Call{
-			Result:   m.substituteLocal(s.Result, subst),
-			Func:     funcName,
+			Result:      m.substituteLocal(s.Result, subst),
+			Func:        funcName,
+			FuncOperand: funcOperand,
+			Args:        newArgs,
+			TypeArgs:    newTypeArgs,
+		}
+	case *Spawn:
+		newArgs := make([]Operand, len(s.Args))
+		for i, arg := range s.Args {
+			newArgs[i] = m.substituteOperand(arg, subst)
+		}
+		newTypeArgs := make([]types.Type, len(s.TypeArgs))
+		for i, arg := range s.TypeArgs {
+			newTypeArgs[i] = m.substituteType(arg, subst)
+		}
+		var group Operand
+		if s.Group != nil {
+			group = m.substituteOperand(s.Group, subst)
+		}
+		return &Spawn{
+			Func:     s.Func,
 			Args:     newArgs,
 			TypeArgs: newTypeArgs,
+			Group:    group,
 		}
 	case *LoadField:
 		return &LoadField{
@@ -358,9 +413,10 @@ func (m *Monomorphizer) substituteStmt(stmt Statement, subst map[string]types.Ty
 			newIndices[i] = m.substituteOperand(idx, subst)
 		}
 		return &LoadIndex{
-			Result:  m.substituteLocal(s.Result, subst),
-			Target:  m.substituteOperand(s.Target, subst),
-			Indices: newIndices,
+			Result:   m.substituteLocal(s.Result, subst),
+			Target:   m.substituteOperand(s.Target, subst),
+			Indices:  newIndices,
+			InBounds: s.InBounds,
 		}
 	case *StoreField:
 		return &StoreField{
@@ -374,9 +430,10 @@ func (m *Monomorphizer) substituteStmt(stmt Statement, subst map[string]types.Ty
 			newIndices[i] = m.substituteOperand(idx, subst)
 		}
 		return &StoreIndex{
-			Target:  m.substituteOperand(s.Target, subst),
-			Indices: newIndices,
-			Value:   m.substituteOperand(s.Value, subst),
+			Target:   m.substituteOperand(s.Target, subst),
+			Indices:  newIndices,
+			Value:    m.substituteOperand(s.Value, subst),
+			InBounds: s.InBounds,
 		}
 	case *ConstructStruct:
 		newFields := make(map[string]Operand)
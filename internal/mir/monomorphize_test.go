@@ -151,3 +151,91 @@ func TestMonomorphize_Simple(t *testing.T) {
 		t.Errorf("Second call should have empty TypeArgs, got %v", call2.TypeArgs)
 	}
 }
+
+func TestMonomorphize_SpawnInGenericFunction(t *testing.T) {
+	// Setup: fn walk[T](f: fn(T) -> void, x: T) { f(x); spawn walk(f, x); }
+	// Call walk(g, 1) -> walk[int], whose spawn starts walk[int] too
+	typeParamT := &types.TypeParam{Name: "T"}
+	fnOfT := &types.Function{Params: []types.Type{typeParamT}, Return: types.TypeVoid}
+	f := Local{ID: 0, Name: "f", Type: fnOfT}
+	x := Local{ID: 1, Name: "x", Type: typeParamT}
+	unit := Local{ID: 2, Type: types.TypeVoid}
+
+	walkEntry := &BasicBlock{
+		Label: "entry",
+		Statements: []Statement{
+			&Call{Result: unit, FuncOperand: &LocalRef{Local: f}, Args: []Operand{&LocalRef{Local: x}}},
+			&Spawn{
+				Func:     "walk",
+				Args:     []Operand{&LocalRef{Local: f}, &LocalRef{Local: x}},
+				TypeArgs: []types.Type{typeParamT},
+			},
+		},
+		Terminator: &Return{},
+	}
+	walkFn := &Function{
+		Name:       "walk",
+		TypeParams: []types.TypeParam{*typeParamT},
+		Params:     []Local{f, x},
+		ReturnType: types.TypeVoid,
+		Locals:     []Local{f, x, unit},
+		Blocks:     []*BasicBlock{walkEntry},
+		Entry:      walkEntry,
+	}
+
+	g := Local{ID: 0, Name: "g", Type: &types.Function{Params: []types.Type{types.TypeInt}, Return: types.TypeVoid}}
+	mainEntry := &BasicBlock{
+		Label: "entry",
+		Statements: []Statement{
+			&Call{
+				Result:   Local{ID: 1, Type: types.TypeVoid},
+				Func:     "walk",
+				Args:     []Operand{&LocalRef{Local: g}, &Literal{Value: int64(1), Type: types.TypeInt}},
+				TypeArgs: []types.Type{types.TypeInt},
+			},
+		},
+		Terminator: &Return{},
+	}
+	mainFn := &Function{
+		Name:       "main",
+		ReturnType: types.TypeVoid,
+		Locals:     []Local{g},
+		Blocks:     []*BasicBlock{mainEntry},
+		Entry:      mainEntry,
+	}
+
+	module := &Module{Functions: []*Function{walkFn, mainFn}}
+	if err := NewMonomorphizer(module).Monomorphize(); err != nil {
+		t.Fatalf("Monomorphization failed: %v", err)
+	}
+
+	// Should have: walk, main, walk$int (and no walk$T)
+	var spec *Function
+	for _, fn := range module.Functions {
+		switch fn.Name {
+		case "walk$int":
+			spec = fn
+		case "walk$T":
+			t.Errorf("generic function specialized for its own type parameter")
+		}
+	}
+	if spec == nil {
+		t.Fatal("Missing specialized function walk$int")
+	}
+
+	call := spec.Entry.Statements[0].(*Call)
+	if call.FuncOperand == nil {
+		t.Fatal("closure call lost its operand")
+	}
+	if got := call.FuncOperand.OperandType().String(); got != "fn(int) -> void" {
+		t.Errorf("closure operand type expected fn(int) -> void, got %s", got)
+	}
+
+	spawn := spec.Entry.Statements[1].(*Spawn)
+	if spawn.Func != "walk$int" {
+		t.Errorf("spawn expected to walk$int, got %s", spawn.Func)
+	}
+	if len(spawn.TypeArgs) != 0 {
+		t.Errorf("spawn should have empty TypeArgs, got %v", spawn.TypeArgs)
+	}
+}
@@ -0,0 +1,462 @@
+package optimize
+
+import (
+	"strings"
+
+	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/mir/ssa"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// maxInductionStep bounds the constant an induction variable may be
+// advanced by, so that i + step cannot overflow while i < len
+const maxInductionStep = 1 << 32
+
+// EliminateBoundsChecks marks slice accesses that are proven in bounds by the
+// loop around them (InBounds), so the backend emits them without a check.
+//
+// The recognised shape is the counting loop
+//
+//	let mut i = 0;
+//	while i < len(xs) {
+//	    ... xs[i] ...
+//	    i = i + 1;
+//	}
+//
+// xs[i] in the loop body is in bounds when the header compares i against
+// runtime_slice_len(xs) on every iteration, i never goes negative (it is
+// only ever set to non-negative constants or advanced by them), i is only
+// advanced at the end of an iteration, and nothing in the loop can change
+// the length of xs.
+func EliminateBoundsChecks(module *mir.Module) *mir.Module {
+	for _, fn := range module.Functions {
+		eliminateBoundsChecksInFunction(fn)
+	}
+	return module
+}
+
+// eliminateBoundsChecksInFunction marks the in-bounds accesses of one function
+func eliminateBoundsChecksInFunction(fn *mir.Function) {
+	loops := findNaturalLoops(fn)
+	if len(loops) == 0 {
+		return
+	}
+
+	defs := buildDefinitions(fn)
+
+	// Locals whose address is taken can change in ways we cannot see
+	addressTaken := make(map[int]bool)
+	for _, block := range fn.Blocks {
+		for _, stmt := range block.Statements {
+			if addr, ok := stmt.(*mir.AddressOf); ok {
+				addressTaken[addr.Target.ID] = true
+			}
+		}
+	}
+	params := make(map[int]bool)
+	for _, param := range fn.Params {
+		params[param.ID] = true
+	}
+
+	for _, loop := range loops {
+		eliminateLoopBoundsChecks(loop, defs, addressTaken, params)
+	}
+}
+
+// definition is a statement that assigns a local
+type definition struct {
+	block *mir.BasicBlock
+	index int
+	stmt  mir.Statement
+}
+
+// buildDefinitions maps each local ID to every statement that assigns it
+func buildDefinitions(fn *mir.Function) map[int][]definition {
+	defs := make(map[int][]definition)
+	for _, block := range fn.Blocks {
+		for i, stmt := range block.Statements {
+			if id, ok := definedLocal(stmt); ok {
+				defs[id] = append(defs[id], definition{block: block, index: i, stmt: stmt})
+			}
+		}
+	}
+	return defs
+}
+
+// definedLocal returns the local a statement assigns, if any
+func definedLocal(stmt mir.Statement) (int, bool) {
+	switch s := stmt.(type) {
+	case *mir.Assign:
+		return s.Local.ID, true
+	case *mir.Phi:
+		return s.Result.ID, true
+	case *mir.Call:
+		return s.Result.ID, true
+	case *mir.Load:
+		return s.Result.ID, true
+	case *mir.LoadField:
+		return s.Result.ID, true
+	case *mir.LoadIndex:
+		return s.Result.ID, true
+	case *mir.ConstructStruct:
+		return s.Result.ID, true
+	case *mir.ConstructArray:
+		return s.Result.ID, true
+	case *mir.ConstructTuple:
+		return s.Result.ID, true
+	case *mir.ConstructEnum:
+		return s.Result.ID, true
+	case *mir.Discriminant:
+		return s.Result.ID, true
+	case *mir.AccessVariantPayload:
+		return s.Result.ID, true
+	case *mir.MakeChannel:
+		return s.Result.ID, true
+	case *mir.Receive:
+		return s.Result.ID, true
+	case *mir.SizeOf:
+		return s.Result.ID, true
+	case *mir.AlignOf:
+		return s.Result.ID, true
+	case *mir.AddressOf:
+		return s.Result.ID, true
+	case *mir.Cast:
+		return s.Result.ID, true
+	case *mir.MakeClosure:
+		return s.Result.ID, true
+	}
+	return 0, false
+}
+
+// findNaturalLoops finds the natural loops of a function: one per header,
+// covering the blocks of every back edge (an edge to a dominating block)
+func findNaturalLoops(fn *mir.Function) []*Loop {
+	idom := ssa.ComputeDominators(fn)
+	preds := buildPredecessorsMap(fn)
+
+	var loops []*Loop
+	byHeader := make(map[*mir.BasicBlock]*Loop)
+	for _, block := range fn.Blocks {
+		for _, succ := range getSuccessorsForLICM(block) {
+			if !dominates(succ, block, idom, len(fn.Blocks)) {
+				continue
+			}
+			loop, ok := byHeader[succ]
+			if !ok {
+				loop = &Loop{Header: succ}
+				byHeader[succ] = loop
+				loops = append(loops, loop)
+			}
+			for _, b := range findLoopBlocks(succ, block, fn, preds) {
+				if !containsBlock(loop.Blocks, b) {
+					loop.Blocks = append(loop.Blocks, b)
+				}
+			}
+		}
+	}
+	return loops
+}
+
+// dominates checks if a dominates b by walking up b's immediate dominators
+func dominates(a, b *mir.BasicBlock, idom map[*mir.BasicBlock]*mir.BasicBlock, maxDepth int) bool {
+	for depth := 0; b != nil && depth <= maxDepth; depth++ {
+		if b == a {
+			return true
+		}
+		next, ok := idom[b]
+		if !ok {
+			return false
+		}
+		b = next
+	}
+	return false
+}
+
+// containsBlock checks if a block is in a list
+func containsBlock(blocks []*mir.BasicBlock, block *mir.BasicBlock) bool {
+	for _, b := range blocks {
+		if b == block {
+			return true
+		}
+	}
+	return false
+}
+
+// eliminateLoopBoundsChecks marks the accesses xs[i] of a counting loop
+func eliminateLoopBoundsChecks(loop *Loop, defs map[int][]definition, addressTaken, params map[int]bool) {
+	inLoop := make(map[*mir.BasicBlock]bool)
+	for _, block := range loop.Blocks {
+		inLoop[block] = true
+	}
+
+	// The header must leave the loop when the condition fails, so every
+	// other block of the loop runs only while it holds
+	branch, ok := loop.Header.Terminator.(*mir.Branch)
+	if !ok || !inLoop[branch.True] || inLoop[branch.False] {
+		return
+	}
+	index, slice, ok := loopBound(loop.Header, branch.Condition, defs)
+	if !ok || addressTaken[index.ID] || addressTaken[slice.ID] {
+		return
+	}
+	// A parameter used as the index starts out unknown
+	if params[index.ID] || !isNonNegativeCounter(index, defs) {
+		return
+	}
+
+	// The slice must stay the same slice with the same length
+	for _, def := range defs[slice.ID] {
+		if inLoop[def.block] {
+			return
+		}
+	}
+	for _, block := range loop.Blocks {
+		if !preservesSliceLengths(block) {
+			return
+		}
+	}
+
+	// The index may only be advanced at the end of an iteration: in a block
+	// that goes straight back to the header, after the accesses in it
+	advancedAt := make(map[*mir.BasicBlock]int)
+	for _, def := range defs[index.ID] {
+		if !inLoop[def.block] {
+			continue
+		}
+		if latch, ok := def.block.Terminator.(*mir.Goto); !ok || latch.Target != loop.Header || def.block == loop.Header {
+			return
+		}
+		if at, seen := advancedAt[def.block]; !seen || def.index < at {
+			advancedAt[def.block] = def.index
+		}
+	}
+
+	for _, block := range loop.Blocks {
+		if block == loop.Header {
+			continue
+		}
+		for i, stmt := range block.Statements {
+			if at, ok := advancedAt[block]; ok && i > at {
+				break
+			}
+			switch s := stmt.(type) {
+			case *mir.LoadIndex:
+				if indexes(s.Target, s.Indices, slice, index) {
+					s.InBounds = true
+				}
+			case *mir.StoreIndex:
+				if indexes(s.Target, s.Indices, slice, index) {
+					s.InBounds = true
+				}
+			}
+		}
+	}
+}
+
+// loopBound matches a header condition i < runtime_slice_len(xs) (or
+// runtime_slice_len(xs) > i) computed in the header, returning i and xs
+func loopBound(header *mir.BasicBlock, cond mir.Operand, defs map[int][]definition) (mir.Local, mir.Local, bool) {
+	condRef, ok := cond.(*mir.LocalRef)
+	if !ok {
+		return mir.Local{}, mir.Local{}, false
+	}
+	cmp, at, ok := singleDefinitionIn(condRef.Local, header, defs)
+	if !ok {
+		return mir.Local{}, mir.Local{}, false
+	}
+	call, ok := cmp.(*mir.Call)
+	if !ok || len(call.Args) != 2 {
+		return mir.Local{}, mir.Local{}, false
+	}
+
+	var indexOp, lenOp mir.Operand
+	switch call.Func {
+	case "__lt__":
+		indexOp, lenOp = call.Args[0], call.Args[1]
+	case "__gt__":
+		indexOp, lenOp = call.Args[1], call.Args[0]
+	default:
+		return mir.Local{}, mir.Local{}, false
+	}
+	indexRef, ok := indexOp.(*mir.LocalRef)
+	if !ok {
+		return mir.Local{}, mir.Local{}, false
+	}
+	lenRef, ok := lenOp.(*mir.LocalRef)
+	if !ok {
+		return mir.Local{}, mir.Local{}, false
+	}
+
+	// The length is read in the header, before the comparison
+	lenDef, lenAt, ok := singleDefinitionIn(lenRef.Local, header, defs)
+	if !ok || lenAt > at {
+		return mir.Local{}, mir.Local{}, false
+	}
+	lenCall, ok := lenDef.(*mir.Call)
+	if !ok || lenCall.Func != "runtime_slice_len" || len(lenCall.Args) != 1 {
+		return mir.Local{}, mir.Local{}, false
+	}
+	sliceRef, ok := lenCall.Args[0].(*mir.LocalRef)
+	if !ok {
+		return mir.Local{}, mir.Local{}, false
+	}
+
+	// The index must not change in the header after it is compared
+	for _, def := range defs[indexRef.Local.ID] {
+		if def.block == header {
+			return mir.Local{}, mir.Local{}, false
+		}
+	}
+
+	return indexRef.Local, sliceRef.Local, true
+}
+
+// singleDefinitionIn returns the only statement assigning a local, if it is
+// in the given block
+func singleDefinitionIn(local mir.Local, block *mir.BasicBlock, defs map[int][]definition) (mir.Statement, int, bool) {
+	localDefs := defs[local.ID]
+	if len(localDefs) != 1 || localDefs[0].block != block {
+		return nil, 0, false
+	}
+	return localDefs[0].stmt, localDefs[0].index, true
+}
+
+// isNonNegativeCounter checks that every assignment of a local sets it to a
+// non-negative constant or advances it by one: i = k or i = i + k, k >= 0
+func isNonNegativeCounter(local mir.Local, defs map[int][]definition) bool {
+	localDefs := defs[local.ID]
+	if len(localDefs) == 0 {
+		return false
+	}
+	for _, def := range localDefs {
+		assign, ok := def.stmt.(*mir.Assign)
+		if !ok {
+			return false
+		}
+		switch rhs := assign.RHS.(type) {
+		case *mir.Literal:
+			if k, ok := intLiteral(rhs); !ok || k < 0 {
+				return false
+			}
+		case *mir.LocalRef:
+			if !isIncrementOf(rhs.Local, local, defs) {
+				return false
+			}
+		default:
+			return false
+		}
+	}
+	return true
+}
+
+// isIncrementOf checks that tmp is only assigned local + k, 0 <= k <= maxInductionStep
+func isIncrementOf(tmp, local mir.Local, defs map[int][]definition) bool {
+	tmpDefs := defs[tmp.ID]
+	if len(tmpDefs) != 1 {
+		return false
+	}
+	call, ok := tmpDefs[0].stmt.(*mir.Call)
+	if !ok || call.Func != "__add__" || len(call.Args) != 2 {
+		return false
+	}
+	for i := range call.Args {
+		ref, ok := call.Args[i].(*mir.LocalRef)
+		if !ok || ref.Local.ID != local.ID {
+			continue
+		}
+		lit, ok := call.Args[1-i].(*mir.Literal)
+		if !ok {
+			return false
+		}
+		k, ok := intLiteral(lit)
+		return ok && k >= 0 && k <= maxInductionStep
+	}
+	return false
+}
+
+// intLiteral returns the value of an integer literal
+func intLiteral(lit *mir.Literal) (int64, bool) {
+	switch v := lit.Value.(type) {
+	case int64:
+		return v, true
+	case int:
+		return int64(v), true
+	}
+	return 0, false
+}
+
+// indexes checks if an access is target[index, ...] on the given locals
+func indexes(target mir.Operand, indices []mir.Operand, slice, index mir.Local) bool {
+	targetRef, ok := target.(*mir.LocalRef)
+	if !ok || targetRef.Local.ID != slice.ID || len(indices) == 0 {
+		return false
+	}
+	indexRef, ok := indices[0].(*mir.LocalRef)
+	return ok && indexRef.Local.ID == index.ID
+}
+
+// preservesSliceLengths checks that a block cannot change the length of any
+// slice: it makes no calls except to pure operators and known runtime
+// functions, does not overwrite slice headers, and never lets another legion
+// run (which could change a shared slice meanwhile)
+func preservesSliceLengths(block *mir.BasicBlock) bool {
+	for _, stmt := range block.Statements {
+		switch s := stmt.(type) {
+		case *mir.Call:
+			if !isLengthPreservingCall(s) {
+				return false
+			}
+		case *mir.StoreField:
+			if isSlice(s.Target.OperandType()) || isSlice(s.Value.OperandType()) {
+				return false
+			}
+		case *mir.StoreIndex:
+			if isSlice(s.Value.OperandType()) {
+				return false
+			}
+		case *mir.Spawn, *mir.Yield, *mir.Send, *mir.Receive:
+			return false
+		}
+	}
+
+	switch block.Terminator.(type) {
+	case *mir.Goto, *mir.Branch, *mir.Return:
+		return true
+	}
+	return false
+}
+
+// isLengthPreservingCall checks if a call cannot change the length of a slice
+func isLengthPreservingCall(call *mir.Call) bool {
+	if call.Func == "" {
+		return false // Closures can do anything
+	}
+	if isOperatorIntrinsic(call.Func) {
+		// Operators on primitives are pure; on other types they may be
+		// user-defined methods
+		for _, arg := range call.Args {
+			if _, ok := arg.OperandType().(*types.Primitive); !ok {
+				return false
+			}
+		}
+		return true
+	}
+	switch call.Func {
+	case "println", "runtime_slice_len":
+		return true
+	}
+	return strings.HasPrefix(call.Func, "runtime_string_") || strings.HasPrefix(call.Func, "runtime_println_")
+}
+
+// isSlice checks if a type is a slice
+func isSlice(t types.Type) bool {
+	switch t := t.(type) {
+	case *types.Slice:
+		return true
+	case *types.Reference:
+		return isSlice(t.Elem)
+	case *types.Named:
+		return t.Ref != nil && isSlice(t.Ref)
+	}
+	return false
+}
@@ -0,0 +1,193 @@
+package optimize
+
+import (
+	"testing"
+
+	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// countingLoop builds
+//
+//	fn sum(xs: []int) -> int {
+//	    total = 0; i = 0
+//	    while i < len(xs) { total = total + xs[i]; <extra>; i = i + step }
+//	    return total
+//	}
+//
+// and returns the function and the xs[i] load
+func countingLoop(step int64, extra ...mir.Statement) (*mir.Function, *mir.LoadIndex) {
+	xs := mir.Local{ID: 0, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	total := mir.Local{ID: 1, Name: "total", Type: types.TypeInt}
+	i := mir.Local{ID: 2, Name: "i", Type: types.TypeInt}
+	n := mir.Local{ID: 3, Type: &types.Primitive{Kind: types.Int64}}
+	cond := mir.Local{ID: 4, Type: types.TypeBool}
+	elem := mir.Local{ID: 5, Type: types.TypeInt}
+	sum := mir.Local{ID: 6, Type: types.TypeInt}
+	next := mir.Local{ID: 7, Type: types.TypeInt}
+
+	entry := &mir.BasicBlock{Label: "entry"}
+	header := &mir.BasicBlock{Label: "loop.header"}
+	body := &mir.BasicBlock{Label: "loop.body"}
+	end := &mir.BasicBlock{Label: "loop.end"}
+
+	entry.Statements = []mir.Statement{
+		&mir.Assign{Local: total, RHS: &mir.Literal{Type: types.TypeInt, Value: int64(0)}},
+		&mir.Assign{Local: i, RHS: &mir.Literal{Type: types.TypeInt, Value: int64(0)}},
+	}
+	entry.Terminator = &mir.Goto{Target: header}
+
+	header.Statements = []mir.Statement{
+		&mir.Call{Result: n, Func: "runtime_slice_len", Args: []mir.Operand{&mir.LocalRef{Local: xs}}},
+		&mir.Call{Result: cond, Func: "__lt__", Args: []mir.Operand{&mir.LocalRef{Local: i}, &mir.LocalRef{Local: n}}},
+	}
+	header.Terminator = &mir.Branch{Condition: &mir.LocalRef{Local: cond}, True: body, False: end}
+
+	load := &mir.LoadIndex{Result: elem, Target: &mir.LocalRef{Local: xs}, Indices: []mir.Operand{&mir.LocalRef{Local: i}}}
+	body.Statements = []mir.Statement{
+		load,
+		&mir.Call{Result: sum, Func: "__add__", Args: []mir.Operand{&mir.LocalRef{Local: total}, &mir.LocalRef{Local: elem}}},
+		&mir.Assign{Local: total, RHS: &mir.LocalRef{Local: sum}},
+	}
+	body.Statements = append(body.Statements, extra...)
+	body.Statements = append(body.Statements,
+		&mir.Call{Result: next, Func: "__add__", Args: []mir.Operand{&mir.LocalRef{Local: i}, &mir.Literal{Type: types.TypeInt, Value: step}}},
+		&mir.Assign{Local: i, RHS: &mir.LocalRef{Local: next}},
+	)
+	body.Terminator = &mir.Goto{Target: header}
+
+	end.Terminator = &mir.Return{Value: &mir.LocalRef{Local: total}}
+
+	fn := &mir.Function{
+		Name:       "sum",
+		Params:     []mir.Local{xs},
+		ReturnType: types.TypeInt,
+		Locals:     []mir.Local{total, i, n, cond, elem, sum, next},
+		Blocks:     []*mir.BasicBlock{entry, header, body, end},
+		Entry:      entry,
+	}
+	return fn, load
+}
+
+func runBCE(fn *mir.Function) {
+	EliminateBoundsChecks(&mir.Module{Functions: []*mir.Function{fn}})
+}
+
+func TestBCECountingLoop(t *testing.T) {
+	fn, load := countingLoop(1)
+	runBCE(fn)
+
+	if !load.InBounds {
+		t.Error("xs[i] in a loop bounded by i < len(xs) should be marked in bounds")
+	}
+}
+
+func TestBCEStoreInCountingLoop(t *testing.T) {
+	xs := mir.Local{ID: 0, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	i := mir.Local{ID: 2, Name: "i", Type: types.TypeInt}
+	store := &mir.StoreIndex{
+		Target:  &mir.LocalRef{Local: xs},
+		Indices: []mir.Operand{&mir.LocalRef{Local: i}},
+		Value:   &mir.Literal{Type: types.TypeInt, Value: int64(0)},
+	}
+	fn, _ := countingLoop(1, store)
+	runBCE(fn)
+
+	if !store.InBounds {
+		t.Error("xs[i] = v in a loop bounded by i < len(xs) should be marked in bounds")
+	}
+}
+
+func TestBCEKeepsChecks(t *testing.T) {
+	xs := mir.Local{ID: 0, Name: "xs", Type: &types.Slice{Elem: types.TypeInt}}
+	i := mir.Local{ID: 2, Name: "i", Type: types.TypeInt}
+	other := mir.Local{ID: 8, Name: "ys", Type: &types.Slice{Elem: types.TypeInt}}
+	unit := mir.Local{ID: 9, Type: types.TypeVoid}
+
+	tests := []struct {
+		name  string
+		step  int64
+		extra []mir.Statement
+	}{
+		{
+			name:  "slice may shrink",
+			step:  1,
+			extra: []mir.Statement{&mir.Call{Result: unit, Func: "runtime_slice_pop", Args: []mir.Operand{&mir.LocalRef{Local: xs}}}},
+		},
+		{
+			name:  "unknown function",
+			step:  1,
+			extra: []mir.Statement{&mir.Call{Result: unit, Func: "shrink", Args: []mir.Operand{&mir.LocalRef{Local: other}}}},
+		},
+		{
+			name:  "slice reassigned",
+			step:  1,
+			extra: []mir.Statement{&mir.Assign{Local: xs, RHS: &mir.LocalRef{Local: other}}},
+		},
+		{
+			name:  "index set to a non-constant",
+			step:  1,
+			extra: []mir.Statement{&mir.Assign{Local: i, RHS: &mir.LocalRef{Local: other}}},
+		},
+		{
+			name:  "index address taken",
+			step:  1,
+			extra: []mir.Statement{&mir.AddressOf{Result: mir.Local{ID: 10, Type: &types.Pointer{Elem: types.TypeInt}}, Target: i}},
+		},
+		{
+			name:  "legions may run",
+			step:  1,
+			extra: []mir.Statement{&mir.Yield{}},
+		},
+		{
+			name: "negative step",
+			step: -1,
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			fn, load := countingLoop(tt.step, tt.extra...)
+			runBCE(fn)
+
+			if load.InBounds {
+				t.Error("xs[i] should keep its bounds check")
+			}
+		})
+	}
+}
+
+func TestBCEAccessAfterIncrement(t *testing.T) {
+	fn, _ := countingLoop(1)
+
+	// xs[i] after i = i + 1 may be one past the end
+	body := fn.Blocks[2]
+	late := &mir.LoadIndex{
+		Result:  mir.Local{ID: 11, Type: types.TypeInt},
+		Target:  &mir.LocalRef{Local: fn.Params[0]},
+		Indices: []mir.Operand{&mir.LocalRef{Local: mir.Local{ID: 2, Name: "i", Type: types.TypeInt}}},
+	}
+	body.Statements = append(body.Statements, late)
+	runBCE(fn)
+
+	if late.InBounds {
+		t.Error("xs[i] after the increment should keep its bounds check")
+	}
+	if load := body.Statements[0].(*mir.LoadIndex); !load.InBounds {
+		t.Error("xs[i] before the increment should be marked in bounds")
+	}
+}
+
+func TestBCEIndexParameter(t *testing.T) {
+	fn, load := countingLoop(1)
+
+	// The index starts at whatever the caller passed
+	fn.Params = append(fn.Params, mir.Local{ID: 2, Name: "i", Type: types.TypeInt})
+	entry := fn.Blocks[0]
+	entry.Statements = entry.Statements[:1]
+	runBCE(fn)
+
+	if load.InBounds {
+		t.Error("an index parameter should keep its bounds check")
+	}
+}
@@ -388,9 +388,10 @@ func replaceOperandsInStatement(stmt mir.Statement, lattice map[int]*ConstantInf
 			newIndices[i] = replaceOperand(idx, lattice)
 		}
 		return &mir.LoadIndex{
-			Result:  s.Result,
-			Target:  replaceOperand(s.Target, lattice),
-			Indices: newIndices,
+			Result:   s.Result,
+			Target:   replaceOperand(s.Target, lattice),
+			Indices:  newIndices,
+			InBounds: s.InBounds,
 		}
 
 	case *mir.StoreIndex:
@@ -399,9 +400,10 @@ func replaceOperandsInStatement(stmt mir.Statement, lattice map[int]*ConstantInf
 			newIndices[i] = replaceOperand(idx, lattice)
 		}
 		return &mir.StoreIndex{
-			Target:  replaceOperand(s.Target, lattice),
-			Indices: newIndices,
-			Value:   replaceOperand(s.Value, lattice),
+			Target:   replaceOperand(s.Target, lattice),
+			Indices:  newIndices,
+			Value:    replaceOperand(s.Value, lattice),
+			InBounds: s.InBounds,
 		}
 
 	case *mir.ConstructStruct:
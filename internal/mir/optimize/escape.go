@@ -0,0 +1,721 @@
+package optimize
+
+import (
+	"fmt"
+
+	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+// EscapeNote records what escape analysis decided for one allocation site
+type EscapeNote struct {
+	Func    *mir.Function
+	Kind    string    // What is allocated: "struct Point", "tuple", "enum Shape::Circle", "closure f"
+	Local   mir.Local // The local the allocation is assigned to
+	Escapes bool
+	Reason  string // Why it escapes ("" if it does not)
+}
+
+// String formats the note the way `malphas build -m` prints it
+func (n EscapeNote) String() string {
+	what := n.Kind
+	if n.Local.Name != "" {
+		what += " " + n.Local.Name
+	}
+	if n.Escapes {
+		return fmt.Sprintf("%s: %s escapes: %s", n.Func.Name, what, n.Reason)
+	}
+	return fmt.Sprintf("%s: %s does not escape", n.Func.Name, what)
+}
+
+// StackAllocate marks the structs, tuples, enums and closures that never
+// outlive the call that makes them (Stack), so the backend allocates them
+// with an alloca instead of runtime_alloc, and returns a note per site.
+//
+// The analysis is flow-insensitive and unifies as it goes (Steensgaard
+// style): the locals that may point at the same object share a class, and
+// each class has one content class standing for everything reachable through
+// the fields, elements and payloads of its objects. A class escapes when one
+// of its values is returned, sent, spawned with, cast, has its address taken
+// or is passed to anything but a known function that keeps its argument to
+// itself, and everything in the content of an escaping class escapes too.
+// What a call returns or a channel delivers may be reachable from elsewhere,
+// so whatever is stored into it escapes.
+// Each function is summarised by which of its parameters escape; the
+// summaries are iterated to a fixpoint so recursion is handled.
+//
+// An allocation that does not escape also stays on the heap when it is
+// stored into a parameter (the caller would see it), and when it is made in
+// a loop while a value from the previous iteration may still be in use:
+// each site has one stack slot, reused by every iteration.
+func StackAllocate(module *mir.Module) (*mir.Module, []EscapeNote) {
+	funcs := make(map[string]*mir.Function)
+	for _, fn := range module.Functions {
+		if _, dup := funcs[fn.Name]; dup {
+			// Two functions with one name: a call could be to either
+			funcs[fn.Name] = nil
+			continue
+		}
+		funcs[fn.Name] = fn
+	}
+
+	summaries := make(map[string][]bool)
+	for changed := true; changed; {
+		changed = false
+		for _, fn := range module.Functions {
+			if funcs[fn.Name] != fn {
+				continue
+			}
+			escapes := analyzeEscapes(fn, funcs, summaries).paramEscapes()
+			old := summaries[fn.Name]
+			for i := range escapes {
+				if old != nil && old[i] {
+					escapes[i] = true
+				}
+				if old == nil || escapes[i] != old[i] {
+					changed = true
+				}
+			}
+			summaries[fn.Name] = escapes
+		}
+	}
+
+	var notes []EscapeNote
+	for _, fn := range module.Functions {
+		notes = append(notes, analyzeEscapes(fn, funcs, summaries).decide()...)
+	}
+	return module, notes
+}
+
+// allocSite is a statement that allocates an object
+type allocSite struct {
+	block *mir.BasicBlock
+	index int
+	local mir.Local
+	kind  string
+	stack *bool // The statement's Stack flag
+}
+
+// escapeAnalysis holds the classes of one function
+type escapeAnalysis struct {
+	fn      *mir.Function
+	parent  []int          // Union-find over class nodes
+	content []int          // Content class of a root, or -1
+	reason  []string       // Why a root escapes, or ""
+	nodes   map[int]int    // Local ID -> class node
+	names   map[int]string // Temporary local ID -> the variable it is first assigned to
+	sites   []allocSite
+}
+
+// analyzeEscapes builds the classes of fn, given the parameter summaries of
+// the functions it calls
+func analyzeEscapes(fn *mir.Function, funcs map[string]*mir.Function, summaries map[string][]bool) *escapeAnalysis {
+	a := &escapeAnalysis{fn: fn, nodes: make(map[int]int), names: make(map[int]string)}
+	for _, block := range fn.Blocks {
+		for i, stmt := range block.Statements {
+			a.statement(block, i, stmt, funcs, summaries)
+		}
+		switch term := block.Terminator.(type) {
+		case *mir.Return:
+			a.escapeOperand(term.Value, "returned")
+		case *mir.Select:
+			for _, c := range term.Cases {
+				if c.Kind == "send" {
+					a.escapeOperand(c.Value, "sent on a channel")
+				}
+				if c.Kind == "recv" && c.Result != nil {
+					a.external(*c.Result, "stored into a value received from a channel")
+				}
+			}
+		}
+	}
+	a.propagate()
+	return a
+}
+
+// statement adds the constraints of one statement
+func (a *escapeAnalysis) statement(block *mir.BasicBlock, index int, stmt mir.Statement, funcs map[string]*mir.Function, summaries map[string][]bool) {
+	switch s := stmt.(type) {
+	case *mir.Assign:
+		a.link(s.Local, s.RHS)
+		if ref, ok := s.RHS.(*mir.LocalRef); ok && ref.Local.Name == "" && s.Local.Name != "" {
+			if _, named := a.names[ref.Local.ID]; !named {
+				a.names[ref.Local.ID] = s.Local.Name
+			}
+		}
+	case *mir.Phi:
+		for _, input := range s.Inputs {
+			a.link(s.Result, input)
+		}
+	case *mir.Call:
+		a.call(s, funcs, summaries)
+	case *mir.Spawn:
+		for _, arg := range s.Args {
+			a.escapeOperand(arg, "passed to a spawned legion")
+		}
+	case *mir.Load:
+		a.loadFrom(s.Result, s.Address)
+	case *mir.LoadField:
+		a.loadFrom(s.Result, s.Target)
+	case *mir.LoadIndex:
+		a.loadFrom(s.Result, s.Target)
+	case *mir.AccessVariantPayload:
+		a.loadFrom(s.Result, s.Target)
+	case *mir.StoreField:
+		a.storeInto(s.Target, s.Value)
+	case *mir.StoreIndex:
+		a.storeInto(s.Target, s.Value)
+	case *mir.ConstructStruct:
+		for _, field := range s.Fields {
+			a.storeInto(&mir.LocalRef{Local: s.Result}, field)
+		}
+		if s.Type != nil {
+			a.addSite(block, index, s.Result, "struct "+s.Type.String(), &s.Stack)
+		}
+	case *mir.ConstructTuple:
+		for _, elem := range s.Elements {
+			a.storeInto(&mir.LocalRef{Local: s.Result}, elem)
+		}
+		a.addSite(block, index, s.Result, "tuple", &s.Stack)
+	case *mir.ConstructEnum:
+		for _, value := range s.Values {
+			a.storeInto(&mir.LocalRef{Local: s.Result}, value)
+		}
+		a.addSite(block, index, s.Result, "enum "+s.Type+"::"+s.Variant, &s.Stack)
+	case *mir.ConstructArray:
+		for _, elem := range s.Elements {
+			a.storeInto(&mir.LocalRef{Local: s.Result}, elem)
+		}
+	case *mir.MakeClosure:
+		a.storeInto(&mir.LocalRef{Local: s.Result}, s.Env)
+		a.addSite(block, index, s.Result, "closure "+s.Func, &s.Stack)
+	case *mir.Send:
+		a.escapeOperand(s.Value, "sent on a channel")
+	case *mir.Receive:
+		a.external(s.Result, "stored into a value received from a channel")
+	case *mir.AddressOf:
+		a.escapeOperand(&mir.LocalRef{Local: s.Target}, "address taken")
+	case *mir.Cast:
+		a.escapeOperand(s.Operand, "cast to "+s.Type.String())
+	}
+}
+
+// call adds the constraints of a call: an argument escapes unless the callee
+// is a function of the module whose summary says the parameter does not
+func (a *escapeAnalysis) call(call *mir.Call, funcs map[string]*mir.Function, summaries map[string][]bool) {
+	if call.FuncOperand != nil {
+		a.external(call.Result, "stored into the result of a closure call")
+		// The callee gets the closure's environment and the arguments,
+		// not the closure itself
+		if n, ok := a.operandNode(call.FuncOperand); ok {
+			a.escape(a.contentOf(n), "closure environment passed to a closure call")
+		}
+		for _, arg := range call.Args {
+			a.escapeOperand(arg, "passed to a closure call")
+		}
+		return
+	}
+	// The result may be reachable from the arguments (or, for the runtime,
+	// from anywhere): the summaries do not say
+	a.external(call.Result, "stored into the result of "+call.Func)
+	if isOperatorIntrinsic(call.Func) || readOnlyRuntimeCalls[call.Func] {
+		return
+	}
+	callee := funcs[call.Func]
+	for i, arg := range call.Args {
+		if callee == nil || i >= len(callee.Params) {
+			a.escapeOperand(arg, "passed to "+call.Func)
+			continue
+		}
+		if summary := summaries[call.Func]; summary != nil && summary[i] {
+			a.escapeOperand(arg, "passed to "+call.Func+" as "+paramName(callee, i)+", which escapes")
+		}
+	}
+}
+
+// readOnlyRuntimeCalls are the runtime functions that read their arguments
+// without keeping a pointer to them or to anything they hold
+var readOnlyRuntimeCalls = map[string]bool{
+	"runtime_slice_len":       true,
+	"runtime_slice_clear":     true,
+	"runtime_slice_reserve":   true,
+	"runtime_string_find":     true,
+	"runtime_string_contains": true,
+}
+
+// holdsPointer reports whether values of type t can point at an object:
+// numbers and bools are left out of the classes so that, say, printing a
+// field does not make the struct's whole content escape
+func holdsPointer(t types.Type) bool {
+	switch t := t.(type) {
+	case *types.Primitive:
+		return !types.PointerFree(t)
+	case *types.Named:
+		if t.Ref == nil {
+			return !types.PointerFree(t)
+		}
+	}
+	return true
+}
+
+// node returns the class node of a local
+func (a *escapeAnalysis) node(local mir.Local) int {
+	if n, ok := a.nodes[local.ID]; ok {
+		return n
+	}
+	n := a.newNode()
+	a.nodes[local.ID] = n
+	return n
+}
+
+// operandNode returns the class node of an operand that can hold a pointer
+func (a *escapeAnalysis) operandNode(op mir.Operand) (int, bool) {
+	ref, ok := op.(*mir.LocalRef)
+	if !ok || !holdsPointer(ref.Local.Type) {
+		return 0, false
+	}
+	return a.node(ref.Local), true
+}
+
+func (a *escapeAnalysis) newNode() int {
+	a.parent = append(a.parent, len(a.parent))
+	a.content = append(a.content, -1)
+	a.reason = append(a.reason, "")
+	return len(a.parent) - 1
+}
+
+func (a *escapeAnalysis) find(n int) int {
+	for a.parent[n] != n {
+		a.parent[n] = a.parent[a.parent[n]]
+		n = a.parent[n]
+	}
+	return n
+}
+
+// union merges two classes, and with them their contents
+func (a *escapeAnalysis) union(x, y int) {
+	x, y = a.find(x), a.find(y)
+	if x == y {
+		return
+	}
+	a.parent[y] = x
+	if a.reason[x] == "" {
+		a.reason[x] = a.reason[y]
+	}
+	cx, cy := a.content[x], a.content[y]
+	switch {
+	case cy < 0:
+	case cx < 0:
+		a.content[x] = cy
+	default:
+		a.union(cx, cy)
+	}
+}
+
+// contentOf returns the content class of a class, making it if needed
+func (a *escapeAnalysis) contentOf(n int) int {
+	n = a.find(n)
+	if a.content[n] < 0 {
+		c := a.newNode()
+		a.content[n] = c
+		return c
+	}
+	return a.find(a.content[n])
+}
+
+// link records that local may hold the value of op
+func (a *escapeAnalysis) link(local mir.Local, op mir.Operand) {
+	if !holdsPointer(local.Type) {
+		return
+	}
+	if n, ok := a.operandNode(op); ok {
+		a.union(a.node(local), n)
+	}
+}
+
+// loadFrom records that result is read out of the object target points at
+func (a *escapeAnalysis) loadFrom(result mir.Local, target mir.Operand) {
+	if !holdsPointer(result.Type) {
+		return
+	}
+	if t, ok := a.operandNode(target); ok {
+		a.union(a.node(result), a.contentOf(t))
+	}
+}
+
+// storeInto records that value is stored in the object target points at
+func (a *escapeAnalysis) storeInto(target, value mir.Operand) {
+	v, ok := a.operandNode(value)
+	if !ok {
+		return
+	}
+	if t, ok := a.operandNode(target); ok {
+		a.union(a.contentOf(t), v)
+	}
+}
+
+func (a *escapeAnalysis) escape(n int, reason string) {
+	n = a.find(n)
+	if a.reason[n] == "" {
+		a.reason[n] = reason
+	}
+}
+
+// external records that local holds an object made outside this function,
+// which the caller or another legion may reach too: whatever is stored into
+// it escapes
+func (a *escapeAnalysis) external(local mir.Local, reason string) {
+	if prim, ok := local.Type.(*types.Primitive); local.Type == nil || ok && prim.Kind == types.Void {
+		return // No result
+	}
+	if holdsPointer(local.Type) {
+		a.escape(a.contentOf(a.node(local)), reason)
+	}
+}
+
+func (a *escapeAnalysis) escapeOperand(op mir.Operand, reason string) {
+	if n, ok := a.operandNode(op); ok {
+		a.escape(n, reason)
+	}
+}
+
+func (a *escapeAnalysis) addSite(block *mir.BasicBlock, index int, local mir.Local, kind string, stack *bool) {
+	a.node(local)
+	a.sites = append(a.sites, allocSite{block: block, index: index, local: local, kind: kind, stack: stack})
+}
+
+// propagate makes the content of every escaping class escape
+func (a *escapeAnalysis) propagate() {
+	for n := range a.parent {
+		if a.parent[n] != n || a.reason[n] == "" {
+			continue
+		}
+		for c := a.content[n]; c >= 0; c = a.content[c] {
+			c = a.find(c)
+			if a.reason[c] != "" {
+				break
+			}
+			a.reason[c] = "stored in a value that escapes"
+		}
+	}
+}
+
+// chain returns the classes reachable from n through contents, starting
+// with n's own, and whether the chain loops back on itself
+func (a *escapeAnalysis) chain(n int) ([]int, bool) {
+	var classes []int
+	seen := make(map[int]bool)
+	for c := n; c >= 0; c = a.content[c] {
+		c = a.find(c)
+		if seen[c] {
+			return classes, true
+		}
+		seen[c] = true
+		classes = append(classes, c)
+	}
+	return classes, false
+}
+
+// paramEscapes summarises which parameters may escape. Besides escaping
+// outright, a parameter counts as escaping when what it reaches is shared
+// with another parameter or loops back on itself, since the caller's classes
+// would have to be merged to follow it.
+func (a *escapeAnalysis) paramEscapes() []bool {
+	escapes := make([]bool, len(a.fn.Params))
+	chains := make([][]int, len(a.fn.Params))
+	reached := make(map[int]int)
+	for i, param := range a.fn.Params {
+		if !holdsPointer(param.Type) {
+			continue
+		}
+		classes, loops := a.chain(a.node(param))
+		chains[i] = classes
+		for _, c := range classes {
+			reached[c]++
+			if a.reason[c] != "" {
+				escapes[i] = true
+			}
+		}
+		if loops {
+			escapes[i] = true
+		}
+	}
+	for i, classes := range chains {
+		for _, c := range classes {
+			if reached[c] > 1 {
+				escapes[i] = true
+			}
+		}
+	}
+	return escapes
+}
+
+// decide sets the Stack flag of every site that can live on the stack and
+// returns the notes
+func (a *escapeAnalysis) decide() []EscapeNote {
+	if len(a.sites) == 0 {
+		return nil
+	}
+
+	// Classes stored into a parameter, and which parameter
+	storedInto := make(map[int]string)
+	for _, param := range a.fn.Params {
+		if !holdsPointer(param.Type) {
+			continue
+		}
+		classes, _ := a.chain(a.node(param))
+		for _, c := range classes[1:] {
+			if _, ok := storedInto[c]; !ok {
+				storedInto[c] = paramName(a.fn, indexOfParam(a.fn, param))
+			}
+		}
+	}
+
+	var live *liveness
+	cyclic := make(map[*mir.BasicBlock]bool)
+	notes := make([]EscapeNote, 0, len(a.sites))
+	for _, site := range a.sites {
+		class := a.find(a.node(site.local))
+		reason := a.reason[class]
+		if reason == "" {
+			if param, ok := storedInto[class]; ok {
+				reason = "stored into parameter " + param
+			}
+		}
+		if reason == "" {
+			inCycle, ok := cyclic[site.block]
+			if !ok {
+				inCycle = reachesItself(site.block)
+				cyclic[site.block] = inCycle
+			}
+			if inCycle {
+				if live == nil {
+					live = computeLiveness(a.fn)
+				}
+				if a.heldAcrossSite(class, live.before(site.block, site.index)) {
+					reason = "kept across loop iterations"
+				}
+			}
+		}
+		*site.stack = reason == ""
+		local := site.local
+		if local.Name == "" {
+			local.Name = a.names[local.ID]
+		}
+		notes = append(notes, EscapeNote{
+			Func:    a.fn,
+			Kind:    site.kind,
+			Local:   local,
+			Escapes: reason != "",
+			Reason:  reason,
+		})
+	}
+	return notes
+}
+
+// heldAcrossSite reports whether a live local may point at an object of
+// class, or at an object holding one
+func (a *escapeAnalysis) heldAcrossSite(class int, live map[int]bool) bool {
+	for id, n := range a.nodes {
+		if !live[id] {
+			continue
+		}
+		classes, _ := a.chain(n)
+		for _, c := range classes {
+			if c == class {
+				return true
+			}
+		}
+	}
+	return false
+}
+
+func indexOfParam(fn *mir.Function, param mir.Local) int {
+	for i, p := range fn.Params {
+		if p.ID == param.ID {
+			return i
+		}
+	}
+	return -1
+}
+
+// paramName names parameter i of fn for a note
+func paramName(fn *mir.Function, i int) string {
+	if i >= 0 && i < len(fn.Params) && fn.Params[i].Name != "" {
+		return fn.Params[i].Name
+	}
+	return fmt.Sprintf("#%d", i)
+}
+
+// reachesItself reports whether control can come back to block after
+// leaving it
+func reachesItself(block *mir.BasicBlock) bool {
+	seen := make(map[*mir.BasicBlock]bool)
+	worklist := append([]*mir.BasicBlock(nil), escapeSuccessors(block)...)
+	for len(worklist) > 0 {
+		b := worklist[len(worklist)-1]
+		worklist = worklist[:len(worklist)-1]
+		if b == block {
+			return true
+		}
+		if seen[b] {
+			continue
+		}
+		seen[b] = true
+		worklist = append(worklist, escapeSuccessors(b)...)
+	}
+	return false
+}
+
+// escapeSuccessors returns the successors of a block, select cases included
+func escapeSuccessors(block *mir.BasicBlock) []*mir.BasicBlock {
+	if sel, ok := block.Terminator.(*mir.Select); ok {
+		var succs []*mir.BasicBlock
+		for _, c := range sel.Cases {
+			if c.Target != nil {
+				succs = append(succs, c.Target)
+			}
+		}
+		return succs
+	}
+	return getSuccessorsForLICM(block)
+}
+
+// liveness holds the locals live on exit from each block
+type liveness struct {
+	liveOut map[*mir.BasicBlock]map[int]bool
+}
+
+// computeLiveness solves the backward liveness equations of fn
+func computeLiveness(fn *mir.Function) *liveness {
+	live := &liveness{liveOut: make(map[*mir.BasicBlock]map[int]bool)}
+	liveIn := make(map[*mir.BasicBlock]map[int]bool)
+	for _, block := range fn.Blocks {
+		live.liveOut[block] = make(map[int]bool)
+		liveIn[block] = make(map[int]bool)
+	}
+	for changed := true; changed; {
+		changed = false
+		for i := len(fn.Blocks) - 1; i >= 0; i-- {
+			block := fn.Blocks[i]
+			out := live.liveOut[block]
+			for _, succ := range escapeSuccessors(block) {
+				for id := range liveIn[succ] {
+					if !out[id] {
+						out[id] = true
+						changed = true
+					}
+				}
+			}
+			in := live.before(block, 0)
+			for id := range in {
+				if !liveIn[block][id] {
+					liveIn[block][id] = true
+					changed = true
+				}
+			}
+		}
+	}
+	return live
+}
+
+// before returns the locals live just before statement index of block
+func (l *liveness) before(block *mir.BasicBlock, index int) map[int]bool {
+	live := make(map[int]bool, len(l.liveOut[block]))
+	for id := range l.liveOut[block] {
+		live[id] = true
+	}
+	for _, id := range terminatorUses(block.Terminator) {
+		live[id] = true
+	}
+	for i := len(block.Statements) - 1; i >= index; i-- {
+		stmt := block.Statements[i]
+		if id, ok := definedLocal(stmt); ok {
+			delete(live, id)
+		}
+		for _, id := range statementUses(stmt) {
+			live[id] = true
+		}
+	}
+	return live
+}
+
+// statementUses returns the IDs of the locals a statement reads
+func statementUses(stmt mir.Statement) []int {
+	var ops []mir.Operand
+	switch s := stmt.(type) {
+	case *mir.Assign:
+		ops = []mir.Operand{s.RHS}
+	case *mir.Phi:
+		for _, input := range s.Inputs {
+			ops = append(ops, input)
+		}
+	case *mir.Call:
+		ops = append([]mir.Operand{s.FuncOperand}, s.Args...)
+	case *mir.Spawn:
+		ops = append([]mir.Operand{s.Group}, s.Args...)
+	case *mir.Load:
+		ops = []mir.Operand{s.Address}
+	case *mir.LoadField:
+		ops = []mir.Operand{s.Target}
+	case *mir.StoreField:
+		ops = []mir.Operand{s.Target, s.Value}
+	case *mir.LoadIndex:
+		ops = append([]mir.Operand{s.Target}, s.Indices...)
+	case *mir.StoreIndex:
+		ops = append([]mir.Operand{s.Target, s.Value}, s.Indices...)
+	case *mir.ConstructStruct:
+		for _, field := range s.Fields {
+			ops = append(ops, field)
+		}
+	case *mir.ConstructArray:
+		ops = s.Elements
+	case *mir.ConstructTuple:
+		ops = s.Elements
+	case *mir.ConstructEnum:
+		ops = s.Values
+	case *mir.Discriminant:
+		ops = []mir.Operand{s.Target}
+	case *mir.AccessVariantPayload:
+		ops = []mir.Operand{s.Target}
+	case *mir.MakeChannel:
+		ops = []mir.Operand{s.Capacity}
+	case *mir.Send:
+		ops = []mir.Operand{s.Channel, s.Value}
+	case *mir.Receive:
+		ops = []mir.Operand{s.Channel}
+	case *mir.AddressOf:
+		return []int{s.Target.ID}
+	case *mir.Cast:
+		ops = []mir.Operand{s.Operand}
+	case *mir.MakeClosure:
+		ops = []mir.Operand{s.Env}
+	}
+	return operandLocals(ops)
+}
+
+// terminatorUses returns the IDs of the locals a terminator reads
+func terminatorUses(term mir.Terminator) []int {
+	var ops []mir.Operand
+	switch t := term.(type) {
+	case *mir.Return:
+		ops = []mir.Operand{t.Value}
+	case *mir.Branch:
+		ops = []mir.Operand{t.Condition}
+	case *mir.Select:
+		for _, c := range t.Cases {
+			ops = append(ops, c.Channel, c.Value)
+		}
+	}
+	return operandLocals(ops)
+}
+
+func operandLocals(ops []mir.Operand) []int {
+	var ids []int
+	for _, op := range ops {
+		if ref, ok := op.(*mir.LocalRef); ok {
+			ids = append(ids, ref.Local.ID)
+		}
+	}
+	return ids
+}
@@ -0,0 +1,280 @@
+package optimize
+
+import (
+	"strings"
+	"testing"
+
+	"github.com/malphas-lang/malphas-lang/internal/mir"
+	"github.com/malphas-lang/malphas-lang/internal/types"
+)
+
+var pointType = &types.Struct{Name: "Point", Fields: []types.Field{{Name: "x", Type: types.TypeInt}}}
+
+// boxType holds a pointer to a Point
+var boxType = &types.Struct{Name: "Box", Fields: []types.Field{{Name: "p", Type: pointType}}}
+
+// straightLine builds a one-block function
+func straightLine(name string, params []mir.Local, ret mir.Operand, stmts ...mir.Statement) *mir.Function {
+	entry := &mir.BasicBlock{Label: "entry", Statements: stmts, Terminator: &mir.Return{Value: ret}}
+	return &mir.Function{
+		Name:       name,
+		Params:     params,
+		ReturnType: types.TypeInt,
+		Blocks:     []*mir.BasicBlock{entry},
+		Entry:      entry,
+	}
+}
+
+func newPoint(result mir.Local) *mir.ConstructStruct {
+	return &mir.ConstructStruct{
+		Result: result,
+		Type:   pointType,
+		Fields: map[string]mir.Operand{"x": &mir.Literal{Type: types.TypeInt, Value: int64(1)}},
+	}
+}
+
+func ref(l mir.Local) mir.Operand { return &mir.LocalRef{Local: l} }
+
+func runStackAllocate(t *testing.T, fns ...*mir.Function) []EscapeNote {
+	t.Helper()
+	_, notes := StackAllocate(&mir.Module{Functions: fns})
+	return notes
+}
+
+// reader is fn reader(p: Point) -> int { return p.x }
+func reader() *mir.Function {
+	p := mir.Local{ID: 0, Name: "p", Type: pointType}
+	x := mir.Local{ID: 1, Type: types.TypeInt}
+	return straightLine("reader", []mir.Local{p}, ref(x),
+		&mir.LoadField{Result: x, Target: ref(p), Field: "x"})
+}
+
+// identity is fn identity(p: Point) -> Point { return p }
+func identity() *mir.Function {
+	p := mir.Local{ID: 0, Name: "p", Type: pointType}
+	return straightLine("identity", []mir.Local{p}, ref(p))
+}
+
+func TestStackAllocateLocalStruct(t *testing.T) {
+	p := mir.Local{ID: 0, Name: "p", Type: pointType}
+	x := mir.Local{ID: 1, Type: types.TypeInt}
+	cons := newPoint(p)
+	main := straightLine("main", nil, ref(x),
+		cons,
+		&mir.Call{Result: x, Func: "reader", Args: []mir.Operand{ref(p)}},
+	)
+
+	notes := runStackAllocate(t, main, reader())
+
+	if !cons.Stack {
+		t.Fatalf("a Point only passed to a function that reads it should be on the stack, notes: %v", notes)
+	}
+	if len(notes) != 1 || notes[0].String() != "main: struct Point p does not escape" {
+		t.Errorf("unexpected notes: %v", notes)
+	}
+}
+
+func TestStackAllocateEscapes(t *testing.T) {
+	tests := []struct {
+		name   string
+		build  func(p mir.Local) []*mir.Function
+		reason string
+	}{
+		{"returned", func(p mir.Local) []*mir.Function {
+			return []*mir.Function{straightLine("main", nil, ref(p), newPoint(p))}
+		}, "returned"},
+		{"passed to the runtime", func(p mir.Local) []*mir.Function {
+			r := mir.Local{ID: 9, Type: types.TypeInt}
+			return []*mir.Function{straightLine("main", nil, nil, newPoint(p),
+				&mir.Call{Result: r, Func: "runtime_keep", Args: []mir.Operand{ref(p)}})}
+		}, "passed to runtime_keep"},
+		{"returned by the callee", func(p mir.Local) []*mir.Function {
+			r := mir.Local{ID: 9, Type: pointType}
+			return []*mir.Function{straightLine("main", nil, nil, newPoint(p),
+				&mir.Call{Result: r, Func: "identity", Args: []mir.Operand{ref(p)}}), identity()}
+		}, "passed to identity as p, which escapes"},
+		{"stored in a returned box", func(p mir.Local) []*mir.Function {
+			box := mir.Local{ID: 9, Name: "box", Type: boxType}
+			return []*mir.Function{straightLine("main", nil, ref(box), newPoint(p),
+				&mir.ConstructStruct{Result: box, Type: boxType, Fields: map[string]mir.Operand{"p": ref(p)}})}
+		}, "stored in a value that escapes"},
+		{"sent", func(p mir.Local) []*mir.Function {
+			ch := mir.Local{ID: 9, Type: &types.Channel{Elem: pointType}}
+			return []*mir.Function{straightLine("main", []mir.Local{ch}, nil, newPoint(p),
+				&mir.Send{Channel: ref(ch), Value: ref(p)})}
+		}, "sent on a channel"},
+		{"spawned with", func(p mir.Local) []*mir.Function {
+			return []*mir.Function{straightLine("main", nil, nil, newPoint(p),
+				&mir.Spawn{Func: "reader", Args: []mir.Operand{ref(p)}}), reader()}
+		}, "passed to a spawned legion"},
+		{"stored into a call result", func(p mir.Local) []*mir.Function {
+			// fn unbox(b: Box) -> Box { return b } hands back what the caller holds
+			b := mir.Local{ID: 0, Name: "b", Type: boxType}
+			unbox := straightLine("unbox", []mir.Local{b}, ref(b))
+			arg := mir.Local{ID: 8, Name: "arg", Type: boxType}
+			box := mir.Local{ID: 9, Name: "box", Type: boxType}
+			return []*mir.Function{straightLine("main", []mir.Local{arg}, nil, newPoint(p),
+				&mir.Call{Result: box, Func: "unbox", Args: []mir.Operand{ref(arg)}},
+				&mir.StoreField{Target: ref(box), Field: "p", Value: ref(p)}), unbox}
+		}, "stored into the result of unbox"},
+		{"stored into a runtime result", func(p mir.Local) []*mir.Function {
+			box := mir.Local{ID: 9, Name: "box", Type: boxType}
+			return []*mir.Function{straightLine("main", nil, nil, newPoint(p),
+				&mir.Call{Result: box, Func: "runtime_global_box"},
+				&mir.StoreField{Target: ref(box), Field: "p", Value: ref(p)})}
+		}, "stored into the result of runtime_global_box"},
+		{"stored into a received value", func(p mir.Local) []*mir.Function {
+			ch := mir.Local{ID: 8, Type: &types.Channel{Elem: boxType}}
+			box := mir.Local{ID: 9, Name: "box", Type: boxType}
+			return []*mir.Function{straightLine("main", []mir.Local{ch}, nil, newPoint(p),
+				&mir.Receive{Result: box, Channel: ref(ch)},
+				&mir.StoreField{Target: ref(box), Field: "p", Value: ref(p)})}
+		}, "stored into a value received from a channel"},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			p := mir.Local{ID: 0, Name: "p", Type: pointType}
+			fns := tt.build(p)
+			notes := runStackAllocate(t, fns...)
+			cons := fns[0].Blocks[0].Statements[0].(*mir.ConstructStruct)
+			if cons.Stack {
+				t.Fatalf("the Point should stay on the heap, notes: %v", notes)
+			}
+			if len(notes) == 0 || notes[0].Reason != tt.reason {
+				t.Errorf("got notes %v, want reason %q", notes, tt.reason)
+			}
+		})
+	}
+}
+
+// A Point stored into a parameter is seen by the caller
+func TestStackAllocateStoredIntoParameter(t *testing.T) {
+	box := mir.Local{ID: 0, Name: "box", Type: boxType}
+	p := mir.Local{ID: 1, Type: pointType}
+	cons := newPoint(p)
+	fill := straightLine("fill", []mir.Local{box}, nil,
+		cons,
+		&mir.StoreField{Target: ref(box), Field: "p", Value: ref(p)},
+	)
+
+	notes := runStackAllocate(t, fill)
+
+	if cons.Stack {
+		t.Fatalf("a Point stored into a parameter should stay on the heap")
+	}
+	if !strings.Contains(notes[0].String(), "escapes: stored into parameter box") {
+		t.Errorf("unexpected note: %v", notes[0])
+	}
+}
+
+// pointLoop builds
+//
+//	prev = Point{}            // before the loop
+//	while c { cur = Point{}; <use>; prev = cur }
+//	return prev.x
+//
+// where use reads prev after the Point is made when readPrevAfter is set
+func pointLoop(readPrevAfter bool) (*mir.Function, *mir.ConstructStruct) {
+	prev := mir.Local{ID: 0, Name: "prev", Type: pointType}
+	cur := mir.Local{ID: 1, Name: "cur", Type: pointType}
+	c := mir.Local{ID: 2, Name: "c", Type: types.TypeBool}
+	x := mir.Local{ID: 3, Type: types.TypeInt}
+	y := mir.Local{ID: 4, Type: types.TypeInt}
+
+	entry := &mir.BasicBlock{Label: "entry"}
+	header := &mir.BasicBlock{Label: "loop.header"}
+	body := &mir.BasicBlock{Label: "loop.body"}
+	end := &mir.BasicBlock{Label: "loop.end"}
+
+	entry.Statements = []mir.Statement{newPoint(prev)}
+	entry.Terminator = &mir.Goto{Target: header}
+	header.Terminator = &mir.Branch{Condition: ref(c), True: body, False: end}
+
+	cons := newPoint(cur)
+	body.Statements = []mir.Statement{cons}
+	if readPrevAfter {
+		body.Statements = append(body.Statements, &mir.LoadField{Result: y, Target: ref(prev), Field: "x"})
+	}
+	body.Statements = append(body.Statements, &mir.Assign{Local: prev, RHS: ref(cur)})
+	body.Terminator = &mir.Goto{Target: header}
+
+	end.Statements = []mir.Statement{&mir.LoadField{Result: x, Target: ref(prev), Field: "x"}}
+	end.Terminator = &mir.Return{Value: ref(x)}
+
+	fn := &mir.Function{
+		Name:       "walk",
+		Params:     []mir.Local{c},
+		ReturnType: types.TypeInt,
+		Blocks:     []*mir.BasicBlock{entry, header, body, end},
+		Entry:      entry,
+	}
+	return fn, cons
+}
+
+func TestStackAllocateLoop(t *testing.T) {
+	// The previous iteration's Point is dead when the next one is made, so
+	// the slot can be reused
+	fn, cons := pointLoop(false)
+	runStackAllocate(t, fn)
+	if !cons.Stack {
+		t.Errorf("a Point replaced before the next one is made should be on the stack")
+	}
+
+	// prev still points at the last Point when the next one is made
+	fn, cons = pointLoop(true)
+	notes := runStackAllocate(t, fn)
+	if cons.Stack {
+		t.Fatalf("a Point read after the next one is made should stay on the heap")
+	}
+	if notes[1].Reason != "kept across loop iterations" {
+		t.Errorf("unexpected note: %v", notes[1])
+	}
+	if entry := fn.Entry.Statements[0].(*mir.ConstructStruct); !entry.Stack {
+		t.Errorf("the Point made before the loop should be on the stack")
+	}
+}
+
+// A recursive function that only reads its parameter keeps it on the stack
+func TestStackAllocateRecursion(t *testing.T) {
+	p := mir.Local{ID: 0, Name: "p", Type: pointType}
+	r := mir.Local{ID: 1, Type: types.TypeInt}
+	rec := straightLine("rec", []mir.Local{p}, ref(r),
+		&mir.Call{Result: r, Func: "rec", Args: []mir.Operand{ref(p)}})
+
+	q := mir.Local{ID: 0, Name: "q", Type: pointType}
+	x := mir.Local{ID: 1, Type: types.TypeInt}
+	cons := newPoint(q)
+	main := straightLine("main", nil, ref(x),
+		cons,
+		&mir.Call{Result: x, Func: "rec", Args: []mir.Operand{ref(q)}})
+
+	runStackAllocate(t, main, rec)
+	if !cons.Stack {
+		t.Errorf("a Point passed to a recursive reader should be on the stack")
+	}
+}
+
+// Calling a closure passes its environment on, but not the closure itself
+func TestStackAllocateClosure(t *testing.T) {
+	envType := &types.Struct{Name: "f_env"}
+	env := mir.Local{ID: 0, Type: envType}
+	fnType := &types.Function{Params: []types.Type{types.TypeInt}, Return: types.TypeInt}
+	f := mir.Local{ID: 1, Name: "f", Type: fnType}
+	r := mir.Local{ID: 2, Type: types.TypeInt}
+	envCons := &mir.ConstructStruct{Result: env, Type: envType, Fields: map[string]mir.Operand{}}
+	closure := &mir.MakeClosure{Result: f, Func: "f", Env: ref(env)}
+	main := straightLine("main", nil, ref(r),
+		envCons,
+		closure,
+		&mir.Call{Result: r, FuncOperand: ref(f), Args: []mir.Operand{&mir.Literal{Type: types.TypeInt, Value: int64(1)}}},
+	)
+
+	runStackAllocate(t, main)
+	if !closure.Stack {
+		t.Errorf("a closure only called locally should be on the stack")
+	}
+	if envCons.Stack {
+		t.Errorf("the environment of a called closure should stay on the heap")
+	}
+}
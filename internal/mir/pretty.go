@@ -102,6 +102,9 @@ func (s *Spawn) PrettyPrint() string {
 	for i, arg := range s.Args {
 		args[i] = operandString(arg)
 	}
+	if s.Group != nil {
+		return fmt.Sprintf("spawn %s(%s) in %s", s.Func, strings.Join(args, ", "), operandString(s.Group))
+	}
 	return fmt.Sprintf("spawn %s(%s)", s.Func, strings.Join(args, ", "))
 }
 
@@ -243,6 +243,14 @@ func (p *Parser) parseFieldExpr(target ast.Expr) ast.Expr {
 	return ast.NewFieldExpr(target, field, span)
 }
 
+// atTypeArgument reports whether an index starts with a type that cannot be
+// an expression: a channel type (make[chan int]) or a slice type
+// (make[[]int]), which an index never is
+func (p *Parser) atTypeArgument() bool {
+	return p.curTok.Type == lexer.CHAN ||
+		(p.curTok.Type == lexer.LBRACKET && p.peekTok.Type == lexer.RBRACKET)
+}
+
 func (p *Parser) parseIndexExpr(target ast.Expr) ast.Expr {
 	openTok := p.curTok
 
@@ -252,7 +260,7 @@ func (p *Parser) parseIndexExpr(target ast.Expr) ast.Expr {
 
 	if p.curTok.Type != lexer.RBRACKET {
 		var index ast.Expr
-		if p.curTok.Type == lexer.CHAN {
+		if p.atTypeArgument() {
 			typ := p.parseType()
 			if typ != nil {
 				index = ast.NewTypeWrapperExpr(typ, typ.Span())
@@ -270,7 +278,7 @@ func (p *Parser) parseIndexExpr(target ast.Expr) ast.Expr {
 			p.nextToken() // move to comma
 			p.nextToken() // move to next index start
 
-			if p.curTok.Type == lexer.CHAN {
+			if p.atTypeArgument() {
 				typ := p.parseType()
 				if typ != nil {
 					index = ast.NewTypeWrapperExpr(typ, typ.Span())
@@ -3639,3 +3639,108 @@ fn main() {
 		})
 	}
 }
+
+func TestParseWithArenaStmt(t *testing.T) {
+	const src = `
+package foo;
+
+fn main() {
+	with arena {
+		let xs = [1, 2, 3];
+	}
+}
+`
+	file, errs := parseFile(t, src)
+	assertNoErrors(t, errs)
+
+	fn := file.Decls[0].(*ast.FnDecl)
+	if len(fn.Body.Stmts) != 1 {
+		t.Fatalf("expected 1 statement, got %d", len(fn.Body.Stmts))
+	}
+
+	stmt, ok := fn.Body.Stmts[0].(*ast.WithArenaStmt)
+	if !ok {
+		t.Fatalf("expected *ast.WithArenaStmt, got %T", fn.Body.Stmts[0])
+	}
+	if stmt.Body == nil || len(stmt.Body.Stmts) != 1 {
+		t.Fatalf("expected arena body with 1 statement, got %#v", stmt.Body)
+	}
+}
+
+func TestParseWithArenaStmtRequiresArena(t *testing.T) {
+	const src = `
+package foo;
+
+fn main() {
+	with pool {
+	}
+}
+`
+	_, errs := parseFile(t, src)
+	if len(errs) == 0 {
+		t.Fatal("expected an error for `with` without `arena`")
+	}
+}
+
+func TestParseMakeSliceTypeArgument(t *testing.T) {
+	const src = `
+package foo;
+
+fn main() {
+	let xs = make[[]int](8);
+}
+`
+	file, errs := parseFile(t, src)
+	assertNoErrors(t, errs)
+
+	fn := file.Decls[0].(*ast.FnDecl)
+	letStmt := fn.Body.Stmts[0].(*ast.LetStmt)
+	call, ok := letStmt.Value.(*ast.CallExpr)
+	if !ok {
+		t.Fatalf("expected *ast.CallExpr, got %T", letStmt.Value)
+	}
+	index, ok := call.Callee.(*ast.IndexExpr)
+	if !ok || len(index.Indices) != 1 {
+		t.Fatalf("expected make[...] callee, got %#v", call.Callee)
+	}
+	wrapper, ok := index.Indices[0].(*ast.TypeWrapperExpr)
+	if !ok {
+		t.Fatalf("expected *ast.TypeWrapperExpr type argument, got %T", index.Indices[0])
+	}
+	if _, ok := wrapper.Type.(*ast.SliceType); !ok {
+		t.Fatalf("expected *ast.SliceType, got %T", wrapper.Type)
+	}
+}
+
+func TestParseSpawnScopeStmt(t *testing.T) {
+	const src = `
+package foo;
+
+fn main() {
+	spawn scope {
+		spawn worker(1);
+		spawn { worker(2); };
+	}
+	spawn scope(3);
+}
+`
+	file, errs := parseFile(t, src)
+	assertNoErrors(t, errs)
+
+	fn := file.Decls[0].(*ast.FnDecl)
+	if len(fn.Body.Stmts) != 2 {
+		t.Fatalf("expected 2 statements, got %d", len(fn.Body.Stmts))
+	}
+
+	stmt, ok := fn.Body.Stmts[0].(*ast.SpawnScopeStmt)
+	if !ok {
+		t.Fatalf("expected *ast.SpawnScopeStmt, got %T", fn.Body.Stmts[0])
+	}
+	if stmt.Body == nil || len(stmt.Body.Stmts) != 2 {
+		t.Fatalf("expected scope body with 2 statements, got %#v", stmt.Body)
+	}
+	// `scope` is only special before a block
+	if _, ok := fn.Body.Stmts[1].(*ast.SpawnStmt); !ok {
+		t.Fatalf("expected *ast.SpawnStmt for a call to scope, got %T", fn.Body.Stmts[1])
+	}
+}
@@ -25,6 +25,8 @@ func (p *Parser) parseStmt() ast.Stmt {
 		return p.parseSpawnStmt()
 	case lexer.SELECT:
 		return p.parseSelectStmt()
+	case lexer.WITH:
+		return p.parseWithArenaStmt()
 	default:
 		return p.parseExprStmt()
 	}
@@ -234,6 +236,61 @@ func (p *Parser) parseWhileStmt() ast.Stmt {
 	return ast.NewWhileStmt(condition, body, span)
 }
 
+// parseWithArenaStmt parses an arena region: with arena { ... }
+func (p *Parser) parseWithArenaStmt() ast.Stmt {
+	start := p.curTok.Span
+
+	if p.peekTok.Type != lexer.IDENT || p.peekTok.Literal != "arena" {
+		p.reportExpectedError("'arena' after 'with'", p.peekTok, p.peekTok.Span)
+		return nil
+	}
+	p.nextToken()
+
+	if !p.expect(lexer.LBRACE) {
+		return nil
+	}
+
+	prevAllow := p.allowBlockTail
+	prevTail := p.pendingTail
+	p.allowBlockTail = true
+	p.pendingTail = nil
+	body := p.parseBlockExpr()
+	p.pendingTail = prevTail
+	p.allowBlockTail = prevAllow
+	if body == nil {
+		return nil
+	}
+	if p.curTok.Type == lexer.RBRACE {
+		p.nextToken()
+	}
+
+	return ast.NewWithArenaStmt(body, mergeSpan(start, body.Span()))
+}
+
+// parseSpawnScopeStmt parses the rest of a spawn scope: spawn scope { ... }.
+// curTok is 'scope'.
+func (p *Parser) parseSpawnScopeStmt(start lexer.Span) ast.Stmt {
+	if !p.expect(lexer.LBRACE) {
+		return nil
+	}
+
+	prevAllow := p.allowBlockTail
+	prevTail := p.pendingTail
+	p.allowBlockTail = true
+	p.pendingTail = nil
+	body := p.parseBlockExpr()
+	p.pendingTail = prevTail
+	p.allowBlockTail = prevAllow
+	if body == nil {
+		return nil
+	}
+	if p.curTok.Type == lexer.RBRACE {
+		p.nextToken()
+	}
+
+	return ast.NewSpawnScopeStmt(body, mergeSpan(start, body.Span()))
+}
+
 func (p *Parser) parseForStmt() ast.Stmt {
 	start := p.curTok.Span
 
@@ -337,6 +394,11 @@ func (p *Parser) parseSpawnStmt() ast.Stmt {
 
 	p.nextToken()
 
+	// Structured scope: spawn scope { ... }
+	if p.curTok.Type == lexer.IDENT && p.curTok.Literal == "scope" && p.peekTok.Type == lexer.LBRACE {
+		return p.parseSpawnScopeStmt(start)
+	}
+
 	// Check for block literal: spawn { ... }
 	if p.curTok.Type == lexer.LBRACE {
 		block := p.parseBlockLiteral()
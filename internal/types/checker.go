@@ -91,8 +91,9 @@ func NewChecker() *Checker {
 	c.GlobalScope.Insert("format", &Symbol{
 		Name: "format",
 		Type: &Function{
-			Params: []Type{TypeString, &Named{Name: "any"}, &Named{Name: "any"}, &Named{Name: "any"}, &Named{Name: "any"}}, // format string + up to 4 args
-			Return: TypeString,
+			Params:   []Type{TypeString, &Named{Name: "any"}},
+			Variadic: true,
+			Return:   TypeString,
 		},
 	})
 
@@ -146,6 +147,45 @@ func NewChecker() *Checker {
 		},
 	})
 
+	// num_workers: fn() -> int
+	// The number of OS threads running legions
+	c.GlobalScope.Insert("num_workers", &Symbol{
+		Name: "num_workers",
+		Type: &Function{
+			Params: []Type{},
+			Return: TypeInt,
+		},
+	})
+
+	// send_many: fn[T](chan T, []T) -> int
+	// Sends the elements in order, returns how many were sent
+	c.GlobalScope.Insert("send_many", &Symbol{
+		Name: "send_many",
+		Type: &Function{
+			TypeParams: []TypeParam{{Name: "T"}},
+			Params: []Type{
+				&Channel{Elem: &TypeParam{Name: "T"}},
+				&Slice{Elem: &TypeParam{Name: "T"}},
+			},
+			Return: TypeInt,
+		},
+	})
+
+	// recv_many: fn[T](chan T, []T, int) -> int
+	// Appends up to max received elements, returns how many (0 once closed)
+	c.GlobalScope.Insert("recv_many", &Symbol{
+		Name: "recv_many",
+		Type: &Function{
+			TypeParams: []TypeParam{{Name: "T"}},
+			Params: []Type{
+				&Channel{Elem: &TypeParam{Name: "T"}},
+				&Slice{Elem: &TypeParam{Name: "T"}},
+				TypeInt,
+			},
+			Return: TypeInt,
+		},
+	})
+
 	// comparable interface (marker for Go compatibility)
 	c.GlobalScope.Insert("comparable", &Symbol{
 		Name: "comparable",
@@ -742,7 +742,9 @@ func (c *Checker) checkExprInternal(expr ast.Expr, scope *Scope, inUnsafe bool)
 
 			// Check argument count for non-generic functions
 			if len(fn.TypeParams) == 0 {
-				if len(argTypes) != len(fn.Params) {
+				// Variadic: the last parameter absorbs any number of arguments
+				variadic := fn.Variadic && len(fn.Params) > 0 && len(argTypes) >= len(fn.Params)-1
+				if !variadic && len(argTypes) != len(fn.Params) {
 					// Build function signature string for help text
 					paramStrs := make([]string, len(fn.Params))
 					for i, p := range fn.Params {
@@ -774,9 +776,16 @@ func (c *Checker) checkExprInternal(expr ast.Expr, scope *Scope, inUnsafe bool)
 				}
 
 				// Check argument types
-				for i := 0; i < len(argTypes) && i < len(fn.Params); i++ {
-					if !c.assignableTo(argTypes[i], fn.Params[i]) {
-						c.reportTypeMismatch(fn.Params[i], argTypes[i], e.Args[i].Span(), fmt.Sprintf("argument %d to function %s", i+1, fnName))
+				for i := 0; i < len(argTypes); i++ {
+					var param Type
+					if i < len(fn.Params) {
+						param = fn.Params[i]
+					}
+					if variadic && i >= len(fn.Params)-1 {
+						param = fn.Params[len(fn.Params)-1]
+					}
+					if param != nil && !c.assignableTo(argTypes[i], param) {
+						c.reportTypeMismatch(param, argTypes[i], e.Args[i].Span(), fmt.Sprintf("argument %d to function %s", i+1, fnName))
 					}
 				}
 			}
@@ -2852,6 +2861,16 @@ func (c *Checker) lookupMethod(typ Type, methodName string) *Function {
 		return nil
 	}
 
+	// Built-in Vec operations on slices
+	if slice, ok := typ.(*Slice); ok {
+		return sliceMethod(slice, methodName)
+	}
+
+	// Built-in search operations on strings
+	if prim, ok := typ.(*Primitive); ok && prim.Kind == String {
+		return stringMethod(methodName)
+	}
+
 	typeName := c.getTypeName(typ)
 	if typeName == "" {
 		return nil
@@ -2863,6 +2882,62 @@ func (c *Checker) lookupMethod(typ Type, methodName string) *Function {
 	return nil
 }
 
+// sliceMethod returns the signature of a built-in slice method (lowered to
+// the runtime_slice_* operations), or nil if there is no such method
+func sliceMethod(slice *Slice, methodName string) *Function {
+	var params []Type
+	var ret Type = TypeVoid
+	mutates := true
+
+	switch methodName {
+	case "push":
+		params = []Type{slice.Elem}
+	case "pop":
+		ret = &Optional{Elem: slice.Elem}
+	case "set", "insert":
+		params = []Type{TypeInt, slice.Elem}
+	case "remove", "reserve":
+		params = []Type{TypeInt}
+	case "clear":
+	case "len":
+		ret, mutates = TypeInt, false
+	case "copy", "to_owned":
+		ret, mutates = slice, false
+	case "subslice":
+		params, ret, mutates = []Type{TypeInt, TypeInt}, slice, false
+	default:
+		return nil
+	}
+
+	return &Function{
+		Receiver: &ReceiverType{IsMutable: mutates, Type: slice},
+		Params:   params,
+		Return:   ret,
+	}
+}
+
+// stringMethod returns the signature of a built-in string method (lowered to
+// the runtime_string_* search kernels), or nil if there is no such method
+func stringMethod(methodName string) *Function {
+	var ret Type
+	switch methodName {
+	case "find":
+		ret = TypeInt
+	case "contains":
+		ret = TypeBool
+	case "split":
+		ret = &Slice{Elem: TypeString}
+	default:
+		return nil
+	}
+
+	return &Function{
+		Receiver: &ReceiverType{Type: TypeString},
+		Params:   []Type{TypeString},
+		Return:   ret,
+	}
+}
+
 // checkFunctionLiteralWithType checks a function literal against an expected function type.
 // It infers parameter types from the expected type if they're not provided in the literal.
 func (c *Checker) checkFunctionLiteralWithType(fnLit *ast.FunctionLiteral, expectedType *Function, scope *Scope, inUnsafe bool) Type {
@@ -233,6 +233,9 @@ func (c *Checker) assignableTo(src, dst Type) bool {
 		if src == TypeNil {
 			return true
 		}
+		if srcOpt, ok := src.(*Optional); ok && c.assignableTo(srcOpt.Elem, dstOpt.Elem) {
+			return true
+		}
 		// Allow &T -> T? (Reference to Optional)
 		// Since T? is implemented as *T, passing a reference &T is valid
 		if srcRef, ok := src.(*Reference); ok {
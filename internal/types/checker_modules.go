@@ -169,6 +169,8 @@ func (c *Checker) processModDecl(modDecl *ast.ModDecl, currentFile *ast.File, pa
 				DefNode: d,
 			}
 			c.GlobalScope.Insert(d.Name.Name, symbol)
+			// Lowering reads the parameter types from here, as for the main file
+			c.ExprTypes[d] = symbol.Type
 			// Extract public symbols immediately
 			if d.Pub {
 				moduleInfo.Scope.Insert(d.Name.Name, symbol)
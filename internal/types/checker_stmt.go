@@ -477,6 +477,10 @@ func (c *Checker) checkStmt(stmt ast.Stmt, scope *Scope, inUnsafe bool) {
 			DefNode: s.Iterator,
 		})
 		c.checkBlock(s.Body, loopScope, inUnsafe)
+	case *ast.WithArenaStmt:
+		c.checkBlock(s.Body, scope, inUnsafe)
+	case *ast.SpawnScopeStmt:
+		c.checkBlock(s.Body, scope, inUnsafe)
 	case *ast.BreakStmt:
 		// Break is valid (no type checking needed)
 	case *ast.ContinueStmt:
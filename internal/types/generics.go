@@ -248,6 +248,10 @@ func unify(t1, t2 Type, subst map[string]Type) error {
 			}
 			return unify(t1.Value, t2.Value, subst)
 		}
+	case *Channel:
+		if t2, ok := t2.(*Channel); ok {
+			return unify(t1.Elem, t2.Elem, subst)
+		}
 	case *Pointer:
 		if t2, ok := t2.(*Pointer); ok {
 			return unify(t1.Elem, t2.Elem, subst)
@@ -0,0 +1,32 @@
+package types
+
+// PointerFree reports whether values of type t are represented without any
+// references to heap memory, so that memory holding only such values can be
+// allocated without being scanned by the garbage collector.
+//
+// Integers, floats and bools are pointer-free, as are fixed-size arrays of
+// them. Strings, slices, maps, channels, functions, pointers, optionals and
+// all aggregates (structs, enums and tuples are stored by reference) are not.
+// Unresolved and generic types are conservatively assumed to hold pointers.
+func PointerFree(t Type) bool {
+	switch t := t.(type) {
+	case *Primitive:
+		switch t.Kind {
+		case Int, Int8, Int32, Int64, U8, U16, U32, U64, U128, Usize, Float, Bool:
+			return true
+		}
+		return false
+	case *Array:
+		return PointerFree(t.Elem)
+	case *Named:
+		if t.Ref != nil {
+			return PointerFree(t.Ref)
+		}
+		switch t.Name {
+		case "int", "i8", "i32", "i64", "u8", "u16", "u32", "u64", "u128", "usize", "float", "f64", "bool":
+			return true
+		}
+		return false
+	}
+	return false
+}
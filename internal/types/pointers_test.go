@@ -0,0 +1,32 @@
+package types
+
+import "testing"
+
+func TestPointerFree(t *testing.T) {
+	tests := []struct {
+		typ  Type
+		want bool
+	}{
+		{TypeInt, true},
+		{TypeU8, true},
+		{TypeFloat, true},
+		{TypeBool, true},
+		{TypeString, false},
+		{TypeNil, false},
+		{&Array{Elem: TypeInt64, Len: 4}, true},
+		{&Array{Elem: TypeString, Len: 4}, false},
+		{&Slice{Elem: TypeInt}, false},
+		{&Named{Name: "float"}, true},
+		{&Named{Name: "Point"}, false},
+		{&Named{Name: "Id", Ref: TypeInt}, true},
+		{&Struct{Name: "Point", Fields: []Field{{Name: "x", Type: TypeInt}}}, false},
+		{&Pointer{Elem: TypeInt}, false},
+		{&Optional{Elem: TypeInt}, false},
+	}
+
+	for _, tt := range tests {
+		if got := PointerFree(tt.typ); got != tt.want {
+			t.Errorf("PointerFree(%s) = %v, want %v", tt.typ, got, tt.want)
+		}
+	}
+}
@@ -0,0 +1,96 @@
+package types
+
+import (
+	"strings"
+	"testing"
+
+	"github.com/malphas-lang/malphas-lang/internal/parser"
+)
+
+func TestSliceMethods(t *testing.T) {
+	tests := []struct {
+		name     string
+		input    string
+		hasError bool
+		errorMsg string
+	}{
+		{
+			name: "push and pop",
+			input: `
+			package main;
+			fn main() {
+				let mut xs: []int = []int{};
+				xs.push(1);
+				xs.set(0, 2);
+				let last: int? = xs.pop();
+				let n: int = xs.len();
+			}
+			`,
+			hasError: false,
+		},
+		{
+			name: "push wrong element type",
+			input: `
+			package main;
+			fn main() {
+				let mut xs: []int = []int{};
+				xs.push("one");
+			}
+			`,
+			hasError: true,
+			errorMsg: "argument 1 to method push",
+		},
+		{
+			name: "push on immutable slice",
+			input: `
+			package main;
+			fn main() {
+				let xs: []int = []int{};
+				xs.push(1);
+			}
+			`,
+			hasError: true,
+			errorMsg: "cannot call method requiring &mut on immutable value",
+		},
+		{
+			name: "unknown method",
+			input: `
+			package main;
+			fn main() {
+				let mut xs: []int = []int{};
+				xs.shuffle();
+			}
+			`,
+			hasError: true,
+			errorMsg: "shuffle",
+		},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			p := parser.New(tt.input)
+			file := p.ParseFile()
+			if len(p.Errors()) > 0 {
+				t.Fatalf("parse errors: %v", p.Errors())
+			}
+
+			checker := NewChecker()
+			checker.Check(file)
+
+			if tt.hasError {
+				found := false
+				for _, err := range checker.Errors {
+					if strings.Contains(err.Message, tt.errorMsg) {
+						found = true
+						break
+					}
+				}
+				if !found {
+					t.Errorf("expected error %q, got %v", tt.errorMsg, checker.Errors)
+				}
+			} else if len(checker.Errors) > 0 {
+				t.Errorf("unexpected errors: %v", checker.Errors)
+			}
+		})
+	}
+}
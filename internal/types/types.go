@@ -203,6 +203,7 @@ type Function struct {
 	Unsafe     bool
 	TypeParams []TypeParam
 	Params     []Type
+	Variadic   bool // the last parameter may be repeated any number of times (built-ins only)
 	Return     Type
 	Receiver   *ReceiverType // nil for free functions, non-nil for methods
 }
@@ -218,6 +219,9 @@ func (f *Function) String() string {
 	for _, p := range f.Params {
 		params = append(params, p.String())
 	}
+	if f.Variadic && len(params) > 0 {
+		params[len(params)-1] += "..."
+	}
 	ret := "void"
 	if f.Return != nil {
 		ret = f.Return.String()
@@ -7,10 +7,17 @@
 #define _XOPEN_SOURCE 600
 // _DARWIN_C_SOURCE is required on macOS for MAP_ANONYMOUS
 #define _DARWIN_C_SOURCE
+// _DEFAULT_SOURCE is required on glibc for MAP_ANONYMOUS
+#define _DEFAULT_SOURCE
 
 #include "runtime.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <gc/gc.h> // Boehm GC
+#include <limits.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,28 +27,63 @@
 // #include <ucontext.h>  // Removed: deprecated on macOS
 #include <signal.h>   // For stack overflow detection
 #include <sys/mman.h> // For mmap for stack allocation
+#include <netdb.h> // Network poller and TCP helpers
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <linux/futex.h> // Worker parking
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) ||     \
+    defined(__OpenBSD__)
+#include <sys/event.h>
+#endif
 
-// Simple hash map implementation (for now, using a basic approach)
+// Open-addressing hash map (Robin Hood hashing with backward-shift deletion).
+// Entries live in one flat array and cache the key's hash, so a probe compares
+// hashes first and only touches the key on a likely match. Capacity is always
+// a power of two and the table doubles once it passes the maximum load factor.
 #define HASHMAP_INITIAL_SIZE 16
+#define HASHMAP_MAX_LOAD_NUM 7 // Grow when size exceeds 7/8 of capacity
+#define HASHMAP_MAX_LOAD_DEN 8
 
 typedef struct HashMapEntry {
+  size_t hash; // Cached key hash (0 marks an empty slot)
   String *key;
   void *value;
-  struct HashMapEntry *next;
 } HashMapEntry;
 
 struct HashMap {
-  HashMapEntry **buckets;
+  HashMapEntry *entries;
   size_t size;
-  size_t capacity;
+  size_t capacity; // Always a power of two
+  Arena *arena;    // Arena the map was created in (NULL: none)
 };
 
 // Garbage collector initialization
 // This should be called once at program startup
-void runtime_gc_init(void) { GC_INIT(); }
+static void stats_gc_event(GC_EventType event);
+
+void runtime_gc_init(void) {
+  GC_INIT();
+  GC_set_on_collection_event(stats_gc_event); // Pause times (see runtime_stats)
+}
 
 // Memory allocation using Boehm GC
-void *runtime_alloc(size_t size) {
+//
+// Runtime-internal objects that must outlive any arena (the scheduler,
+// legions, channels, the intern table) are allocated with gc_alloc and
+// gc_alloc_atomic, straight from the GC. Everything else goes through
+// runtime_alloc and runtime_alloc_atomic, which serve the calling legion's
+// arena if it has one open, and small objects from a per-thread allocation
+// buffer otherwise. Growable objects (slices, string builders, maps) record
+// the arena they were created in, and their buffers always grow there (see
+// alloc_owned): an object from outside an arena must stay valid when it
+// grows inside one.
+
+static void *gc_alloc(size_t size) {
   void *ptr = GC_malloc(size);
   if (!ptr) {
     fprintf(stderr, "runtime_alloc: out of memory\n");
@@ -50,16 +92,509 @@ void *runtime_alloc(size_t size) {
   return ptr;
 }
 
+static void *gc_alloc_atomic(size_t size) {
+  void *ptr = GC_malloc_atomic(size);
+  if (!ptr) {
+    fprintf(stderr, "runtime_alloc_atomic: out of memory\n");
+    abort();
+  }
+  return ptr;
+}
+
+#define ALLOC_ALIGN 16
+
+static inline size_t alloc_round(size_t size) {
+  return (size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+}
+
+// Thread-local allocation buffers (TLABs): a small object is a pointer bump
+// in a buffer the thread allocated last, instead of a trip through
+// GC_malloc. A buffer is one GC object, which the GC keeps alive while any
+// object in it is reachable (it recognises interior pointers); the price is
+// that live objects also keep their dead neighbours alive until the whole
+// buffer is garbage. The first ALLOC_ALIGN bytes of a buffer are left unused
+// so that no object starts at the buffer's base (see alloc_resize).
+#define TLAB_SIZE 16384
+#define TLAB_MAX_OBJECT 256 // Larger objects come from the GC directly
+
+typedef struct Tlab {
+  char *cur; // Scanned buffer (zeroed by the GC)
+  char *end;
+  char *atomic_cur; // Pointer-free buffer
+  char *atomic_end;
+  // Every runtime_alloc and runtime_alloc_atomic on this thread, whatever
+  // served it (written by the owning thread only, read by runtime_stats)
+  atomic_uint_fast64_t allocs;
+  atomic_uint_fast64_t alloc_bytes;
+  struct Tlab *next; // All Tlabs ever created, for runtime_stats
+} Tlab;
+
+// The Tlab itself is an uncollectable GC object, so the GC sees the buffers
+// it points into even though it does not scan thread-local storage
+static __thread Tlab *t_tlab = NULL;
+static Tlab *_Atomic g_tlabs = NULL;
+
+// Arenas: a legion's allocations come from its innermost open arena, whose
+// chunks are all freed at once when it ends. Chunks of scanned memory are
+// uncollectable GC objects (so the GC still sees pointers from them into its
+// heap); pointer-free chunks are plain malloc memory.
+#define ARENA_CHUNK_SIZE 65536
+#define ARENA_MAX_OBJECT (ARENA_CHUNK_SIZE / 4) // Larger objects get a chunk
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  char pad[ALLOC_ALIGN - sizeof(struct ArenaChunk *)];
+} ArenaChunk;
+
+struct Arena {
+  char *cur; // Scanned chunk being filled
+  char *end;
+  ArenaChunk *chunks;
+  char *atomic_cur; // Pointer-free chunk being filled
+  char *atomic_end;
+  ArenaChunk *atomic_chunks;
+  Arena *parent; // Arena that was open when this one began
+};
+
+// Innermost arena of the legion running on this thread. The scheduler saves
+// and restores it around every legion switch, so it follows the legion.
+static __thread Arena *t_arena = NULL;
+
+static __attribute__((noinline)) Tlab *tlab_new(void) {
+  Tlab *tlab = (Tlab *)GC_malloc_uncollectable(sizeof(Tlab));
+  if (!tlab) {
+    fprintf(stderr, "runtime_alloc: out of memory\n");
+    abort();
+  }
+  tlab->next = atomic_load(&g_tlabs);
+  while (!atomic_compare_exchange_weak(&g_tlabs, &tlab->next, tlab)) {
+  }
+  t_tlab = tlab;
+  return tlab;
+}
+
+// Count an allocation. Only the owning thread writes the counters, so a
+// relaxed load and store is enough (and as cheap as a plain increment).
+static inline void tlab_count(Tlab *tlab, size_t size) {
+  atomic_store_explicit(
+      &tlab->allocs,
+      atomic_load_explicit(&tlab->allocs, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+  atomic_store_explicit(
+      &tlab->alloc_bytes,
+      atomic_load_explicit(&tlab->alloc_bytes, memory_order_relaxed) + size,
+      memory_order_relaxed);
+}
+
+static void *tlab_refill(Tlab *tlab, int atomic, size_t size) {
+  char *buf = atomic ? (char *)gc_alloc_atomic(TLAB_SIZE)
+                     : (char *)gc_alloc(TLAB_SIZE);
+  char *obj = buf + ALLOC_ALIGN;
+  if (atomic) {
+    tlab->atomic_cur = obj + size;
+    tlab->atomic_end = buf + TLAB_SIZE;
+  } else {
+    tlab->cur = obj + size;
+    tlab->end = buf + TLAB_SIZE;
+  }
+  return obj;
+}
+
+static ArenaChunk *arena_chunk_new(size_t size, int atomic) {
+  ArenaChunk *chunk = atomic ? (ArenaChunk *)malloc(size)
+                             : (ArenaChunk *)GC_malloc_uncollectable(size);
+  if (!chunk) {
+    fprintf(stderr, "runtime_arena: out of memory\n");
+    abort();
+  }
+  return chunk;
+}
+
+static void *arena_alloc(Arena *arena, size_t size, int atomic) {
+  char **cur = atomic ? &arena->atomic_cur : &arena->cur;
+  char **end = atomic ? &arena->atomic_end : &arena->end;
+  ArenaChunk **chunks = atomic ? &arena->atomic_chunks : &arena->chunks;
+
+  if ((size_t)(*end - *cur) >= size) {
+    void *ptr = *cur;
+    *cur += size;
+    return ptr;
+  }
+
+  ArenaChunk *chunk;
+  if (size > ARENA_MAX_OBJECT) {
+    // A chunk of its own, leaving the current one to be filled
+    chunk = arena_chunk_new(sizeof(ArenaChunk) + size, atomic);
+    chunk->next = *chunks;
+    *chunks = chunk;
+    return chunk + 1;
+  }
+  chunk = arena_chunk_new(ARENA_CHUNK_SIZE, atomic);
+  chunk->next = *chunks;
+  *chunks = chunk;
+  *cur = (char *)(chunk + 1) + size;
+  *end = (char *)chunk + ARENA_CHUNK_SIZE;
+  return chunk + 1;
+}
+
+// runtime_alloc and runtime_alloc_atomic must not be inlined: a legion can
+// move to another thread between two calls, and an inlined copy could keep
+// using the thread-local state of the thread it started on.
+__attribute__((noinline)) void *runtime_alloc(size_t size) {
+  size = alloc_round(size ? size : 1);
+  Tlab *tlab = t_tlab;
+  if (!tlab) {
+    tlab = tlab_new();
+  }
+  tlab_count(tlab, size);
+  Arena *arena = t_arena;
+  if (arena) {
+    return arena_alloc(arena, size, 0); // Uncollectable chunks come zeroed
+  }
+  if (size > TLAB_MAX_OBJECT) {
+    return gc_alloc(size);
+  }
+  if ((size_t)(tlab->end - tlab->cur) >= size) {
+    void *ptr = tlab->cur;
+    tlab->cur += size;
+    return ptr;
+  }
+  return tlab_refill(tlab, 0, size);
+}
+
+// Allocation of memory that will never hold pointers (byte buffers, numeric
+// elements): the GC neither scans it nor zeroes it
+__attribute__((noinline)) void *runtime_alloc_atomic(size_t size) {
+  size = alloc_round(size ? size : 1);
+  Tlab *tlab = t_tlab;
+  if (!tlab) {
+    tlab = tlab_new();
+  }
+  tlab_count(tlab, size);
+  Arena *arena = t_arena;
+  if (arena) {
+    return arena_alloc(arena, size, 1);
+  }
+  if (size > TLAB_MAX_OBJECT) {
+    return gc_alloc_atomic(size);
+  }
+  if ((size_t)(tlab->atomic_end - tlab->atomic_cur) >= size) {
+    void *ptr = tlab->atomic_cur;
+    tlab->atomic_cur += size;
+    return ptr;
+  }
+  return tlab_refill(tlab, 1, size);
+}
+
+// Allocate memory that holds pointers only if pointer_free is 0
+static inline void *alloc_maybe_atomic(size_t size, int pointer_free) {
+  return pointer_free ? runtime_alloc_atomic(size) : runtime_alloc(size);
+}
+
+// Allocate a buffer for an object created in `arena` (NULL if it was created
+// outside any arena), whichever arena the calling legion has open now. The
+// object may be from an enclosing scope, so its buffers must not come from an
+// arena that ends before it does.
+static void *alloc_owned(Arena *arena, size_t size, int pointer_free) {
+  Arena *current = t_arena;
+  if (arena == current) {
+    return alloc_maybe_atomic(size, pointer_free);
+  }
+  t_arena = arena;
+  void *ptr = alloc_maybe_atomic(size, pointer_free);
+  t_arena = current;
+  return ptr;
+}
+
+// Resize a buffer from alloc_owned. Only a buffer that is a GC object of its
+// own can be resized in place (GC_realloc also keeps its kind); one carved
+// out of a TLAB or an arena is copied, and the old copy is left to the GC or
+// the arena.
+static void *alloc_resize(Arena *arena, void *old, size_t old_size,
+                          size_t new_size, int pointer_free) {
+  if (GC_base(old) == old) {
+    void *ptr = GC_realloc(old, new_size);
+    if (!ptr) {
+      fprintf(stderr, "runtime_alloc: out of memory\n");
+      abort();
+    }
+    return ptr;
+  }
+  void *ptr = alloc_owned(arena, new_size, pointer_free);
+  memcpy(ptr, old, old_size < new_size ? old_size : new_size);
+  return ptr;
+}
+
+Arena *runtime_arena_begin(void) {
+  Arena *arena = (Arena *)malloc(sizeof(Arena));
+  if (!arena) {
+    fprintf(stderr, "runtime_arena_begin: out of memory\n");
+    abort();
+  }
+  memset(arena, 0, sizeof(Arena));
+  arena->parent = t_arena;
+  t_arena = arena;
+  return arena;
+}
+
+void runtime_arena_end(Arena *arena) {
+  if (!arena) {
+    return;
+  }
+  if (t_arena != arena) {
+    fprintf(stderr, "runtime_arena_end: arena is not the innermost one\n");
+    abort();
+  }
+  t_arena = arena->parent;
+  for (ArenaChunk *chunk = arena->chunks; chunk;) {
+    ArenaChunk *next = chunk->next;
+    GC_free(chunk);
+    chunk = next;
+  }
+  for (ArenaChunk *chunk = arena->atomic_chunks; chunk;) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(arena);
+}
+
+// ============================================================================
+// String kernels
+// ============================================================================
+// Byte search, substring search and hashing for strings. The searches compare
+// 16 bytes at a time (32 with AVX2) with SSE2, which every x86-64 has, or with
+// NEON on AArch64, and fall back to libc elsewhere. Vector loads never read
+// past the end of the bytes searched; the last partial block is done a byte
+// at a time.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define STRING_SIMD 1
+#define SIMD_WIDTH 32
+typedef __m256i simd_bytes;
+static inline simd_bytes simd_load(const char *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+static inline simd_bytes simd_splat(char c) { return _mm256_set1_epi8(c); }
+// One bit per byte where a and b are equal, SIMD_MASK_SHIFT bits apart
+static inline uint64_t simd_eq(simd_bytes a, simd_bytes b) {
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+#define SIMD_MASK_SHIFT 0
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define STRING_SIMD 1
+#define SIMD_WIDTH 16
+typedef __m128i simd_bytes;
+static inline simd_bytes simd_load(const char *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+static inline simd_bytes simd_splat(char c) { return _mm_set1_epi8(c); }
+static inline uint64_t simd_eq(simd_bytes a, simd_bytes b) {
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+#define SIMD_MASK_SHIFT 0
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define STRING_SIMD 1
+#define SIMD_WIDTH 16
+typedef uint8x16_t simd_bytes;
+static inline simd_bytes simd_load(const char *p) {
+  return vld1q_u8((const uint8_t *)p);
+}
+static inline simd_bytes simd_splat(char c) { return vdupq_n_u8((uint8_t)c); }
+// NEON has no movemask: narrowing the comparison leaves a nibble per byte,
+// of which one bit is kept
+static inline uint64_t simd_eq(simd_bytes a, simd_bytes b) {
+  uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(vceqq_u8(a, b)), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+         0x8888888888888888ull;
+}
+#define SIMD_MASK_SHIFT 2
+#endif
+
+#if STRING_SIMD
+// Index of the byte a simd_eq bit stands for
+static inline size_t simd_mask_index(uint64_t mask) {
+  return (size_t)__builtin_ctzll(mask) >> SIMD_MASK_SHIFT;
+}
+#endif
+
+// Index of the first c in p[0, n), or -1
+static int64_t string_find_byte(const char *p, size_t n, char c) {
+#if STRING_SIMD
+  size_t i = 0;
+  simd_bytes needle = simd_splat(c);
+  for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+    uint64_t mask = simd_eq(simd_load(p + i), needle);
+    if (mask)
+      return (int64_t)(i + simd_mask_index(mask));
+  }
+  for (; i < n; i++) {
+    if (p[i] == c)
+      return (int64_t)i;
+  }
+  return -1;
+#else
+  const char *found = n ? memchr(p, c, n) : NULL;
+  return found ? (int64_t)(found - p) : -1;
+#endif
+}
+
+// Index of the first occurrence of needle[0, m) in p[0, n), or -1 (0 for an
+// empty needle). Blocks of candidate positions are filtered by comparing both
+// the first and the last byte of the needle at once, so memcmp only runs
+// where both match; with real text that is rarely more than the matches.
+static int64_t string_find(const char *p, size_t n, const char *needle,
+                           size_t m) {
+  if (m == 0)
+    return 0;
+  if (m > n)
+    return -1;
+  if (m == 1)
+    return string_find_byte(p, n, needle[0]);
+
+  size_t i = 0;
+#if STRING_SIMD
+  simd_bytes first = simd_splat(needle[0]);
+  simd_bytes last = simd_splat(needle[m - 1]);
+  for (; i + m - 1 + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+    uint64_t mask = simd_eq(simd_load(p + i), first) &
+                    simd_eq(simd_load(p + i + m - 1), last);
+    while (mask) {
+      size_t at = i + simd_mask_index(mask);
+      if (memcmp(p + at + 1, needle + 1, m - 2) == 0)
+        return (int64_t)at;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i + m <= n; i++) {
+    int64_t at = string_find_byte(p + i, n - m + 1 - i, needle[0]);
+    if (at < 0)
+      return -1;
+    i += (size_t)at;
+    if (memcmp(p + i + 1, needle + 1, m - 1) == 0)
+      return (int64_t)i;
+  }
+  return -1;
+}
+
+// wyhash (final version 4, public domain): a multiply-mix hash that consumes
+// 8 bytes per step, or 48 on long strings, instead of one
+static const uint64_t wyhash_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+    0x589965cc75374cc3ull};
+
+// The 128-bit product of a and b, as its low and high halves
+static inline void wyhash_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t lo = t + (rm1 << 32);
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+  *a = lo;
+  *b = hi;
+#endif
+}
+
+static inline uint64_t wyhash_mix(uint64_t a, uint64_t b) {
+  wyhash_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t wyhash_read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t wyhash_read4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint64_t wyhash(const void *key, size_t len, uint64_t seed) {
+  const uint8_t *p = (const uint8_t *)key;
+  const uint64_t *s = wyhash_secret;
+  uint64_t a, b;
+  seed ^= wyhash_mix(seed ^ s[0], s[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t off = (len >> 3) << 2;
+      a = (wyhash_read4(p) << 32) | wyhash_read4(p + off);
+      b = (wyhash_read4(p + len - 4) << 32) | wyhash_read4(p + len - 4 - off);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wyhash_mix(wyhash_read8(p) ^ s[1], wyhash_read8(p + 8) ^ seed);
+        see1 = wyhash_mix(wyhash_read8(p + 16) ^ s[2],
+                          wyhash_read8(p + 24) ^ see1);
+        see2 = wyhash_mix(wyhash_read8(p + 32) ^ s[3],
+                          wyhash_read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wyhash_mix(wyhash_read8(p) ^ s[1], wyhash_read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyhash_read8(p + i - 16);
+    b = wyhash_read8(p + i - 8);
+  }
+  a ^= s[1];
+  b ^= seed;
+  wyhash_mum(&a, &b);
+  return wyhash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
 // String operations
-String *runtime_string_new(const char *data, size_t len) {
-  String *s = (String *)runtime_alloc(sizeof(String));
+
+// Strings are immutable once built, so they may be shared freely: static
+// constants (the compiler emits literals the same way) and the operands of a
+// concatenation with an empty string are returned as they are.
+static String g_string_empty = {0, (char *)""};
+static String g_string_true = {4, (char *)"true"};
+static String g_string_false = {5, (char *)"false"};
+
+// Allocate a string of len bytes (plus terminator) with its bytes stored
+// inline after the header, so a string costs one allocation instead of two.
+// The only pointer in it is data, which points into the same object, so the
+// GC need not scan it.
+static String *string_alloc(size_t len) {
+  String *s = (String *)runtime_alloc_atomic(sizeof(String) + len + 1);
   s->len = len;
-  s->data = (char *)runtime_alloc(len + 1);
-  memcpy(s->data, data, len);
+  s->data = (char *)(s + 1);
   s->data[len] = '\0';
   return s;
 }
 
+String *runtime_string_new(const char *data, size_t len) {
+  if (len == 0) {
+    return &g_string_empty;
+  }
+  String *s = string_alloc(len);
+  memcpy(s->data, data, len);
+  return s;
+}
+
 void runtime_string_free(String *s) {
   // With GC, we don't need to manually free memory
   // This function is kept for API compatibility but does nothing
@@ -72,57 +607,270 @@ const char *runtime_string_cstr(String *s) { return s ? s->data : ""; }
 
 // String concatenation
 String *runtime_string_concat(String *a, String *b) {
-  if (!a && !b) {
-    return runtime_string_new("", 0);
-  }
-  if (!a) {
-    return runtime_string_new(b->data, b->len);
+  if (!a || a->len == 0) {
+    return b ? b : &g_string_empty;
   }
-  if (!b) {
-    return runtime_string_new(a->data, a->len);
+  if (!b || b->len == 0) {
+    return a;
   }
 
-  size_t total_len = a->len + b->len;
-  String *result = (String *)runtime_alloc(sizeof(String));
-  result->len = total_len;
-  result->data = (char *)runtime_alloc(total_len + 1);
-
+  String *result = string_alloc(a->len + b->len);
   memcpy(result->data, a->data, a->len);
   memcpy(result->data + a->len, b->data, b->len);
-  result->data[total_len] = '\0';
-
   return result;
 }
 
+// Format value in decimal into the end of buf, returning where it starts
+static char *format_i64(int64_t value, char *end) {
+  static const char digits[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+  // Negate as unsigned so INT64_MIN works
+  uint64_t n = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  char *p = end;
+  while (n >= 100) {
+    unsigned i = (unsigned)(n % 100) * 2;
+    n /= 100;
+    *--p = digits[i + 1];
+    *--p = digits[i];
+  }
+  if (n >= 10) {
+    unsigned i = (unsigned)n * 2;
+    *--p = digits[i + 1];
+    *--p = digits[i];
+  } else {
+    *--p = (char)('0' + n);
+  }
+  if (value < 0) {
+    *--p = '-';
+  }
+  return p;
+}
+
+// Longest output of format_double
+#define FORMAT_DOUBLE_MAX 40
+
+// Format value as %g into buf, returning the length
+static size_t format_double(double value, char *buf) {
+  // Integral values print the same under %g as in decimal, up to 6 digits
+  if (value > -1e6 && value < 1e6 && value == (double)(int64_t)value &&
+      !(value == 0 && signbit(value))) {
+    char *end = buf + FORMAT_DOUBLE_MAX;
+    char *start = format_i64((int64_t)value, end);
+    size_t len = (size_t)(end - start);
+    memmove(buf, start, len);
+    return len;
+  }
+  int len = snprintf(buf, FORMAT_DOUBLE_MAX, "%g", value);
+  return len < 0 ? 0 : (size_t)len;
+}
+
 // Convert integer to string
 String *runtime_string_from_i64(int64_t value) {
-  char buffer[32];
-  int len = snprintf(buffer, sizeof(buffer), "%lld", (long long)value);
-  if (len < 0)
-    len = 0;
-  if (len >= (int)sizeof(buffer))
-    len = sizeof(buffer) - 1;
-  return runtime_string_new(buffer, len);
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *start = format_i64(value, end);
+  return runtime_string_new(start, (size_t)(end - start));
 }
 
 // Convert double to string
 String *runtime_string_from_double(double value) {
-  char buffer[64];
-  int len = snprintf(buffer, sizeof(buffer), "%g", value);
-  if (len < 0)
-    len = 0;
-  if (len >= (int)sizeof(buffer))
-    len = sizeof(buffer) - 1;
-  return runtime_string_new(buffer, len);
+  char buffer[FORMAT_DOUBLE_MAX];
+  return runtime_string_new(buffer, format_double(value, buffer));
 }
 
 // Convert bool to string
 String *runtime_string_from_bool(int8_t value) {
+  return value ? &g_string_true : &g_string_false;
+}
+
+// StringBuilder: a growable buffer for building a string piece by piece.
+// Appends are amortised O(1), and finishing hands the buffer to the new
+// String without copying it.
+struct StringBuilder {
+  char *data; // cap bytes plus room for the terminator
+  size_t len;
+  size_t cap;
+  Arena *arena; // Arena the builder was created in (NULL: none)
+};
+
+StringBuilder *runtime_string_builder_new(int64_t capacity) {
+  StringBuilder *sb = (StringBuilder *)runtime_alloc(sizeof(StringBuilder));
+  sb->arena = t_arena;
+  sb->cap = capacity > 0 ? (size_t)capacity : 0;
+  sb->data = sb->cap ? (char *)runtime_alloc_atomic(sb->cap + 1) : NULL;
+  sb->len = 0;
+  return sb;
+}
+
+// Make room for `extra` more bytes
+static void string_builder_reserve(StringBuilder *sb, size_t extra) {
+  if (sb->len + extra <= sb->cap) {
+    return;
+  }
+  size_t cap = sb->cap ? sb->cap * 2 : 32;
+  if (cap < sb->len + extra) {
+    cap = sb->len + extra;
+  }
+  if (!sb->data) {
+    sb->data = (char *)alloc_owned(sb->arena, cap + 1, 1);
+  } else {
+    sb->data =
+        (char *)alloc_resize(sb->arena, sb->data, sb->cap + 1, cap + 1, 1);
+  }
+  sb->cap = cap;
+}
+
+static void string_builder_append_bytes(StringBuilder *sb, const char *data,
+                                        size_t len) {
+  string_builder_reserve(sb, len);
+  memcpy(sb->data + sb->len, data, len);
+  sb->len += len;
+}
+
+void runtime_string_builder_append(StringBuilder *sb, String *s) {
+  if (s) {
+    string_builder_append_bytes(sb, s->data, s->len);
+  }
+}
+
+void runtime_string_builder_append_i64(StringBuilder *sb, int64_t value) {
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *start = format_i64(value, end);
+  string_builder_append_bytes(sb, start, (size_t)(end - start));
+}
+
+void runtime_string_builder_append_double(StringBuilder *sb, double value) {
+  char buffer[FORMAT_DOUBLE_MAX];
+  string_builder_append_bytes(sb, buffer, format_double(value, buffer));
+}
+
+void runtime_string_builder_append_bool(StringBuilder *sb, int8_t value) {
   if (value) {
-    return runtime_string_new("true", 4);
+    string_builder_append_bytes(sb, "true", 4);
   } else {
-    return runtime_string_new("false", 5);
+    string_builder_append_bytes(sb, "false", 5);
+  }
+}
+
+int64_t runtime_string_builder_len(StringBuilder *sb) {
+  return (int64_t)sb->len;
+}
+
+// Results up to this length are copied out of the builder by finish
+#define STRING_BUILDER_COPY_MAX 64
+
+// Turn the contents into a String and leave the builder empty
+String *runtime_string_builder_finish(StringBuilder *sb) {
+  if (sb->len == 0) {
+    return &g_string_empty;
+  }
+  // Short results are copied inline (one small allocation, and the builder
+  // keeps its buffer); long ones take the buffer over without copying
+  if (sb->len <= STRING_BUILDER_COPY_MAX) {
+    String *s = runtime_string_new(sb->data, sb->len);
+    sb->len = 0;
+    return s;
+  }
+  String *s = (String *)runtime_alloc(sizeof(String));
+  sb->data[sb->len] = '\0';
+  s->data = sb->data;
+  s->len = sb->len;
+  sb->data = NULL;
+  sb->len = sb->cap = 0;
+  return s;
+}
+
+int64_t runtime_string_find(String *s, String *sub) {
+  if (!s || !sub)
+    return -1;
+  return string_find(s->data, s->len, sub->data, sub->len);
+}
+
+int8_t runtime_string_contains(String *s, String *sub) {
+  return runtime_string_find(s, sub) >= 0;
+}
+
+Slice *runtime_string_split(String *s, String *sep) {
+  Slice *parts = runtime_slice_new(sizeof(String *), 0, 4, 0);
+  if (!s)
+    return parts;
+  if (!sep || sep->len == 0) {
+    runtime_slice_push(parts, &s);
+    return parts;
+  }
+  size_t start = 0;
+  for (;;) {
+    int64_t at =
+        string_find(s->data + start, s->len - start, sep->data, sep->len);
+    size_t end = at < 0 ? s->len : start + (size_t)at;
+    String *part = runtime_string_new(s->data + start, end - start);
+    runtime_slice_push(parts, &part);
+    if (at < 0)
+      return parts;
+    start = end + sep->len;
+  }
+}
+
+// String formatting with {} placeholders, taking nargs arguments each
+// preceded by its FORMAT_ARG_* kind (integers and bools as int64_t). Each {}
+// is replaced by the next argument; placeholders beyond the last argument
+// are dropped.
+String *runtime_string_formatv(String *fmt, int64_t nargs, ...) {
+  if (!fmt || !fmt->data) {
+    return runtime_string_new("", 0);
+  }
+
+  StringBuilder sb = {.arena = t_arena};
+  string_builder_reserve(&sb, fmt->len + (size_t)(nargs > 0 ? nargs : 0) * 8);
+
+  va_list ap;
+  va_start(ap, nargs);
+  int64_t used = 0;
+  size_t start = 0;
+  // Jump from one '{' to the next rather than testing every byte
+  for (size_t i = 0; i + 1 < fmt->len; i++) {
+    int64_t brace = string_find_byte(fmt->data + i, fmt->len - 1 - i, '{');
+    if (brace < 0) {
+      break;
+    }
+    i += (size_t)brace;
+    if (fmt->data[i + 1] != '}') {
+      continue;
+    }
+    string_builder_append_bytes(&sb, fmt->data + start, i - start);
+    start = i + 2;
+    i++; // Skip the '}'
+    if (used >= nargs) {
+      continue;
+    }
+    used++;
+    switch (va_arg(ap, int)) {
+    case FORMAT_ARG_I64:
+      runtime_string_builder_append_i64(&sb, va_arg(ap, int64_t));
+      break;
+    case FORMAT_ARG_F64:
+      runtime_string_builder_append_double(&sb, va_arg(ap, double));
+      break;
+    case FORMAT_ARG_BOOL:
+      runtime_string_builder_append_bool(&sb, va_arg(ap, int64_t) != 0);
+      break;
+    default:
+      runtime_string_builder_append(&sb, va_arg(ap, String *));
+      break;
+    }
   }
+  va_end(ap);
+  string_builder_append_bytes(&sb, fmt->data + start, fmt->len - start);
+  return runtime_string_builder_finish(&sb);
 }
 
 // String formatting with {} placeholders
@@ -130,92 +878,291 @@ String *runtime_string_from_bool(int8_t value) {
 // Replaces {} with arguments in order
 String *runtime_string_format(String *fmt, String *arg1, String *arg2,
                               String *arg3, String *arg4) {
-  if (!fmt || !fmt->data) {
-    return runtime_string_new("", 0);
+  return runtime_string_formatv(fmt, 4, FORMAT_ARG_STRING, arg1,
+                                FORMAT_ARG_STRING, arg2, FORMAT_ARG_STRING,
+                                arg3, FORMAT_ARG_STRING, arg4);
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+// runtime_println_* format by hand and append to a buffer instead of going
+// through printf and stdio's lock: each worker thread has a buffer of its own,
+// so legions logging at once do not contend, and other threads share one.
+// Buffers are written out when full, when a worker runs out of work, on
+// runtime_stdout_flush, at scheduler shutdown and at exit. Output is also
+// kept in causal order: a thread writes out its buffer before it spawns a
+// legion or wakes one (or another thread) up, which covers joins, wait groups
+// and channel handoffs; a legion's output is written out when it parks or
+// completes; and a thread without a buffer of its own, such as main's, writes
+// out the workers' buffers before it prints. A legion resuming on another
+// worker first flushes the buffer it left output in, so each legion's lines
+// stay in order; only lines from legions running concurrently can come out in
+// a different order from the one they were printed in. When stdout is a
+// terminal (or MALPHAS_STDOUT=unbuffered) every line is written immediately
+// instead; MALPHAS_STDOUT=buffered forces buffering.
+
+#define OUTPUT_BUFFER_SIZE 8192
+#define OUTPUT_MODE_UNSET 0
+#define OUTPUT_MODE_BUFFERED 1
+#define OUTPUT_MODE_UNBUFFERED 2
+
+typedef struct OutputBuffer {
+  pthread_mutex_t mutex; // Taken by the owner too, so any thread may flush
+  char *data;            // OUTPUT_BUFFER_SIZE bytes, allocated on first use
+  atomic_size_t len;     // Peeked at without the lock
+  int registered;        // Linked into the registry
+  struct OutputBuffer *next;
+} OutputBuffer;
+
+static atomic_int g_output_mode = OUTPUT_MODE_UNSET;
+static OutputBuffer g_output_shared = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0,
+                                       NULL};
+static __thread OutputBuffer *t_output = NULL; // This worker's buffer
+static pthread_mutex_t g_output_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static OutputBuffer *g_output_registry = NULL; // Buffers flushed at exit
+
+static void output_write_fd(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    data += n;
+    len -= (size_t)n;
   }
+}
 
-  String *args[] = {arg1, arg2, arg3, arg4};
+static void output_buffer_init(OutputBuffer *buf) {
+  pthread_mutex_init(&buf->mutex, NULL);
+  buf->data = NULL;
+  atomic_init(&buf->len, 0);
+  buf->registered = 0;
+  buf->next = NULL;
+}
 
-  // Estimate result size (format string + all arguments)
-  size_t result_size = fmt->len;
-  int placeholder_count = 0;
-  for (size_t i = 0; i < fmt->len; i++) {
-    if (fmt->data[i] == '{' && i + 1 < fmt->len && fmt->data[i + 1] == '}') {
-      placeholder_count++;
-      if (placeholder_count <= 4 && args[placeholder_count - 1]) {
-        result_size += args[placeholder_count - 1]->len;
-      }
-      result_size -= 2; // Remove {} from size
-      i++;              // Skip the '}'
+static void output_register(OutputBuffer *buf) {
+  pthread_mutex_lock(&g_output_registry_mutex);
+  if (!buf->registered) {
+    buf->registered = 1;
+    buf->next = g_output_registry;
+    g_output_registry = buf;
+  }
+  pthread_mutex_unlock(&g_output_registry_mutex);
+}
+
+static void output_flush_locked(OutputBuffer *buf) {
+  size_t len = atomic_load_explicit(&buf->len, memory_order_relaxed);
+  if (len > 0) {
+    output_write_fd(buf->data, len);
+    atomic_store_explicit(&buf->len, 0, memory_order_relaxed);
+  }
+}
+
+static void output_flush(OutputBuffer *buf) {
+  if (atomic_load_explicit(&buf->len, memory_order_relaxed) == 0) {
+    return;
+  }
+  pthread_mutex_lock(&buf->mutex);
+  output_flush_locked(buf);
+  pthread_mutex_unlock(&buf->mutex);
+}
+
+// Flush every buffer but `skip`
+static void output_flush_all_but(OutputBuffer *skip) {
+  pthread_mutex_lock(&g_output_registry_mutex);
+  for (OutputBuffer *buf = g_output_registry; buf; buf = buf->next) {
+    if (buf != skip) {
+      output_flush(buf);
     }
   }
+  pthread_mutex_unlock(&g_output_registry_mutex);
+}
 
-  // Allocate result buffer
-  char *result_buf = (char *)runtime_alloc(result_size + 1);
-  size_t result_pos = 0;
-  int current_arg = 0;
+// Flush every buffer
+void runtime_stdout_flush(void) { output_flush_all_but(NULL); }
 
-  // Process format string
-  for (size_t i = 0; i < fmt->len; i++) {
-    if (fmt->data[i] == '{' && i + 1 < fmt->len && fmt->data[i + 1] == '}') {
-      // Replace {} with argument
-      if (current_arg < 4 && args[current_arg]) {
-        String *arg = args[current_arg];
-        memcpy(result_buf + result_pos, arg->data, arg->len);
-        result_pos += arg->len;
-      }
-      current_arg++;
-      i++; // Skip the '}'
+// Flush what the calling thread has printed, before it lets something that
+// may print after it run
+static void output_flush_own(void) {
+  output_flush(t_output ? t_output : &g_output_shared);
+}
+
+static int output_mode(void) {
+  int mode = atomic_load_explicit(&g_output_mode, memory_order_relaxed);
+  if (mode != OUTPUT_MODE_UNSET) {
+    return mode;
+  }
+  const char *env = getenv("MALPHAS_STDOUT");
+  if (env && strcmp(env, "unbuffered") == 0) {
+    mode = OUTPUT_MODE_UNBUFFERED;
+  } else if (env && strcmp(env, "buffered") == 0) {
+    mode = OUTPUT_MODE_BUFFERED;
+  } else {
+    mode = isatty(STDOUT_FILENO) ? OUTPUT_MODE_UNBUFFERED
+                                 : OUTPUT_MODE_BUFFERED;
+  }
+  int expected = OUTPUT_MODE_UNSET;
+  if (!atomic_compare_exchange_strong(&g_output_mode, &expected, mode)) {
+    return expected;
+  }
+  if (mode == OUTPUT_MODE_BUFFERED) {
+    output_register(&g_output_shared);
+    atexit(runtime_stdout_flush);
+  }
+  return mode;
+}
+
+// Write `text` followed by `tail` (the line's newline) as one unit
+static void output_write(const char *text, size_t len, const char *tail,
+                         size_t tail_len) {
+  size_t total = len + tail_len;
+  if (output_mode() == OUTPUT_MODE_UNBUFFERED) {
+    char line[512];
+    if (total <= sizeof(line)) {
+      memcpy(line, text, len);
+      memcpy(line + len, tail, tail_len);
+      output_write_fd(line, total);
     } else {
-      result_buf[result_pos++] = fmt->data[i];
+      output_write_fd(text, len);
+      output_write_fd(tail, tail_len);
     }
+    return;
   }
 
-  result_buf[result_pos] = '\0';
-  String *result = (String *)runtime_alloc(sizeof(String));
-  result->len = result_pos;
-  result->data = result_buf;
-
-  return result;
+  OutputBuffer *buf = t_output;
+  if (!buf) {
+    // Whatever the legions printed before this thread went on to print
+    // comes first
+    buf = &g_output_shared;
+    output_flush_all_but(buf);
+  }
+  pthread_mutex_lock(&buf->mutex);
+  if (!buf->data) {
+    buf->data = (char *)malloc(OUTPUT_BUFFER_SIZE);
+  }
+  size_t used = atomic_load_explicit(&buf->len, memory_order_relaxed);
+  if (!buf->data || used + total > OUTPUT_BUFFER_SIZE) {
+    output_flush_locked(buf);
+    used = 0;
+  }
+  if (!buf->data || total > OUTPUT_BUFFER_SIZE) {
+    output_write_fd(text, len);
+    output_write_fd(tail, tail_len);
+  } else {
+    memcpy(buf->data + used, text, len);
+    memcpy(buf->data + used + len, tail, tail_len);
+    atomic_store_explicit(&buf->len, used + total, memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&buf->mutex);
 }
 
 // Print functions
-void runtime_println_i64(int64_t value) { printf("%lld\n", value); }
+void runtime_println_i64(int64_t value) {
+  char buf[24];
+  char *end = buf + sizeof(buf) - 1;
+  *end = '\n';
+  char *start = format_i64(value, end);
+  output_write(start, (size_t)(end + 1 - start), "", 0);
+}
 
-void runtime_println_i32(int32_t value) { printf("%d\n", value); }
+void runtime_println_i32(int32_t value) { runtime_println_i64(value); }
 
-void runtime_println_i8(int8_t value) { printf("%d\n", value); }
+void runtime_println_i8(int8_t value) { runtime_println_i64(value); }
 
-void runtime_println_double(double value) { printf("%g\n", value); }
+void runtime_println_double(double value) {
+  char buf[FORMAT_DOUBLE_MAX];
+  output_write(buf, format_double(value, buf), "\n", 1);
+}
 
 void runtime_println_bool(int8_t value) {
-  printf("%s\n", value ? "true" : "false");
+  if (value) {
+    output_write("true\n", 5, "", 0);
+  } else {
+    output_write("false\n", 6, "", 0);
+  }
 }
 
 void runtime_println_string(String *s) {
   if (s && s->data) {
-    printf("%s\n", s->data);
+    output_write(s->data, s->len, "\n", 1);
   } else {
-    printf("(null)\n");
+    output_write("(null)\n", 7, "", 0);
   }
 }
 
 // Slice operations (for Vec)
-Slice *runtime_slice_new(size_t elem_size, size_t len, size_t cap) {
+// Allocate a data buffer for cap elements of the slice. Buffers of
+// pointer-free elements are not scanned by the GC; alloc_resize keeps that
+// kind when they grow.
+static void *slice_alloc_data(Slice *slice, size_t cap) {
+  return alloc_owned(slice->arena, slice->elem_size * cap,
+                     (slice->flags & SLICE_POINTER_FREE) != 0);
+}
+
+Slice *runtime_slice_new(size_t elem_size, size_t len, size_t cap,
+                         int8_t pointer_free) {
   if (cap < len)
     cap = len;
   if (cap == 0)
     cap = 1;
 
   Slice *slice = (Slice *)runtime_alloc(sizeof(Slice));
+  slice->arena = t_arena;
   slice->len = len;
   slice->cap = cap;
   slice->elem_size = elem_size;
-  slice->data = runtime_alloc(elem_size * cap);
+  slice->flags = pointer_free ? SLICE_POINTER_FREE : 0;
+  slice->data = slice_alloc_data(slice, cap);
   memset(slice->data, 0, elem_size * cap);
   return slice;
 }
 
+// Give the slice a buffer of its own with room for cap elements, holding a
+// copy of its current elements. Used before a slice whose buffer is shared
+// with a subslice view is written to or grown (copy-on-write).
+static void slice_unshare(Slice *slice, size_t cap) {
+  void *data = slice_alloc_data(slice, cap);
+  memcpy(data, slice->data, slice->elem_size * slice->len);
+  slice->data = data;
+  slice->cap = cap;
+  slice->flags &= ~(size_t)SLICE_SHARED;
+}
+
+// Grow the buffer to new_cap elements. A shared buffer (which may start in
+// the middle of an allocation) is never resized in place.
+static void slice_grow(Slice *slice, size_t new_cap) {
+  if (slice->flags & SLICE_SHARED) {
+    slice_unshare(slice, new_cap);
+    return;
+  }
+  slice->data = alloc_resize(slice->arena, slice->data,
+                             slice->elem_size * slice->cap,
+                             slice->elem_size * new_cap,
+                             (slice->flags & SLICE_POINTER_FREE) != 0);
+  slice->cap = new_cap;
+}
+
+// Make the buffer safe to write in place
+static inline void slice_make_writable(Slice *slice) {
+  if (slice->flags & SLICE_SHARED) {
+    slice_unshare(slice, slice->cap);
+  }
+}
+
+void runtime_slice_make_writable(Slice *slice) { slice_make_writable(slice); }
+
+// Compiled code indexes slices inline and only calls out here on failure
+void runtime_slice_index_panic(int64_t index, size_t len) {
+  runtime_stdout_flush();
+  fprintf(stderr, "index out of bounds: index %lld, len %zu\n",
+          (long long)index, len);
+  abort();
+}
+
 void *runtime_slice_get(Slice *slice, size_t index) {
   if (!slice || index >= slice->len) {
     fprintf(stderr, "runtime_slice_get: index out of bounds\n");
@@ -229,30 +1176,35 @@ void runtime_slice_set(Slice *slice, size_t index, void *value) {
     fprintf(stderr, "runtime_slice_set: index out of bounds\n");
     abort();
   }
+  slice_make_writable(slice);
   void *dest = (char *)slice->data + (index * slice->elem_size);
   memcpy(dest, value, slice->elem_size);
 }
 
-void runtime_slice_push(Slice *slice, void *value) {
-  if (!slice) {
-    fprintf(stderr, "runtime_slice_push: null slice\n");
-    abort();
-  }
-
-  // Grow if needed
+// Make room for one more element in a buffer of its own
+static void slice_reserve_one(Slice *slice) {
   if (slice->len >= slice->cap) {
     size_t new_cap = slice->cap * 2;
     if (new_cap == 0)
       new_cap = 1;
-    // Use GC_realloc for growing slices
-    slice->data = GC_realloc(slice->data, slice->elem_size * new_cap);
-    if (!slice->data) {
-      fprintf(stderr, "runtime_slice_push: out of memory\n");
-      abort();
-    }
-    slice->cap = new_cap;
+    slice_grow(slice, new_cap);
+  } else {
+    slice_make_writable(slice);
+  }
+}
+
+// Compiled code pushes inline and only calls out here when the buffer is
+// full or shared
+void runtime_slice_grow(Slice *slice) { slice_reserve_one(slice); }
+
+void runtime_slice_push(Slice *slice, void *value) {
+  if (!slice) {
+    fprintf(stderr, "runtime_slice_push: null slice\n");
+    abort();
   }
 
+  slice_reserve_one(slice);
+
   void *dest = (char *)slice->data + (slice->len * slice->elem_size);
   memcpy(dest, value, slice->elem_size);
   slice->len++;
@@ -282,12 +1234,7 @@ void runtime_slice_reserve(Slice *slice, size_t additional) {
         new_cap = 1;
     }
 
-    slice->data = GC_realloc(slice->data, slice->elem_size * new_cap);
-    if (!slice->data) {
-      fprintf(stderr, "runtime_slice_reserve: out of memory\n");
-      abort();
-    }
-    slice->cap = new_cap;
+    slice_grow(slice, new_cap);
   }
 }
 
@@ -307,7 +1254,8 @@ void *runtime_slice_pop(Slice *slice) {
   }
 
   slice->len--;
-  void *result = runtime_alloc(slice->elem_size);
+  void *result = alloc_maybe_atomic(slice->elem_size,
+                                    (slice->flags & SLICE_POINTER_FREE) != 0);
   void *src = (char *)slice->data + (slice->len * slice->elem_size);
   memcpy(result, src, slice->elem_size);
   return result;
@@ -320,6 +1268,7 @@ void runtime_slice_remove(Slice *slice, size_t index) {
   }
 
   // Shift elements after index to the left
+  slice_make_writable(slice);
   size_t elems_to_move = slice->len - index - 1;
   if (elems_to_move > 0) {
     void *dest = (char *)slice->data + (index * slice->elem_size);
@@ -345,12 +1294,9 @@ void runtime_slice_insert(Slice *slice, size_t index, void *value) {
     size_t new_cap = slice->cap * 2;
     if (new_cap == 0)
       new_cap = 1;
-    slice->data = GC_realloc(slice->data, slice->elem_size * new_cap);
-    if (!slice->data) {
-      fprintf(stderr, "runtime_slice_insert: out of memory\n");
-      abort();
-    }
-    slice->cap = new_cap;
+    slice_grow(slice, new_cap);
+  } else {
+    slice_make_writable(slice);
   }
 
   // Shift elements from index to the right
@@ -373,10 +1319,12 @@ Slice *runtime_slice_copy(Slice *slice) {
   }
 
   Slice *copy = (Slice *)runtime_alloc(sizeof(Slice));
+  copy->arena = t_arena;
   copy->len = slice->len;
   copy->cap = slice->cap;
   copy->elem_size = slice->elem_size;
-  copy->data = runtime_alloc(slice->elem_size * slice->cap);
+  copy->flags = slice->flags & ~(size_t)SLICE_SHARED;
+  copy->data = slice_alloc_data(copy, slice->cap);
   memcpy(copy->data, slice->data, slice->elem_size * slice->len);
   // Zero out the rest of the capacity
   if (slice->len < slice->cap) {
@@ -400,38 +1348,43 @@ Slice *runtime_slice_subslice(Slice *slice, size_t start, size_t end) {
     abort();
   }
 
-  // Create a new slice with a copy of the data
-  // This ensures the subslice is independent and safe even if the original is
-  // freed
+  // The subslice is a view into the same buffer: no elements are copied.
+  // Both slices are marked shared, so whichever is written to (or grown)
+  // first copies its elements out, and neither sees the other's writes to
+  // its own elements. What the elements refer to stays shared, and for a
+  // [][]T that includes the inner slice headers, which are stored in the
+  // buffer: a write through view[i] (a push onto it, or view[i][j] = x)
+  // made before either side is copied changes the parent's row too. The
+  // view's capacity ends at its length, and the GC keeps the whole buffer
+  // alive through the view's interior pointer.
   size_t sub_len = end - start;
   Slice *sub = (Slice *)runtime_alloc(sizeof(Slice));
+  sub->arena = t_arena;
   sub->len = sub_len;
-  sub->cap = sub_len; // Capacity matches length for subslice
+  sub->cap = sub_len;
   sub->elem_size = slice->elem_size;
-  sub->data = runtime_alloc(slice->elem_size * sub_len);
-
-  // Copy the elements from the original slice
-  void *src = (char *)slice->data + (start * slice->elem_size);
-  memcpy(sub->data, src, slice->elem_size * sub_len);
+  slice->flags |= SLICE_SHARED;
+  sub->flags = slice->flags;
+  sub->data = (char *)slice->data + (start * slice->elem_size);
 
   return sub;
 }
 
-// Simple hash function for strings
+// Hash of a string's contents (for the map and the intern table)
 static size_t hash_string(String *key) {
   if (!key || !key->data)
     return 0;
-  size_t hash = 5381;
-  for (size_t i = 0; i < key->len; i++) {
-    hash = ((hash << 5) + hash) + key->data[i];
-  }
-  return hash;
+  return (size_t)wyhash(key->data, key->len, 0);
 }
 
 // String comparison
 static int string_equal(String *a, String *b) {
+  // Literals and interned strings are shared, so equal keys are often the
+  // same pointer
+  if (a == b)
+    return 1;
   if (!a || !b)
-    return a == b;
+    return 0;
   if (a->len != b->len)
     return 0;
   return memcmp(a->data, b->data, a->len) == 0;
@@ -440,15 +1393,159 @@ static int string_equal(String *a, String *b) {
 // Public string comparison function for LLVM codegen
 int runtime_string_equal(String *a, String *b) { return string_equal(a, b); }
 
+// Intern table: one canonical String per distinct content, so that interned
+// map keys compare by pointer. Interned strings live as long as the program.
+#define INTERN_INITIAL_SIZE 64
+
+static struct {
+  pthread_mutex_t mutex;
+  String **slots; // Open addressing, linear probing; NULL marks an empty slot
+  size_t size;
+  size_t capacity; // Always a power of two
+} g_intern = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+static void intern_grow(void) {
+  size_t capacity = g_intern.capacity ? g_intern.capacity * 2 : INTERN_INITIAL_SIZE;
+  String **slots = (String **)gc_alloc(capacity * sizeof(String *));
+  memset(slots, 0, capacity * sizeof(String *));
+  for (size_t i = 0; i < g_intern.capacity; i++) {
+    String *s = g_intern.slots[i];
+    if (s) {
+      size_t index = hash_string(s) & (capacity - 1);
+      while (slots[index]) {
+        index = (index + 1) & (capacity - 1);
+      }
+      slots[index] = s;
+    }
+  }
+  g_intern.slots = slots;
+  g_intern.capacity = capacity;
+}
+
+String *runtime_string_intern(String *s) {
+  if (!s || s->len == 0) {
+    return &g_string_empty;
+  }
+  size_t hash = hash_string(s);
+  pthread_mutex_lock(&g_intern.mutex);
+  // Keep the load factor at or below 1/2
+  if ((g_intern.size + 1) * 2 > g_intern.capacity) {
+    intern_grow();
+  }
+  size_t mask = g_intern.capacity - 1;
+  size_t index = hash & mask;
+  String *found;
+  while ((found = g_intern.slots[index]) && !string_equal(found, s)) {
+    index = (index + 1) & mask;
+  }
+  if (!found) {
+    // Strings are immutable, so s itself can be the canonical copy, unless
+    // it lives in an arena and would be freed with it
+    found = s;
+    if (t_arena) {
+      found = (String *)gc_alloc_atomic(sizeof(String) + s->len + 1);
+      found->len = s->len;
+      found->data = (char *)(found + 1);
+      memcpy(found->data, s->data, s->len);
+      found->data[s->len] = '\0';
+    }
+    g_intern.slots[index] = found;
+    g_intern.size++;
+  }
+  pthread_mutex_unlock(&g_intern.mutex);
+  return found;
+}
+
 // HashMap operations
+
+// Hash used for table slots; never 0 so that 0 can mark an empty slot
+static inline size_t hashmap_hash(String *key) {
+  size_t hash = hash_string(key);
+  return hash ? hash : 1;
+}
+
+// Distance of the entry in slot `index` from its preferred slot
+static inline size_t hashmap_probe_distance(HashMap *map, size_t hash,
+                                            size_t index) {
+  return (index - (hash & (map->capacity - 1))) & (map->capacity - 1);
+}
+
+static HashMapEntry *hashmap_alloc_entries(HashMap *map, size_t capacity) {
+  HashMapEntry *entries = (HashMapEntry *)alloc_owned(
+      map->arena, capacity * sizeof(HashMapEntry), 0);
+  memset(entries, 0, capacity * sizeof(HashMapEntry));
+  return entries;
+}
+
+// Insert an entry known not to be present (Robin Hood displacement)
+static void hashmap_insert_new(HashMap *map, size_t hash, String *key,
+                               void *value) {
+  size_t mask = map->capacity - 1;
+  size_t index = hash & mask;
+  size_t dist = 0;
+  HashMapEntry incoming = {hash, key, value};
+
+  for (;;) {
+    HashMapEntry *slot = &map->entries[index];
+    if (slot->hash == 0) {
+      *slot = incoming;
+      map->size++;
+      return;
+    }
+    // Steal the slot from entries that are closer to their home slot
+    size_t slot_dist = hashmap_probe_distance(map, slot->hash, index);
+    if (slot_dist < dist) {
+      HashMapEntry displaced = *slot;
+      *slot = incoming;
+      incoming = displaced;
+      dist = slot_dist;
+    }
+    index = (index + 1) & mask;
+    dist++;
+  }
+}
+
+static void hashmap_grow(HashMap *map) {
+  HashMapEntry *old_entries = map->entries;
+  size_t old_capacity = map->capacity;
+
+  map->capacity = old_capacity * 2;
+  map->entries = hashmap_alloc_entries(map, map->capacity);
+  map->size = 0;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_entries[i].hash != 0) {
+      hashmap_insert_new(map, old_entries[i].hash, old_entries[i].key,
+                         old_entries[i].value);
+    }
+  }
+}
+
+// Find the slot holding `key`, or -1 if absent. Robin Hood ordering lets the
+// probe stop as soon as it meets an entry closer to home than the key would be.
+static ptrdiff_t hashmap_find(HashMap *map, String *key, size_t hash) {
+  size_t mask = map->capacity - 1;
+  size_t index = hash & mask;
+
+  for (size_t dist = 0;; dist++) {
+    HashMapEntry *slot = &map->entries[index];
+    if (slot->hash == 0 ||
+        hashmap_probe_distance(map, slot->hash, index) < dist) {
+      return -1;
+    }
+    if (slot->hash == hash && string_equal(slot->key, key)) {
+      return (ptrdiff_t)index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
 HashMap *runtime_hashmap_new(void) {
   HashMap *map = (HashMap *)runtime_alloc(sizeof(HashMap));
+  map->arena = t_arena;
   map->capacity = HASHMAP_INITIAL_SIZE;
   map->size = 0;
-  // Use GC_malloc instead of calloc, then zero-initialize
-  map->buckets =
-      (HashMapEntry **)runtime_alloc(map->capacity * sizeof(HashMapEntry *));
-  memset(map->buckets, 0, map->capacity * sizeof(HashMapEntry *));
+  map->entries = hashmap_alloc_entries(map, map->capacity);
   return map;
 }
 
@@ -456,60 +1553,94 @@ void runtime_hashmap_put(HashMap *map, String *key, void *value) {
   if (!map || !key)
     return;
 
-  size_t hash = hash_string(key);
-  size_t index = hash % map->capacity;
+  size_t hash = hashmap_hash(key);
 
   // Check if key exists
-  HashMapEntry *entry = map->buckets[index];
-  while (entry) {
-    if (string_equal(entry->key, key)) {
-      entry->value = value;
-      return;
-    }
-    entry = entry->next;
+  ptrdiff_t index = hashmap_find(map, key, hash);
+  if (index >= 0) {
+    map->entries[index].value = value;
+    return;
   }
 
-  // Insert new entry
-  entry = (HashMapEntry *)runtime_alloc(sizeof(HashMapEntry));
-  entry->key = key;
-  entry->value = value;
-  entry->next = map->buckets[index];
-  map->buckets[index] = entry;
-  map->size++;
+  // Grow before inserting so the load factor stays bounded
+  if ((map->size + 1) * HASHMAP_MAX_LOAD_DEN >
+      map->capacity * HASHMAP_MAX_LOAD_NUM) {
+    hashmap_grow(map);
+  }
+  hashmap_insert_new(map, hash, key, value);
 }
 
 void *runtime_hashmap_get(HashMap *map, String *key) {
   if (!map || !key)
     return NULL;
 
-  size_t hash = hash_string(key);
-  size_t index = hash % map->capacity;
-
-  HashMapEntry *entry = map->buckets[index];
-  while (entry) {
-    if (string_equal(entry->key, key)) {
-      return entry->value;
-    }
-    entry = entry->next;
-  }
-  return NULL;
+  ptrdiff_t index = hashmap_find(map, key, hashmap_hash(key));
+  return index >= 0 ? map->entries[index].value : NULL;
 }
 
 int8_t runtime_hashmap_contains_key(HashMap *map, String *key) {
   if (!map || !key)
     return 0;
 
-  size_t hash = hash_string(key);
-  size_t index = hash % map->capacity;
+  return hashmap_find(map, key, hashmap_hash(key)) >= 0 ? 1 : 0;
+}
+
+int8_t runtime_hashmap_remove(HashMap *map, String *key) {
+  if (!map || !key)
+    return 0;
 
-  HashMapEntry *entry = map->buckets[index];
-  while (entry) {
-    if (string_equal(entry->key, key)) {
-      return 1; // Key exists
+  ptrdiff_t found = hashmap_find(map, key, hashmap_hash(key));
+  if (found < 0)
+    return 0; // Key does not exist
+
+  // Backward-shift deletion: pull following entries one slot closer to home
+  // until we reach an empty slot or an entry already in its home slot. This
+  // keeps probe sequences intact without tombstones.
+  size_t mask = map->capacity - 1;
+  size_t index = (size_t)found;
+  for (;;) {
+    size_t next = (index + 1) & mask;
+    HashMapEntry *slot = &map->entries[next];
+    if (slot->hash == 0 ||
+        hashmap_probe_distance(map, slot->hash, next) == 0) {
+      break;
     }
-    entry = entry->next;
+    map->entries[index] = *slot;
+    index = next;
   }
-  return 0; // Key does not exist
+  memset(&map->entries[index], 0, sizeof(HashMapEntry));
+  map->size--;
+  return 1;
+}
+
+void runtime_hashmap_clear(HashMap *map) {
+  if (!map)
+    return;
+  // Keep the allocated capacity for reuse, like runtime_slice_clear
+  memset(map->entries, 0, map->capacity * sizeof(HashMapEntry));
+  map->size = 0;
+}
+
+// Iterate entries in slot order. `cursor` must start at 0; each call advances
+// it past the returned entry. Returns 1 and fills key/value (either may be
+// NULL) while entries remain, 0 when iteration is complete. Inserting or
+// removing during iteration may skip or repeat entries.
+int8_t runtime_hashmap_iter_next(HashMap *map, size_t *cursor, String **key,
+                                 void **value) {
+  if (!map || !cursor)
+    return 0;
+
+  while (*cursor < map->capacity) {
+    HashMapEntry *slot = &map->entries[(*cursor)++];
+    if (slot->hash != 0) {
+      if (key)
+        *key = slot->key;
+      if (value)
+        *value = slot->value;
+      return 1;
+    }
+  }
+  return 0;
 }
 
 size_t runtime_hashmap_len(HashMap *map) { return map ? map->size : 0; }
@@ -534,12 +1665,20 @@ void runtime_hashmap_free(HashMap *map) {
 // NOTE: Legion struct must be defined before Channel struct because Channel
 // functions access Legion members.
 
-#define LEGION_STACK_SIZE (256 * 1024)     // 256KB initial stack
-#define LEGION_STACK_MAX (2 * 1024 * 1024) // 2MB max stack size
-#define LEGION_STACK_GUARD_SIZE (4096)     // Guard page size
-#define MAX_OS_THREADS 4      // Number of OS threads in the thread pool
-#define LEGION_QUEUE_SIZE 256 // Work-stealing queue size
-#define WORK_STEAL_ATTEMPTS 3 // Number of queues to try when stealing
+#define LEGION_STACK_SIZE (8 * 1024)       // Initially committed stack
+#define LEGION_STACK_MAX (2 * 1024 * 1024) // Stack address space per legion
+#define LEGION_STACK_KEEP (64 * 1024) // Committed stack a recycled legion keeps
+#define LEGION_STACK_GUARD_SIZE (4096) // Guard size (at least one page)
+#define LEGION_SIGNAL_STACK_SIZE (64 * 1024) // Per-worker fault handler stack
+#define SCHEDULER_MAX_WORKERS 1024 // Upper bound on OS threads in the pool
+#define LEGION_QUEUE_SIZE 256      // Per-worker deque size (overflow is global)
+#define WORK_STEAL_ATTEMPTS 3 // Passes over the other workers when stealing
+#define GLOBAL_QUEUE_INTERVAL 61 // Check the global queue first every N picks
+#define RUNNEXT_STEAL_DELAY_SPINS 100 // Pauses before taking a busy runnext
+#define LEGION_POOL_BATCH 32      // Dead legions moved to/from the depot at once
+#define LEGION_POOL_LOCAL_MAX 64  // Dead legions cached per worker
+#define LEGION_POOL_DEPOT_MAX 1024 // Dead legions kept in the global depot
+#define NETPOLL_MAX_EVENTS 128     // Readiness events collected per poll
 
 // Legion states
 typedef enum {
@@ -552,9 +1691,20 @@ typedef enum {
 // Forward declaration
 static void legion_entry(Legion *legion);
 
+// A one-shot timer on a worker's timer heap. fn(arg) runs on some worker, on
+// the scheduler stack, once the (monotonic) deadline has passed.
+typedef struct Timer {
+  int64_t when;         // Deadline (runtime_nanotime)
+  void (*fn)(void *);   // Action (must not block)
+  void *arg;
+  struct Worker *owner; // Worker whose heap it was last added to
+  int index;            // Position in owner's heap (-1 when not queued)
+  atomic_int running;   // 1 while fn is being called
+} Timer;
+
 // Context structure for green threads
 #if defined(__aarch64__)
-// ARM64: x19-x28, fp, lr, sp
+// ARM64: x19-x28, fp, lr, sp, d8-d15
 typedef struct Context {
   uint64_t x19;
   uint64_t x20;
@@ -569,6 +1719,7 @@ typedef struct Context {
   uint64_t fp; // x29
   uint64_t lr; // x30
   uint64_t sp;
+  uint64_t d[8]; // d8-d15 (callee-saved FP registers)
 } Context;
 #elif defined(__x86_64__)
 // x86_64: rbx, rbp, r12-r15, rsp, rip
@@ -586,152 +1737,104 @@ typedef struct Context {
 #error "Unsupported architecture"
 #endif
 
-// Context switching functions implemented in inline assembly
-__attribute__((noinline)) static void malphas_context_switch(Context *from,
-                                                             Context *to) {
-#if defined(__aarch64__)
-  __asm__ volatile(
-      // Save current context to 'from'
-      "stp x19, x20, [%0, #0]\n\t"
-      "stp x21, x22, [%0, #16]\n\t"
-      "stp x23, x24, [%0, #32]\n\t"
-      "stp x25, x26, [%0, #48]\n\t"
-      "stp x27, x28, [%0, #64]\n\t"
-      "stp x29, x30, [%0, #80]\n\t" // fp, lr
-      "mov x9, sp\n\t"
-      "str x9, [%0, #96]\n\t"
-
-      // Load new context from 'to'
-      "ldp x19, x20, [%1, #0]\n\t"
-      "ldp x21, x22, [%1, #16]\n\t"
-      "ldp x23, x24, [%1, #32]\n\t"
-      "ldp x25, x26, [%1, #48]\n\t"
-      "ldp x27, x28, [%1, #64]\n\t"
-      "ldp x29, x30, [%1, #80]\n\t"
-      "ldr x9, [%1, #96]\n\t"
-      "mov sp, x9\n\t"
-
-      // Return (lr is restored to x30, so ret will jump to saved location)
-      "ret\n\t"
-      :
-      : "r"(from), "r"(to)
-      : "memory", "x9");
-#elif defined(__x86_64__)
-  __asm__ volatile(
-      // Save current context to 'from'
-      "movq %%rbx, 0(%0)\n\t"
-      "movq %%rbp, 8(%0)\n\t"
-      "movq %%r12, 16(%0)\n\t"
-      "movq %%r13, 24(%0)\n\t"
-      "movq %%r14, 32(%0)\n\t"
-      "movq %%r15, 40(%0)\n\t"
-      "movq %%rsp, 48(%0)\n\t"
-      // Save return address (current instruction pointer is implicitly saved on
-      // stack by call, but we need to save the return address from the stack to
-      // our struct) Actually, for switch, we just save the return address that
-      // is on the stack? No, standard way is to save a label or rely on 'ret'
-      // using the value on stack. But here we are switching stacks.
-
-      // Better approach for x86_64 switch:
-      // 1. Save callee-saved regs.
-      // 2. Save RSP.
-      // 3. Load new RSP.
-      // 4. Restore callee-saved regs.
-      // 5. Ret (pops RIP from new stack).
-
-      // Wait, 'from->rip' needs to be set to the return address of THIS call.
-      // The 'call' instruction pushed RIP onto the stack.
-      // So 'pop' into a temp reg and save it? No, we want 'ret' to work later.
-
-      // Correct logic:
-      // We don't explicitly save RIP in the struct during switch.
-      // The RIP is on the stack. We save the SP *after* the call pushed RIP.
-      // When we restore SP and 'ret', it pops the RIP.
-      // So 'rip' field in Context is only used for initialization
-      // (make_context).
-
-      "movq %%rbx, 0(%0)\n\t"
-      "movq %%rbp, 8(%0)\n\t"
-      "movq %%r12, 16(%0)\n\t"
-      "movq %%r13, 24(%0)\n\t"
-      "movq %%r14, 32(%0)\n\t"
-      "movq %%r15, 40(%0)\n\t"
-      "movq %%rsp, 48(%0)\n\t"
-      "leaq 1f(%%rip), %%rax\n\t" // Get address of label 1
-      "movq %%rax, 56(%0)\n\t" // Save it as RIP (for consistency, though mostly
-                               // unused in switch)
-
-      // Load new context
-      "movq 0(%1), %%rbx\n\t"
-      "movq 8(%1), %%rbp\n\t"
-      "movq 16(%1), %%r12\n\t"
-      "movq 24(%1), %%r13\n\t"
-      "movq 32(%1), %%r14\n\t"
-      "movq 40(%1), %%r15\n\t"
-      "movq 48(%1), %%rsp\n\t"
-
-      // For newly created contexts, we might need to push RIP or jump.
-      // If we use the 'ret' trick, the new stack must have the entry point at
-      // the top. Let's assume 'make_context' sets up the stack correctly.
-
-      "jmp *56(%1)\n\t" // Jump to saved RIP (or entry point)
-
-      "1:\n\t"
-      :
-      : "r"(from), "r"(to)
-      : "memory", "rax");
-#endif
-}
-
-// Initialize a context
-static void malphas_context_make(Context *ctx, void (*fn)(void *), void *arg,
-                                 void *stack_base, size_t stack_size) {
-  memset(ctx, 0, sizeof(Context));
-
-  // Stack grows down
-  uintptr_t sp = (uintptr_t)stack_base + stack_size;
-
-  // Align stack to 16 bytes
-  sp = sp & ~15;
-
-#if defined(__aarch64__)
-  ctx->sp = sp;
-  ctx->fp = sp;             // Frame pointer starts at top of stack
-  ctx->lr = (uint64_t)fn;   // Link register holds the function entry point
-  ctx->x19 = (uint64_t)arg; // We'll use a wrapper to move arg to x0
-
-  // We need a wrapper because 'fn' expects arg in x0, but context switch
-  // restores callee-saved. We can put 'arg' in x19 (callee-saved) and have a
-  // trampoline that moves x19 to x0. Or simpler: just set x0? No, x0 is not
-  // callee-saved, it won't be restored by switch. So we MUST use a trampoline
-  // or modify switch to restore x0 (bad). Let's use a trampoline helper.
-#elif defined(__x86_64__)
-  ctx->rsp = sp - 8; // Reserve space for return address (alignment)
-  ctx->rip = (uint64_t)fn;
-  ctx->rbx = (uint64_t)arg; // Pass arg in rbx (callee-saved)
+// Context switching is implemented in standalone assembly rather than inline
+// asm so that the compiler cannot allocate the operands to callee-saved
+// registers that the switch itself overwrites.
+//
+// malphas_context_switch(from, to) saves the callee-saved registers and the
+// resume point into `from` and continues execution at `to`. A saved context
+// resumes as if malphas_context_switch had returned.
+void malphas_context_switch(Context *from, Context *to);
+// Entry point of a fresh context: calls fn(arg) with fn/arg taken from the
+// callee-saved registers set up by malphas_context_make_trampoline.
+void malphas_legion_trampoline(void);
+
+#if defined(__APPLE__)
+#define MALPHAS_ASM_SYM(name) "_" #name
+#define MALPHAS_ASM_TYPE(name)
+#else
+#define MALPHAS_ASM_SYM(name) #name
+#define MALPHAS_ASM_TYPE(name) ".type " #name ", @function\n"
 #endif
-}
 
-// Trampoline to call the function with argument
-static void legion_trampoline(void) {
 #if defined(__aarch64__)
-  // Recover arg from x19 (where we put it in make_context)
-  // Recover fn from x20 (we'll store fn in x20 too)
-  __asm__ volatile(
-      "mov x0, x19\n\t" // arg
-      "blr x20\n\t"     // call fn
-                        // If fn returns, we should exit cleanly?
-      // In our case, legion_entry calls the user fn and then handles death.
-      // So 'fn' here is actually 'legion_entry', and 'arg' is 'Legion*'.
-  );
+__asm__(".text\n"
+        ".p2align 2\n"
+        ".globl " MALPHAS_ASM_SYM(malphas_context_switch) "\n"
+        MALPHAS_ASM_TYPE(malphas_context_switch)
+        MALPHAS_ASM_SYM(malphas_context_switch) ":\n"
+        // Save current context to 'from' (x0)
+        "  stp x19, x20, [x0, #0]\n"
+        "  stp x21, x22, [x0, #16]\n"
+        "  stp x23, x24, [x0, #32]\n"
+        "  stp x25, x26, [x0, #48]\n"
+        "  stp x27, x28, [x0, #64]\n"
+        "  stp x29, x30, [x0, #80]\n" // fp, lr
+        "  mov x9, sp\n"
+        "  str x9, [x0, #96]\n"
+        "  stp d8, d9, [x0, #104]\n"
+        "  stp d10, d11, [x0, #120]\n"
+        "  stp d12, d13, [x0, #136]\n"
+        "  stp d14, d15, [x0, #152]\n"
+        // Load new context from 'to' (x1)
+        "  ldp x19, x20, [x1, #0]\n"
+        "  ldp x21, x22, [x1, #16]\n"
+        "  ldp x23, x24, [x1, #32]\n"
+        "  ldp x25, x26, [x1, #48]\n"
+        "  ldp x27, x28, [x1, #64]\n"
+        "  ldp x29, x30, [x1, #80]\n"
+        "  ldr x9, [x1, #96]\n"
+        "  mov sp, x9\n"
+        "  ldp d8, d9, [x1, #104]\n"
+        "  ldp d10, d11, [x1, #120]\n"
+        "  ldp d12, d13, [x1, #136]\n"
+        "  ldp d14, d15, [x1, #152]\n"
+        // Return to the restored lr
+        "  ret\n"
+        ".globl " MALPHAS_ASM_SYM(malphas_legion_trampoline) "\n"
+        MALPHAS_ASM_TYPE(malphas_legion_trampoline)
+        MALPHAS_ASM_SYM(malphas_legion_trampoline) ":\n"
+        "  mov x0, x19\n" // arg
+        "  blr x20\n"     // fn (legion_entry never returns)
+        "  brk #0\n");
 #elif defined(__x86_64__)
-  __asm__ volatile("movq %rbx, %rdi\n\t" // arg (System V ABI: first arg in rdi)
-                   "callq *%r12\n\t"     // call fn (stored in r12)
-  );
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".globl " MALPHAS_ASM_SYM(malphas_context_switch) "\n"
+        MALPHAS_ASM_TYPE(malphas_context_switch)
+        MALPHAS_ASM_SYM(malphas_context_switch) ":\n"
+        // Save current context to 'from' (rdi)
+        "  movq %rbx, 0(%rdi)\n"
+        "  movq %rbp, 8(%rdi)\n"
+        "  movq %r12, 16(%rdi)\n"
+        "  movq %r13, 24(%rdi)\n"
+        "  movq %r14, 32(%rdi)\n"
+        "  movq %r15, 40(%rdi)\n"
+        // Resume point is our return address; the saved stack pointer is the
+        // caller's, as it will be after that return
+        "  movq (%rsp), %rax\n"
+        "  movq %rax, 56(%rdi)\n"
+        "  leaq 8(%rsp), %rax\n"
+        "  movq %rax, 48(%rdi)\n"
+        // Load new context from 'to' (rsi)
+        "  movq 0(%rsi), %rbx\n"
+        "  movq 8(%rsi), %rbp\n"
+        "  movq 16(%rsi), %r12\n"
+        "  movq 24(%rsi), %r13\n"
+        "  movq 32(%rsi), %r14\n"
+        "  movq 40(%rsi), %r15\n"
+        "  movq 48(%rsi), %rsp\n"
+        "  jmpq *56(%rsi)\n"
+        ".globl " MALPHAS_ASM_SYM(malphas_legion_trampoline) "\n"
+        MALPHAS_ASM_TYPE(malphas_legion_trampoline)
+        MALPHAS_ASM_SYM(malphas_legion_trampoline) ":\n"
+        "  movq %rbx, %rdi\n" // arg (System V ABI: first arg in rdi)
+        "  callq *%r12\n"     // fn (legion_entry never returns)
+        "  ud2\n");
 #endif
-}
 
-// Revised make_context to use trampoline
+// Set up a fresh context that starts in the trampoline, which calls fn(arg)
+// on the given stack
 static void malphas_context_make_trampoline(Context *ctx, void (*fn)(void *),
                                             void *arg, void *stack_base,
                                             size_t stack_size) {
@@ -741,13 +1844,15 @@ static void malphas_context_make_trampoline(Context *ctx, void (*fn)(void *),
 
 #if defined(__aarch64__)
   ctx->sp = sp;
-  ctx->fp = sp;
-  ctx->lr = (uint64_t)legion_trampoline; // Start at trampoline
-  ctx->x19 = (uint64_t)arg;              // arg for trampoline
-  ctx->x20 = (uint64_t)fn;               // fn for trampoline
+  ctx->fp = 0;
+  ctx->lr = (uint64_t)malphas_legion_trampoline; // Start at trampoline
+  ctx->x19 = (uint64_t)arg;                      // arg for trampoline
+  ctx->x20 = (uint64_t)fn;                       // fn for trampoline
 #elif defined(__x86_64__)
-  ctx->rsp = sp - 8; // Alignment
-  ctx->rip = (uint64_t)legion_trampoline;
+  // The trampoline is jumped to (not called), so a 16-byte aligned rsp gives
+  // fn the ABI-required alignment once the trampoline's call pushes rip
+  ctx->rsp = sp;
+  ctx->rip = (uint64_t)malphas_legion_trampoline;
   ctx->rbx = (uint64_t)arg; // arg
   ctx->r12 = (uint64_t)fn;  // fn
 #endif
@@ -758,712 +1863,3724 @@ typedef struct Channel Channel;
 struct Legion {
   void (*fn)(void *);    // Function to execute
   void *arg;             // Argument to pass
-  void *stack;           // Stack pointer (growable)
-  void *stack_base;      // Base of allocated stack (for growth)
-  size_t stack_size;     // Current stack size
-  size_t stack_cap;      // Stack capacity
-  Context ctx;           // Execution context (custom struct)
-  Context ctx_saved;     // Saved context when blocked
+  void *stack;           // Lowest committed stack address
+  void *stack_base;      // Base of the stack reservation
+  size_t stack_size;     // Committed stack size (grows on demand)
+  size_t stack_cap;      // Reserved stack size
+  Context ctx;           // Execution context, saved whenever the legion
+                         // switches back to its scheduler
   LegionState state;     // Current state
   struct Legion *next;   // For linked lists (run queue, etc.)
   pthread_cond_t cond;   // Condition variable for blocking
   pthread_mutex_t mutex; // Mutex for blocking operations
   Channel *blocked_on;   // Channel this legion is blocked on (if any)
-  int id;                // Unique legion ID
+  void (*park_unlock)(void *); // Run by the scheduler once the legion has
+  void *park_arg;              // switched out (releases channel locks)
+  int id;                      // Unique legion ID
   int thread_id;      // OS thread ID currently running this legion (-1 if none)
   int stack_overflow; // Flag for stack overflow detection
+  int stack_mapped;   // Stack came from mmap (released with munmap)
+  Timer timer;        // Deadline of the legion's current sleep or timed wait
+  OutputBuffer *output; // Worker buffer that may hold its output (or NULL)
+  Arena *arena;         // Innermost open arena (while switched out)
+  WaitGroup *group;     // Wait group to signal when fn returns (or NULL)
+  JoinHandle *join;     // Handle to complete when fn returns (or NULL)
 };
 
-// Forward declaration for unblock_legion_from_channel (defined later)
-static void unblock_legion_from_channel(Legion *legion);
+// Parking primitives used by channels and select (defined with the scheduler)
+static void legion_park(void (*unlock)(void *), void *arg);
+
+// Signal whoever waits for a legion that has returned (defined with the wait
+// groups)
+static void legion_finish(Legion *legion);
+
+// Statistics, counted per worker (defined with the scheduler)
+typedef enum {
+  STAT_SPAWNED,
+  STAT_COMPLETED,
+  STAT_RUNS,
+  STAT_YIELDS,
+  STAT_PREEMPTIONS,
+  STAT_BLOCKS,
+  STAT_UNBLOCKS,
+  STAT_CHAN_PARKS,
+  STAT_STEAL_ATTEMPTS,
+  STAT_STEALS,
+  STAT_STOLEN,
+  STAT_WORKER_PARKS,
+  STAT_WORKER_WAKEUPS,
+  STAT_COUNT
+} StatCounter;
+
+typedef struct StatCounters {
+  atomic_uint_fast64_t n[STAT_COUNT];
+} StatCounters;
+
+static void stat_add(StatCounter counter, uint64_t n);
+
+// Event tracing, on when MALPHAS_TRACE names an output file
+typedef enum {
+  TRACE_SPAWN,    // Instant: legion created
+  TRACE_RUN,      // Begin: worker switched to the legion
+  TRACE_STOP,     // End: legion switched out (arg: LegionState, or -1 if preempted)
+  TRACE_UNBLOCK,  // Instant: legion made runnable again
+  TRACE_STEAL,    // Instant: arg legions stolen from worker `legion`
+  TRACE_PARK,     // Instant: worker going to sleep
+  TRACE_GC_START, // Begin: collection
+  TRACE_GC_END,   // End: collection
+} TraceKind;
+
+static int g_trace_on = 0; // Set before any legion runs
+
+static void trace_event(TraceKind kind, int64_t legion, int64_t arg);
+
+static inline void trace(TraceKind kind, int64_t legion, int64_t arg) {
+  if (__builtin_expect(g_trace_on, 0)) {
+    trace_event(kind, legion, arg);
+  }
+}
+
+// ============================================================================
+// Channels
+// ============================================================================
+// Buffered channels keep their elements in a bounded lock-free ring, so an
+// operation that finds room (or an element) never takes the channel mutex.
+//
+// Operations that cannot proceed are represented by Waiters (the runtime's
+// analogue of Go's sudog) queued on the channel under its mutex. A plain
+// send/recv enqueues one waiter; select enqueues one per case, all sharing a
+// SelectState so that exactly one case can complete. On an unbuffered channel
+// whoever completes a waiter's operation also moves the value: a sender copies
+// straight into a parked receiver's destination, a receiver copies straight
+// out of a parked sender's value. On a buffered channel the value stays in the
+// ring and the waiter is simply woken to retry.
+
+// Parks either a legion (through the scheduler) or a plain OS thread such as
+// main (on a mutex/condition pair)
+typedef struct Parker {
+  Legion *legion; // NULL when parking an OS thread
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int woken;
+} Parker;
+
+typedef struct SelectState {
+  atomic_int done; // Set by whoever claims the select (exactly once)
+  int winner;      // Index of the case that completed
+} SelectState;
+
+typedef struct Waiter {
+  Parker *parker;
+  void *elem;          // Send: value to copy from; recv: slot to copy into
+  SelectState *select; // Shared state when part of a select, else NULL
+  int case_index;      // Index of this case within its select
+  int8_t success;      // Unbuffered: 1 if the waker moved a value, 0 if closed
+  int8_t queued;       // 1 while linked into a channel queue
+  struct Waiter *next;
+  struct Waiter *prev;
+} Waiter;
+
+typedef struct WaitQueue {
+  Waiter *first;
+  Waiter *last;
+  atomic_size_t len; // Read without the lock by the ring fast paths
+} WaitQueue;
+
+// Fields written by different threads are kept at least this far apart
+#define CACHE_LINE_SIZE 64
 
 // Channel implementation
+//
+// The ring is Vyukov's bounded MPMC queue: every slot carries a sequence
+// number telling whether it is free for the producer at a given position or
+// holds the element for the consumer at that position, so producers and
+// consumers only contend on their own index. Channels made with
+// runtime_channel_new_spsc promise one sender and one receiver and use bare
+// head/tail indices with no read-modify-write atomics at all.
 struct Channel {
-  void *buffer;              // Circular buffer
-  size_t elem_size;          // Size of each element
-  size_t capacity;           // Maximum capacity
-  size_t head;               // Read position
-  size_t tail;               // Write position
-  size_t count;              // Number of elements
-  pthread_mutex_t mutex;     // Mutex for synchronization
-  pthread_cond_t not_full;   // Condition variable for not full
-  pthread_cond_t not_empty;  // Condition variable for not empty
-  atomic_int closed;         // 1 if closed, 0 otherwise
-  Legion *blocked_senders;   // Linked list of blocked sending legions
-  Legion *blocked_receivers; // Linked list of blocked receiving legions
+  // Immutable after creation
+  void *buffer;       // Ring slots, elem_size bytes each
+  atomic_size_t *seq; // Per-slot sequence numbers (MPMC ring only)
+  size_t elem_size;   // Size of each element
+  size_t capacity;    // Ring size; 0 for unbuffered channels
+  int spsc;           // Single-producer/single-consumer ring
+  int pointer_free;   // Elements hold no pointers (ring and boxes unscanned)
+  char pad0[CACHE_LINE_SIZE];
+  // Producer side
+  atomic_size_t tail; // Next position to write
+  size_t head_cache;  // SPSC: the producer's last view of head
+  char pad1[CACHE_LINE_SIZE];
+  // Consumer side
+  atomic_size_t head; // Next position to read
+  size_t tail_cache;  // SPSC: the consumer's last view of tail
+  char pad2[CACHE_LINE_SIZE];
+  pthread_mutex_t mutex; // Protects the wait queues
+  atomic_int closed;     // 1 if closed, 0 otherwise
+  WaitQueue sendq;       // Parked senders
+  WaitQueue recvq;       // Parked receivers
 };
 
-Channel *runtime_channel_new(size_t elem_size, size_t capacity) {
-  Channel *ch = (Channel *)runtime_alloc(sizeof(Channel));
-  ch->elem_size = elem_size;
-  ch->capacity = capacity;
-  ch->head = 0;
-  ch->tail = 0;
-  ch->count = 0;
-  ch->buffer = runtime_alloc(elem_size * capacity);
-  pthread_mutex_init(&ch->mutex, NULL);
-  pthread_cond_init(&ch->not_full, NULL);
-  pthread_cond_init(&ch->not_empty, NULL);
-  atomic_store(&ch->closed, 0);
-  ch->blocked_senders = NULL;
-  ch->blocked_receivers = NULL;
-  return ch;
+static void parker_init(Parker *parker) {
+  parker->legion = runtime_get_current_legion();
+  parker->woken = 0;
+  if (!parker->legion) {
+    pthread_mutex_init(&parker->mutex, NULL);
+    pthread_cond_init(&parker->cond, NULL);
+  }
 }
 
-void runtime_channel_send(Channel *ch, void *value) {
-  if (!ch)
+static void parker_destroy(Parker *parker) {
+  if (!parker->legion) {
+    pthread_mutex_destroy(&parker->mutex);
+    pthread_cond_destroy(&parker->cond);
+  }
+}
+
+// Park until parker_wake. `unlock(arg)` releases the channel lock(s) only
+// once the caller can safely be woken: for a legion that is after it has
+// switched out to the scheduler.
+static void parker_park(Parker *parker, void (*unlock)(void *), void *arg) {
+  stat_add(STAT_CHAN_PARKS, 1);
+  if (parker->legion) {
+    legion_park(unlock, arg);
+    return;
+  }
+
+  pthread_mutex_lock(&parker->mutex);
+  unlock(arg);
+  while (!parker->woken) {
+    pthread_cond_wait(&parker->cond, &parker->mutex);
+  }
+  pthread_mutex_unlock(&parker->mutex);
+}
+
+static void parker_wake(Parker *parker) {
+  output_flush_own();
+  Legion *legion = parker->legion;
+  if (legion) {
+    runtime_legion_unblock(legion);
     return;
+  }
 
-  pthread_mutex_lock(&ch->mutex);
+  pthread_mutex_lock(&parker->mutex);
+  parker->woken = 1;
+  pthread_cond_signal(&parker->cond);
+  pthread_mutex_unlock(&parker->mutex);
+}
 
-  // Wait until there's space or channel is closed
-  while (ch->count >= ch->capacity && atomic_load(&ch->closed) == 0) {
-    // If we're in a legion context, block the legion instead of using
-    // pthread_cond_wait
-    Legion *current = runtime_get_current_legion();
-    if (current) {
-      // Add to blocked senders list
-      current->next = ch->blocked_senders;
-      ch->blocked_senders = current;
-
-      // Block the legion and release the channel mutex
-      runtime_legion_block(current, ch);
-      pthread_mutex_unlock(&ch->mutex);
+// Timers (defined with the scheduler)
+static void timer_start(Timer *t, int64_t when, void (*fn)(void *),
+                        void *arg);
+static void timer_stop(Timer *t);
+
+typedef struct TimedPark {
+  Parker *parker;
+  atomic_int *done; // Claimed by whichever of waker and deadline comes first
+  int64_t deadline;
+  void (*unlock)(void *);
+  void *arg;
+} TimedPark;
+
+static void timed_park_expire(void *arg) {
+  TimedPark *park = (TimedPark *)arg;
+  int expected = 0;
+  if (atomic_compare_exchange_strong(park->done, &expected, 1)) {
+    parker_wake(park->parker);
+  }
+}
 
-      // Yield to scheduler (this will switch contexts)
-      runtime_legion_yield();
+// Runs once the legion has switched out, so the timer cannot fire early
+static void timed_park_unlock(void *arg) {
+  TimedPark *park = (TimedPark *)arg;
+  timer_start(&park->parker->legion->timer, park->deadline, timed_park_expire,
+              park);
+  park->unlock(park->arg);
+}
 
-      // When we resume, re-acquire the mutex
-      pthread_mutex_lock(&ch->mutex);
-      // Check again if we can proceed
-      if (ch->count >= ch->capacity && atomic_load(&ch->closed) == 0) {
-        continue; // Still blocked, wait again
-      }
-    } else {
-      // Not in legion context, use traditional blocking
-      pthread_cond_wait(&ch->not_full, &ch->mutex);
+// Like parker_park, but give up at `deadline` (runtime_nanotime, negative
+// waits forever). Giving up claims *done first, exactly as a waker completing
+// the operation would, so the caller can tell from the claim what happened.
+static void parker_park_until(Parker *parker, void (*unlock)(void *),
+                              void *arg, int64_t deadline, atomic_int *done) {
+  if (deadline < 0) {
+    parker_park(parker, unlock, arg);
+    return;
+  }
+  stat_add(STAT_CHAN_PARKS, 1);
+  if (parker->legion) {
+    TimedPark park = {parker, done, deadline, unlock, arg};
+    legion_park(timed_park_unlock, &park);
+    timer_stop(&parker->legion->timer);
+    return;
+  }
+
+  // Condition variables time out against the realtime clock
+  int64_t remaining = deadline - runtime_nanotime();
+  struct timespec abs;
+  clock_gettime(CLOCK_REALTIME, &abs);
+  if (remaining > 0) {
+    abs.tv_sec += remaining / 1000000000;
+    abs.tv_nsec += remaining % 1000000000;
+    if (abs.tv_nsec >= 1000000000) {
+      abs.tv_sec++;
+      abs.tv_nsec -= 1000000000;
     }
   }
 
-  // If closed, unlock and return
-  if (atomic_load(&ch->closed) != 0) {
-    pthread_mutex_unlock(&ch->mutex);
-    return;
+  pthread_mutex_lock(&parker->mutex);
+  unlock(arg);
+  int timed_out = 0;
+  while (!parker->woken && !timed_out) {
+    if (pthread_cond_timedwait(&parker->cond, &parker->mutex, &abs) ==
+        ETIMEDOUT) {
+      int expected = 0;
+      timed_out = atomic_compare_exchange_strong(done, &expected, 1);
+      // Otherwise a waker has claimed the operation and is on its way
+      if (!timed_out) {
+        while (!parker->woken) {
+          pthread_cond_wait(&parker->cond, &parker->mutex);
+        }
+      }
+    }
   }
+  pthread_mutex_unlock(&parker->mutex);
+}
 
-  // Copy value into buffer
-  void *dest = (char *)ch->buffer + (ch->tail * ch->elem_size);
-  memcpy(dest, value, ch->elem_size);
+static void waitq_enqueue(WaitQueue *q, Waiter *w) {
+  w->next = NULL;
+  w->prev = q->last;
+  if (q->last)
+    q->last->next = w;
+  else
+    q->first = w;
+  q->last = w;
+  w->queued = 1;
+  atomic_fetch_add_explicit(&q->len, 1, memory_order_relaxed);
+}
 
-  ch->tail = (ch->tail + 1) % ch->capacity;
-  ch->count++;
+static void waitq_remove(WaitQueue *q, Waiter *w) {
+  if (!w->queued)
+    return;
+  if (w->prev)
+    w->prev->next = w->next;
+  else
+    q->first = w->next;
+  if (w->next)
+    w->next->prev = w->prev;
+  else
+    q->last = w->prev;
+  w->next = w->prev = NULL;
+  w->queued = 0;
+  atomic_fetch_sub_explicit(&q->len, 1, memory_order_relaxed);
+}
 
-  // Unblock a waiting receiver if any
-  if (ch->blocked_receivers) {
-    Legion *receiver = ch->blocked_receivers;
-    ch->blocked_receivers = receiver->next;
-    receiver->next = NULL;
-    unblock_legion_from_channel(receiver);
+// Dequeue the first waiter whose operation we may complete. Waiters belonging
+// to a select that another case already won are dropped along the way.
+static Waiter *waitq_dequeue(WaitQueue *q) {
+  for (;;) {
+    Waiter *w = q->first;
+    if (!w)
+      return NULL;
+    waitq_remove(q, w);
+
+    if (w->select) {
+      int expected = 0;
+      if (!atomic_compare_exchange_strong(&w->select->done, &expected, 1)) {
+        continue; // Select already completed through another case
+      }
+      w->select->winner = w->case_index;
+    }
+    return w;
   }
+}
 
-  // Signal that channel is not empty (wake up waiting legions/threads)
-  pthread_cond_signal(&ch->not_empty);
-  pthread_mutex_unlock(&ch->mutex);
+static void channel_unlock(void *arg) {
+  pthread_mutex_unlock(&((Channel *)arg)->mutex);
 }
 
-void *runtime_channel_recv(Channel *ch) {
-  if (!ch)
-    return NULL;
+static inline void *channel_slot(Channel *ch, size_t index) {
+  return (char *)ch->buffer + (index * ch->elem_size);
+}
 
-  pthread_mutex_lock(&ch->mutex);
+static inline void channel_copy_in(Channel *ch, void *dst, const void *src) {
+  if (dst) {
+    if (src)
+      memcpy(dst, src, ch->elem_size);
+    else
+      memset(dst, 0, ch->elem_size);
+  }
+}
 
-  // Wait until there's data or channel is closed
-  while (ch->count == 0 && atomic_load(&ch->closed) == 0) {
-    // If we're in a legion context, block the legion instead of using
-    // pthread_cond_wait
-    Legion *current = runtime_get_current_legion();
-    if (current) {
-      // Add to blocked receivers list
-      current->next = ch->blocked_receivers;
-      ch->blocked_receivers = current;
-
-      // Block the legion and release the channel mutex
-      runtime_legion_block(current, ch);
-      pthread_mutex_unlock(&ch->mutex);
+static inline size_t ring_index(Channel *ch, size_t pos) {
+  return pos % ch->capacity;
+}
 
-      // Yield to scheduler (this will switch contexts)
-      runtime_legion_yield();
+// Sequence numbers of an MPMC ring slot: free for the push at pos, or holding
+// the value pushed at pos. A pop at pos frees the slot for pos + capacity.
+// The two states take distinct values even when capacity is 1, where "full
+// at pos" and "free at pos + 1" would otherwise read the same.
+static inline size_t ring_seq_free(size_t pos) { return 2 * pos; }
+static inline size_t ring_seq_full(size_t pos) { return 2 * pos + 1; }
+
+// Append a value to the ring without locking. Returns 0 if the ring is full.
+static int ring_push(Channel *ch, const void *value) {
+  if (ch->spsc) {
+    size_t tail = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    if (tail - ch->head_cache >= ch->capacity) {
+      ch->head_cache = atomic_load_explicit(&ch->head, memory_order_acquire);
+      if (tail - ch->head_cache >= ch->capacity)
+        return 0;
+    }
+    channel_copy_in(ch, channel_slot(ch, ring_index(ch, tail)), value);
+    atomic_store_explicit(&ch->tail, tail + 1, memory_order_release);
+    return 1;
+  }
 
-      // When we resume, re-acquire the mutex
-      pthread_mutex_lock(&ch->mutex);
-      // Check again if we can proceed
-      if (ch->count == 0 && atomic_load(&ch->closed) == 0) {
-        continue; // Still blocked, wait again
+  size_t pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+  for (;;) {
+    atomic_size_t *seq = &ch->seq[ring_index(ch, pos)];
+    intptr_t dif = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) -
+                   (intptr_t)ring_seq_free(pos);
+    if (dif == 0) {
+      // Slot is free for this lap: claim the position (a failed CAS reloads
+      // pos)
+      if (atomic_compare_exchange_weak_explicit(&ch->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        channel_copy_in(ch, channel_slot(ch, ring_index(ch, pos)), value);
+        atomic_store_explicit(seq, ring_seq_full(pos), memory_order_release);
+        return 1;
       }
+    } else if (dif < 0) {
+      return 0; // Slot still holds the element from the previous lap: full
     } else {
-      // Not in legion context, use traditional blocking
-      pthread_cond_wait(&ch->not_empty, &ch->mutex);
+      pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
     }
   }
+}
 
-  // If closed and empty, return NULL
-  if (ch->count == 0 && atomic_load(&ch->closed) != 0) {
-    pthread_mutex_unlock(&ch->mutex);
-    return NULL;
+// Take the oldest value from the ring into dst (may be NULL) without locking.
+// Returns 0 if the ring is empty.
+static int ring_pop(Channel *ch, void *dst) {
+  if (ch->spsc) {
+    size_t head = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    if (head == ch->tail_cache) {
+      ch->tail_cache = atomic_load_explicit(&ch->tail, memory_order_acquire);
+      if (head == ch->tail_cache)
+        return 0;
+    }
+    channel_copy_in(ch, dst, channel_slot(ch, ring_index(ch, head)));
+    atomic_store_explicit(&ch->head, head + 1, memory_order_release);
+    return 1;
   }
 
-  // Read value from buffer
-  void *src = (char *)ch->buffer + (ch->head * ch->elem_size);
-  void *result = runtime_alloc(ch->elem_size);
-  memcpy(result, src, ch->elem_size);
-
-  ch->head = (ch->head + 1) % ch->capacity;
-  ch->count--;
-
-  // Unblock a waiting sender if any
-  if (ch->blocked_senders) {
-    Legion *sender = ch->blocked_senders;
-    ch->blocked_senders = sender->next;
-    sender->next = NULL;
-    unblock_legion_from_channel(sender);
+  size_t pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+  for (;;) {
+    atomic_size_t *seq = &ch->seq[ring_index(ch, pos)];
+    intptr_t dif = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) -
+                   (intptr_t)ring_seq_full(pos);
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ch->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        channel_copy_in(ch, dst, channel_slot(ch, ring_index(ch, pos)));
+        // Free the slot for the producer one lap ahead
+        atomic_store_explicit(seq, ring_seq_free(pos + ch->capacity),
+                              memory_order_release);
+        return 1;
+      }
+    } else if (dif < 0) {
+      return 0; // Slot not yet filled for this lap: empty
+    } else {
+      pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    }
   }
-
-  // Signal that channel is not full (wake up waiting legions/threads)
-  pthread_cond_signal(&ch->not_full);
-  pthread_mutex_unlock(&ch->mutex);
-
-  return result;
 }
 
-void runtime_channel_close(Channel *ch) {
-  if (!ch)
-    return;
+// Whether a push/pop could succeed right now (without performing it)
+static int ring_can_push(Channel *ch) {
+  size_t tail = atomic_load_explicit(&ch->tail, memory_order_acquire);
+  if (ch->spsc)
+    return tail - atomic_load_explicit(&ch->head, memory_order_acquire) <
+           ch->capacity;
+  return atomic_load_explicit(&ch->seq[ring_index(ch, tail)],
+                              memory_order_acquire) == ring_seq_free(tail);
+}
 
-  pthread_mutex_lock(&ch->mutex);
-  atomic_store(&ch->closed, 1);
-  // Wake up all waiting threads
-  pthread_cond_broadcast(&ch->not_full);
-  pthread_cond_broadcast(&ch->not_empty);
-  pthread_mutex_unlock(&ch->mutex);
+static int ring_can_pop(Channel *ch) {
+  size_t head = atomic_load_explicit(&ch->head, memory_order_acquire);
+  if (ch->spsc)
+    return head != atomic_load_explicit(&ch->tail, memory_order_acquire);
+  return atomic_load_explicit(&ch->seq[ring_index(ch, head)],
+                              memory_order_acquire) == ring_seq_full(head);
 }
 
-int8_t runtime_channel_is_closed(Channel *ch) {
-  if (!ch)
-    return 1;
-  return (int8_t)atomic_load(&ch->closed);
+// Copy n elements into the ring from position pos on, or out of it: a run
+// that wraps around the end of the buffer takes two copies
+static void ring_copy_in(Channel *ch, size_t pos, const char *src, size_t n) {
+  size_t start = ring_index(ch, pos);
+  size_t first = ch->capacity - start < n ? ch->capacity - start : n;
+  memcpy(channel_slot(ch, start), src, first * ch->elem_size);
+  if (n > first)
+    memcpy(ch->buffer, src + first * ch->elem_size,
+           (n - first) * ch->elem_size);
 }
 
-// Non-blocking send: returns 1 if successful, 0 if would block
-int8_t runtime_channel_try_send(Channel *ch, void *value) {
-  if (!ch)
-    return 0;
+static void ring_copy_out(Channel *ch, size_t pos, char *dst, size_t n) {
+  size_t start = ring_index(ch, pos);
+  size_t first = ch->capacity - start < n ? ch->capacity - start : n;
+  memcpy(dst, channel_slot(ch, start), first * ch->elem_size);
+  if (n > first)
+    memcpy(dst + first * ch->elem_size, ch->buffer,
+           (n - first) * ch->elem_size);
+}
 
-  pthread_mutex_lock(&ch->mutex);
+// Append up to n values from src to the ring without locking, claiming all
+// the room they take at once. Returns how many were appended (0 if full).
+static size_t ring_push_many(Channel *ch, const char *src, size_t n) {
+  if (ch->spsc) {
+    size_t tail = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    size_t room = ch->capacity - (tail - ch->head_cache);
+    if (room < n) {
+      ch->head_cache = atomic_load_explicit(&ch->head, memory_order_acquire);
+      room = ch->capacity - (tail - ch->head_cache);
+    }
+    size_t k = room < n ? room : n;
+    if (k == 0)
+      return 0;
+    ring_copy_in(ch, tail, src, k);
+    atomic_store_explicit(&ch->tail, tail + k, memory_order_release);
+    return k;
+  }
 
-  // If closed, unlock and return failure
-  if (atomic_load(&ch->closed) != 0) {
-    pthread_mutex_unlock(&ch->mutex);
-    return 0;
+  size_t pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+  for (;;) {
+    // Count the slots free for this lap from pos on. None of them can be
+    // taken from under us but through tail, so one CAS claims them all.
+    size_t k = 0;
+    while (k < n && k < ch->capacity &&
+           atomic_load_explicit(&ch->seq[ring_index(ch, pos + k)],
+                                memory_order_acquire) ==
+               ring_seq_free(pos + k)) {
+      k++;
+    }
+    if (k == 0) {
+      intptr_t dif = (intptr_t)atomic_load_explicit(
+                         &ch->seq[ring_index(ch, pos)], memory_order_acquire) -
+                     (intptr_t)ring_seq_free(pos);
+      if (dif < 0)
+        return 0; // Full
+      pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(&ch->tail, &pos, pos + k,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      ring_copy_in(ch, pos, src, k);
+      for (size_t i = 0; i < k; i++) {
+        atomic_store_explicit(&ch->seq[ring_index(ch, pos + i)],
+                              ring_seq_full(pos + i), memory_order_release);
+      }
+      return k;
+    }
   }
+}
 
-  // If full, unlock and return failure (non-blocking)
-  if (ch->count >= ch->capacity) {
-    pthread_mutex_unlock(&ch->mutex);
-    return 0;
+// Take up to n of the oldest values from the ring into dst without locking.
+// Returns how many were taken (0 if empty).
+static size_t ring_pop_many(Channel *ch, char *dst, size_t n) {
+  if (ch->spsc) {
+    size_t head = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    if (ch->tail_cache - head < n) {
+      ch->tail_cache = atomic_load_explicit(&ch->tail, memory_order_acquire);
+    }
+    size_t avail = ch->tail_cache - head;
+    size_t k = avail < n ? avail : n;
+    if (k == 0)
+      return 0;
+    ring_copy_out(ch, head, dst, k);
+    atomic_store_explicit(&ch->head, head + k, memory_order_release);
+    return k;
   }
 
-  // Copy value into buffer
-  void *dest = (char *)ch->buffer + (ch->tail * ch->elem_size);
-  memcpy(dest, value, ch->elem_size);
+  size_t pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+  for (;;) {
+    size_t k = 0;
+    while (k < n && k < ch->capacity &&
+           atomic_load_explicit(&ch->seq[ring_index(ch, pos + k)],
+                                memory_order_acquire) ==
+               ring_seq_full(pos + k)) {
+      k++;
+    }
+    if (k == 0) {
+      intptr_t dif = (intptr_t)atomic_load_explicit(
+                         &ch->seq[ring_index(ch, pos)], memory_order_acquire) -
+                     (intptr_t)ring_seq_full(pos);
+      if (dif < 0)
+        return 0; // Empty
+      pos = atomic_load_explicit(&ch->head, memory_order_relaxed);
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(&ch->head, &pos, pos + k,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      ring_copy_out(ch, pos, dst, k);
+      for (size_t i = 0; i < k; i++) {
+        atomic_store_explicit(&ch->seq[ring_index(ch, pos + i)],
+                              ring_seq_free(pos + i + ch->capacity),
+                              memory_order_release);
+      }
+      return k;
+    }
+  }
+}
 
-  ch->tail = (ch->tail + 1) % ch->capacity;
-  ch->count++;
+// After a lock-free ring operation, wake one waiter from `q` (if any) to
+// retry. Pairs with the fence a parking operation issues between enqueuing
+// itself and re-checking the ring, so that either the waiter sees our update
+// or we see the waiter.
+static void channel_notify(Channel *ch, WaitQueue *q) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&q->len, memory_order_relaxed) == 0)
+    return;
 
-  // Signal that channel is not empty
-  pthread_cond_signal(&ch->not_empty);
+  pthread_mutex_lock(&ch->mutex);
+  Waiter *w = waitq_dequeue(q);
   pthread_mutex_unlock(&ch->mutex);
-
-  return 1;
+  if (w)
+    parker_wake(w->parker);
 }
 
-// Non-blocking receive: returns 1 if successful, 0 if would block
-// value is set to the received value if successful
-int8_t runtime_channel_try_recv(Channel *ch, void **value) {
-  if (!ch || !value)
-    return 0;
+// Like channel_notify, after a batch of n ring operations: wake up to n
+// waiters, all dequeued under one acquisition of the lock
+static void channel_notify_many(Channel *ch, WaitQueue *q, size_t n) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&q->len, memory_order_relaxed) == 0)
+    return;
 
+  Waiter *woken = NULL;
+  Waiter *w;
   pthread_mutex_lock(&ch->mutex);
-
-  // If empty and not closed, unlock and return failure (non-blocking)
-  if (ch->count == 0 && atomic_load(&ch->closed) == 0) {
-    pthread_mutex_unlock(&ch->mutex);
-    return 0;
+  while (n-- > 0 && (w = waitq_dequeue(q)) != NULL) {
+    w->next = woken;
+    woken = w;
   }
-
-  // If closed and empty, return failure
-  if (ch->count == 0 && atomic_load(&ch->closed) != 0) {
-    pthread_mutex_unlock(&ch->mutex);
-    *value = NULL;
-    return 0;
+  pthread_mutex_unlock(&ch->mutex);
+  while (woken) {
+    Waiter *next = woken->next;
+    parker_wake(woken->parker);
+    woken = next;
   }
+}
 
-  // Read value from buffer
-  void *src = (char *)ch->buffer + (ch->head * ch->elem_size);
-  void *result = runtime_alloc(ch->elem_size);
-  memcpy(result, src, ch->elem_size);
-
-  ch->head = (ch->head + 1) % ch->capacity;
-  ch->count--;
-
-  // Signal that channel is not full
-  pthread_cond_signal(&ch->not_full);
-  pthread_mutex_unlock(&ch->mutex);
+// Try to complete a send with ch->mutex held. Returns 1 if the value was
+// delivered or buffered; *wake is set to a waiter that must be woken once
+// the lock is dropped.
+static int channel_send_locked(Channel *ch, void *value, Waiter **wake) {
+  *wake = NULL;
+
+  if (ch->capacity > 0) {
+    if (!ring_push(ch, value))
+      return 0;
+    // Let a parked receiver retry
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ch->recvq.len, memory_order_relaxed) > 0)
+      *wake = waitq_dequeue(&ch->recvq);
+    return 1;
+  }
 
-  *value = result;
+  // Unbuffered: hand the value directly to a parked receiver, if any
+  Waiter *receiver = waitq_dequeue(&ch->recvq);
+  if (!receiver)
+    return 0;
+  channel_copy_in(ch, receiver->elem, value);
+  receiver->success = 1;
+  *wake = receiver;
   return 1;
 }
 
-// Wait on condition variable for send to become possible
-// NOTE: Caller must hold the channel's mutex before calling this
-// The mutex will be released while waiting and re-acquired before returning
-void runtime_channel_wait_for_send(Channel *ch) {
-  if (!ch)
-    return;
-  // Mutex must already be held by caller
-  while (ch->count >= ch->capacity && atomic_load(&ch->closed) == 0) {
-    pthread_cond_wait(&ch->not_full, &ch->mutex);
+// Try to complete a receive into `dst` (may be NULL) with ch->mutex held.
+// Returns 1 if a value was received, 0 if the channel is empty; *wake is set
+// to a waiter that must be woken once the lock is dropped.
+static int channel_recv_locked(Channel *ch, void *dst, Waiter **wake) {
+  *wake = NULL;
+
+  if (ch->capacity > 0) {
+    if (!ring_pop(ch, dst))
+      return 0;
+    // Let a parked sender retry
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ch->sendq.len, memory_order_relaxed) > 0)
+      *wake = waitq_dequeue(&ch->sendq);
+    return 1;
   }
-}
 
-// Wait on condition variable for recv to become possible
-// NOTE: Caller must hold the channel's mutex before calling this
-// The mutex will be released while waiting and re-acquired before returning
-void runtime_channel_wait_for_recv(Channel *ch) {
-  if (!ch)
-    return;
-  // Mutex must already be held by caller
-  while (ch->count == 0 && atomic_load(&ch->closed) == 0) {
-    pthread_cond_wait(&ch->not_empty, &ch->mutex);
-  }
+  // Unbuffered: take the value straight from a parked sender, if any
+  Waiter *sender = waitq_dequeue(&ch->sendq);
+  if (!sender)
+    return 0;
+  channel_copy_in(ch, dst, sender->elem);
+  sender->success = 1;
+  *wake = sender;
+  return 1;
 }
 
-// Sleep for specified nanoseconds (for select polling with timeout)
+static Channel *channel_new(size_t elem_size, size_t capacity, int spsc,
+                            int pointer_free) {
+  Channel *ch = (Channel *)gc_alloc(sizeof(Channel));
+  ch->elem_size = elem_size;
+  ch->capacity = capacity;
+  ch->spsc = spsc;
+  ch->pointer_free = pointer_free;
+  // Unbuffered channels hand values over directly and need no ring
+  size_t buffer_size = elem_size * capacity;
+  ch->buffer = capacity == 0  ? NULL
+               : pointer_free ? gc_alloc_atomic(buffer_size)
+                              : gc_alloc(buffer_size);
+  ch->seq = NULL;
+  if (capacity > 0 && !spsc) {
+    ch->seq =
+        (atomic_size_t *)gc_alloc_atomic(capacity * sizeof(atomic_size_t));
+    for (size_t i = 0; i < capacity; i++) {
+      atomic_init(&ch->seq[i], ring_seq_free(i));
+    }
+  }
+  atomic_init(&ch->tail, 0);
+  atomic_init(&ch->head, 0);
+  ch->head_cache = 0;
+  ch->tail_cache = 0;
+  pthread_mutex_init(&ch->mutex, NULL);
+  atomic_init(&ch->closed, 0);
+  ch->sendq.first = ch->sendq.last = NULL;
+  ch->recvq.first = ch->recvq.last = NULL;
+  atomic_init(&ch->sendq.len, 0);
+  atomic_init(&ch->recvq.len, 0);
+  return ch;
+}
+
+Channel *runtime_channel_new(size_t elem_size, size_t capacity,
+                             int8_t pointer_free) {
+  return channel_new(elem_size, capacity, 0, pointer_free != 0);
+}
+
+Channel *runtime_channel_new_spsc(size_t elem_size, size_t capacity,
+                                  int8_t pointer_free) {
+  return channel_new(elem_size, capacity, 1, pointer_free != 0);
+}
+
+// Send a value, blocking while the ring is full. Returns 1 once the value is
+// buffered or delivered, 0 if the channel is (or gets) closed first.
+static int channel_send(Channel *ch, void *value) {
+  if (!ch)
+    return 0;
+
+  for (;;) {
+    // Sending on a closed channel is a no-op
+    if (atomic_load(&ch->closed) != 0)
+      return 0;
+
+    // Fast path: room in the ring
+    if (ch->capacity > 0 && ring_push(ch, value)) {
+      channel_notify(ch, &ch->recvq);
+      return 1;
+    }
+
+    pthread_mutex_lock(&ch->mutex);
+    if (atomic_load(&ch->closed) != 0) {
+      pthread_mutex_unlock(&ch->mutex);
+      return 0;
+    }
+
+    // Become visible to receivers first, then check again: a lock-free
+    // receiver that frees a slot after this point will find us queued
+    Parker parker;
+    parker_init(&parker);
+    Waiter self = {0};
+    self.parker = &parker;
+    self.elem = value;
+    waitq_enqueue(&ch->sendq, &self);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    Waiter *wake;
+    if (channel_send_locked(ch, value, &wake)) {
+      waitq_remove(&ch->sendq, &self);
+      pthread_mutex_unlock(&ch->mutex);
+      parker_destroy(&parker);
+      if (wake)
+        parker_wake(wake->parker);
+      return 1;
+    }
+
+    // Park until a receiver takes our value (unbuffered), a slot frees up
+    // (buffered) or the channel closes
+    parker_park(&parker, channel_unlock, ch);
+    parker_destroy(&parker);
+    if (ch->capacity == 0)
+      return self.success;
+  }
+}
+
+void runtime_channel_send(Channel *ch, void *value) { channel_send(ch, value); }
+
+int8_t runtime_channel_recv_into(Channel *ch, void *dst) {
+  if (!ch)
+    return 0;
+
+  for (;;) {
+    // Fast path: an element in the ring
+    if (ch->capacity > 0 && ring_pop(ch, dst)) {
+      channel_notify(ch, &ch->sendq);
+      return 1;
+    }
+
+    pthread_mutex_lock(&ch->mutex);
+
+    // Become visible to senders first, then check again: a lock-free sender
+    // that fills the ring after this point will find us queued
+    Parker parker;
+    parker_init(&parker);
+    Waiter self = {0};
+    self.parker = &parker;
+    self.elem = dst;
+    waitq_enqueue(&ch->recvq, &self);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    Waiter *wake;
+    if (channel_recv_locked(ch, dst, &wake)) {
+      waitq_remove(&ch->recvq, &self);
+      pthread_mutex_unlock(&ch->mutex);
+      parker_destroy(&parker);
+      if (wake)
+        parker_wake(wake->parker);
+      return 1;
+    }
+
+    // Closed and empty: yield the zero value
+    if (atomic_load(&ch->closed) != 0) {
+      waitq_remove(&ch->recvq, &self);
+      pthread_mutex_unlock(&ch->mutex);
+      parker_destroy(&parker);
+      channel_copy_in(ch, dst, NULL);
+      return 0;
+    }
+
+    // Park until a sender hands us a value (unbuffered), fills the ring
+    // (buffered) or the channel closes
+    parker_park(&parker, channel_unlock, ch);
+    parker_destroy(&parker);
+    if (ch->capacity == 0) {
+      if (!self.success)
+        channel_copy_in(ch, dst, NULL);
+      return self.success;
+    }
+  }
+}
+
+void *runtime_channel_recv(Channel *ch) {
+  if (!ch)
+    return NULL;
+
+  void *result = alloc_maybe_atomic(ch->elem_size, ch->pointer_free);
+  if (!runtime_channel_recv_into(ch, result)) {
+    return NULL; // Closed and empty
+  }
+  return result;
+}
+
+void runtime_channel_close(Channel *ch) {
+  if (!ch)
+    return;
+
+  pthread_mutex_lock(&ch->mutex);
+  if (atomic_load(&ch->closed) != 0) {
+    pthread_mutex_unlock(&ch->mutex);
+    return;
+  }
+  atomic_store(&ch->closed, 1);
+
+  // Release every parked receiver (with a zero value) and sender (dropping
+  // its value). Waiters are collected first and woken after unlocking.
+  Waiter *released = NULL;
+  Waiter *w;
+  while ((w = waitq_dequeue(&ch->recvq)) != NULL) {
+    channel_copy_in(ch, w->elem, NULL);
+    w->success = 0;
+    w->next = released;
+    released = w;
+  }
+  while ((w = waitq_dequeue(&ch->sendq)) != NULL) {
+    w->success = 0;
+    w->next = released;
+    released = w;
+  }
+  pthread_mutex_unlock(&ch->mutex);
+
+  while (released) {
+    Waiter *next = released->next;
+    parker_wake(released->parker);
+    released = next;
+  }
+}
+
+int8_t runtime_channel_is_closed(Channel *ch) {
+  if (!ch)
+    return 1;
+  return (int8_t)atomic_load(&ch->closed);
+}
+
+// Non-blocking send: returns 1 if successful, 0 if would block
+int8_t runtime_channel_try_send(Channel *ch, void *value) {
+  if (!ch)
+    return 0;
+
+  // If closed, return failure
+  if (atomic_load(&ch->closed) != 0)
+    return 0;
+
+  if (ch->capacity > 0) {
+    if (!ring_push(ch, value))
+      return 0;
+    channel_notify(ch, &ch->recvq);
+    return 1;
+  }
+
+  pthread_mutex_lock(&ch->mutex);
+  Waiter *wake;
+  int sent = atomic_load(&ch->closed) == 0 && channel_send_locked(ch, value, &wake);
+  pthread_mutex_unlock(&ch->mutex);
+  if (sent && wake)
+    parker_wake(wake->parker);
+  return (int8_t)sent;
+}
+
+// Non-blocking receive into dst: returns 1 if successful, 0 if would block
+// (or if the channel is closed and empty)
+int8_t runtime_channel_try_recv_into(Channel *ch, void *dst) {
+  if (!ch)
+    return 0;
+
+  if (ch->capacity > 0) {
+    if (!ring_pop(ch, dst))
+      return 0;
+    channel_notify(ch, &ch->sendq);
+    return 1;
+  }
+
+  pthread_mutex_lock(&ch->mutex);
+  Waiter *wake;
+  int received = channel_recv_locked(ch, dst, &wake);
+  pthread_mutex_unlock(&ch->mutex);
+  if (wake)
+    parker_wake(wake->parker);
+  return (int8_t)received;
+}
+
+// Non-blocking receive: returns 1 if successful, 0 if would block
+// value is set to the received value if successful
+int8_t runtime_channel_try_recv(Channel *ch, void **value) {
+  if (!ch || !value)
+    return 0;
+
+  void *result = alloc_maybe_atomic(ch->elem_size, ch->pointer_free);
+  int8_t received = runtime_channel_try_recv_into(ch, result);
+
+  // Empty (open or closed): report failure (non-blocking)
+  *value = received ? result : NULL;
+  return received;
+}
+
+// Batched operations move runs of elements between a slice's buffer and the
+// ring with at most two copies each way, and wake the waiters a run satisfies
+// together. Compiled code lays a slice's elements out at the element type's
+// own size, which is the channel's elem_size (slice->elem_size only bounds
+// it: small elements get word-sized slots of capacity).
+
+// Take up to max buffered elements into out without blocking
+static size_t channel_take_many(Channel *ch, char *out, size_t max) {
+  if (max == 0)
+    return 0;
+  if (ch->capacity > 0) {
+    size_t k = ring_pop_many(ch, out, max);
+    if (k > 0)
+      channel_notify_many(ch, &ch->sendq, k);
+    return k;
+  }
+  // Unbuffered: take values from parked senders one at a time
+  size_t k = 0;
+  while (k < max &&
+         runtime_channel_try_recv_into(ch, out + k * ch->elem_size)) {
+    k++;
+  }
+  return k;
+}
+
+int64_t runtime_channel_send_many(Channel *ch, Slice *values) {
+  if (!ch || !values)
+    return 0;
+
+  const char *src = (const char *)values->data;
+  size_t n = values->len;
+  size_t sent = 0;
+  while (sent < n) {
+    if (atomic_load(&ch->closed) != 0)
+      break;
+    if (ch->capacity > 0) {
+      size_t k = ring_push_many(ch, src + sent * ch->elem_size, n - sent);
+      if (k > 0) {
+        channel_notify_many(ch, &ch->recvq, k);
+        sent += k;
+        continue;
+      }
+    }
+    // No room (or no ring): block on one element, then go on in runs
+    if (!channel_send(ch, (void *)(src + sent * ch->elem_size)))
+      break;
+    sent++;
+  }
+  return (int64_t)sent;
+}
+
+int64_t runtime_channel_recv_many(Channel *ch, Slice *dst, int64_t max) {
+  if (!ch || !dst || max <= 0)
+    return 0;
+
+  runtime_slice_reserve(dst, (size_t)max);
+  slice_make_writable(dst);
+  char *out = (char *)dst->data + dst->len * ch->elem_size;
+
+  size_t got = channel_take_many(ch, out, (size_t)max);
+  if (got == 0) {
+    // Nothing buffered: wait for one element, then take whatever else is
+    // there by the time it arrives
+    if (!runtime_channel_recv_into(ch, out))
+      return 0; // Closed and empty
+    got = 1 + channel_take_many(ch, out + ch->elem_size, (size_t)max - 1);
+  }
+  dst->len += got;
+  return (int64_t)got;
+}
+
+// ============================================================================
+// Select
+// ============================================================================
+// runtime_select implements `select` in one call, in the style of Go's
+// selectgo: poll every case in a random order; if none is ready (and the
+// select may block), enqueue a waiter on every channel at once, park, and let
+// the first operation that completes claim the select.
+
+// Cheap per-thread xorshift for picking the polling start point
+static __thread uint64_t g_select_rand = 0;
+
+static uint64_t select_rand(void) {
+  uint64_t x = g_select_rand;
+  if (x == 0)
+    x = (uint64_t)(uintptr_t)&g_select_rand ^ 0x9E3779B97F4A7C15ULL;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  g_select_rand = x;
+  return x;
+}
+
+typedef struct SelectLocks {
+  Channel **channels; // Distinct channels, sorted by address
+  int count;
+} SelectLocks;
+
+// Lock every distinct channel in address order (avoids lock-order deadlocks
+// between concurrent selects)
+static void select_lock(SelectLocks *locks) {
+  for (int i = 0; i < locks->count; i++) {
+    pthread_mutex_lock(&locks->channels[i]->mutex);
+  }
+}
+
+static void select_unlock(void *arg) {
+  SelectLocks *locks = (SelectLocks *)arg;
+  for (int i = locks->count - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&locks->channels[i]->mutex);
+  }
+}
+
+// Try every case once, starting at `start`, with all channels locked.
+// Returns the index of the case that completed (or -1), with *wake set to a
+// waiter to wake once the locks are dropped.
+static int64_t select_poll(SelectCase *cases, int64_t ncases, int64_t start,
+                           Waiter **wake) {
+  *wake = NULL;
+  for (int64_t n = 0; n < ncases; n++) {
+    int64_t i = (start + n) % ncases;
+    SelectCase *c = &cases[i];
+    Channel *ch = c->channel;
+    if (!ch)
+      continue; // A nil channel is never ready
+
+    if (c->kind == SELECT_CASE_SEND) {
+      if (atomic_load(&ch->closed) != 0 ||
+          !channel_send_locked(ch, c->elem, wake))
+        continue;
+    } else {
+      if (channel_recv_locked(ch, c->elem, wake)) {
+        c->received = 1;
+      } else if (atomic_load(&ch->closed) != 0) {
+        channel_copy_in(ch, c->elem, NULL); // Closed: zero value
+      } else {
+        continue;
+      }
+    }
+    return i;
+  }
+  return -1;
+}
+
+// Enqueue/dequeue the waiters of every usable case
+static void select_enqueue(SelectCase *cases, int64_t ncases, Waiter *waiters) {
+  for (int64_t i = 0; i < ncases; i++) {
+    SelectCase *c = &cases[i];
+    if (!c->channel)
+      continue;
+    waitq_enqueue(c->kind == SELECT_CASE_SEND ? &c->channel->sendq
+                                              : &c->channel->recvq,
+                  &waiters[i]);
+  }
+}
+
+static void select_dequeue(SelectCase *cases, int64_t ncases, Waiter *waiters) {
+  for (int64_t i = 0; i < ncases; i++) {
+    SelectCase *c = &cases[i];
+    if (!c->channel)
+      continue;
+    waitq_remove(c->kind == SELECT_CASE_SEND ? &c->channel->sendq
+                                             : &c->channel->recvq,
+                 &waiters[i]);
+  }
+}
+
+// Whether a buffered case could proceed without the lock having changed
+static int select_ring_ready(SelectCase *cases, int64_t ncases) {
+  for (int64_t i = 0; i < ncases; i++) {
+    Channel *ch = cases[i].channel;
+    if (!ch || ch->capacity == 0)
+      continue;
+    if (cases[i].kind == SELECT_CASE_SEND ? ring_can_push(ch)
+                                          : ring_can_pop(ch))
+      return 1;
+  }
+  return 0;
+}
+
+int64_t runtime_select(SelectCase *cases, int64_t ncases, int8_t block) {
+  return runtime_select_timeout(cases, ncases, block ? -1 : 0);
+}
+
+int64_t runtime_select_timeout(SelectCase *cases, int64_t ncases,
+                               int64_t timeout_ns) {
+  int64_t deadline = timeout_ns > 0 ? runtime_nanotime() + timeout_ns : -1;
+
+  // Collect the distinct channels in address order (insertion sort; selects
+  // are small)
+  Channel *channels[ncases > 0 ? ncases : 1];
+  SelectLocks locks = {channels, 0};
+  for (int64_t i = 0; i < ncases; i++) {
+    Channel *ch = cases[i].channel;
+    cases[i].received = 0;
+    if (!ch)
+      continue;
+    int pos = locks.count;
+    while (pos > 0 && channels[pos - 1] > ch)
+      pos--;
+    if (pos > 0 && channels[pos - 1] == ch)
+      continue;
+    memmove(&channels[pos + 1], &channels[pos],
+            (locks.count - pos) * sizeof(Channel *));
+    channels[pos] = ch;
+    locks.count++;
+  }
+
+  // With no usable cases, nothing is ever enqueued and we park forever
+  Waiter waiters[ncases > 0 ? ncases : 1];
+  int64_t start = ncases > 0 ? (int64_t)(select_rand() % (uint64_t)ncases) : 0;
+
+  select_lock(&locks);
+  for (;;) {
+    // Pass 1: look for a case that can proceed right now
+    Waiter *wake;
+    int64_t chosen = select_poll(cases, ncases, start, &wake);
+    if (chosen >= 0) {
+      select_unlock(&locks);
+      if (wake)
+        parker_wake(wake->parker);
+      return chosen;
+    }
+
+    if (timeout_ns == 0) {
+      select_unlock(&locks);
+      return -1;
+    }
+
+    // Pass 2: enqueue on every channel and park until one case completes
+    Parker parker;
+    parker_init(&parker);
+    SelectState state;
+    atomic_store(&state.done, 0);
+    state.winner = -1;
+
+    memset(waiters, 0, sizeof(waiters));
+    for (int64_t i = 0; i < ncases; i++) {
+      waiters[i].parker = &parker;
+      waiters[i].elem = cases[i].elem;
+      waiters[i].select = &state;
+      waiters[i].case_index = (int)i;
+    }
+    select_enqueue(cases, ncases, waiters);
+
+    // Buffered channels change without their lock: now that we are visible
+    // to their notifiers, look again before sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (select_ring_ready(cases, ncases)) {
+      select_dequeue(cases, ncases, waiters);
+      parker_destroy(&parker);
+      continue;
+    }
+    if (deadline >= 0 && runtime_nanotime() >= deadline) {
+      select_dequeue(cases, ncases, waiters);
+      select_unlock(&locks);
+      parker_destroy(&parker);
+      return -1;
+    }
+
+    parker_park_until(&parker, select_unlock, &locks, deadline, &state.done);
+    parker_destroy(&parker);
+
+    // Pass 3: dequeue the losing waiters
+    select_lock(&locks);
+    select_dequeue(cases, ncases, waiters);
+
+    int64_t winner = state.winner;
+    if (winner < 0) {
+      // The deadline claimed the select
+      select_unlock(&locks);
+      return -1;
+    }
+    if (cases[winner].channel->capacity > 0) {
+      // Woken to retry a buffered case: try it first
+      start = winner;
+      continue;
+    }
+    select_unlock(&locks);
+
+    if (cases[winner].kind == SELECT_CASE_RECV) {
+      cases[winner].received = waiters[winner].success;
+    }
+    return winner;
+  }
+}
+
+int8_t runtime_channel_send_timeout(Channel *ch, void *value,
+                                    int64_t timeout_ns) {
+  if (ch && atomic_load(&ch->closed) != 0)
+    return 0;
+  SelectCase c = {ch, value, SELECT_CASE_SEND, 0};
+  return runtime_select_timeout(&c, 1, timeout_ns) == 0;
+}
+
+int8_t runtime_channel_recv_into_timeout(Channel *ch, void *dst,
+                                         int64_t timeout_ns) {
+  SelectCase c = {ch, dst, SELECT_CASE_RECV, 0};
+  if (runtime_select_timeout(&c, 1, timeout_ns) < 0)
+    return -1;
+  return (int8_t)c.received;
+}
+
+typedef struct LegionSleep {
+  Legion *legion;
+  int64_t deadline;
+} LegionSleep;
+
+static void legion_sleep_expire(void *arg) {
+  runtime_legion_unblock((Legion *)arg);
+}
+
+static void legion_sleep_unlock(void *arg) {
+  LegionSleep *sleep = (LegionSleep *)arg;
+  timer_start(&sleep->legion->timer, sleep->deadline, legion_sleep_expire,
+              sleep->legion);
+}
+
+// Sleep for the given number of nanoseconds. A legion parks on a timer and
+// leaves its worker to the other legions; any other thread blocks.
 void runtime_nanosleep(long nanoseconds) {
-  struct timespec req;
-  req.tv_sec = nanoseconds / 1000000000L;
-  req.tv_nsec = nanoseconds % 1000000000L;
-  nanosleep(&req, NULL);
+  Legion *legion = runtime_get_current_legion();
+  if (!legion) {
+    struct timespec req;
+    req.tv_sec = nanoseconds / 1000000000L;
+    req.tv_nsec = nanoseconds % 1000000000L;
+    nanosleep(&req, NULL);
+    return;
+  }
+  if (nanoseconds <= 0) {
+    runtime_legion_yield();
+    return;
+  }
+
+  LegionSleep sleep = {legion, runtime_nanotime() + nanoseconds};
+  legion_park(legion_sleep_unlock, &sleep);
+}
+
+// ============================================================================
+// Wait groups and join handles
+// ============================================================================
+// A WaitGroup counts outstanding work; waiting parks (a legion through the
+// scheduler, any other thread on its Parker) until the count reaches zero,
+// so fork-join code needs neither a channel nor a message per task. A
+// JoinHandle is a wait group of one with room for the legion's result.
+// runtime_waitgroup_track and runtime_legion_join_handle attach a legion
+// before it starts; legion_entry signals both when the legion's function has
+// returned, so joining never polls the legion (which is recycled once dead).
+
+typedef struct GroupWaiter {
+  Parker parker;
+  struct GroupWaiter *next;
+} GroupWaiter;
+
+struct WaitGroup {
+  atomic_int_fast64_t count;
+  pthread_mutex_t mutex; // Protects waiters
+  GroupWaiter *waiters;  // Parked in runtime_waitgroup_wait
+};
+
+struct JoinHandle {
+  WaitGroup done;
+  void *result;
+};
+
+static void waitgroup_init(WaitGroup *wg, int64_t count) {
+  atomic_init(&wg->count, count);
+  pthread_mutex_init(&wg->mutex, NULL);
+  wg->waiters = NULL;
+}
+
+WaitGroup *runtime_waitgroup_new(void) {
+  WaitGroup *wg = (WaitGroup *)gc_alloc(sizeof(WaitGroup));
+  waitgroup_init(wg, 0);
+  return wg;
+}
+
+void runtime_waitgroup_add(WaitGroup *wg, int64_t delta) {
+  int64_t count = atomic_fetch_add(&wg->count, delta) + delta;
+  if (count < 0) {
+    fprintf(stderr, "fatal: wait group count went negative (%lld)\n",
+            (long long)count);
+    abort();
+  }
+  if (count > 0 || delta == 0) {
+    return;
+  }
+
+  // Reached zero: wake everyone who parked while it was positive. A waiter
+  // checks the count under the mutex before queuing, so none is missed.
+  pthread_mutex_lock(&wg->mutex);
+  GroupWaiter *waiters = wg->waiters;
+  wg->waiters = NULL;
+  pthread_mutex_unlock(&wg->mutex);
+  while (waiters) {
+    GroupWaiter *next = waiters->next; // The waiter may return once woken
+    parker_wake(&waiters->parker);
+    waiters = next;
+  }
+}
+
+void runtime_waitgroup_done(WaitGroup *wg) { runtime_waitgroup_add(wg, -1); }
+
+static void waitgroup_unlock(void *arg) {
+  pthread_mutex_unlock((pthread_mutex_t *)arg);
+}
+
+void runtime_waitgroup_wait(WaitGroup *wg) {
+  if (atomic_load(&wg->count) == 0) {
+    return;
+  }
+  pthread_mutex_lock(&wg->mutex);
+  if (atomic_load(&wg->count) == 0) {
+    pthread_mutex_unlock(&wg->mutex);
+    return;
+  }
+  GroupWaiter waiter;
+  parker_init(&waiter.parker);
+  waiter.next = wg->waiters;
+  wg->waiters = &waiter;
+  parker_park(&waiter.parker, waitgroup_unlock, &wg->mutex);
+  parker_destroy(&waiter.parker);
+}
+
+void runtime_waitgroup_track(WaitGroup *wg, Legion *legion) {
+  runtime_waitgroup_add(wg, 1);
+  legion->group = wg;
+}
+
+JoinHandle *runtime_legion_join_handle(Legion *legion) {
+  JoinHandle *handle = (JoinHandle *)gc_alloc(sizeof(JoinHandle));
+  waitgroup_init(&handle->done, 1);
+  handle->result = NULL;
+  legion->join = handle;
+  return handle;
+}
+
+void *runtime_legion_join(JoinHandle *handle) {
+  runtime_waitgroup_wait(&handle->done);
+  return handle->result;
+}
+
+void runtime_legion_set_result(void *result) {
+  Legion *legion = runtime_get_current_legion();
+  if (legion && legion->join) {
+    legion->join->result = result;
+  }
+}
+
+static void legion_finish(Legion *legion) {
+  JoinHandle *join = legion->join;
+  WaitGroup *group = legion->group;
+  legion->join = NULL;
+  legion->group = NULL;
+  if (join) {
+    runtime_waitgroup_done(&join->done);
+  }
+  if (group) {
+    runtime_waitgroup_done(group);
+  }
+}
+
+// ============================================================================
+// Legion (M:N Threading Model) - Infernal Scheduler (continued)
+// ============================================================================
+// The Legion struct is defined above (before Channel) to allow Channel
+// functions to access Legion members. Scheduler implementation continues below.
+
+// Spin-wait hint to the CPU
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// A Note is a one-shot wakeup for a single sleeper (after the Go runtime's):
+// note_clear arms it, note_sleep blocks until note_wakeup has been called.
+// On Linux it is just a futex word; elsewhere a mutex and condition variable.
+typedef struct Note {
+  atomic_int key; // 0 while armed, 1 once woken
+#if !defined(__linux__)
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#endif
+} Note;
+
+static void note_init(Note *note) {
+  atomic_init(&note->key, 0);
+#if !defined(__linux__)
+  pthread_mutex_init(&note->mutex, NULL);
+  pthread_cond_init(&note->cond, NULL);
+#endif
+}
+
+static void note_clear(Note *note) { atomic_store(&note->key, 0); }
+
+static void note_wakeup(Note *note) {
+#if defined(__linux__)
+  if (atomic_exchange(&note->key, 1) == 0) {
+    syscall(SYS_futex, &note->key, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+#else
+  pthread_mutex_lock(&note->mutex);
+  atomic_store(&note->key, 1);
+  pthread_cond_signal(&note->cond);
+  pthread_mutex_unlock(&note->mutex);
+#endif
+}
+
+// Block until note_wakeup, or until timeout_ns pass (negative waits forever).
+// Returns 1 if woken, 0 on timeout.
+static int note_sleep(Note *note, int64_t timeout_ns) {
+  struct timespec deadline;
+  if (timeout_ns >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ns / 1000000000;
+    deadline.tv_nsec += timeout_ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+#if defined(__linux__)
+  while (atomic_load(&note->key) == 0) {
+    struct timespec remaining, *timeout = NULL;
+    if (timeout_ns >= 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+      remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if (remaining.tv_nsec < 0) {
+        remaining.tv_sec--;
+        remaining.tv_nsec += 1000000000;
+      }
+      if (remaining.tv_sec < 0) {
+        return 0;
+      }
+      timeout = &remaining;
+    }
+    syscall(SYS_futex, &note->key, FUTEX_WAIT_PRIVATE, 0, timeout, NULL, 0);
+  }
+  return 1;
+#else
+  int woken = 1;
+  pthread_mutex_lock(&note->mutex);
+  while (atomic_load(&note->key) == 0) {
+    if (timeout_ns < 0) {
+      pthread_cond_wait(&note->cond, &note->mutex);
+      continue;
+    }
+    // Condition variables time out against the realtime clock
+    struct timespec now, abs;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &abs);
+    abs.tv_sec += deadline.tv_sec - now.tv_sec;
+    abs.tv_nsec += deadline.tv_nsec - now.tv_nsec;
+    while (abs.tv_nsec < 0) {
+      abs.tv_sec--;
+      abs.tv_nsec += 1000000000;
+    }
+    while (abs.tv_nsec >= 1000000000) {
+      abs.tv_sec++;
+      abs.tv_nsec -= 1000000000;
+    }
+    if (pthread_cond_timedwait(&note->cond, &note->mutex, &abs) != 0 &&
+        atomic_load(&note->key) == 0) {
+      woken = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&note->mutex);
+  return woken;
+#endif
+}
+
+// Per-worker scheduler state. Workers are allocated as one array and each
+// starts on its own cache line (as do the indices written by other threads),
+// so neighbouring workers' queue counters never false-share.
+//
+// The run queue is a Chase-Lev deque: only the owning worker pushes and pops,
+// at the bottom (LIFO, so freshly spawned work runs while it is cache-hot);
+// other workers steal from the top (FIFO) with a CAS. Anything that does not
+// fit, and anything scheduled from outside a worker, goes to the scheduler's
+// unbounded global queue.
+typedef struct Worker {
+  _Alignas(CACHE_LINE_SIZE) _Atomic(Legion *) run_queue[LEGION_QUEUE_SIZE];
+  atomic_long top; // Next slot to steal (advanced by thieves and the owner)
+  char pad0[CACHE_LINE_SIZE];
+  atomic_long bottom; // Next slot to push (written by the owner only)
+  char pad1[CACHE_LINE_SIZE];
+  _Atomic(Legion *) runnext; // Legion to run next on this worker
+  Legion *current_legion;    // Currently running legion
+  Context scheduler_ctx;     // Scheduler loop context
+  pthread_t thread;          // OS thread running this worker
+  uint32_t tick;             // Scheduling rounds (global queue fairness)
+  uint64_t rand;             // xorshift state for picking steal victims
+  Legion *free_legions;      // Dead legions ready for reuse (owner only)
+  int free_count;
+  Note park_note;            // Sleeps on this while idle
+  struct Worker *idle_next;  // Idle list link (under idle_mutex)
+  int idle;                  // On the idle list (under idle_mutex)
+  int spinning;              // Counted in spinning_workers
+  pthread_mutex_t timers_mutex; // Protects the timer heap
+  Timer **timers;               // Binary min-heap on Timer.when
+  int ntimers;
+  int timers_cap;
+  _Atomic(int64_t) timer_next; // Earliest deadline (INT64_MAX if none)
+  atomic_int polling; // Blocked in the network poller instead of on park_note
+  OutputBuffer out;   // Buffered stdout of the legions run here
+  atomic_uint run_seq; // Bumped as each legion starts and stops: odd while one runs
+  atomic_int preempt;  // Set by the monitor: yield at the next safepoint
+  StatCounters stats;  // Events counted on this worker's thread
+  struct TraceRing *trace; // Its recent trace events (allocated on first use)
+  int id;
+} Worker;
+
+// Count an event on the worker running the caller (see stat_add)
+static inline void worker_stat(Worker *w, StatCounter counter, uint64_t n) {
+  atomic_uint_fast64_t *slot = &w->stats.n[counter];
+  atomic_store_explicit(
+      slot, atomic_load_explicit(slot, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+// Scheduler structure
+typedef struct {
+  Worker *workers;            // Cache-line aligned array of num_workers
+  void *workers_mem;          // Allocation backing `workers`
+  int num_workers;            // OS threads started (cap for set_workers)
+  atomic_int active_workers;  // Workers currently allowed to run legions
+  pthread_mutex_t procs_mutex; // Parks workers above active_workers
+  pthread_cond_t procs_cond;
+  pthread_mutex_t global_mutex; // Protects the global queue list
+  Legion *global_head;          // Global queue (linked through Legion.next)
+  Legion *global_tail;
+  atomic_long global_size;     // Read without the lock
+  pthread_mutex_t idle_mutex;  // Protects the idle worker list
+  Worker *idle_head;           // Parked workers (linked through idle_next)
+  atomic_int idle_workers;     // Length of the idle list
+  atomic_int spinning_workers; // Workers out of work but still looking
+  _Atomic(Worker *) timer_sleeper;   // Parked worker waiting on the timers
+  _Atomic(int64_t) timer_sleep_until; // ... and the deadline it sleeps until
+  pthread_mutex_t pool_mutex;    // Protects the dead legion depot
+  Legion *pool_depot;            // Dead legions shared between workers
+  int pool_depot_count;
+  atomic_int active_legions;     // Number of active legions
+  atomic_int timers_firing;      // Timers taken off a heap, fn not yet done
+  atomic_int draining;           // Shutdown is waiting for the legions
+  Note drain_note;               // Woken when none is left to wait for
+  atomic_int shutdown;           // Shutdown flag
+  pthread_key_t thread_local_id; // Thread-local storage for thread ID
+  pthread_t monitor;             // Preempts legions that overrun their slice
+  Note monitor_note;             // Woken to stop the monitor at shutdown
+} Scheduler;
+
+static Scheduler *g_scheduler = NULL;
+static atomic_int g_legion_id_counter = 0;
+
+// Thread-local storage for current thread ID. The ID is stored off by one so
+// that worker 0 is distinguishable from "no value" (NULL). It is looked up
+// through pthread_getspecific rather than a __thread variable because a legion
+// can resume on a different OS thread, and the compiler may cache the address
+// of a __thread variable across the context switch.
+static int get_thread_id(void) {
+  if (!g_scheduler) {
+    return -1;
+  }
+  void *id = pthread_getspecific(g_scheduler->thread_local_id);
+  if (id == NULL) {
+    return -1;
+  }
+  return (int)(intptr_t)id - 1;
+}
+
+static void set_thread_id(int id) {
+  pthread_setspecific(g_scheduler->thread_local_id, (void *)(intptr_t)(id + 1));
+}
+
+// Get the currently running legion
+Legion *runtime_get_current_legion(void) {
+  if (!g_scheduler) {
+    return NULL;
+  }
+
+  int thread_id = get_thread_id();
+  if (thread_id < 0 || thread_id >= g_scheduler->num_workers) {
+    return NULL;
+  }
+
+  return g_scheduler->workers[thread_id].current_legion;
+}
+
+// Number of workers to run: one per online CPU unless MALPHAS_MAXPROCS says
+// otherwise (a la GOMAXPROCS)
+static int scheduler_default_workers(void) {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int n = ncpu > 0 ? (int)ncpu : 1;
+
+  const char *env = getenv("MALPHAS_MAXPROCS");
+  if (env && *env) {
+    char *end;
+    long requested = strtol(env, &end, 10);
+    if (*end == '\0' && requested > 0) {
+      n = requested < SCHEDULER_MAX_WORKERS ? (int)requested
+                                            : SCHEDULER_MAX_WORKERS;
+    }
+  }
+  return n < SCHEDULER_MAX_WORKERS ? n : SCHEDULER_MAX_WORKERS;
+}
+
+// Legion stacks reserve LEGION_STACK_MAX of address space above a guard page
+// but only commit (make accessible) the top of it. Running into the rest of
+// the reservation faults into legion_fault_handler, which commits more with
+// grow_legion_stack and retries the access, so a legion costs a few pages
+// until it actually recurses deeply. mir2llvm marks every function with
+// "probe-stack" so that a large frame touches its pages in order instead of
+// jumping over the guard page.
+static size_t stack_page_size(void) {
+  static size_t page;
+  if (!page) {
+    long sys = sysconf(_SC_PAGESIZE);
+    page = sys > LEGION_STACK_GUARD_SIZE ? (size_t)sys : LEGION_STACK_GUARD_SIZE;
+  }
+  return page;
+}
+
+static size_t round_to_page(size_t n) {
+  size_t page = stack_page_size();
+  return (n + page - 1) & ~(page - 1);
+}
+
+// Reserve a cap-byte stack above a guard page and commit its top size bytes.
+// Returns the base of the reservation, or NULL.
+static void *allocate_stack_with_guard(size_t cap, size_t size) {
+  size_t guard = stack_page_size();
+  char *mem = mmap(NULL, guard + cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  if (mprotect(mem + guard + cap - size, size, PROT_READ | PROT_WRITE) != 0) {
+    munmap(mem, guard + cap);
+    return NULL;
+  }
+  return mem + guard;
+}
+
+// Commit the top size bytes of a legion's stack. Returns 0 if that does not
+// fit the reservation.
+static int legion_stack_commit(Legion *legion, size_t size) {
+  if (size <= legion->stack_size) {
+    return 1;
+  }
+  if (!legion->stack_mapped || size > legion->stack_cap) {
+    return 0;
+  }
+  char *top = (char *)legion->stack_base + legion->stack_cap;
+  if (mprotect(top - size, size - legion->stack_size,
+               PROT_READ | PROT_WRITE) != 0) {
+    return 0;
+  }
+  legion->stack_size = size;
+  legion->stack = top - size;
+  return 1;
+}
+
+// Return all but the top size bytes of a dead legion's stack to the OS
+static void legion_stack_decommit(Legion *legion, size_t size) {
+  if (!legion->stack_mapped || legion->stack_size <= size) {
+    return;
+  }
+  // Mapping fresh inaccessible pages over the range discards its contents
+  char *top = (char *)legion->stack_base + legion->stack_cap;
+  if (mmap(top - legion->stack_size, legion->stack_size - size, PROT_NONE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+    return;
+  }
+  legion->stack_size = size;
+  legion->stack = top - size;
+}
+
+// Grow a legion's committed stack to cover fault_addr, at least doubling it.
+// Returns 0 if the address is not in the uncommitted part of the reservation.
+static int grow_legion_stack(Legion *legion, void *fault_addr) {
+  char *addr = (char *)fault_addr;
+  char *top = (char *)legion->stack_base + legion->stack_cap;
+  if (!legion->stack_mapped || addr < (char *)legion->stack_base ||
+      addr >= top - legion->stack_size) {
+    return 0;
+  }
+
+  size_t new_size = legion->stack_size * 2;
+  size_t needed = round_to_page((size_t)(top - addr));
+  if (new_size < needed) {
+    new_size = needed;
+  }
+  if (new_size > legion->stack_cap) {
+    new_size = legion->stack_cap;
+  }
+  return legion_stack_commit(legion, new_size);
+}
+
+static struct sigaction g_prev_segv_action;
+static struct sigaction g_prev_bus_action;
+
+// SIGSEGV/SIGBUS handler (runs on the worker's signal stack). Faults in the
+// running legion's stack reservation grow the stack; anything else is handed
+// back to the previous disposition by re-raising on return.
+static void legion_fault_handler(int sig, siginfo_t *info, void *uctx) {
+  (void)uctx;
+  int thread_id = get_thread_id();
+  Legion *legion = NULL;
+  if (thread_id >= 0 && thread_id < g_scheduler->num_workers) {
+    legion = g_scheduler->workers[thread_id].current_legion;
+  }
+
+  if (legion && legion->stack_mapped) {
+    if (grow_legion_stack(legion, info->si_addr)) {
+      return; // Retry the access
+    }
+    char *addr = (char *)info->si_addr;
+    char *base = (char *)legion->stack_base;
+    if (addr >= base - stack_page_size() && addr < base + legion->stack_cap) {
+      static const char msg[] = "malphas: legion stack overflow\n";
+      legion->stack_overflow = 1;
+      ssize_t written = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+      (void)written;
+    }
+  }
+
+  sigaction(sig, sig == SIGSEGV ? &g_prev_segv_action : &g_prev_bus_action,
+            NULL);
+}
+
+static void install_fault_handler(void) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = legion_fault_handler;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGSEGV, &sa, &g_prev_segv_action);
+  sigaction(SIGBUS, &sa, &g_prev_bus_action);
+}
+
+static pthread_once_t g_scheduler_once = PTHREAD_ONCE_INIT;
+static void *scheduler_monitor(void *arg);
+static void stats_init(void);
+
+static void scheduler_init_once(void) {
+  Scheduler *sched = (Scheduler *)gc_alloc(sizeof(Scheduler));
+
+  // A thread is started per CPU even when MALPHAS_MAXPROCS asks for fewer, so
+  // that runtime_scheduler_set_workers can raise the count later
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int active = scheduler_default_workers();
+  int num_workers = ncpu > active ? (int)ncpu : active;
+  if (num_workers > SCHEDULER_MAX_WORKERS) {
+    num_workers = SCHEDULER_MAX_WORKERS;
+  }
+
+  // GC memory is only 16-byte aligned: over-allocate and align by hand. The
+  // array stays reachable (it holds the queued legions) through both fields.
+  sched->workers_mem =
+      gc_alloc(num_workers * sizeof(Worker) + CACHE_LINE_SIZE);
+  sched->workers =
+      (Worker *)(((uintptr_t)sched->workers_mem + CACHE_LINE_SIZE - 1) &
+                 ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+  sched->num_workers = num_workers;
+  atomic_init(&sched->active_workers, active);
+  pthread_mutex_init(&sched->procs_mutex, NULL);
+  pthread_cond_init(&sched->procs_cond, NULL);
+  pthread_mutex_init(&sched->global_mutex, NULL);
+  sched->global_head = sched->global_tail = NULL;
+  atomic_init(&sched->global_size, 0);
+  pthread_mutex_init(&sched->idle_mutex, NULL);
+  sched->idle_head = NULL;
+  atomic_init(&sched->idle_workers, 0);
+  atomic_init(&sched->spinning_workers, 0);
+  atomic_init(&sched->timer_sleeper, NULL);
+  atomic_init(&sched->timer_sleep_until, INT64_MAX);
+  pthread_mutex_init(&sched->pool_mutex, NULL);
+  sched->pool_depot = NULL;
+  sched->pool_depot_count = 0;
+  atomic_init(&sched->active_legions, 0);
+  atomic_init(&sched->timers_firing, 0);
+  atomic_init(&sched->draining, 0);
+  note_init(&sched->drain_note);
+  atomic_init(&sched->shutdown, 0);
+
+  // Initialize thread-local storage
+  pthread_key_create(&sched->thread_local_id, NULL);
+
+  for (int i = 0; i < num_workers; i++) {
+    Worker *w = &sched->workers[i];
+    w->id = i;
+    for (int j = 0; j < LEGION_QUEUE_SIZE; j++) {
+      atomic_init(&w->run_queue[j], NULL);
+    }
+    atomic_init(&w->top, 0);
+    atomic_init(&w->bottom, 0);
+    atomic_init(&w->runnext, NULL);
+    w->current_legion = NULL;
+    w->tick = 0;
+    w->rand = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+    w->free_legions = NULL;
+    w->free_count = 0;
+    note_init(&w->park_note);
+    w->idle_next = NULL;
+    w->idle = 0;
+    w->spinning = 0;
+    pthread_mutex_init(&w->timers_mutex, NULL);
+    w->timers = NULL;
+    w->ntimers = 0;
+    w->timers_cap = 0;
+    atomic_init(&w->timer_next, INT64_MAX);
+    atomic_init(&w->polling, 0);
+    output_buffer_init(&w->out);
+    atomic_init(&w->run_seq, 0);
+    atomic_init(&w->preempt, 0);
+    for (int j = 0; j < STAT_COUNT; j++) {
+      atomic_init(&w->stats.n[j], 0);
+    }
+    w->trace = NULL;
+  }
+
+  g_scheduler = sched;
+  install_fault_handler();
+  stats_init();
+
+  // Start OS thread pool
+  for (int i = 0; i < num_workers; i++) {
+    Worker *w = &sched->workers[i];
+    pthread_create(&w->thread, NULL, (void *(*)(void *))runtime_scheduler_run,
+                   &w->id);
+  }
+  note_init(&sched->monitor_note);
+  pthread_create(&sched->monitor, NULL, scheduler_monitor, NULL);
+}
+
+// Initialize the infernal scheduler
+void runtime_scheduler_init(void) {
+  pthread_once(&g_scheduler_once, scheduler_init_once);
+}
+
+// Change how many workers run legions (n <= 0 only queries). Returns the
+// previous count. Workers above the new count finish their current legion,
+// hand their queue to the others and sleep until the count is raised again.
+int64_t runtime_scheduler_set_workers(int64_t n) {
+  runtime_scheduler_init();
+
+  int previous = atomic_load(&g_scheduler->active_workers);
+  if (n <= 0) {
+    return previous;
+  }
+  if (n > g_scheduler->num_workers) {
+    n = g_scheduler->num_workers;
+  }
+
+  pthread_mutex_lock(&g_scheduler->procs_mutex);
+  atomic_store(&g_scheduler->active_workers, (int)n);
+  pthread_cond_broadcast(&g_scheduler->procs_cond);
+  pthread_mutex_unlock(&g_scheduler->procs_mutex);
+  return previous;
+}
+
+// Release a dead legion's stack and synchronization objects. The Legion
+// itself is GC memory and goes away with its last reference.
+static void legion_destroy(Legion *legion) {
+  if (legion->stack_mapped) {
+    munmap((char *)legion->stack_base - stack_page_size(),
+           legion->stack_cap + stack_page_size());
+  }
+  legion->stack_base = legion->stack = NULL;
+  pthread_cond_destroy(&legion->cond);
+  pthread_mutex_destroy(&legion->mutex);
+}
+
+// Destroy every legion on a list linked through Legion.next
+static void legion_destroy_list(Legion *list) {
+  while (list) {
+    Legion *next = list->next;
+    legion_destroy(list);
+    list = next;
+  }
+}
+
+static Worker *current_worker(void);
+
+// Take a dead legion (with its stack) for reuse. Spawning on a worker pops
+// from that worker's cache, refilling it from the depot a batch at a time;
+// other threads take from the depot directly. Returns NULL if the pools are
+// empty.
+static Legion *legion_pool_take(void) {
+  if (!g_scheduler) {
+    return NULL;
+  }
+  Worker *self = current_worker();
+  Legion *legion;
+  if (self) {
+    if (!self->free_legions) {
+      pthread_mutex_lock(&g_scheduler->pool_mutex);
+      for (int i = 0; i < LEGION_POOL_BATCH && g_scheduler->pool_depot; i++) {
+        legion = g_scheduler->pool_depot;
+        g_scheduler->pool_depot = legion->next;
+        g_scheduler->pool_depot_count--;
+        legion->next = self->free_legions;
+        self->free_legions = legion;
+        self->free_count++;
+      }
+      pthread_mutex_unlock(&g_scheduler->pool_mutex);
+    }
+    legion = self->free_legions;
+    if (legion) {
+      self->free_legions = legion->next;
+      self->free_count--;
+    }
+    return legion;
+  }
+
+  pthread_mutex_lock(&g_scheduler->pool_mutex);
+  legion = g_scheduler->pool_depot;
+  if (legion) {
+    g_scheduler->pool_depot = legion->next;
+    g_scheduler->pool_depot_count--;
+  }
+  pthread_mutex_unlock(&g_scheduler->pool_mutex);
+  return legion;
+}
+
+// Return a dead legion to the worker that ran it. A full cache spills a batch
+// into the depot, and whatever the depot has no room for is destroyed.
+static void legion_pool_put(Worker *self, Legion *legion) {
+  legion_stack_decommit(legion, LEGION_STACK_KEEP);
+  legion->next = self->free_legions;
+  self->free_legions = legion;
+  self->free_count++;
+  if (self->free_count <= LEGION_POOL_LOCAL_MAX) {
+    return;
+  }
+
+  Legion *excess = NULL;
+  pthread_mutex_lock(&g_scheduler->pool_mutex);
+  for (int i = 0; i < LEGION_POOL_BATCH; i++) {
+    legion = self->free_legions;
+    self->free_legions = legion->next;
+    self->free_count--;
+    if (g_scheduler->pool_depot_count < LEGION_POOL_DEPOT_MAX) {
+      legion->next = g_scheduler->pool_depot;
+      g_scheduler->pool_depot = legion;
+      g_scheduler->pool_depot_count++;
+    } else {
+      legion->next = excess;
+      excess = legion;
+    }
+  }
+  pthread_mutex_unlock(&g_scheduler->pool_mutex);
+  legion_destroy_list(excess);
+}
+
+// Give back half of the depot's stacks. Called by workers that found nothing
+// to do, so a burst of spawns does not pin its peak stack memory forever.
+static void legion_pool_trim(void) {
+  pthread_mutex_lock(&g_scheduler->pool_mutex);
+  int n = g_scheduler->pool_depot_count / 2;
+  Legion *trimmed = NULL;
+  for (int i = 0; i < n; i++) {
+    Legion *legion = g_scheduler->pool_depot;
+    g_scheduler->pool_depot = legion->next;
+    legion->next = trimmed;
+    trimmed = legion;
+  }
+  g_scheduler->pool_depot_count -= n;
+  pthread_mutex_unlock(&g_scheduler->pool_mutex);
+  legion_destroy_list(trimmed);
+}
+
+// Create a new legion (spawned entity)
+Legion *runtime_legion_spawn(void (*fn)(void *), void *arg, size_t stack_size) {
+  if (stack_size == 0) {
+    stack_size = LEGION_STACK_SIZE;
+  }
+  if (stack_size > LEGION_STACK_MAX) {
+    stack_size = LEGION_STACK_MAX;
+  }
+  stack_size = round_to_page(stack_size);
+
+  // Reuse a dead legion and its stack, committing more of it if needed
+  Legion *legion = legion_pool_take();
+  if (legion && !legion_stack_commit(legion, stack_size)) {
+    legion_destroy(legion);
+    legion = NULL;
+  }
+
+  if (!legion) {
+    legion = (Legion *)gc_alloc(sizeof(Legion));
+    legion->stack_cap = LEGION_STACK_MAX;
+    legion->stack_size = stack_size;
+
+    // Reserve the stack behind a guard page
+    legion->stack_base = allocate_stack_with_guard(LEGION_STACK_MAX, stack_size);
+    legion->stack_mapped = legion->stack_base != NULL;
+    if (!legion->stack_base) {
+      // Fallback to regular allocation, which cannot grow
+      legion->stack_base = gc_alloc(LEGION_STACK_MAX);
+      legion->stack_size = LEGION_STACK_MAX;
+    }
+    legion->stack =
+        (char *)legion->stack_base + legion->stack_cap - legion->stack_size;
+    pthread_cond_init(&legion->cond, NULL);
+    pthread_mutex_init(&legion->mutex, NULL);
+    legion->timer.owner = NULL;
+    legion->timer.index = -1;
+    atomic_init(&legion->timer.running, 0);
+  }
+
+  legion->fn = fn;
+  legion->arg = arg;
+  legion->state = LEGION_STATE_RUNNABLE;
+  legion->next = NULL;
+  legion->id = atomic_fetch_add(&g_legion_id_counter, 1);
+  stat_add(STAT_SPAWNED, 1);
+  trace(TRACE_SPAWN, legion->id, 0);
+  legion->thread_id = -1;
+  legion->stack_overflow = 0;
+  legion->blocked_on = NULL;
+  legion->park_unlock = NULL;
+  legion->park_arg = NULL;
+  legion->output = NULL;
+  legion->arena = NULL;
+  legion->group = NULL;
+  legion->join = NULL;
+
+  // Initialize context
+  malphas_context_make_trampoline(&legion->ctx, (void (*)(void *))legion_entry,
+                                  legion, legion->stack_base,
+                                  legion->stack_cap);
+
+  return legion;
+}
+
+// Idle workers wait on their own Note on a list under idle_mutex. A worker
+// that runs out of work first spins (looks around the queues, stealing) while
+// counted in spinning_workers, and only then parks. Making work available
+// wakes one parked worker, and only when nobody is spinning already: a
+// spinner will find the work itself, and the first spinner to find some
+// wakes the next (worker_stop_spinning), so wakeups track demand instead of
+// every spawn broadcasting.
+
+static void idle_push(Worker *w) {
+  pthread_mutex_lock(&g_scheduler->idle_mutex);
+  w->idle_next = g_scheduler->idle_head;
+  g_scheduler->idle_head = w;
+  w->idle = 1;
+  atomic_fetch_add(&g_scheduler->idle_workers, 1);
+  pthread_mutex_unlock(&g_scheduler->idle_mutex);
+}
+
+// Pop a parked worker for waking. `spinning` marks it as a spinner (already
+// counted in spinning_workers by the caller); this happens under the lock so
+// that a worker failing idle_remove sees it.
+static Worker *idle_pop(int spinning) {
+  pthread_mutex_lock(&g_scheduler->idle_mutex);
+  Worker *w = g_scheduler->idle_head;
+  if (w) {
+    g_scheduler->idle_head = w->idle_next;
+    w->idle = 0;
+    w->spinning = spinning;
+    atomic_fetch_sub(&g_scheduler->idle_workers, 1);
+  }
+  pthread_mutex_unlock(&g_scheduler->idle_mutex);
+  return w;
+}
+
+// Take w off the idle list. Returns 0 if a waker has already popped it (and
+// so is about to wake it, with w->spinning set).
+static int idle_remove(Worker *w) {
+  int removed = 0;
+  pthread_mutex_lock(&g_scheduler->idle_mutex);
+  if (w->idle) {
+    Worker **link = &g_scheduler->idle_head;
+    while (*link != w) {
+      link = &(*link)->idle_next;
+    }
+    *link = w->idle_next;
+    w->idle = 0;
+    atomic_fetch_sub(&g_scheduler->idle_workers, 1);
+    removed = 1;
+  }
+  pthread_mutex_unlock(&g_scheduler->idle_mutex);
+  return removed;
+}
+
+// Network poller (defined after the timers)
+static void netpoll_break(void);
+
+// Shutdown drain (defined after the network poller)
+static void scheduler_drain_check(void);
+
+// Wake a parked worker. The timer sleeper may be blocked in the network
+// poller rather than on its note: the store to the note and the load of
+// `polling` pair with the sleeper's store to `polling` and re-check of the
+// note, so either it sees the note or we break the poll.
+static void worker_wakeup(Worker *w) {
+  stat_add(STAT_WORKER_WAKEUPS, 1);
+  note_wakeup(&w->park_note);
+  if (atomic_load(&w->polling)) {
+    netpoll_break();
+  }
+}
+
+// Wake one parked worker, as a spinner, after making work available. Pairs
+// with the fence a parking worker issues between joining the idle list and
+// re-checking for work.
+static void scheduler_wake_idle(void) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&g_scheduler->spinning_workers,
+                           memory_order_relaxed) != 0 ||
+      atomic_load_explicit(&g_scheduler->idle_workers, memory_order_relaxed) ==
+          0) {
+    return;
+  }
+  int expected = 0;
+  if (!atomic_compare_exchange_strong(&g_scheduler->spinning_workers,
+                                      &expected, 1)) {
+    return; // Somebody else started spinning
+  }
+  Worker *w = idle_pop(1);
+  if (!w) {
+    atomic_fetch_sub(&g_scheduler->spinning_workers, 1);
+    return;
+  }
+  worker_wakeup(w);
+}
+
+// Wake every parked worker (shutdown)
+static void scheduler_wake_all(void) {
+  Worker *w;
+  while ((w = idle_pop(0)) != NULL) {
+    worker_wakeup(w);
+  }
+}
+
+// Monotonic clock in nanoseconds
+int64_t runtime_nanotime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Timers live on per-worker binary heaps, added to by the worker that arms
+// them and run by whichever worker gets there first: the owner every
+// scheduling round, spinners while they steal, and parking workers before
+// they sleep. One parked worker (the timer sleeper) sleeps only until the
+// earliest deadline on behalf of everybody; the rest sleep indefinitely.
+
+static void timer_heap_swap(Worker *w, int i, int j) {
+  Timer *t = w->timers[i];
+  w->timers[i] = w->timers[j];
+  w->timers[j] = t;
+  w->timers[i]->index = i;
+  w->timers[j]->index = j;
+}
+
+static void timer_heap_up(Worker *w, int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (w->timers[parent]->when <= w->timers[i]->when) {
+      break;
+    }
+    timer_heap_swap(w, i, parent);
+    i = parent;
+  }
+}
+
+static void timer_heap_down(Worker *w, int i) {
+  for (;;) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < w->ntimers &&
+        w->timers[left]->when < w->timers[smallest]->when) {
+      smallest = left;
+    }
+    if (right < w->ntimers &&
+        w->timers[right]->when < w->timers[smallest]->when) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    timer_heap_swap(w, i, smallest);
+    i = smallest;
+  }
+}
+
+// Remove the timer at heap position i (timers_mutex held)
+static void timer_heap_remove(Worker *w, int i) {
+  Timer *t = w->timers[i];
+  int last = --w->ntimers;
+  if (i != last) {
+    w->timers[i] = w->timers[last];
+    w->timers[i]->index = i;
+    timer_heap_down(w, i);
+    timer_heap_up(w, i);
+  }
+  w->timers[last] = NULL;
+  t->index = -1;
+  atomic_store(&w->timer_next,
+               w->ntimers > 0 ? w->timers[0]->when : INT64_MAX);
+}
+
+// A timer became the earliest on its heap: make sure some worker will be
+// awake in time to run it
+static void timer_notify(int64_t when) {
+  atomic_thread_fence(memory_order_seq_cst);
+  Worker *sleeper = atomic_load(&g_scheduler->timer_sleeper);
+  if (sleeper) {
+    if (when < atomic_load(&g_scheduler->timer_sleep_until)) {
+      worker_wakeup(sleeper);
+    }
+    return;
+  }
+  scheduler_wake_idle();
+}
+
+// Arm t to run fn(arg) at `when`, on the calling worker's heap. Must be
+// called on a worker thread.
+static void timer_start(Timer *t, int64_t when, void (*fn)(void *),
+                        void *arg) {
+  // A previous firing of the same timer may still be finishing
+  while (atomic_load(&t->running)) {
+    cpu_relax();
+  }
+
+  Worker *w = &g_scheduler->workers[get_thread_id()];
+  t->when = when;
+  t->fn = fn;
+  t->arg = arg;
+
+  pthread_mutex_lock(&w->timers_mutex);
+  if (w->ntimers == w->timers_cap) {
+    // GC memory, so that the timers (embedded in legions) keep the legions
+    // they will wake alive
+    int cap = w->timers_cap ? w->timers_cap * 2 : 16;
+    Timer **timers = (Timer **)gc_alloc(cap * sizeof(Timer *));
+    if (w->ntimers > 0) {
+      memcpy(timers, w->timers, w->ntimers * sizeof(Timer *));
+    }
+    w->timers = timers;
+    w->timers_cap = cap;
+  }
+  t->owner = w;
+  t->index = w->ntimers++;
+  w->timers[t->index] = t;
+  timer_heap_up(w, t->index);
+  int earliest = t->index == 0;
+  atomic_store(&w->timer_next, w->timers[0]->when);
+  pthread_mutex_unlock(&w->timers_mutex);
+
+  if (earliest) {
+    timer_notify(when);
+  }
+}
+
+// Disarm t. Once this returns, t's action has either not run and never will,
+// or has finished running.
+static void timer_stop(Timer *t) {
+  Worker *w = t->owner;
+  if (w) {
+    pthread_mutex_lock(&w->timers_mutex);
+    if (t->index >= 0) {
+      timer_heap_remove(w, t->index);
+    }
+    pthread_mutex_unlock(&w->timers_mutex);
+  }
+  while (atomic_load(&t->running)) {
+    cpu_relax();
+  }
+}
+
+// Run the timers on w's heap that are due by `now`. Returns how many ran.
+static int timers_run(Worker *w, int64_t now) {
+  if (atomic_load_explicit(&w->timer_next, memory_order_relaxed) > now) {
+    return 0;
+  }
+  int ran = 0;
+  pthread_mutex_lock(&w->timers_mutex);
+  while (w->ntimers > 0 && w->timers[0]->when <= now) {
+    Timer *t = w->timers[0];
+    // Counted before it leaves the heap, so a drain never sees it in neither
+    atomic_fetch_add(&g_scheduler->timers_firing, 1);
+    timer_heap_remove(w, 0);
+    atomic_store(&t->running, 1);
+    pthread_mutex_unlock(&w->timers_mutex);
+
+    t->fn(t->arg);
+    atomic_store(&t->running, 0);
+    atomic_fetch_sub(&g_scheduler->timers_firing, 1);
+    scheduler_drain_check(); // It may have had no legion left to wake
+    ran++;
+
+    pthread_mutex_lock(&w->timers_mutex);
+  }
+  pthread_mutex_unlock(&w->timers_mutex);
+  return ran;
+}
+
+static int timers_run_all(int64_t now) {
+  int ran = 0;
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    ran += timers_run(&g_scheduler->workers[i], now);
+  }
+  return ran;
+}
+
+// Earliest deadline on any heap (INT64_MAX if none)
+static int64_t timers_earliest(void) {
+  int64_t earliest = INT64_MAX;
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    int64_t next = atomic_load(&g_scheduler->workers[i].timer_next);
+    if (next < earliest) {
+      earliest = next;
+    }
+  }
+  return earliest;
 }
 
 // ============================================================================
-// Legion (M:N Threading Model) - Infernal Scheduler (continued)
+// Network Poller
 // ============================================================================
-// The Legion struct is defined above (before Channel) to allow Channel
-// functions to access Legion members. Scheduler implementation continues below.
+// Descriptors opened with runtime_io_open are made non-blocking and registered,
+// edge-triggered, with epoll (kqueue on macOS and the BSDs). An operation that
+// would block parks on the descriptor's PollDesc through the same Parker path
+// channels use, so a legion leaves its worker to the other legions. Readiness
+// is collected by the timer sleeper, which blocks in the poller instead of on
+// its note (wakers break the poll with an eventfd write or an EVFILT_USER
+// event), and by workers that run out of work, which look without blocking.
+// One PollDesc is kept per descriptor number for the life of the process, so
+// the pointer handed to the kernel never dangles; a stale event for a reused
+// number is just a spurious wakeup, which every caller retries through.
+
+typedef struct PollWait {
+  Parker parker;
+  atomic_int done; // Claimed by whichever of readiness, close and deadline
+  int64_t result;  // 0 if ready, -EBADF if closed, else -ETIMEDOUT
+} PollWait;
+
+typedef struct PollDesc {
+  pthread_mutex_t mutex;
+  int registered;      // Registered with the poller (until runtime_io_close)
+  int ready[2];        // Readiness arrived while nobody waited, per mode
+  PollWait *waiter[2]; // Parked reader and writer
+} PollDesc;
+
+static struct {
+  int fd;           // epoll or kqueue descriptor
+  int break_fd;     // eventfd that interrupts epoll_wait (Linux)
+  int init_error;   // errno if the poller could not be created
+  atomic_int active;   // The poller exists (the timer sleeper blocks in it)
+  atomic_int breaking; // A break is pending, so further ones can be skipped
+  atomic_int polling;  // A worker is running a non-blocking poll
+  atomic_int waiters;  // Parked in runtime_io_wait
+  pthread_mutex_t descs_mutex; // Protects descs
+  PollDesc **descs;            // Indexed by descriptor number
+  int ndescs;
+} g_netpoll;
+
+static pthread_once_t g_netpoll_once = PTHREAD_ONCE_INIT;
+
+static void netpoll_init(void) {
+  pthread_mutex_init(&g_netpoll.descs_mutex, NULL);
+  g_netpoll.fd = -1;
+  g_netpoll.break_fd = -1;
+#if defined(__linux__)
+  g_netpoll.fd = epoll_create1(EPOLL_CLOEXEC);
+  if (g_netpoll.fd < 0) {
+    g_netpoll.init_error = errno;
+    return;
+  }
+  g_netpoll.break_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (g_netpoll.break_fd < 0 ||
+      epoll_ctl(g_netpoll.fd, EPOLL_CTL_ADD, g_netpoll.break_fd, &ev) < 0) {
+    g_netpoll.init_error = errno;
+    return;
+  }
+#elif defined(EVFILT_USER)
+  g_netpoll.fd = kqueue();
+  if (g_netpoll.fd < 0) {
+    g_netpoll.init_error = errno;
+    return;
+  }
+  fcntl(g_netpoll.fd, F_SETFD, FD_CLOEXEC);
+  struct kevent ev;
+  EV_SET(&ev, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+  if (kevent(g_netpoll.fd, &ev, 1, NULL, 0, NULL) < 0) {
+    g_netpoll.init_error = errno;
+    return;
+  }
+#else
+  g_netpoll.init_error = ENOSYS;
+  return;
+#endif
+  atomic_store(&g_netpoll.active, 1);
+}
 
-// Scheduler structure
-typedef struct {
-  pthread_t threads[MAX_OS_THREADS]; // OS thread pool
-  int num_threads;                   // Actual number of threads
-  Legion *run_queue[MAX_OS_THREADS]
-                   [LEGION_QUEUE_SIZE]; // Per-thread run queues (work-stealing)
-  atomic_int queue_head[MAX_OS_THREADS];       // Head of each queue (atomic for
-                                               // work-stealing)
-  atomic_int queue_tail[MAX_OS_THREADS];       // Tail of each queue (atomic for
-                                               // work-stealing)
-  pthread_mutex_t queue_mutex[MAX_OS_THREADS]; // Mutex for each queue
-  pthread_cond_t queue_cond[MAX_OS_THREADS];   // Condition for queue
-  atomic_int active_legions;                   // Number of active legions
-  atomic_int shutdown;                         // Shutdown flag
-  Legion *current_legion[MAX_OS_THREADS]; // Currently running legion per thread
-  pthread_key_t thread_local_id;          // Thread-local storage for thread ID
-} Scheduler;
+// Interrupt a worker blocked in netpoll
+static void netpoll_break(void) {
+  int expected = 0;
+  if (!atomic_compare_exchange_strong(&g_netpoll.breaking, &expected, 1)) {
+    return;
+  }
+#if defined(__linux__)
+  uint64_t one = 1;
+  ssize_t n = write(g_netpoll.break_fd, &one, sizeof(one));
+  (void)n;
+#elif defined(EVFILT_USER)
+  struct kevent ev;
+  EV_SET(&ev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+  kevent(g_netpoll.fd, &ev, 1, NULL, 0, NULL);
+#endif
+}
 
-static Scheduler *g_scheduler = NULL;
-static atomic_int g_legion_id_counter = 0;
+// The PollDesc for fd, created if `create` (NULL if fd is out of range or has
+// none)
+static PollDesc *pollfd_get(int64_t fd, int create) {
+  if (fd < 0 || fd > INT_MAX) {
+    return NULL;
+  }
+  PollDesc *pd = NULL;
+  pthread_mutex_lock(&g_netpoll.descs_mutex);
+  if (fd >= g_netpoll.ndescs && create) {
+    int n = g_netpoll.ndescs ? g_netpoll.ndescs : 64;
+    while (n <= fd) {
+      n *= 2;
+    }
+    PollDesc **descs =
+        (PollDesc **)realloc(g_netpoll.descs, n * sizeof(PollDesc *));
+    if (descs) {
+      memset(descs + g_netpoll.ndescs, 0,
+             (n - g_netpoll.ndescs) * sizeof(PollDesc *));
+      g_netpoll.descs = descs;
+      g_netpoll.ndescs = n;
+    }
+  }
+  if (fd < g_netpoll.ndescs) {
+    pd = g_netpoll.descs[fd];
+    if (!pd && create) {
+      // Plain memory: the kernel holds the only other reference
+      pd = (PollDesc *)calloc(1, sizeof(PollDesc));
+      if (pd) {
+        pthread_mutex_init(&pd->mutex, NULL);
+        g_netpoll.descs[fd] = pd;
+      }
+    }
+  }
+  pthread_mutex_unlock(&g_netpoll.descs_mutex);
+  return pd;
+}
 
-// Thread-local storage for current thread ID
-static void init_thread_local_id(void) {
-  pthread_key_create(&g_scheduler->thread_local_id, NULL);
+static void pollfd_unlock(void *arg) {
+  pthread_mutex_unlock(&((PollDesc *)arg)->mutex);
 }
 
-static int get_thread_id(void) {
-  void *id = pthread_getspecific(g_scheduler->thread_local_id);
-  if (id == NULL) {
-    return -1;
+// Readiness for `mode` arrived on pd: wake its waiter, or remember it for the
+// next one. Returns 1 if somebody was woken.
+static int pollfd_ready(PollDesc *pd, int mode) {
+  pthread_mutex_lock(&pd->mutex);
+  PollWait *wait = pd->waiter[mode];
+  pd->waiter[mode] = NULL;
+  int expected = 0;
+  if (wait && atomic_compare_exchange_strong(&wait->done, &expected, 1)) {
+    wait->result = 0;
+    pthread_mutex_unlock(&pd->mutex);
+    parker_wake(&wait->parker);
+    return 1;
   }
-  return (int)(intptr_t)id;
+  pd->ready[mode] = 1;
+  pthread_mutex_unlock(&pd->mutex);
+  return 0;
 }
 
-static void set_thread_id(int id) {
-  pthread_setspecific(g_scheduler->thread_local_id, (void *)(intptr_t)id);
+#if defined(__linux__)
+// epoll_wait only takes milliseconds, which would make the timer sleeper late
+// by up to one; epoll_pwait2 (Linux 5.11) takes a timespec.
+static int netpoll_epoll_wait(struct epoll_event *events, int64_t timeout_ns) {
+#if defined(SYS_epoll_pwait2)
+  static atomic_int no_pwait2;
+  if (timeout_ns > 0 && !atomic_load_explicit(&no_pwait2,
+                                               memory_order_relaxed)) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    int n = (int)syscall(SYS_epoll_pwait2, g_netpoll.fd, events,
+                         NETPOLL_MAX_EVENTS, &ts, NULL, 0);
+    if (n >= 0 || errno != ENOSYS) {
+      return n;
+    }
+    atomic_store_explicit(&no_pwait2, 1, memory_order_relaxed);
+  }
+#endif
+  int ms = -1;
+  if (timeout_ns >= 0) {
+    int64_t t = (timeout_ns + 999999) / 1000000;
+    ms = t > INT_MAX ? INT_MAX : (int)t;
+  }
+  return epoll_wait(g_netpoll.fd, events, NETPOLL_MAX_EVENTS, ms);
 }
+#endif
 
-// Get the currently running legion
-Legion *runtime_get_current_legion(void) {
-  if (!g_scheduler) {
+// Wait up to timeout_ns (negative waits forever, 0 only looks) for I/O and
+// wake whoever waits on what became ready: on a worker thread they land on
+// its own queues. Returns how many were woken.
+static int netpoll(int64_t timeout_ns) {
+  int woken = 0;
+#if defined(__linux__)
+  struct epoll_event events[NETPOLL_MAX_EVENTS];
+  int n = netpoll_epoll_wait(events, timeout_ns);
+  for (int i = 0; i < n; i++) {
+    PollDesc *pd = (PollDesc *)events[i].data.ptr;
+    uint32_t ev = events[i].events;
+    if (!pd) {
+      // The break is meant for the blocked poller, so only it takes it
+      if (timeout_ns != 0) {
+        uint64_t count;
+        ssize_t r = read(g_netpoll.break_fd, &count, sizeof(count));
+        (void)r;
+        atomic_store(&g_netpoll.breaking, 0);
+      }
+      continue;
+    }
+    if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+      woken += pollfd_ready(pd, IO_WAIT_READ);
+    }
+    if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+      woken += pollfd_ready(pd, IO_WAIT_WRITE);
+    }
+  }
+#elif defined(EVFILT_USER)
+  struct kevent events[NETPOLL_MAX_EVENTS];
+  struct timespec ts, *timeout = NULL;
+  if (timeout_ns >= 0) {
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    timeout = &ts;
+  }
+  int n = kevent(g_netpoll.fd, NULL, 0, events, NETPOLL_MAX_EVENTS, timeout);
+  for (int i = 0; i < n; i++) {
+    if (events[i].filter == EVFILT_USER) {
+      // EV_CLEAR has reset it: pass a break meant for the blocked poller on
+      atomic_store(&g_netpoll.breaking, 0);
+      if (timeout_ns == 0) {
+        netpoll_break();
+      }
+      continue;
+    }
+    PollDesc *pd = (PollDesc *)events[i].udata;
+    if (events[i].filter == EVFILT_READ) {
+      woken += pollfd_ready(pd, IO_WAIT_READ);
+    } else if (events[i].filter == EVFILT_WRITE) {
+      woken += pollfd_ready(pd, IO_WAIT_WRITE);
+    }
+  }
+#else
+  (void)timeout_ns;
+#endif
+  return woken;
+}
+
+// Poll without blocking if anybody waits for I/O and no other worker is
+// already looking. Returns how many were woken.
+static int netpoll_check(void) {
+  if (atomic_load_explicit(&g_netpoll.waiters, memory_order_relaxed) == 0) {
+    return 0;
+  }
+  int expected = 0;
+  if (!atomic_compare_exchange_strong(&g_netpoll.polling, &expected, 1)) {
+    return 0;
+  }
+  int woken = netpoll(0);
+  atomic_store(&g_netpoll.polling, 0);
+  return woken;
+}
+
+// Somebody started waiting for I/O: make sure some worker will poll. A timer
+// sleeper that went to sleep on its note (before the poller existed) is woken
+// so that it goes back to sleep in the poller.
+static void netpoll_notify(void) {
+  atomic_thread_fence(memory_order_seq_cst);
+  Worker *sleeper = atomic_load(&g_scheduler->timer_sleeper);
+  if (sleeper) {
+    if (!atomic_load(&sleeper->polling)) {
+      worker_wakeup(sleeper);
+    }
+    return;
+  }
+  scheduler_wake_idle();
+}
+
+// Make fd non-blocking and register it with the poller
+int64_t runtime_io_open(int64_t fd) {
+  runtime_scheduler_init();
+  pthread_once(&g_netpoll_once, netpoll_init);
+  if (!atomic_load(&g_netpoll.active)) {
+    return -g_netpoll.init_error;
+  }
+  PollDesc *pd = pollfd_get(fd, 1);
+  if (!pd) {
+    return fd < 0 ? -EBADF : -ENOMEM;
+  }
+
+  int64_t result = 0;
+  pthread_mutex_lock(&pd->mutex);
+  if (!pd->registered) {
+#if defined(__linux__)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = pd;
+    int rc = epoll_ctl(g_netpoll.fd, EPOLL_CTL_ADD, (int)fd, &ev);
+#elif defined(EVFILT_USER)
+    struct kevent ev[2];
+    EV_SET(&ev[0], (uintptr_t)fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, pd);
+    EV_SET(&ev[1], (uintptr_t)fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, pd);
+    int rc = kevent(g_netpoll.fd, ev, 2, NULL, 0, NULL);
+#else
+    int rc = -1;
+    errno = ENOSYS;
+#endif
+    // Regular files cannot be polled (EPERM): they never block anyway
+    if (rc < 0 && errno != EEXIST) {
+      result = -errno;
+    } else {
+      int flags = fcntl((int)fd, F_GETFL);
+      if (flags < 0 ||
+          (!(flags & O_NONBLOCK) &&
+           fcntl((int)fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+        result = -errno;
+      } else {
+        pd->registered = 1;
+        pd->ready[IO_WAIT_READ] = 0;
+        pd->ready[IO_WAIT_WRITE] = 0;
+      }
+    }
+  }
+  pthread_mutex_unlock(&pd->mutex);
+  return result;
+}
+
+// Park until fd is ready for `mode` (IO_WAIT_READ or IO_WAIT_WRITE), for at
+// most timeout_ns (negative waits forever, 0 only looks). fd is registered on
+// first use. Readiness is edge-triggered: callers retry their operation and
+// wait again if it still would block.
+int64_t runtime_io_wait(int64_t fd, int32_t mode, int64_t timeout_ns) {
+  if (mode != IO_WAIT_READ && mode != IO_WAIT_WRITE) {
+    return -EINVAL;
+  }
+  PollDesc *pd = pollfd_get(fd, 0);
+  if (!pd || !pd->registered) {
+    int64_t err = runtime_io_open(fd);
+    if (err < 0) {
+      return err;
+    }
+    pd = pollfd_get(fd, 0);
+  }
+
+  pthread_mutex_lock(&pd->mutex);
+  if (!pd->registered) {
+    pthread_mutex_unlock(&pd->mutex);
+    return -EBADF; // Closed meanwhile
+  }
+  if (pd->ready[mode]) {
+    pd->ready[mode] = 0;
+    pthread_mutex_unlock(&pd->mutex);
+    return 0;
+  }
+  if (pd->waiter[mode]) {
+    pthread_mutex_unlock(&pd->mutex);
+    return -EBUSY; // One waiter per direction
+  }
+  if (timeout_ns == 0) {
+    pthread_mutex_unlock(&pd->mutex);
+    return -ETIMEDOUT;
+  }
+
+  PollWait wait;
+  parker_init(&wait.parker);
+  atomic_init(&wait.done, 0);
+  wait.result = -ETIMEDOUT;
+  pd->waiter[mode] = &wait;
+  atomic_fetch_add(&g_netpoll.waiters, 1);
+  netpoll_notify();
+
+  int64_t deadline = timeout_ns > 0 ? runtime_nanotime() + timeout_ns : -1;
+  parker_park_until(&wait.parker, pollfd_unlock, pd, deadline, &wait.done);
+
+  pthread_mutex_lock(&pd->mutex);
+  if (pd->waiter[mode] == &wait) {
+    pd->waiter[mode] = NULL; // Timed out
+  }
+  pthread_mutex_unlock(&pd->mutex);
+  atomic_fetch_sub(&g_netpoll.waiters, 1);
+  parker_destroy(&wait.parker);
+  return wait.result;
+}
+
+// Read up to len bytes, parking while fd has nothing to read. Returns the
+// count (0 at end of file) or -errno.
+int64_t runtime_io_read(int64_t fd, void *buf, int64_t len) {
+  for (;;) {
+    ssize_t n = read((int)fd, buf, (size_t)len);
+    if (n >= 0) {
+      return n;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return -errno;
+    }
+    int64_t err = runtime_io_wait(fd, IO_WAIT_READ, -1);
+    if (err < 0) {
+      return err;
+    }
+  }
+}
+
+// Write without raising SIGPIPE on sockets
+static ssize_t io_write_some(int fd, const void *buf, size_t len) {
+#if defined(MSG_NOSIGNAL)
+  ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+  if (n >= 0 || errno != ENOTSOCK) {
+    return n;
+  }
+#endif
+  return write(fd, buf, len);
+}
+
+// Write all len bytes, parking while fd is full. Returns len, the count
+// written before an error, or -errno if nothing was.
+int64_t runtime_io_write(int64_t fd, const void *buf, int64_t len) {
+  int64_t written = 0;
+  while (written < len) {
+    ssize_t n =
+        io_write_some((int)fd, (const char *)buf + written, len - written);
+    if (n >= 0) {
+      written += n;
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    int64_t err = -errno;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      err = runtime_io_wait(fd, IO_WAIT_WRITE, -1);
+      if (err == 0) {
+        continue;
+      }
+    }
+    return written > 0 ? written : err;
+  }
+  return written;
+}
+
+// Options every connected socket gets (failures are harmless: not TCP)
+static void socket_setup(int fd) {
+  int one = 1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#if defined(SO_NOSIGPIPE)
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+// Accept a connection on a listening socket, parking until one arrives.
+// Returns the new (registered) descriptor or -errno.
+int64_t runtime_io_accept(int64_t fd) {
+  for (;;) {
+    int conn = accept((int)fd, NULL, NULL);
+    if (conn >= 0) {
+      socket_setup(conn);
+      int64_t err = runtime_io_open(conn);
+      if (err < 0) {
+        close(conn);
+        return err;
+      }
+      return conn;
+    }
+    if (errno == EINTR || errno == ECONNABORTED) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return -errno;
+    }
+    int64_t err = runtime_io_wait(fd, IO_WAIT_READ, -1);
+    if (err < 0) {
+      return err;
+    }
+  }
+}
+
+// Deregister and close fd. Legions waiting on it wake with -EBADF.
+int64_t runtime_io_close(int64_t fd) {
+  PollDesc *pd = pollfd_get(fd, 0);
+  if (pd) {
+    PollWait *woken[2] = {NULL, NULL};
+    pthread_mutex_lock(&pd->mutex);
+    if (pd->registered) {
+#if defined(__linux__)
+      epoll_ctl(g_netpoll.fd, EPOLL_CTL_DEL, (int)fd, NULL);
+#endif
+      pd->registered = 0;
+      for (int mode = 0; mode < 2; mode++) {
+        PollWait *wait = pd->waiter[mode];
+        pd->waiter[mode] = NULL;
+        int expected = 0;
+        if (wait && atomic_compare_exchange_strong(&wait->done, &expected, 1)) {
+          wait->result = -EBADF;
+          woken[mode] = wait;
+        }
+      }
+    }
+    pthread_mutex_unlock(&pd->mutex);
+    for (int mode = 0; mode < 2; mode++) {
+      if (woken[mode]) {
+        parker_wake(&woken[mode]->parker);
+      }
+    }
+  }
+  return close((int)fd) < 0 ? -errno : 0;
+}
+
+// Resolve host:port for a stream socket. An empty host is the wildcard
+// address when listening and loopback when connecting. Name lookup blocks the
+// worker.
+static int64_t tcp_resolve(String *host, int64_t port, int passive,
+                           struct addrinfo **res) {
+  char service[32];
+  snprintf(service, sizeof(service), "%lld", (long long)port);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  const char *name = host && host->len > 0 ? host->data : NULL;
+  int rc = getaddrinfo(name, service, &hints, res);
+  if (rc == 0) {
+    return 0;
+  }
+  return rc == EAI_SYSTEM ? -errno : -EADDRNOTAVAIL;
+}
+
+// Listen for TCP connections on host:port. Returns the registered listening
+// descriptor or -errno.
+int64_t runtime_tcp_listen(String *host, int64_t port) {
+  struct addrinfo *res;
+  int64_t err = tcp_resolve(host, port, 1, &res);
+  if (err < 0) {
+    return err;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      err = -errno;
+      continue;
+    }
+    int one = 1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+        listen(fd, SOMAXCONN) == 0) {
+      err = runtime_io_open(fd);
+      if (err == 0) {
+        break;
+      }
+    } else {
+      err = -errno;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd >= 0 ? fd : err;
+}
+
+// Connect to host:port, parking while the connection is established. Returns
+// the registered descriptor or -errno.
+int64_t runtime_tcp_connect(String *host, int64_t port) {
+  struct addrinfo *res;
+  int64_t err = tcp_resolve(host, port, 0, &res);
+  if (err < 0) {
+    return err;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      err = -errno;
+      continue;
+    }
+    socket_setup(fd);
+    err = runtime_io_open(fd);
+    if (err == 0) {
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        break;
+      }
+      err = -errno;
+      if (errno == EINPROGRESS) {
+        err = runtime_io_wait(fd, IO_WAIT_WRITE, -1);
+        int soerr = 0;
+        socklen_t len = sizeof(soerr);
+        if (err == 0 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &len) == 0 &&
+            soerr == 0) {
+          break;
+        }
+        if (err == 0) {
+          err = soerr ? -soerr : -errno;
+        }
+      }
+    }
+    runtime_io_close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd >= 0 ? fd : err;
+}
+
+// ============================================================================
+// Legion (M:N Threading Model) - Infernal Scheduler (continued)
+// ============================================================================
+
+// Append a chain of `count` legions (linked through `next`) to the global
+// queue
+static void global_push_batch(Legion *first, Legion *last, long count) {
+  last->next = NULL;
+  pthread_mutex_lock(&g_scheduler->global_mutex);
+  if (g_scheduler->global_tail) {
+    g_scheduler->global_tail->next = first;
+  } else {
+    g_scheduler->global_head = first;
+  }
+  g_scheduler->global_tail = last;
+  atomic_fetch_add(&g_scheduler->global_size, count);
+  pthread_mutex_unlock(&g_scheduler->global_mutex);
+}
+
+static void global_push(Legion *legion) {
+  global_push_batch(legion, legion, 1);
+}
+
+// Pop from the bottom of the owner's deque
+static Legion *deque_pop(Worker *w) {
+  long b = atomic_load_explicit(&w->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&w->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&w->top, memory_order_relaxed);
+
+  if (t > b) {
+    // Empty
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
     return NULL;
   }
 
-  int thread_id = get_thread_id();
-  if (thread_id < 0 || thread_id >= MAX_OS_THREADS) {
+  Legion *legion = atomic_load_explicit(&w->run_queue[b % LEGION_QUEUE_SIZE],
+                                        memory_order_relaxed);
+  if (t == b) {
+    // Last element: race thieves for it
+    if (!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      legion = NULL;
+    }
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+  }
+  return legion;
+}
+
+// Push to the bottom of the owner's deque. When it is full, move half of it
+// (plus the new legion) to the global queue, so the next pushes are cheap.
+static void deque_push(Worker *w, Legion *legion) {
+  long b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+  long t = atomic_load_explicit(&w->top, memory_order_acquire);
+
+  if (b - t >= LEGION_QUEUE_SIZE) {
+    Legion *last = legion;
+    long count = 1;
+    for (int i = 0; i < LEGION_QUEUE_SIZE / 2; i++) {
+      Legion *moved = deque_pop(w);
+      if (!moved) {
+        break; // Thieves emptied it meanwhile
+      }
+      last->next = moved;
+      last = moved;
+      count++;
+    }
+    global_push_batch(legion, last, count);
+    return;
+  }
+
+  atomic_store_explicit(&w->run_queue[b % LEGION_QUEUE_SIZE], legion,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+}
+
+// Steal from the top of another worker's deque. Returns NULL if it is empty
+// or another thread won the race.
+static Legion *deque_steal(Worker *victim) {
+  long t = atomic_load_explicit(&victim->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+  if (t >= b) {
+    return NULL;
+  }
+
+  Legion *legion = atomic_load_explicit(
+      &victim->run_queue[t % LEGION_QUEUE_SIZE], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&victim->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
     return NULL;
   }
+  return legion;
+}
 
-  return g_scheduler->current_legion[thread_id];
+// Approximate number of legions in a deque
+static long deque_size(Worker *w) {
+  long n = atomic_load_explicit(&w->bottom, memory_order_relaxed) -
+           atomic_load_explicit(&w->top, memory_order_relaxed);
+  return n > 0 ? n : 0;
 }
 
-// Initialize the infernal scheduler
-void runtime_scheduler_init(void) {
-  if (g_scheduler != NULL) {
-    return; // Already initialized
+// Steal half of the victim's deque: return one legion to run and keep the
+// rest on our own deque
+static Legion *deque_steal_half(Worker *self, Worker *victim) {
+  long n = deque_size(victim);
+  if (n == 0) {
+    return NULL;
+  }
+
+  Legion *first = NULL;
+  long got = 0;
+  for (long want = n - n / 2; want > 0; want--) {
+    Legion *legion = deque_steal(victim);
+    if (!legion) {
+      break;
+    }
+    got++;
+    if (!first) {
+      first = legion;
+    } else {
+      deque_push(self, legion);
+    }
+  }
+  if (first) {
+    worker_stat(self, STAT_STEALS, 1);
+    worker_stat(self, STAT_STOLEN, got);
+    trace(TRACE_STEAL, victim->id, got);
+  }
+  return first;
+}
+
+// Take a fair share of the global queue: return one legion to run and move
+// the rest onto our own deque
+static Legion *global_grab(Worker *self) {
+  if (atomic_load(&g_scheduler->global_size) == 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_scheduler->global_mutex);
+  long size = atomic_load(&g_scheduler->global_size);
+  long n = size / atomic_load(&g_scheduler->active_workers) + 1;
+  if (n > size) {
+    n = size;
+  }
+  if (n > LEGION_QUEUE_SIZE / 2) {
+    n = LEGION_QUEUE_SIZE / 2;
+  }
+
+  Legion *batch = g_scheduler->global_head;
+  Legion *last = NULL;
+  for (long i = 0; i < n; i++) {
+    last = last ? last->next : batch;
+  }
+  if (last) {
+    g_scheduler->global_head = last->next;
+    if (!g_scheduler->global_head) {
+      g_scheduler->global_tail = NULL;
+    }
+    last->next = NULL;
+    atomic_fetch_sub(&g_scheduler->global_size, n);
   }
+  pthread_mutex_unlock(&g_scheduler->global_mutex);
 
-  g_scheduler = (Scheduler *)runtime_alloc(sizeof(Scheduler));
-  g_scheduler->num_threads = MAX_OS_THREADS;
-  atomic_store(&g_scheduler->active_legions, 0);
-  atomic_store(&g_scheduler->shutdown, 0);
-
-  // Initialize thread-local storage
-  pthread_key_create(&g_scheduler->thread_local_id, NULL);
-
-  for (int i = 0; i < MAX_OS_THREADS; i++) {
-    atomic_store(&g_scheduler->queue_head[i], 0);
-    atomic_store(&g_scheduler->queue_tail[i], 0);
-    pthread_mutex_init(&g_scheduler->queue_mutex[i], NULL);
-    pthread_cond_init(&g_scheduler->queue_cond[i], NULL);
-    g_scheduler->current_legion[i] = NULL;
+  if (!batch || n == 0) {
+    return NULL;
   }
 
-  // Start OS thread pool
-  for (int i = 0; i < MAX_OS_THREADS; i++) {
-    int *thread_id = (int *)runtime_alloc(sizeof(int));
-    *thread_id = i;
-    pthread_create(&g_scheduler->threads[i], NULL,
-                   (void *(*)(void *))runtime_scheduler_run, thread_id);
+  // Deque pushes may overflow into the global queue, so they happen
+  // after dropping its lock
+  Legion *first = batch;
+  batch = batch->next;
+  first->next = NULL;
+  while (batch) {
+    Legion *next = batch->next;
+    batch->next = NULL;
+    deque_push(self, batch);
+    batch = next;
   }
+  return first;
 }
 
-// Allocate stack with guard pages for overflow detection
-static void *allocate_stack_with_guard(size_t size) {
-  // Allocate stack + guard pages
-  size_t total_size = size + LEGION_STACK_GUARD_SIZE * 2;
-  void *mem = mmap(NULL, total_size, PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  if (mem == MAP_FAILED) {
+// The worker the calling thread runs, if it is an active worker
+static Worker *current_worker(void) {
+  int thread_id = get_thread_id();
+  if (thread_id < 0 || thread_id >= g_scheduler->num_workers ||
+      thread_id >= atomic_load(&g_scheduler->active_workers)) {
     return NULL;
   }
-
-  // Protect guard pages
-  mprotect(mem, LEGION_STACK_GUARD_SIZE, PROT_NONE);
-  mprotect((char *)mem + size + LEGION_STACK_GUARD_SIZE,
-           LEGION_STACK_GUARD_SIZE, PROT_NONE);
-
-  // Return pointer to usable stack area (after first guard page)
-  return (char *)mem + LEGION_STACK_GUARD_SIZE;
+  return &g_scheduler->workers[thread_id];
 }
 
-// Create a new legion (spawned entity)
-Legion *runtime_legion_spawn(void (*fn)(void *), void *arg, size_t stack_size) {
-  if (stack_size == 0) {
-    stack_size = LEGION_STACK_SIZE;
-  }
-  if (stack_size > LEGION_STACK_MAX) {
-    stack_size = LEGION_STACK_MAX;
+// Make a runnable legion eligible to run on some worker: the calling worker's
+// own deque when there is one, the global queue otherwise
+static void schedule_legion(Legion *legion) {
+  Worker *self = current_worker();
+  if (self) {
+    deque_push(self, legion);
+  } else {
+    global_push(legion);
   }
+  scheduler_wake_idle();
+}
 
-  Legion *legion = (Legion *)runtime_alloc(sizeof(Legion));
-  legion->fn = fn;
-  legion->arg = arg;
-  legion->stack_size = stack_size;
-  legion->stack_cap = stack_size;
-
-  // Allocate stack with guard pages
-  legion->stack_base = allocate_stack_with_guard(stack_size);
-  if (!legion->stack_base) {
-    // Fallback to regular allocation
-    legion->stack_base = runtime_alloc(stack_size);
-    legion->stack = legion->stack_base;
-  } else {
-    legion->stack = legion->stack_base;
+// Start a legion (add to scheduler)
+void runtime_legion_start(Legion *legion) {
+  if (!legion) {
+    return;
+  }
+  // The scheduler starts lazily on the first spawn
+  if (!g_scheduler) {
+    runtime_scheduler_init();
   }
 
-  legion->state = LEGION_STATE_RUNNABLE;
-  legion->next = NULL;
-  legion->id = atomic_fetch_add(&g_legion_id_counter, 1);
-  legion->thread_id = -1;
-  legion->stack_overflow = 0;
-  legion->blocked_on = NULL;
-  pthread_cond_init(&legion->cond, NULL);
-  pthread_mutex_init(&legion->mutex, NULL);
+  atomic_fetch_add(&g_scheduler->active_legions, 1);
+  output_flush_own();
+  schedule_legion(legion);
+}
 
-  // Initialize context
-  pthread_mutex_init(&legion->mutex, NULL);
+// Switch from the running legion back to this thread's scheduler loop
+static void switch_to_scheduler(Legion *legion, int thread_id) {
+  malphas_context_switch(&legion->ctx,
+                         &g_scheduler->workers[thread_id].scheduler_ctx);
+}
 
-  // Initialize context
-  malphas_context_make_trampoline(&legion->ctx, (void (*)(void *))legion_entry,
-                                  legion, legion->stack, stack_size);
+// Legion entry point (called when context is switched to)
+static void legion_entry(Legion *legion) {
+  // Execute the function
+  legion->fn(legion->arg);
+  output_flush_own();
+  legion_finish(legion);
 
-  return legion;
+  // Function completed - mark as dead
+  legion->state = LEGION_STATE_DEAD;
+  atomic_fetch_sub(&g_scheduler->active_legions, 1);
+  stat_add(STAT_COMPLETED, 1);
 
-  return legion;
+  // Return to the scheduler of whichever thread we finished on. The dead
+  // legion's context is saved but never resumed.
+  switch_to_scheduler(legion, get_thread_id());
 }
 
-// Push legion to local queue (lock-free, called by owner thread)
-static int push_to_local_queue(int thread_id, Legion *legion) {
-  int tail = atomic_load(&g_scheduler->queue_tail[thread_id]);
-  int next_tail = (tail + 1) % LEGION_QUEUE_SIZE;
+// Yield control to scheduler (cooperative)
+void runtime_legion_yield(void) {
+  int thread_id = get_thread_id();
+  if (thread_id < 0 || thread_id >= g_scheduler->num_workers) {
+    return; // Not running in scheduler context
+  }
 
-  // Check if queue is full
-  if (next_tail == atomic_load(&g_scheduler->queue_head[thread_id])) {
-    return 0; // Queue full
+  Legion *current = g_scheduler->workers[thread_id].current_legion;
+  if (!current) {
+    return;
   }
 
-  g_scheduler->run_queue[thread_id][tail] = legion;
-  atomic_store(&g_scheduler->queue_tail[thread_id], next_tail);
-  return 1;
+  // The scheduler re-queues us once our context is saved; queuing ourselves
+  // here would let another worker resume a context that is still running
+  worker_stat(&g_scheduler->workers[thread_id], STAT_YIELDS, 1);
+  current->state = LEGION_STATE_RUNNABLE;
+  switch_to_scheduler(current, thread_id);
 }
 
-// Pop legion from local queue (lock-free, called by owner thread)
-static Legion *pop_from_local_queue(int thread_id) {
-  int head = atomic_load(&g_scheduler->queue_head[thread_id]);
-  int tail = atomic_load(&g_scheduler->queue_tail[thread_id]);
-
-  if (head == tail) {
-    return NULL; // Queue empty
+// Statistics and tracing. Each worker counts the events that happen on its thread in its own
+// StatCounters with relaxed loads and stores (no read-modify-write, since it
+// is the only writer); events on other threads go to a shared set with
+// atomic adds. runtime_stats sums them when asked, so counting costs a load
+// and a store on the hot paths.
+//
+// Tracing records events into a ring per worker (plus a shared one for other
+// threads) that keeps the newest TRACE_RING_SIZE, and writes them out as a
+// Chrome trace (chrome://tracing, ui.perfetto.dev) at exit.
+#define TRACE_RING_SIZE (1 << 16) // Events kept per thread
+#define TRACE_TID_OTHER 1000000   // Trace thread for events off the workers
+
+static StatCounters g_stats_shared; // Events on threads that are not workers
+static atomic_int_fast64_t g_gc_pause_ns = 0;
+static int64_t g_gc_started = 0; // Written under the GC's allocation lock
+static atomic_int g_stats_dump = 0; // Set by SIGUSR1, read by the monitor
+
+typedef struct TraceEvent {
+  int64_t ts;
+  int64_t legion;
+  int64_t arg;
+  int32_t kind;
+} TraceEvent;
+
+typedef struct TraceRing {
+  atomic_size_t count; // Events ever recorded (the slot of the next one)
+  TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static const char *g_trace_path = NULL;
+static int64_t g_trace_start = 0;
+static TraceRing *g_trace_shared = NULL; // Under g_trace_mutex
+static pthread_mutex_t g_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int g_trace_written = 0;
+
+static void stat_add(StatCounter counter, uint64_t n) {
+  int thread_id = get_thread_id();
+  if (thread_id < 0 || thread_id >= g_scheduler->num_workers) {
+    atomic_fetch_add_explicit(&g_stats_shared.n[counter], n,
+                              memory_order_relaxed);
+    return;
   }
-
-  Legion *legion = g_scheduler->run_queue[thread_id][head];
-  atomic_store(&g_scheduler->queue_head[thread_id],
-               (head + 1) % LEGION_QUEUE_SIZE);
-  return legion;
+  worker_stat(&g_scheduler->workers[thread_id], counter, n);
 }
 
-// Steal from another thread's queue (lock-free work-stealing)
-static Legion *steal_from_queue(int victim_thread_id) {
-  int head = atomic_load(&g_scheduler->queue_head[victim_thread_id]);
-  int tail = atomic_load(&g_scheduler->queue_tail[victim_thread_id]);
+static void trace_record(TraceRing *ring, TraceKind kind, int64_t legion,
+                         int64_t arg) {
+  size_t i = atomic_load_explicit(&ring->count, memory_order_relaxed);
+  TraceEvent *e = &ring->events[i % TRACE_RING_SIZE];
+  e->ts = runtime_nanotime();
+  e->legion = legion;
+  e->arg = arg;
+  e->kind = kind;
+  atomic_store_explicit(&ring->count, i + 1, memory_order_release);
+}
 
-  if (head == tail) {
-    return NULL; // Queue empty
+static void trace_event(TraceKind kind, int64_t legion, int64_t arg) {
+  int thread_id = get_thread_id();
+  if (thread_id >= 0 && thread_id < g_scheduler->num_workers) {
+    Worker *w = &g_scheduler->workers[thread_id];
+    if (!w->trace) {
+      w->trace = (TraceRing *)calloc(1, sizeof(TraceRing));
+      if (!w->trace) {
+        return;
+      }
+    }
+    trace_record(w->trace, kind, legion, arg);
+    return;
   }
 
-  // Try to increment head atomically
-  int expected = head;
-  int next_head = (head + 1) % LEGION_QUEUE_SIZE;
-  if (atomic_compare_exchange_strong(&g_scheduler->queue_head[victim_thread_id],
-                                     &expected, next_head)) {
-    return g_scheduler->run_queue[victim_thread_id][head];
+  pthread_mutex_lock(&g_trace_mutex);
+  if (!g_trace_shared) {
+    g_trace_shared = (TraceRing *)calloc(1, sizeof(TraceRing));
   }
-
-  return NULL; // Failed to steal (race condition)
+  if (g_trace_shared) {
+    trace_record(g_trace_shared, kind, legion, arg);
+  }
+  pthread_mutex_unlock(&g_trace_mutex);
 }
 
-// Get approximate queue length for a thread (lock-free, approximate)
-static int get_queue_length(int thread_id) {
-  int head = atomic_load(&g_scheduler->queue_head[thread_id]);
-  int tail = atomic_load(&g_scheduler->queue_tail[thread_id]);
-
-  if (tail >= head) {
-    return tail - head;
-  } else {
-    // Queue wrapped around
-    return (LEGION_QUEUE_SIZE - head) + tail;
+// Boehm calls this around every collection, on the collecting thread
+static void stats_gc_event(GC_EventType event) {
+  if (event == GC_EVENT_START) {
+    g_gc_started = runtime_nanotime();
+    if (g_scheduler) {
+      trace(TRACE_GC_START, -1, 0);
+    }
+  } else if (event == GC_EVENT_END) {
+    atomic_fetch_add_explicit(&g_gc_pause_ns,
+                              runtime_nanotime() - g_gc_started,
+                              memory_order_relaxed);
+    if (g_scheduler) {
+      trace(TRACE_GC_END, -1, 0);
+    }
   }
 }
 
-// Find the thread with the least load
-static int find_least_loaded_thread(void) {
-  int best_thread = 0;
-  int best_load = get_queue_length(0);
-
-  // Check all threads to find the one with shortest queue
-  for (int i = 1; i < MAX_OS_THREADS; i++) {
-    int load = get_queue_length(i);
-    if (load < best_load) {
-      best_load = load;
-      best_thread = i;
+void runtime_stats(RuntimeStats *out) {
+  uint64_t n[STAT_COUNT];
+  for (int c = 0; c < STAT_COUNT; c++) {
+    n[c] = atomic_load_explicit(&g_stats_shared.n[c], memory_order_relaxed);
+  }
+  memset(out, 0, sizeof(*out));
+  if (g_scheduler) {
+    for (int i = 0; i < g_scheduler->num_workers; i++) {
+      Worker *w = &g_scheduler->workers[i];
+      for (int c = 0; c < STAT_COUNT; c++) {
+        n[c] += atomic_load_explicit(&w->stats.n[c], memory_order_relaxed);
+      }
+      out->local_queue_len +=
+          deque_size(w) + (atomic_load(&w->runnext) != NULL);
     }
+    out->legions_active = atomic_load(&g_scheduler->active_legions);
+    out->global_queue_len = atomic_load(&g_scheduler->global_size);
+    out->workers = atomic_load(&g_scheduler->active_workers);
   }
-
-  return best_thread;
+  out->legions_spawned = (int64_t)n[STAT_SPAWNED];
+  out->legions_completed = (int64_t)n[STAT_COMPLETED];
+  out->runs = (int64_t)n[STAT_RUNS];
+  out->yields = (int64_t)n[STAT_YIELDS];
+  out->preemptions = (int64_t)n[STAT_PREEMPTIONS];
+  out->blocks = (int64_t)n[STAT_BLOCKS];
+  out->unblocks = (int64_t)n[STAT_UNBLOCKS];
+  out->chan_parks = (int64_t)n[STAT_CHAN_PARKS];
+  out->steal_attempts = (int64_t)n[STAT_STEAL_ATTEMPTS];
+  out->steals = (int64_t)n[STAT_STEALS];
+  out->legions_stolen = (int64_t)n[STAT_STOLEN];
+  out->worker_parks = (int64_t)n[STAT_WORKER_PARKS];
+  out->worker_wakeups = (int64_t)n[STAT_WORKER_WAKEUPS];
+  for (Tlab *tlab = atomic_load(&g_tlabs); tlab; tlab = tlab->next) {
+    out->allocs += (int64_t)atomic_load_explicit(&tlab->allocs,
+                                                 memory_order_relaxed);
+    out->alloc_bytes += (int64_t)atomic_load_explicit(&tlab->alloc_bytes,
+                                                      memory_order_relaxed);
+  }
+  out->gc_collections = (int64_t)GC_get_gc_no();
+  out->gc_pause_ns = atomic_load(&g_gc_pause_ns);
+  out->gc_heap_bytes = (int64_t)GC_get_heap_size();
 }
 
-// Start a legion (add to scheduler)
-void runtime_legion_start(Legion *legion) {
-  if (!legion || !g_scheduler) {
+void runtime_stats_print(FILE *f) {
+  RuntimeStats st;
+  runtime_stats(&st);
+  fprintf(f,
+          "malphas: legions spawned=%lld completed=%lld active=%lld "
+          "runs=%lld yields=%lld preemptions=%lld\n",
+          (long long)st.legions_spawned, (long long)st.legions_completed,
+          (long long)st.legions_active, (long long)st.runs,
+          (long long)st.yields, (long long)st.preemptions);
+  fprintf(f,
+          "malphas: blocks=%lld unblocks=%lld chan_parks=%lld "
+          "queues global=%lld local=%lld\n",
+          (long long)st.blocks, (long long)st.unblocks,
+          (long long)st.chan_parks, (long long)st.global_queue_len,
+          (long long)st.local_queue_len);
+  fprintf(f,
+          "malphas: steals attempts=%lld hits=%lld legions=%lld "
+          "workers=%lld parks=%lld wakeups=%lld\n",
+          (long long)st.steal_attempts, (long long)st.steals,
+          (long long)st.legions_stolen, (long long)st.workers,
+          (long long)st.worker_parks, (long long)st.worker_wakeups);
+  fprintf(f,
+          "malphas: allocs=%lld (%lldKiB) gc collections=%lld "
+          "pause=%.3fms heap=%lldKiB\n",
+          (long long)st.allocs, (long long)(st.alloc_bytes / 1024),
+          (long long)st.gc_collections, st.gc_pause_ns / 1e6,
+          (long long)(st.gc_heap_bytes / 1024));
+  if (!g_scheduler) {
     return;
   }
-
-  atomic_fetch_add(&g_scheduler->active_legions, 1);
-
-  // Add to a queue for load balancing - use load-aware distribution
-  // instead of simple round-robin for better thread utilization
-  int queue_idx = find_least_loaded_thread();
-
-  // Try lock-free push first
-  if (!push_to_local_queue(queue_idx, legion)) {
-    // Queue full, use mutex-protected path
-    pthread_mutex_lock(&g_scheduler->queue_mutex[queue_idx]);
-    int tail = atomic_load(&g_scheduler->queue_tail[queue_idx]);
-    int next_tail = (tail + 1) % LEGION_QUEUE_SIZE;
-    if (next_tail != atomic_load(&g_scheduler->queue_head[queue_idx])) {
-      g_scheduler->run_queue[queue_idx][tail] = legion;
-      atomic_store(&g_scheduler->queue_tail[queue_idx], next_tail);
-    }
-    pthread_cond_signal(&g_scheduler->queue_cond[queue_idx]);
-    pthread_mutex_unlock(&g_scheduler->queue_mutex[queue_idx]);
-  } else {
-    // Signal waiting thread
-    pthread_mutex_lock(&g_scheduler->queue_mutex[queue_idx]);
-    pthread_cond_signal(&g_scheduler->queue_cond[queue_idx]);
-    pthread_mutex_unlock(&g_scheduler->queue_mutex[queue_idx]);
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    Worker *w = &g_scheduler->workers[i];
+    uint64_t runs = atomic_load_explicit(&w->stats.n[STAT_RUNS],
+                                         memory_order_relaxed);
+    if (runs == 0 && deque_size(w) == 0) {
+      continue;
+    }
+    fprintf(f, "malphas: worker %d runs=%llu steals=%llu parks=%llu queue=%ld\n",
+            i, (unsigned long long)runs,
+            (unsigned long long)atomic_load_explicit(
+                &w->stats.n[STAT_STEALS], memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(
+                &w->stats.n[STAT_WORKER_PARKS], memory_order_relaxed),
+            deque_size(w));
   }
 }
 
-// Scheduler context storage (per thread)
-static __thread Context g_scheduler_context;
-
-// Set scheduler context for current thread
-static void set_scheduler_context(Context *ctx) { g_scheduler_context = *ctx; }
-
-// Get scheduler context for current thread
-static Context *get_scheduler_context(void) { return &g_scheduler_context; }
-
-// Legion entry point (called when context is switched to)
-static void legion_entry(Legion *legion) {
-  // Set up signal handler for stack overflow
-  struct sigaction sa;
-  sa.sa_handler = SIG_DFL;
-  sigemptyset(&sa.sa_mask);
-  sa.sa_flags = SA_ONSTACK;
-  sigaction(SIGSEGV, &sa, NULL);
+static void stats_print_at_exit(void) { runtime_stats_print(stderr); }
 
-  // Execute the function
-  legion->fn(legion->arg);
+static void stats_signal(int sig) {
+  (void)sig;
+  atomic_store(&g_stats_dump, 1);
+}
 
-  // Function completed - mark as dead
-  legion->state = LEGION_STATE_DEAD;
-  atomic_fetch_sub(&g_scheduler->active_legions, 1);
+// Write one ring's events, oldest first
+static void trace_write_ring(FILE *f, TraceRing *ring, int tid, int *first) {
+  static const char *stop_reasons[] = {"yield", "running", "block", "done"};
+  size_t count = atomic_load_explicit(&ring->count, memory_order_acquire);
+  size_t begin = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+  for (size_t i = begin; i < count; i++) {
+    TraceEvent *e = &ring->events[i % TRACE_RING_SIZE];
+    double ts = (e->ts - g_trace_start) / 1000.0;
+    fprintf(f, "%s\n", *first ? "" : ",");
+    *first = 0;
+    switch ((TraceKind)e->kind) {
+    case TRACE_SPAWN:
+      fprintf(f,
+              "{\"name\":\"spawn\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+              "\"pid\":1,\"tid\":%d,\"args\":{\"legion\":%lld}}",
+              ts, tid, (long long)e->legion);
+      break;
+    case TRACE_RUN:
+      fprintf(f,
+              "{\"name\":\"legion %lld\",\"cat\":\"legion\",\"ph\":\"B\","
+              "\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+              (long long)e->legion, ts, tid);
+      break;
+    case TRACE_STOP: {
+      const char *reason = e->arg < 0 ? "preempt"
+                           : e->arg <= LEGION_STATE_DEAD ? stop_reasons[e->arg]
+                                                         : "unknown";
+      fprintf(f,
+              "{\"name\":\"legion %lld\",\"cat\":\"legion\",\"ph\":\"E\","
+              "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"stop\":\"%s\"}}",
+              (long long)e->legion, ts, tid, reason);
+      break;
+    }
+    case TRACE_UNBLOCK:
+      fprintf(f,
+              "{\"name\":\"unblock\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+              "\"pid\":1,\"tid\":%d,\"args\":{\"legion\":%lld}}",
+              ts, tid, (long long)e->legion);
+      break;
+    case TRACE_STEAL:
+      fprintf(f,
+              "{\"name\":\"steal\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+              "\"pid\":1,\"tid\":%d,\"args\":{\"victim\":%lld,"
+              "\"legions\":%lld}}",
+              ts, tid, (long long)e->legion, (long long)e->arg);
+      break;
+    case TRACE_PARK:
+      fprintf(f,
+              "{\"name\":\"park\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+              "\"pid\":1,\"tid\":%d}",
+              ts, tid);
+      break;
+    case TRACE_GC_START:
+    case TRACE_GC_END:
+      fprintf(f,
+              "{\"name\":\"gc\",\"cat\":\"gc\",\"ph\":\"%s\",\"ts\":%.3f,"
+              "\"pid\":1,\"tid\":%d}",
+              e->kind == TRACE_GC_START ? "B" : "E", ts, tid);
+      break;
+    }
+  }
+}
 
-  // Switch back to scheduler
-  int thread_id = legion->thread_id;
-  if (thread_id >= 0 && thread_id < MAX_OS_THREADS) {
-    g_scheduler->current_legion[thread_id] = NULL;
-    legion->thread_id = -1;
+void runtime_trace_write(void) {
+  if (!g_trace_on || !g_scheduler || atomic_exchange(&g_trace_written, 1)) {
+    return;
+  }
+  FILE *f = fopen(g_trace_path, "w");
+  if (!f) {
+    fprintf(stderr, "malphas: cannot write trace to %s\n", g_trace_path);
+    return;
   }
 
-  // Return to scheduler (context switch)
-  // Return to scheduler (context switch)
-  Context *scheduler_ctx = get_scheduler_context();
-  if (scheduler_ctx) {
-    // We don't have a 'from' context here because we are dying.
-    // But context_switch expects one. We can use a dummy or the legion's ctx.
-    // Since the legion is dead, its ctx won't be used again.
-    malphas_context_switch(&legion->ctx, scheduler_ctx);
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  int first = 1;
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    Worker *w = &g_scheduler->workers[i];
+    if (!w->trace) {
+      continue;
+    }
+    fprintf(f,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"worker %d\"}}",
+            first ? "" : ",", i, i);
+    first = 0;
+    trace_write_ring(f, w->trace, i, &first);
   }
+  pthread_mutex_lock(&g_trace_mutex);
+  if (g_trace_shared) {
+    fprintf(f,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"other threads\"}}",
+            first ? "" : ",", TRACE_TID_OTHER);
+    first = 0;
+    trace_write_ring(f, g_trace_shared, TRACE_TID_OTHER, &first);
+  }
+  pthread_mutex_unlock(&g_trace_mutex);
+  fprintf(f, "\n]}\n");
+  fclose(f);
 }
 
-// Grow stack if needed
-static int grow_legion_stack(Legion *legion) {
-  if (legion->stack_size >= LEGION_STACK_MAX) {
-    return 0; // Already at max size
+// Read MALPHAS_TRACE and MALPHAS_STATS, and install the SIGUSR1 dump unless
+// the program handles that signal itself. Runs before any legion does.
+static void stats_init(void) {
+  for (int c = 0; c < STAT_COUNT; c++) {
+    atomic_init(&g_stats_shared.n[c], 0);
   }
 
-  size_t new_size = legion->stack_size * 2;
-  if (new_size > LEGION_STACK_MAX) {
-    new_size = LEGION_STACK_MAX;
+  const char *path = getenv("MALPHAS_TRACE");
+  if (path && *path) {
+    g_trace_path = path;
+    g_trace_start = runtime_nanotime();
+    g_trace_on = 1;
+    atexit(runtime_trace_write);
   }
 
-  // For now, we'll use a simple approach: reallocate
-  // In a production system, you'd use virtual memory tricks
-  void *new_stack = runtime_alloc(new_size);
-  if (!new_stack) {
-    return 0;
+  const char *env = getenv("MALPHAS_STATS");
+  if (env && *env && strcmp(env, "0") != 0) {
+    atexit(stats_print_at_exit);
   }
 
-  // Copy old stack to new (simplified - real implementation would be more
-  // complex)
-  memcpy(new_stack, legion->stack, legion->stack_size);
-
-  legion->stack = new_stack;
-  legion->stack_base = new_stack;
-  legion->stack_size = new_size;
-  legion->stack_cap = new_size;
-
-  // Update context
-  // Update context
-  // For custom context, we just need to update SP if we were running?
-  // But we only grow when NOT running (or when we can migrate).
-  // Actually, growing stack with custom context is harder because SP is inside
-  // the opaque blob. For now, let's disable stack growth or just reset the
-  // context if it's not running.
-
-  // If we are here, we are likely re-initializing.
-  // But wait, 'grow_legion_stack' is not called in the current code?
-  // It seems unused or internal.
-  // If we simply update the stack pointer in the struct, it might be enough if
-  // we reset the context. But preserving execution state across stack move is
-  // very hard without ucontext. Let's just update the struct fields for now.
-
-  // Re-initialize context if we are just setting it up?
-  // No, this function copies stack.
-  // With custom context, the SP in 'ctx' points to the OLD stack.
-  // We need to adjust it by the offset.
-  long offset = (char *)new_stack - (char *)legion->stack;
+  struct sigaction old;
+  if (sigaction(SIGUSR1, NULL, &old) == 0 && old.sa_handler == SIG_DFL) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stats_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+  }
+}
 
-#if defined(__aarch64__)
-  legion->ctx.sp += offset;
-  legion->ctx.fp += offset;
-#elif defined(__x86_64__)
-  legion->ctx.rsp += offset;
-  legion->ctx.rbp += offset;
-#endif
+// Benchmarks (malphas bench). A benchmark function performs its operation n
+// times, on a legion of its own, so that channel and spawn benchmarks measure
+// legions talking to legions rather than wakeups of the main thread.
+// runtime_bench calibrates n the way Go's testing package does: it
+// starts at 1 (which doubles as a warmup) and predicts the n that makes one
+// run last MALPHAS_BENCHTIME nanoseconds, growing at most 100x per step.
+// It then prints MALPHAS_BENCHCOUNT samples at that n, one line each:
+//
+//   BENCH <name> <n> <ns> <allocs> <bytes>
+//
+// (tab separated), which malphas bench turns into per-op statistics.
+#define BENCH_MAX_N 1000000000
 
-  return 1;
+typedef struct {
+  int64_t ns;
+  int64_t allocs;
+  int64_t bytes;
+} BenchSample;
+
+// Results of the benchmark functions, so the optimizer cannot drop them
+static volatile int64_t g_bench_sink;
+
+static int64_t bench_env(const char *name, int64_t fallback) {
+  const char *env = getenv(name);
+  if (!env || !*env) {
+    return fallback;
+  }
+  int64_t v = strtoll(env, NULL, 10);
+  return v > 0 ? v : fallback;
 }
 
-// Yield control to scheduler (cooperative)
-void runtime_legion_yield(void) {
-  int thread_id = get_thread_id();
-  if (thread_id < 0 || thread_id >= MAX_OS_THREADS) {
-    return; // Not running in scheduler context
+typedef struct {
+  int64_t (*fn)(int64_t);
+  int64_t n;
+  BenchSample *out;
+  Note done;
+} BenchRun;
+
+static void bench_legion(void *arg) {
+  BenchRun *run = (BenchRun *)arg;
+  RuntimeStats before, after;
+  runtime_stats(&before);
+  int64_t start = runtime_nanotime();
+  g_bench_sink = run->fn(run->n);
+  run->out->ns = runtime_nanotime() - start;
+  runtime_stats(&after);
+  run->out->allocs = after.allocs - before.allocs;
+  run->out->bytes = after.alloc_bytes - before.alloc_bytes;
+  note_wakeup(&run->done);
+}
+
+static void bench_sample(int64_t (*fn)(int64_t), int64_t n, BenchSample *out) {
+  BenchRun run = {.fn = fn, .n = n, .out = out};
+  note_init(&run.done);
+  runtime_legion_start(runtime_legion_spawn(bench_legion, &run, 0));
+  note_sleep(&run.done, -1);
+}
+
+void runtime_bench(const char *name, int64_t (*fn)(int64_t)) {
+  int64_t benchtime = bench_env("MALPHAS_BENCHTIME", 1000000000);
+  int64_t count = bench_env("MALPHAS_BENCHCOUNT", 1);
+
+  BenchSample s;
+  int64_t n = 1;
+  bench_sample(fn, n, &s);
+  while (s.ns < benchtime && n < BENCH_MAX_N) {
+    int64_t prev = n;
+    int64_t per_op = s.ns / n > 0 ? s.ns / n : 1;
+    n = benchtime / per_op;
+    n += n / 5; // Aim 20% over, so the next run is likely the last
+    if (n > prev * 100) {
+      n = prev * 100;
+    }
+    if (n <= prev) {
+      n = prev + 1;
+    }
+    if (n > BENCH_MAX_N) {
+      n = BENCH_MAX_N;
+    }
+    bench_sample(fn, n, &s);
   }
 
-  Legion *current = g_scheduler->current_legion[thread_id];
-  if (!current) {
-    return;
+  // Keep the samples apart from anything the benchmark printed
+  runtime_stdout_flush();
+  for (int64_t i = 0; i < count; i++) {
+    if (i > 0) {
+      bench_sample(fn, n, &s);
+    }
+    printf("BENCH\t%s\t%lld\t%lld\t%lld\t%lld\n", name, (long long)n,
+           (long long)s.ns, (long long)s.allocs, (long long)s.bytes);
+    fflush(stdout);
   }
+}
+
+// Legion preemption. Compiled code polls runtime_preempt_requested on every
+// loop back-edge (a single load that is almost always zero) and calls
+// runtime_safepoint when it is set. The monitor thread samples each worker's
+// run_seq once per time slice: an odd value that has not moved since the
+// last sample means the same legion has been running for a whole slice, and
+// if anything is waiting behind it the worker is asked to yield at its next
+// safepoint. runtime_preempt_requested counts the workers asked.
+#define LEGION_TIME_SLICE_NS (10 * 1000 * 1000)
+
+atomic_int runtime_preempt_requested = 0;
+
+// Advance run_seq (only its worker writes it)
+static void worker_bump_run_seq(Worker *w) {
+  unsigned seq = atomic_load_explicit(&w->run_seq, memory_order_relaxed);
+  atomic_store_explicit(&w->run_seq, seq + 1, memory_order_relaxed);
+}
 
-  // Save current context
-  // We do this by switching TO the scheduler, which saves FROM (current).
-  // So we don't need explicit getcontext here.
+// Clear a worker's preemption request, if it has one (returns whether it did)
+static int worker_clear_preempt(Worker *w) {
+  if (atomic_load_explicit(&w->preempt, memory_order_relaxed) &&
+      atomic_exchange(&w->preempt, 0)) {
+    atomic_fetch_sub(&runtime_preempt_requested, 1);
+    return 1;
+  }
+  return 0;
+}
 
-  // Save context and switch back to scheduler
-  // The scheduler will resume this legion later
+// Whether a legion is queued where the worker's current one holds it up
+static int worker_has_waiting(Worker *w) {
+  return deque_size(w) > 0 || atomic_load(&w->runnext) != NULL ||
+         atomic_load(&g_scheduler->global_size) > 0;
+}
 
-  // Save context and switch back to scheduler
-  // The scheduler will resume this legion later
-  current->state = LEGION_STATE_RUNNABLE;
+static void *scheduler_monitor(void *arg) {
+  (void)arg;
+  int n = g_scheduler->num_workers;
+  unsigned *seen = (unsigned *)calloc(n, sizeof(unsigned));
+  if (!seen) {
+    return NULL;
+  }
 
-  // Push back to queue
-  if (!push_to_local_queue(thread_id, current)) {
-    // Queue full, try another queue
-    for (int i = 0; i < MAX_OS_THREADS; i++) {
-      if (i != thread_id && push_to_local_queue(i, current)) {
-        break;
+  while (!atomic_load(&g_scheduler->shutdown)) {
+    if (note_sleep(&g_scheduler->monitor_note, LEGION_TIME_SLICE_NS)) {
+      break; // Woken for shutdown
+    }
+    if (atomic_exchange(&g_stats_dump, 0)) {
+      runtime_stats_print(stderr);
+    }
+    for (int i = 0; i < n; i++) {
+      Worker *w = &g_scheduler->workers[i];
+      unsigned seq = atomic_load(&w->run_seq);
+      if ((seq & 1) && seq == seen[i] && worker_has_waiting(w) &&
+          atomic_exchange(&w->preempt, 1) == 0) {
+        atomic_fetch_add(&runtime_preempt_requested, 1);
       }
+      seen[i] = seq;
     }
   }
+  free(seen);
+  return NULL;
+}
 
-  g_scheduler->current_legion[thread_id] = NULL;
-  current->thread_id = -1;
-
-  // Context switch back to scheduler
-  // Context switch back to scheduler
-  Context *scheduler_ctx = get_scheduler_context();
-  if (scheduler_ctx) {
-    malphas_context_switch(&current->ctx_saved, scheduler_ctx);
+// Called by compiled code when runtime_preempt_requested is set: yield if
+// this worker is the one that was asked to
+void runtime_safepoint(void) {
+  int thread_id = get_thread_id();
+  if (thread_id < 0 || thread_id >= g_scheduler->num_workers) {
+    return;
+  }
+  Worker *w = &g_scheduler->workers[thread_id];
+  if (atomic_load_explicit(&w->preempt, memory_order_relaxed)) {
+    worker_stat(w, STAT_PREEMPTIONS, 1);
+    runtime_legion_yield(); // The scheduler clears the request
   }
 }
 
@@ -1472,20 +5589,15 @@ void runtime_legion_block(Legion *legion, Channel *channel) {
   if (!legion)
     return;
 
-  int thread_id = get_thread_id();
-  if (thread_id >= 0 && thread_id < MAX_OS_THREADS) {
-    g_scheduler->current_legion[thread_id] = NULL;
-    legion->thread_id = -1;
-  }
-
   legion->state = LEGION_STATE_BLOCKED;
   legion->blocked_on = channel;
+  stat_add(STAT_BLOCKS, 1);
 
   atomic_fetch_sub(&g_scheduler->active_legions, 1);
 }
 
-// Unblock a blocked legion and add it back to the scheduler
-static void unblock_legion_from_channel(Legion *legion) {
+// Unblock a legion (called when channel operation completes)
+void runtime_legion_unblock(Legion *legion) {
   if (!legion || legion->state != LEGION_STATE_BLOCKED) {
     return;
   }
@@ -1493,134 +5605,440 @@ static void unblock_legion_from_channel(Legion *legion) {
   legion->state = LEGION_STATE_RUNNABLE;
   legion->blocked_on = NULL;
   atomic_fetch_add(&g_scheduler->active_legions, 1);
+  stat_add(STAT_UNBLOCKS, 1);
+  trace(TRACE_UNBLOCK, legion->id, 0);
+
+  // Woken from a worker (typically by the other side of a channel handoff):
+  // run it next on this worker, ahead of the queue, so request/response
+  // pairs ping-pong on one thread without a trip through the run queues.
+  // Whatever was there before moves to the queues.
+  Worker *self = current_worker();
+  if (self) {
+    Legion *prev = atomic_exchange(&self->runnext, legion);
+    if (prev) {
+      schedule_legion(prev);
+    }
+    return;
+  }
 
   // Add back to scheduler
-  runtime_legion_start(legion);
+  schedule_legion(legion);
 }
 
-// Unblock a legion (called when channel operation completes)
-void runtime_legion_unblock(Legion *legion) {
-  if (!legion || legion->state != LEGION_STATE_BLOCKED) {
-    return;
+// Park the running legion until runtime_legion_unblock. `unlock(arg)` runs on
+// the scheduler stack after the legion's context has been saved, so whoever
+// it lets in (e.g. a channel sender) can wake the legion immediately.
+static void legion_park(void (*unlock)(void *), void *arg) {
+  int thread_id = get_thread_id();
+  Legion *current = g_scheduler->workers[thread_id].current_legion;
+
+  output_flush_own();
+  runtime_legion_block(current, NULL);
+  current->park_unlock = unlock;
+  current->park_arg = arg;
+  switch_to_scheduler(current, thread_id);
+}
+
+// Called by a worker that is above active_workers: give away everything it
+// holds, then sleep until it is needed again
+static void worker_retire(Worker *self) {
+  Legion *legion = atomic_exchange(&self->runnext, NULL);
+  if (legion) {
+    global_push(legion);
   }
+  while ((legion = deque_pop(self)) != NULL) {
+    global_push(legion);
+  }
+  scheduler_wake_idle();
 
-  legion->state = LEGION_STATE_RUNNABLE;
-  legion->blocked_on = NULL;
-  atomic_fetch_add(&g_scheduler->active_legions, 1);
+  pthread_mutex_lock(&g_scheduler->procs_mutex);
+  while (self->id >= atomic_load(&g_scheduler->active_workers) &&
+         !atomic_load(&g_scheduler->shutdown)) {
+    pthread_cond_wait(&g_scheduler->procs_cond, &g_scheduler->procs_mutex);
+  }
+  pthread_mutex_unlock(&g_scheduler->procs_mutex);
+}
 
-  // Add back to scheduler
-  runtime_legion_start(legion);
+static uint64_t worker_rand(Worker *self) {
+  uint64_t x = self->rand;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  self->rand = x;
+  return x;
 }
 
-// Scheduler main loop (runs on each OS thread)
-void *runtime_scheduler_run(void *arg) {
-  int thread_id = *(int *)arg;
-  runtime_alloc(sizeof(int)); // Free the arg (GC will handle it)
-  set_thread_id(thread_id);
+// Whether any queue holds work (idle workers check before sleeping)
+static int scheduler_has_work(void) {
+  if (atomic_load(&g_scheduler->global_size) > 0) {
+    return 1;
+  }
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    if (deque_size(&g_scheduler->workers[i]) > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  runtime_alloc(sizeof(int)); // Free the arg (GC will handle it)
-  set_thread_id(thread_id);
+// Take the victim's runnext legion. The victim usually runs it itself as soon
+// as its current legion blocks (that is the point of runnext, and why filling
+// it wakes nobody), so give it a moment first and only take what is still
+// there afterwards.
+static Legion *steal_runnext(Worker *victim) {
+  Legion *legion = atomic_load(&victim->runnext);
+  if (!legion) {
+    return NULL;
+  }
+  for (int i = 0; i < RUNNEXT_STEAL_DELAY_SPINS; i++) {
+    cpu_relax();
+  }
+  if (!atomic_compare_exchange_strong(&victim->runnext, &legion, NULL)) {
+    return NULL;
+  }
+  return legion;
+}
 
-  Context scheduler_ctx;
-  // We don't need to initialize scheduler_ctx, it will be populated by
-  // context_switch
-  set_scheduler_context(&scheduler_ctx);
+// A spinning worker found work: stop counting it, and if it was the last
+// spinner wake another worker, since more work may be waiting
+static void worker_stop_spinning(Worker *self) {
+  self->spinning = 0;
+  if (atomic_fetch_sub(&g_scheduler->spinning_workers, 1) == 1) {
+    scheduler_wake_idle();
+  }
+}
 
-  while (!atomic_load(&g_scheduler->shutdown)) {
-    Legion *legion = NULL;
+// Find the next legion for this worker to run, or NULL if none turned up
+static Legion *worker_find_work(Worker *self) {
+  int num_workers = g_scheduler->num_workers;
+  Legion *legion = NULL;
+
+  // 0. Our own timers that are due (they wake legions into runnext)
+  if (atomic_load_explicit(&self->timer_next, memory_order_relaxed) !=
+      INT64_MAX) {
+    timers_run(self, runtime_nanotime());
+  }
+
+  // 1. Every so often look at the global queue first, and for ready I/O, so
+  // a busy worker cannot starve either
+  if (++self->tick % GLOBAL_QUEUE_INTERVAL == 0) {
+    netpoll_check();
+    legion = global_grab(self);
+    if (legion) {
+      return legion;
+    }
+  }
 
-    // 1. Try to pop from local queue
-    legion = pop_from_local_queue(thread_id);
+  // 2. The legion we just woke, then our own deque, then the global queue
+  legion = atomic_exchange(&self->runnext, NULL);
+  if (!legion) {
+    legion = deque_pop(self);
+  }
+  if (!legion) {
+    legion = global_grab(self);
+  }
+  if (legion) {
+    return legion;
+  }
 
-    // 2. If local queue empty, try work-stealing
+  // 3. Ready I/O, in case nobody is blocked in the poller (what it wakes
+  // lands on our queues)
+  if (netpoll_check() > 0) {
+    legion = atomic_exchange(&self->runnext, NULL);
     if (!legion) {
-      for (int attempt = 0; attempt < WORK_STEAL_ATTEMPTS; attempt++) {
-        int victim = (thread_id + attempt + 1) % MAX_OS_THREADS;
-        legion = steal_from_queue(victim);
+      legion = deque_pop(self);
+    }
+    if (legion) {
+      return legion;
+    }
+  }
+
+  // 4. Spin: steal half of another worker's deque, starting at a random
+  // victim, and on the last pass their runnext legions too. Stealing is
+  // pointless once half the busy workers are already at it.
+  if (!self->spinning) {
+    int busy = atomic_load(&g_scheduler->active_workers) -
+               atomic_load(&g_scheduler->idle_workers);
+    if (2 * atomic_load(&g_scheduler->spinning_workers) >= busy) {
+      return NULL;
+    }
+    self->spinning = 1;
+    atomic_fetch_add(&g_scheduler->spinning_workers, 1);
+  }
+  int64_t now = runtime_nanotime();
+  for (int attempt = 0; attempt < WORK_STEAL_ATTEMPTS; attempt++) {
+    int last = attempt == WORK_STEAL_ATTEMPTS - 1;
+    int start = (int)(worker_rand(self) % (uint64_t)num_workers);
+    for (int i = 0; i < num_workers; i++) {
+      Worker *victim = &g_scheduler->workers[(start + i) % num_workers];
+      if (victim == self) {
+        continue;
+      }
+      // Run the victim's due timers for it: what they wake lands on our
+      // runnext
+      if (attempt == 0 && timers_run(victim, now) > 0) {
+        legion = atomic_exchange(&self->runnext, NULL);
         if (legion) {
-          break;
+          return legion;
         }
       }
+      worker_stat(self, STAT_STEAL_ATTEMPTS, 1);
+      legion = deque_steal_half(self, victim);
+      if (!legion && last) {
+        legion = steal_runnext(victim);
+      }
+      if (legion) {
+        return legion;
+      }
     }
+  }
+  return NULL;
+}
 
-    // 3. If still no work, wait on condition variable
-    if (!legion) {
-      pthread_mutex_lock(&g_scheduler->queue_mutex[thread_id]);
-
-      // Double-check queue is still empty
-      legion = pop_from_local_queue(thread_id);
-      if (!legion) {
-        // Wait for work or shutdown
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_nsec += 10000000; // 10ms timeout
-        if (timeout.tv_nsec >= 1000000000) {
-          timeout.tv_sec++;
-          timeout.tv_nsec -= 1000000000;
-        }
+// Park an out-of-work worker until scheduler_wake_idle picks it (or, for the
+// timer sleeper, until the earliest timer is due or I/O is ready). The worker
+// stops spinning first and joins the idle list before a last look at the
+// queues, so work made available meanwhile is either seen here or wakes it.
+static void worker_park(Worker *self) {
+  if (self->spinning) {
+    self->spinning = 0;
+    atomic_fetch_sub(&g_scheduler->spinning_workers, 1);
+  }
+  // Hand back part of the dead legion depot while there is nothing to do,
+  // and write out what the legions printed
+  if (g_scheduler->pool_depot_count > LEGION_POOL_BATCH) {
+    legion_pool_trim();
+  }
+  output_flush(&self->out);
+  if (timers_run_all(runtime_nanotime()) > 0) {
+    return;
+  }
+
+  note_clear(&self->park_note);
+  idle_push(self);
+  atomic_thread_fence(memory_order_seq_cst);
+  if ((scheduler_has_work() || atomic_load(&g_scheduler->shutdown) ||
+       self->id >= atomic_load(&g_scheduler->active_workers)) &&
+      idle_remove(self)) {
+    return;
+  }
+  worker_stat(self, STAT_WORKER_PARKS, 1);
+  trace(TRACE_PARK, -1, 0);
+
+  Worker *none = NULL;
+  if (!atomic_compare_exchange_strong(&g_scheduler->timer_sleeper, &none,
+                                      self)) {
+    // Either nothing to do, or a waker has already taken us off the list
+    // (and made us a spinner), in which case this returns straight away
+    note_sleep(&self->park_note, -1);
+    return;
+  }
+
+  // We are the timer sleeper. Look at the heaps only now that timer_notify
+  // can see us, so a timer added meanwhile is either seen or wakes us.
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t earliest = timers_earliest();
+  atomic_store(&g_scheduler->timer_sleep_until, earliest);
+  int64_t timeout = -1;
+  if (earliest != INT64_MAX) {
+    timeout = earliest - runtime_nanotime();
+    if (timeout < 0) {
+      timeout = 0;
+    }
+  }
+  if (atomic_load(&g_netpoll.active)) {
+    // Wait for I/O too. Storing `polling` before re-checking the note pairs
+    // with worker_wakeup.
+    atomic_store(&self->polling, 1);
+    if (atomic_load(&self->park_note.key) == 0) {
+      netpoll(timeout);
+    }
+    atomic_store(&self->polling, 0);
+  } else {
+    note_sleep(&self->park_note, timeout);
+  }
+  atomic_store(&g_scheduler->timer_sleep_until, INT64_MAX);
+  atomic_store(&g_scheduler->timer_sleeper, NULL);
+
+  // A timeout, I/O (or timer_notify) wakes us without taking us off the list
+  idle_remove(self);
+  timers_run_all(runtime_nanotime());
+  // Hand the job over if timers or I/O waiters remain
+  if (timers_earliest() != INT64_MAX || atomic_load(&g_netpoll.waiters) > 0) {
+    scheduler_wake_idle();
+  }
+}
 
-        pthread_cond_timedwait(&g_scheduler->queue_cond[thread_id],
-                               &g_scheduler->queue_mutex[thread_id], &timeout);
+// Scheduler main loop (runs on each OS thread)
+void *runtime_scheduler_run(void *arg) {
+  int thread_id = *(int *)arg;
+  Worker *self = &g_scheduler->workers[thread_id];
+  set_thread_id(thread_id);
+  output_register(&self->out);
+  t_output = &self->out;
+
+  // The fault handler needs a stack of its own since it runs exactly when a
+  // legion's stack has no room left
+  stack_t signal_stack;
+  signal_stack.ss_sp = mmap(NULL, LEGION_SIGNAL_STACK_SIZE,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                            -1, 0);
+  signal_stack.ss_size = LEGION_SIGNAL_STACK_SIZE;
+  signal_stack.ss_flags = 0;
+  if (signal_stack.ss_sp != MAP_FAILED) {
+    sigaltstack(&signal_stack, NULL);
+  }
 
-        // Try one more time after wakeup
-        legion = pop_from_local_queue(thread_id);
+  while (!atomic_load(&g_scheduler->shutdown)) {
+    if (thread_id >= atomic_load(&g_scheduler->active_workers)) {
+      if (self->spinning) {
+        worker_stop_spinning(self);
       }
+      worker_retire(self);
+      continue;
+    }
 
-      pthread_mutex_unlock(&g_scheduler->queue_mutex[thread_id]);
+    Legion *legion = worker_find_work(self);
+    if (!legion) {
+      worker_park(self);
+      continue;
+    }
+    if (self->spinning) {
+      worker_stop_spinning(self);
     }
 
-    // 4. Execute legion if we have one
+    // Execute legion if we have one
     if (legion && legion->state == LEGION_STATE_RUNNABLE) {
-      g_scheduler->current_legion[thread_id] = legion;
+      // Output it left on another worker goes first
+      if (legion->output && legion->output != &self->out) {
+        output_flush(legion->output);
+      }
+      legion->output = NULL;
+      self->current_legion = legion;
       legion->thread_id = thread_id;
       legion->state = LEGION_STATE_RUNNING;
 
-      // Set up context for legion execution
-      // It's already set up by spawn or previous yield
-
-      // Save scheduler context and switch to legion
-      Context *saved_ctx = &scheduler_ctx;
-      malphas_context_switch(saved_ctx, &legion->ctx);
-
-      // We return here when legion yields or completes
-      // The legion may have yielded, so check if it's still current
-      if (g_scheduler->current_legion[thread_id] == legion) {
-        g_scheduler->current_legion[thread_id] = NULL;
-        legion->thread_id = -1;
-
-        // If legion completed, it already decremented active_legions
-        // If it yielded, it should have been re-queued
-        if (legion->state == LEGION_STATE_DEAD) {
-          // Legion completed - nothing to do
-        } else if (legion->state == LEGION_STATE_RUNNABLE) {
-          // Legion yielded - already re-queued
+      // Save scheduler context and switch to legion, whose arena (if
+      // any) serves its allocations while it runs here
+      t_arena = legion->arena;
+      worker_bump_run_seq(self);
+      worker_stat(self, STAT_RUNS, 1);
+      trace(TRACE_RUN, legion->id, 0);
+      malphas_context_switch(&self->scheduler_ctx, &legion->ctx);
+      worker_bump_run_seq(self);
+      int preempted = worker_clear_preempt(self) &&
+                      legion->state == LEGION_STATE_RUNNABLE;
+      trace(TRACE_STOP, legion->id, preempted ? -1 : (int64_t)legion->state);
+
+      // We return here when the legion yields, parks or completes; its
+      // context is saved by now
+      legion->arena = t_arena;
+      t_arena = NULL;
+      self->current_legion = NULL;
+      legion->thread_id = -1;
+      if (atomic_load_explicit(&self->out.len, memory_order_relaxed) > 0) {
+        legion->output = &self->out;
+      }
+
+      if (legion->state == LEGION_STATE_RUNNABLE) {
+        // Legion yielded - put it at the back of the global queue, since
+        // our own deque is LIFO and would just hand it straight back
+        global_push(legion);
+        scheduler_wake_idle();
+      } else if (legion->state == LEGION_STATE_BLOCKED) {
+        // Legion parked - release its locks last, since once they are
+        // dropped it may be woken and resumed elsewhere at any moment
+        void (*unlock)(void *) = legion->park_unlock;
+        void *unlock_arg = legion->park_arg;
+        legion->park_unlock = NULL;
+        legion->park_arg = NULL;
+        if (unlock) {
+          unlock(unlock_arg);
         }
+        // Any timer it parks on is armed by now
+        scheduler_drain_check();
+      } else if (legion->state == LEGION_STATE_DEAD) {
+        // Legion completed - it is off its stack now, so recycle both
+        legion_pool_put(self, legion);
+        scheduler_drain_check();
       }
-    } else if (!legion && atomic_load(&g_scheduler->active_legions) == 0) {
-      // No active legions, sleep a bit
-      usleep(1000);
     }
   }
 
+  if (signal_stack.ss_sp != MAP_FAILED) {
+    stack_t disable;
+    memset(&disable, 0, sizeof(disable));
+    disable.ss_flags = SS_DISABLE;
+    sigaltstack(&disable, NULL);
+    munmap(signal_stack.ss_sp, LEGION_SIGNAL_STACK_SIZE);
+  }
   return NULL;
 }
 
-// Shutdown scheduler
+// Whether shutdown still has legions to wait for: one is running or
+// runnable, or a blocked one can still be woken by a timer (a sleep or a
+// timed wait) or by I/O. Legions blocked on anything else could only be woken
+// by the others, which are all blocked too, so they never will be. The loads
+// go in this order so that a timer leaving its heap for the legion it wakes
+// is seen in at least one of the three.
+static int scheduler_draining_busy(void) {
+  return timers_earliest() != INT64_MAX ||
+         atomic_load(&g_scheduler->timers_firing) > 0 ||
+         atomic_load(&g_netpoll.waiters) > 0 ||
+         atomic_load(&g_scheduler->active_legions) > 0;
+}
+
+// Called after a legion has parked or completed (and after a timer has
+// fired): wake shutdown if it is draining and nothing is left to wait for.
+// Each side stores before it loads the other's flag, all sequentially
+// consistent, so the drain or its last waker sees the other's write.
+static void scheduler_drain_check(void) {
+  if (atomic_load(&g_scheduler->draining) && !scheduler_draining_busy()) {
+    note_wakeup(&g_scheduler->drain_note);
+  }
+}
+
+// Shutdown scheduler. Generated programs call this when main returns, so the
+// legions main leaves behind still run to completion (or until all of them
+// are blocked for good) before the process exits.
 void runtime_scheduler_shutdown(void) {
   if (!g_scheduler) {
     return;
   }
 
+  atomic_store(&g_scheduler->draining, 1);
+  while (scheduler_draining_busy()) {
+    note_sleep(&g_scheduler->drain_note, -1);
+    note_clear(&g_scheduler->drain_note);
+  }
+
   atomic_store(&g_scheduler->shutdown, 1);
+  note_wakeup(&g_scheduler->monitor_note);
+  pthread_join(g_scheduler->monitor, NULL);
+
+  // Wake retired and idle workers so they can exit
+  pthread_mutex_lock(&g_scheduler->procs_mutex);
+  pthread_cond_broadcast(&g_scheduler->procs_cond);
+  pthread_mutex_unlock(&g_scheduler->procs_mutex);
+  scheduler_wake_all();
 
   // Wait for all threads
-  for (int i = 0; i < g_scheduler->num_threads; i++) {
-    pthread_join(g_scheduler->threads[i], NULL);
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    pthread_join(g_scheduler->workers[i].thread, NULL);
   }
+  runtime_stdout_flush();
 
   // Cleanup
-  for (int i = 0; i < MAX_OS_THREADS; i++) {
-    pthread_mutex_destroy(&g_scheduler->queue_mutex[i]);
-    pthread_cond_destroy(&g_scheduler->queue_cond[i]);
+  for (int i = 0; i < g_scheduler->num_workers; i++) {
+    Worker *w = &g_scheduler->workers[i];
+    legion_destroy_list(w->free_legions);
+    w->free_legions = NULL;
+    w->free_count = 0;
   }
+  legion_destroy_list(g_scheduler->pool_depot);
+  g_scheduler->pool_depot = NULL;
+  g_scheduler->pool_depot_count = 0;
+  pthread_mutex_destroy(&g_scheduler->pool_mutex);
+  pthread_mutex_destroy(&g_scheduler->global_mutex);
+  pthread_mutex_destroy(&g_scheduler->idle_mutex);
 }
@@ -23,23 +23,91 @@ typedef struct {
     size_t len;
     size_t cap;
     size_t elem_size;
+    size_t flags;  // SLICE_* bits
+    struct Arena* arena;  // Arena the slice was created in, where its buffer grows (NULL: none)
 } Slice;
 
-// HashMap type (simplified)
+// Slice flags
+#define SLICE_POINTER_FREE 1  // Elements hold no pointers (data is not scanned by the GC)
+#define SLICE_SHARED 2        // Data is shared with a subslice view (copied before the first write)
+
+// StringBuilder type (growable buffer for building strings, opaque)
+typedef struct StringBuilder StringBuilder;
+
+// Argument kinds passed to runtime_string_formatv
+#define FORMAT_ARG_I64 0     // int64_t
+#define FORMAT_ARG_F64 1     // double
+#define FORMAT_ARG_BOOL 2    // int64_t, 0 or 1
+#define FORMAT_ARG_STRING 3  // String*
+
+// HashMap type (open addressing, opaque)
 typedef struct HashMap HashMap;
 
 // Channel type
 typedef struct Channel Channel;
 
+// Select case passed to runtime_select
+#define SELECT_CASE_SEND 0
+#define SELECT_CASE_RECV 1
+typedef struct {
+    Channel* channel;  // NULL channels are never ready
+    void* elem;        // Send: value to send; recv: destination (may be NULL)
+    int32_t kind;      // SELECT_CASE_SEND or SELECT_CASE_RECV
+    int32_t received;  // Out (recv): 1 if a value arrived, 0 if closed
+} SelectCase;
+
+// Readiness awaited by runtime_io_wait
+#define IO_WAIT_READ 0
+#define IO_WAIT_WRITE 1
+
+// Runtime statistics: totals since startup, summed over the workers, plus a
+// snapshot of the queues and the heap
+typedef struct RuntimeStats {
+    int64_t legions_spawned;
+    int64_t legions_completed;
+    int64_t legions_active;   // Runnable, running or blocked legions
+    int64_t runs;             // Times a worker switched to a legion
+    int64_t yields;           // Yields, including preemptions
+    int64_t preemptions;      // Yields forced at a safepoint
+    int64_t blocks;           // Parks on a channel, select, sleep or I/O
+    int64_t unblocks;
+    int64_t chan_parks;       // Channel and select operations that had to wait
+    int64_t steal_attempts;   // Deques a spinning worker tried to steal from
+    int64_t steals;           // Attempts that got at least one legion
+    int64_t legions_stolen;
+    int64_t worker_parks;     // Workers going to sleep for lack of work
+    int64_t worker_wakeups;   // Wakeups sent to sleeping workers
+    int64_t global_queue_len; // Legions on the global queue now
+    int64_t local_queue_len;  // Legions on the workers' deques now
+    int64_t allocs;           // runtime_alloc and runtime_alloc_atomic calls
+    int64_t alloc_bytes;      // Bytes they returned (rounded up to 16)
+    int64_t gc_collections;
+    int64_t gc_pause_ns;      // Total time spent in collections
+    int64_t gc_heap_bytes;
+    int64_t workers;          // Workers allowed to run legions
+} RuntimeStats;
+
+// Arena (region of allocations freed all at once, opaque)
+typedef struct Arena Arena;
+
 // Legion (user-level concurrent entity, spawned by spawn keyword) type
 // Named after the demonic host - many legions can run concurrently
 typedef struct Legion Legion;
 
+// WaitGroup (counter that parks waiters until it reaches zero, opaque)
+typedef struct WaitGroup WaitGroup;
+
+// JoinHandle (completion and result of one legion, opaque)
+typedef struct JoinHandle JoinHandle;
+
 // Garbage collector initialization
 void runtime_gc_init(void);
 
 // Memory allocation
 void* runtime_alloc(size_t size);
+void* runtime_alloc_atomic(size_t size);  // Allocate memory that will never hold pointers (not scanned by the GC, not zeroed)
+Arena* runtime_arena_begin(void);  // Open an arena: the calling legion's allocations come from it until it ends (arenas nest)
+void runtime_arena_end(Arena* arena);  // Free everything allocated in the innermost arena at once (nothing from it may be used afterwards)
 
 // String operations
 String* runtime_string_new(const char* data, size_t len);
@@ -51,6 +119,20 @@ String* runtime_string_from_i64(int64_t value);  // Convert int64 to string
 String* runtime_string_from_double(double value);  // Convert double to string
 String* runtime_string_from_bool(int8_t value);  // Convert bool to string
 String* runtime_string_format(String* fmt, String* arg1, String* arg2, String* arg3, String* arg4);  // Format string with {} placeholders
+String* runtime_string_formatv(String* fmt, int64_t nargs, ...);  // Format string with {} placeholders: nargs arguments, each preceded by its FORMAT_ARG_* kind
+String* runtime_string_intern(String* s);  // Return the canonical String with the same contents (equal interned strings are the same pointer)
+int64_t runtime_string_find(String* s, String* sub);  // Byte index of the first occurrence of sub in s, or -1 (0 if sub is empty)
+int8_t runtime_string_contains(String* s, String* sub);  // Returns 1 if sub occurs in s, 0 otherwise
+Slice* runtime_string_split(String* s, String* sep);  // The pieces of s between occurrences of sep, as a []string (s alone if sep is empty)
+
+// StringBuilder operations (amortised appends; finish hands the buffer over without copying)
+StringBuilder* runtime_string_builder_new(int64_t capacity);  // Create a builder with room for capacity bytes
+void runtime_string_builder_append(StringBuilder* sb, String* s);  // Append a string (NULL appends nothing)
+void runtime_string_builder_append_i64(StringBuilder* sb, int64_t value);  // Append an integer in decimal
+void runtime_string_builder_append_double(StringBuilder* sb, double value);  // Append a double as %g
+void runtime_string_builder_append_bool(StringBuilder* sb, int8_t value);  // Append "true" or "false"
+int64_t runtime_string_builder_len(StringBuilder* sb);  // Bytes appended so far
+String* runtime_string_builder_finish(StringBuilder* sb);  // Return the contents as a String and leave the builder empty
 
 // Print functions
 void runtime_println_i64(int64_t value);
@@ -59,9 +141,10 @@ void runtime_println_i8(int8_t value);
 void runtime_println_double(double value);
 void runtime_println_bool(int8_t value);  // i1 in LLVM, int8_t in C
 void runtime_println_string(String* s);
+void runtime_stdout_flush(void);  // Write out buffered output (also done at exit; MALPHAS_STDOUT=unbuffered disables buffering)
 
 // Slice operations (for Vec)
-Slice* runtime_slice_new(size_t elem_size, size_t len, size_t cap);
+Slice* runtime_slice_new(size_t elem_size, size_t len, size_t cap, int8_t pointer_free);  // Create a slice (pointer_free: elements hold no pointers, so data is not scanned by the GC)
 void* runtime_slice_get(Slice* slice, size_t index);
 void runtime_slice_set(Slice* slice, size_t index, void* value);
 void runtime_slice_push(Slice* slice, void* value);
@@ -73,40 +156,81 @@ void runtime_slice_clear(Slice* slice);  // Clear all elements (set len to 0)
 void* runtime_slice_pop(Slice* slice);  // Remove and return last element (returns NULL if empty)
 void runtime_slice_remove(Slice* slice, size_t index);  // Remove element at index
 void runtime_slice_insert(Slice* slice, size_t index, void* value);  // Insert element at index
-Slice* runtime_slice_copy(Slice* slice);  // Create a copy of the slice
-Slice* runtime_slice_subslice(Slice* slice, size_t start, size_t end);  // Create sub-slice [start:end)
+Slice* runtime_slice_copy(Slice* slice);  // Create a copy of the slice (with a buffer of its own)
+Slice* runtime_slice_subslice(Slice* slice, size_t start, size_t end);  // Create a view of [start:end) without copying (copy-on-write)
+void runtime_slice_make_writable(Slice* slice);  // Give a SLICE_SHARED slice a buffer of its own before it is written in place (inline stores)
+void runtime_slice_grow(Slice* slice);  // Make room for one more element in a buffer of its own (slow path of inline pushes)
+void runtime_slice_index_panic(int64_t index, size_t len);  // Report an out-of-bounds index and abort (inline bounds checks, never returns)
 
 // HashMap operations
 HashMap* runtime_hashmap_new(void);
 void runtime_hashmap_put(HashMap* map, String* key, void* value);
 void* runtime_hashmap_get(HashMap* map, String* key);
 int8_t runtime_hashmap_contains_key(HashMap* map, String* key);  // Returns 1 if key exists, 0 otherwise
+int8_t runtime_hashmap_remove(HashMap* map, String* key);  // Removes key, returns 1 if it was present
+void runtime_hashmap_clear(HashMap* map);  // Remove all entries (keeps capacity)
+int8_t runtime_hashmap_iter_next(HashMap* map, size_t* cursor, String** key, void** value);  // Advance cursor (start at 0), returns 1 while entries remain
 size_t runtime_hashmap_len(HashMap* map);  // Returns the number of key-value pairs
 int8_t runtime_hashmap_is_empty(HashMap* map);  // Returns 1 if empty, 0 otherwise
 void runtime_hashmap_free(HashMap* map);
 
 // Channel operations
-Channel* runtime_channel_new(size_t elem_size, size_t capacity);  // Create a new channel
+Channel* runtime_channel_new(size_t elem_size, size_t capacity, int8_t pointer_free);  // Create a new channel (pointer_free: elements hold no pointers)
+Channel* runtime_channel_new_spsc(size_t elem_size, size_t capacity, int8_t pointer_free);  // Create a channel with exactly one sender and one receiver (lock-free ring without contended atomics)
 void runtime_channel_send(Channel* ch, void* value);  // Send a value to channel (blocks if full)
 void* runtime_channel_recv(Channel* ch);  // Receive a value from channel (blocks if empty)
+int8_t runtime_channel_recv_into(Channel* ch, void* dst);  // Receive into dst (blocks if empty), returns 0 and zero-fills dst if closed
 void runtime_channel_close(Channel* ch);  // Close the channel
 int8_t runtime_channel_is_closed(Channel* ch);  // Returns 1 if closed, 0 otherwise
 int8_t runtime_channel_try_send(Channel* ch, void* value);  // Try to send (non-blocking), returns 1 if successful, 0 if would block
 int8_t runtime_channel_try_recv(Channel* ch, void** value);  // Try to receive (non-blocking), returns 1 if successful, 0 if would block
-void runtime_channel_wait_for_send(Channel* ch);  // Wait on condition variable for send to become possible (must hold mutex)
-void runtime_channel_wait_for_recv(Channel* ch);  // Wait on condition variable for recv to become possible (must hold mutex)
-void runtime_nanosleep(long nanoseconds);  // Sleep for specified nanoseconds (for select polling with timeout)
+int8_t runtime_channel_try_recv_into(Channel* ch, void* dst);  // Try to receive into dst (non-blocking), returns 1 if successful, 0 if would block
+int64_t runtime_channel_send_many(Channel* ch, Slice* values);  // Send every element of values in order (blocks while full), returns how many were sent before the channel closed
+int64_t runtime_channel_recv_many(Channel* ch, Slice* dst, int64_t max);  // Append up to max elements to dst, blocking until there is at least one: returns the count, 0 if closed and empty
+int64_t runtime_select(SelectCase* cases, int64_t ncases, int8_t block);  // Run a select: returns chosen case index, or -1 if !block and none ready
+int64_t runtime_select_timeout(SelectCase* cases, int64_t ncases, int64_t timeout_ns);  // Run a select that gives up after timeout_ns (< 0 waits forever, 0 polls): returns chosen case index, or -1 on timeout
+int8_t runtime_channel_send_timeout(Channel* ch, void* value, int64_t timeout_ns);  // Send, giving up after timeout_ns: returns 1 if sent, 0 if timed out (or closed)
+int8_t runtime_channel_recv_into_timeout(Channel* ch, void* dst, int64_t timeout_ns);  // Receive into dst, giving up after timeout_ns: returns 1 if received, 0 if closed (dst zero-filled), -1 if timed out
+void runtime_nanosleep(long nanoseconds);  // Sleep for specified nanoseconds (parks only the calling legion)
+int64_t runtime_nanotime(void);  // Monotonic clock in nanoseconds
+
+// Non-blocking I/O (errors are returned as -errno; blocking parks only the calling legion)
+int64_t runtime_io_open(int64_t fd);  // Make fd non-blocking and register it with the network poller (done on first wait otherwise)
+int64_t runtime_io_wait(int64_t fd, int32_t mode, int64_t timeout_ns);  // Park until fd is ready for mode (IO_WAIT_READ/IO_WAIT_WRITE): returns 0, or -ETIMEDOUT after timeout_ns (< 0 waits forever, 0 polls)
+int64_t runtime_io_read(int64_t fd, void* buf, int64_t len);  // Read up to len bytes: returns the count (0 at end of file)
+int64_t runtime_io_write(int64_t fd, const void* buf, int64_t len);  // Write all len bytes: returns len, or the count written before an error
+int64_t runtime_io_accept(int64_t fd);  // Accept a connection: returns the new registered descriptor
+int64_t runtime_io_close(int64_t fd);  // Deregister and close fd (waiters wake with -EBADF)
+int64_t runtime_tcp_listen(String* host, int64_t port);  // Listen on host:port (empty host: all addresses): returns the listening descriptor
+int64_t runtime_tcp_connect(String* host, int64_t port);  // Connect to host:port (empty host: loopback): returns the connected descriptor
 
 // Legion and scheduler operations
 void runtime_scheduler_init(void);  // Initialize the infernal scheduler (call once at startup)
+int64_t runtime_scheduler_set_workers(int64_t n);  // Set how many OS threads run legions (n <= 0 only queries), returns the previous count
 Legion* runtime_legion_spawn(void (*fn)(void*), void* arg, size_t stack_size);  // Spawn a new legion (from spawn keyword)
 void runtime_legion_start(Legion* legion);  // Start a legion (add to scheduler)
 void runtime_legion_yield(void);  // Yield control to scheduler (cooperative)
+void runtime_safepoint(void);  // Yield if the monitor asked this worker to (polled on loop back-edges)
 void* runtime_scheduler_run(void* arg);  // Run the infernal scheduler (called by OS threads)
-void runtime_scheduler_shutdown(void);  // Shutdown scheduler (wait for all legions to complete)
+void runtime_scheduler_shutdown(void);  // Shutdown scheduler: park until every started legion has returned or is blocked for good, then stop the workers (called when main returns)
 Legion* runtime_get_current_legion(void);  // Get the currently running legion (NULL if not in legion context)
 void runtime_legion_block(Legion* legion, Channel* channel);  // Block a legion on a channel
 void runtime_legion_unblock(Legion* legion);  // Unblock a legion
+JoinHandle* runtime_legion_join_handle(Legion* legion);  // Make a legion joinable (call before runtime_legion_start)
+void* runtime_legion_join(JoinHandle* handle);  // Park until the legion returns, then return its result (see runtime_legion_set_result)
+void runtime_legion_set_result(void* result);  // Set the value runtime_legion_join returns for the calling legion (NULL by default)
+
+// Wait groups (parking, never spinning; also the `spawn scope { }` join point)
+WaitGroup* runtime_waitgroup_new(void);  // Create a wait group with a count of 0
+void runtime_waitgroup_add(WaitGroup* wg, int64_t delta);  // Add delta to the count (aborts if it goes negative)
+void runtime_waitgroup_done(WaitGroup* wg);  // Subtract 1, waking the waiters when the count reaches 0
+void runtime_waitgroup_wait(WaitGroup* wg);  // Park until the count is 0
+void runtime_waitgroup_track(WaitGroup* wg, Legion* legion);  // Add 1 now and subtract it when the legion returns (call before runtime_legion_start)
+
+void runtime_stats(RuntimeStats* out);  // Fill out with the current statistics
+void runtime_stats_print(FILE* f);  // Print the statistics and per-worker counters (also on SIGUSR1 and, with MALPHAS_STATS=1, at exit)
+void runtime_trace_write(void);  // Write the MALPHAS_TRACE event trace now (done at exit when tracing is on)
+void runtime_bench(const char* name, int64_t (*fn)(int64_t n));  // Calibrate and run a benchmark that does its operation n times, printing BENCH sample lines (see malphas bench)
 
 #endif // RUNTIME_H
 
@@ -0,0 +1,155 @@
+// tests/runtime/batch_test.c
+// send_many and recv_many move runs of values but keep channel semantics:
+// FIFO order, a batched send parks while the buffer is full and a batched
+// receive while it is empty, a receive takes at most max and appends, and a
+// close ends both
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define MS (1000 * 1000)
+#define PRODUCERS 4
+#define PER_PRODUCER 5000
+
+static Channel *ch;
+static WaitGroup *wg;
+static atomic_llong sent_total;
+static atomic_llong sum;
+static atomic_llong count;
+
+static void spawn_tracked(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+static Slice *range(int64_t from, int64_t n) {
+    Slice *s = runtime_slice_new(sizeof(int64_t), 0, (size_t)n, 1);
+    for (int64_t v = from; v < from + n; v++) {
+        runtime_slice_push(s, &v);
+    }
+    return s;
+}
+
+static int64_t at(Slice *s, size_t i) {
+    return *(int64_t *)runtime_slice_get(s, i);
+}
+
+static void send_range(void *arg) {
+    int64_t n = (int64_t)(intptr_t)arg;
+    atomic_store(&sent_total, runtime_channel_send_many(ch, range(0, n)));
+}
+
+static void send_one_later(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * MS);
+    int64_t v = 42;
+    runtime_channel_send(ch, &v);
+}
+
+static void produce(void *arg) {
+    int64_t base = (int64_t)(intptr_t)arg * PER_PRODUCER;
+    runtime_channel_send_many(ch, range(base, PER_PRODUCER));
+}
+
+static void consume(void *arg) {
+    (void)arg;
+    Slice *got = runtime_slice_new(sizeof(int64_t), 0, 64, 1);
+    int64_t n;
+    while ((n = runtime_channel_recv_many(ch, got, 64)) > 0) {
+        for (size_t i = 0; i < got->len; i++) {
+            atomic_fetch_add(&sum, at(got, i));
+        }
+        atomic_fetch_add(&count, n);
+        got->len = 0;
+    }
+}
+
+// Send n values through ch from a legion, receiving in batches of up to max
+static void check_order(const char *name, int64_t n, int64_t max) {
+    spawn_tracked(send_range, (void *)(intptr_t)n);
+    Slice *got = runtime_slice_new(sizeof(int64_t), 0, 0, 1);
+    int ok = 1;
+    while ((int64_t)got->len < n) {
+        int64_t k = runtime_channel_recv_many(ch, got, max);
+        ok &= k >= 1 && k <= max;
+    }
+    runtime_waitgroup_wait(wg);
+    for (size_t i = 0; i < got->len; i++) {
+        ok &= at(got, i) == (int64_t)i;
+    }
+    printf("%s: sent %lld, received %zu in order in batches of at most %lld: "
+           "%s\n",
+           name, (long long)atomic_load(&sent_total), got->len,
+           (long long)max, ok ? "ok" : "FAIL");
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(2);
+    wg = runtime_waitgroup_new();
+
+    // More values than the buffer holds: the sender parks while it is full
+    ch = runtime_channel_new(sizeof(int64_t), 4, 1);
+    check_order("buffered", 1000, 3);
+    ch = runtime_channel_new(sizeof(int64_t), 0, 1);
+    check_order("unbuffered", 100, 8);
+
+    // A receive on an empty buffer parks until a value arrives
+    ch = runtime_channel_new(sizeof(int64_t), 4, 1);
+    spawn_tracked(send_one_later, NULL);
+    Slice *got = runtime_slice_new(sizeof(int64_t), 0, 0, 1);
+    int64_t k = runtime_channel_recv_many(ch, got, 4);
+    runtime_waitgroup_wait(wg);
+    printf("recv_many on an empty buffer waited for %lld: %lld\n",
+           (long long)k, (long long)at(got, 0));
+
+    // At most max, appended after what the slice already holds
+    runtime_channel_send_many(ch, range(10, 4));
+    got = range(0, 2);
+    k = runtime_channel_recv_many(ch, got, 3);
+    printf("took %lld of 4, slice now", (long long)k);
+    for (size_t i = 0; i < got->len; i++) {
+        printf(" %lld", (long long)at(got, i));
+    }
+    printf("\n");
+    k = runtime_channel_recv_many(ch, got, 3);
+    printf("then %lld more\n", (long long)k);
+
+    // Closing a full buffer stops a parked send_many; the buffered values are
+    // still delivered, then recv_many reports the close
+    ch = runtime_channel_new(sizeof(int64_t), 2, 1);
+    spawn_tracked(send_range, (void *)(intptr_t)5);
+    runtime_nanosleep(10 * MS);
+    runtime_channel_close(ch);
+    runtime_waitgroup_wait(wg);
+    got = runtime_slice_new(sizeof(int64_t), 0, 0, 1);
+    int64_t drained = runtime_channel_recv_many(ch, got, 8);
+    k = runtime_channel_recv_many(ch, got, 8);
+    printf("send_many cut off by close sent %lld, drained %lld, then %lld\n",
+           (long long)atomic_load(&sent_total), (long long)drained,
+           (long long)k);
+
+    // Batches from several producers and consumers at once
+    ch = runtime_channel_new(sizeof(int64_t), 32, 1);
+    WaitGroup *consumers = runtime_waitgroup_new();
+    for (int i = 0; i < 4; i++) {
+        Legion *l = runtime_legion_spawn(consume, NULL, 0);
+        runtime_waitgroup_track(consumers, l);
+        runtime_legion_start(l);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        spawn_tracked(produce, (void *)(intptr_t)i);
+    }
+    runtime_waitgroup_wait(wg);
+    runtime_channel_close(ch);
+    runtime_waitgroup_wait(consumers);
+    int64_t n = (int64_t)PRODUCERS * PER_PRODUCER;
+    printf("contended: received %lld, sum %s\n", (long long)atomic_load(&count),
+           atomic_load(&sum) == n * (n - 1) / 2 ? "ok" : "FAIL");
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
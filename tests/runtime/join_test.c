@@ -0,0 +1,111 @@
+// tests/runtime/join_test.c
+// Join handles and wait groups park their waiters until the legions they
+// track return: a join yields the legion's result (also once it has already
+// returned), every waiter on a wait group wakes when it reaches zero, a
+// legion can wait on its own children, and shutdown waits for what is left
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define MS (1000 * 1000)
+#define CHILDREN 1000
+#define WAITERS 8
+
+static atomic_llong counter;
+static atomic_int woken;
+static WaitGroup *gate;
+
+static void square(void *arg) {
+    intptr_t n = (intptr_t)arg;
+    runtime_nanosleep(5 * MS);
+    runtime_legion_set_result((void *)(n * n));
+}
+
+static void count(void *arg) {
+    (void)arg;
+    atomic_fetch_add(&counter, 1);
+}
+
+// Waits on its own children, then returns how many ran
+static void parent(void *arg) {
+    (void)arg;
+    WaitGroup *wg = runtime_waitgroup_new();
+    for (int i = 0; i < CHILDREN; i++) {
+        Legion *l = runtime_legion_spawn(count, NULL, 0);
+        runtime_waitgroup_track(wg, l);
+        runtime_legion_start(l);
+    }
+    runtime_waitgroup_wait(wg);
+    runtime_legion_set_result((void *)(intptr_t)atomic_load(&counter));
+}
+
+static void wait_at_gate(void *arg) {
+    (void)arg;
+    runtime_waitgroup_wait(gate);
+    atomic_fetch_add(&woken, 1);
+}
+
+static void late(void *arg) {
+    (void)arg;
+    runtime_nanosleep(20 * MS);
+    atomic_fetch_add(&counter, 1);
+}
+
+static JoinHandle *spawn_joinable(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    JoinHandle *h = runtime_legion_join_handle(l);
+    runtime_legion_start(l);
+    return h;
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(4);
+
+    JoinHandle *handles[4];
+    for (intptr_t i = 0; i < 4; i++) {
+        handles[i] = spawn_joinable(square, (void *)(i + 1));
+    }
+    printf("joined:");
+    for (int i = 3; i >= 0; i--) {
+        printf(" %lld", (long long)(intptr_t)runtime_legion_join(handles[i]));
+    }
+    printf("\n");
+
+    JoinHandle *done = spawn_joinable(count, NULL);
+    runtime_nanosleep(20 * MS);
+    runtime_legion_join(done);
+    printf("join after return: %lld\n",
+           (long long)atomic_exchange(&counter, 0));
+
+    JoinHandle *p = spawn_joinable(parent, NULL);
+    printf("parent saw %lld of %d children\n",
+           (long long)(intptr_t)runtime_legion_join(p), CHILDREN);
+
+    // Every waiter wakes when the count reaches zero, and not before
+    gate = runtime_waitgroup_new();
+    runtime_waitgroup_add(gate, 2);
+    WaitGroup *waiters = runtime_waitgroup_new();
+    for (int i = 0; i < WAITERS; i++) {
+        Legion *l = runtime_legion_spawn(wait_at_gate, NULL, 0);
+        runtime_waitgroup_track(waiters, l);
+        runtime_legion_start(l);
+    }
+    runtime_nanosleep(10 * MS);
+    runtime_waitgroup_done(gate);
+    runtime_nanosleep(10 * MS);
+    printf("woken at count 1: %d\n", atomic_load(&woken));
+    runtime_waitgroup_done(gate);
+    runtime_waitgroup_wait(waiters);
+    printf("woken at count 0: %d\n", atomic_load(&woken));
+    runtime_waitgroup_wait(gate);
+    printf("wait at zero returns at once\n");
+
+    atomic_store(&counter, 0);
+    runtime_legion_start(runtime_legion_spawn(late, NULL, 0));
+    runtime_scheduler_shutdown();
+    printf("after shutdown: %lld\n", (long long)atomic_load(&counter));
+    return 0;
+}
@@ -0,0 +1,118 @@
+// tests/runtime/netpoll_test.c
+// A legion blocked on I/O parks on the network poller and leaves its worker
+// free: with one worker, the legion that makes the descriptor ready still
+// runs, and a read, a write through a full pipe, end of file and a close all
+// wake the waiter
+
+#include "runtime.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MS (1000 * 1000)
+#define BULK (1 << 20)
+
+static int fds[2];
+static atomic_int reader_done;
+static WaitGroup *wg;
+
+static void spawn_tracked(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+static void read_hello(void *arg) {
+    (void)arg;
+    char buf[64] = {0};
+    int64_t n = runtime_io_read(fds[0], buf, sizeof(buf) - 1);
+    atomic_store(&reader_done, 1);
+    printf("read %lld bytes: %s\n", (long long)n, buf);
+}
+
+static void write_hello(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * MS);
+    printf("writer ran while the reader waited: %s\n",
+           atomic_load(&reader_done) ? "no" : "yes");
+    runtime_io_write(fds[1], "hello", 5);
+}
+
+static void write_bulk(void *arg) {
+    (void)arg;
+    static char buf[BULK];
+    for (int i = 0; i < BULK; i++) {
+        buf[i] = (char)(i % 251);
+    }
+    int64_t n = runtime_io_write(fds[1], buf, BULK);
+    printf("wrote %lld bytes\n", (long long)n);
+    runtime_io_close(fds[1]);
+}
+
+static void read_bulk(void *arg) {
+    (void)arg;
+    char buf[4096];
+    int64_t total = 0;
+    int ok = 1;
+    int64_t n;
+    while ((n = runtime_io_read(fds[0], buf, sizeof(buf))) > 0) {
+        for (int64_t i = 0; i < n; i++) {
+            ok &= buf[i] == (char)((total + i) % 251);
+        }
+        total += n;
+    }
+    printf("read %lld bytes to end of file (%lld): %s\n", (long long)total,
+           (long long)n, ok ? "ok" : "FAIL");
+}
+
+static void wait_until_closed(void *arg) {
+    (void)arg;
+    int64_t err = runtime_io_wait(fds[0], IO_WAIT_READ, -1);
+    printf("waiter woken by close: %s\n", err == -EBADF ? "EBADF" : "FAIL");
+}
+
+static void open_pipe(void) {
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        _exit(1);
+    }
+    runtime_io_open(fds[0]);
+    runtime_io_open(fds[1]);
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(1);
+    wg = runtime_waitgroup_new();
+
+    open_pipe();
+    int64_t start = runtime_nanotime();
+    int64_t err = runtime_io_wait(fds[0], IO_WAIT_READ, 10 * MS);
+    printf("wait on an empty pipe: %s after 10ms: %s\n",
+           err == -ETIMEDOUT ? "ETIMEDOUT" : "FAIL",
+           runtime_nanotime() - start >= 10 * MS ? "yes" : "no");
+
+    spawn_tracked(read_hello, NULL);
+    spawn_tracked(write_hello, NULL);
+    runtime_waitgroup_wait(wg);
+
+    // A pipe holds far less than BULK, so the writer parks until the reader
+    // makes room
+    spawn_tracked(read_bulk, NULL);
+    spawn_tracked(write_bulk, NULL);
+    runtime_waitgroup_wait(wg);
+    runtime_io_close(fds[0]);
+
+    open_pipe();
+    spawn_tracked(wait_until_closed, NULL);
+    runtime_nanosleep(10 * MS);
+    runtime_io_close(fds[0]);
+    runtime_waitgroup_wait(wg);
+    runtime_io_close(fds[1]);
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
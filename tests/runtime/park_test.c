@@ -0,0 +1,82 @@
+// tests/runtime/park_test.c
+// Idle workers sleep instead of spinning, and new work (a spawn, or a
+// legion made runnable by a send) wakes one up
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ROUNDS 100
+
+static atomic_int ran;
+static Channel *ch;
+
+static void work(void *arg) {
+    (void)arg;
+    atomic_fetch_add(&ran, 1);
+}
+
+static void wait_for_value(void *arg) {
+    int64_t *out = arg;
+    runtime_channel_recv_into(ch, out);
+}
+
+static int64_t cpu_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(4);
+
+    // Start the workers, then leave them with nothing to do
+    WaitGroup *wg = runtime_waitgroup_new();
+    Legion *l = runtime_legion_spawn(work, NULL, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+    runtime_waitgroup_wait(wg);
+
+    RuntimeStats before, after;
+    runtime_nanosleep(20 * 1000 * 1000);
+    runtime_stats(&before);
+    int64_t cpu = cpu_time();
+    runtime_nanosleep(200 * 1000 * 1000);
+    cpu = cpu_time() - cpu;
+    // Four spinning workers would burn about 800ms here
+    printf("idle workers burned under 50ms of CPU: %s\n",
+           cpu < 50 * 1000 * 1000 ? "yes" : "no");
+
+    for (int i = 0; i < ROUNDS; i++) {
+        runtime_nanosleep(1000 * 1000);
+        l = runtime_legion_spawn(work, NULL, 0);
+        runtime_waitgroup_track(wg, l);
+        runtime_legion_start(l);
+        runtime_waitgroup_wait(wg);
+    }
+    runtime_stats(&after);
+    printf("spawns onto sleeping workers ran: %d of %d\n",
+           atomic_load(&ran) - 1, ROUNDS);
+    printf("workers parked and were woken: %s\n",
+           after.worker_parks > before.worker_parks &&
+                   after.worker_wakeups > before.worker_wakeups
+               ? "yes"
+               : "no");
+
+    ch = runtime_channel_new(sizeof(int64_t), 0, 1);
+    int64_t v = 0;
+    l = runtime_legion_spawn(wait_for_value, &v, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+    runtime_nanosleep(20 * 1000 * 1000);
+    int64_t sent = 5;
+    runtime_channel_send(ch, &sent);
+    runtime_waitgroup_wait(wg);
+    printf("legion woken by a send received %lld\n", (long long)v);
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
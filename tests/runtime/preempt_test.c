@@ -0,0 +1,76 @@
+// tests/runtime/preempt_test.c
+// A legion spinning in a loop is preempted at its back-edge safepoint once
+// it has held its worker for a time slice, so other legions on the same
+// worker still run
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define SPINNERS 3
+
+// Set by the monitor thread; compiled code polls it on every loop back-edge
+extern atomic_int runtime_preempt_requested;
+
+static atomic_int stop;
+static atomic_int started;
+static WaitGroup *wg;
+
+static void spawn_tracked(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+// What a compiled loop does at its back-edge
+static inline void safepoint(void) {
+    if (atomic_load_explicit(&runtime_preempt_requested, memory_order_relaxed))
+        runtime_safepoint();
+}
+
+static void spin_until_stopped(void *arg) {
+    (void)arg;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed))
+        safepoint();
+}
+
+static void stopper(void *arg) {
+    (void)arg;
+    atomic_store(&stop, 1);
+}
+
+// Each spinner keeps its worker until every one of them has started: only
+// time slicing gets them all there
+static void spin_until_all_started(void *arg) {
+    (void)arg;
+    atomic_fetch_add(&started, 1);
+    while (atomic_load_explicit(&started, memory_order_relaxed) < SPINNERS)
+        safepoint();
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(1);
+    wg = runtime_waitgroup_new();
+
+    RuntimeStats before, after;
+    runtime_stats(&before);
+    spawn_tracked(spin_until_stopped, NULL);
+    spawn_tracked(stopper, NULL);
+    runtime_waitgroup_wait(wg);
+    runtime_stats(&after);
+    printf("busy loop stopped by a legion on its worker: yes\n");
+    printf("preempted: %s\n",
+           after.preemptions > before.preemptions ? "yes" : "no");
+
+    for (int i = 0; i < SPINNERS; i++) {
+        spawn_tracked(spin_until_all_started, NULL);
+    }
+    runtime_waitgroup_wait(wg);
+    printf("%d busy loops shared one worker: %d started\n", SPINNERS,
+           atomic_load(&started));
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
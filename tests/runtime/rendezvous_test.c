@@ -0,0 +1,112 @@
+// tests/runtime/rendezvous_test.c
+// An unbuffered channel hands each value from one sender straight to one
+// receiver: a send completes only once a receiver has taken it, and closing
+// the channel releases senders and receivers still waiting
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define ROUNDS 10000
+
+static Channel *ch;
+static Channel *ping;
+static Channel *pong;
+static atomic_int sent;
+
+static void send_seven(void *arg) {
+    (void)arg;
+    int64_t v = 7;
+    runtime_channel_send(ch, &v);
+    atomic_store(&sent, 1);
+}
+
+static void recv_one(void *arg) {
+    int64_t *out = arg;
+    runtime_channel_recv_into(ch, out);
+}
+
+static void echo(void *arg) {
+    (void)arg;
+    int64_t v;
+    while (runtime_channel_recv_into(ping, &v)) {
+        v++;
+        runtime_channel_send(pong, &v);
+    }
+}
+
+static void spawn_tracked(WaitGroup *wg, void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(2);
+
+    ch = runtime_channel_new(sizeof(int64_t), 0, 1);
+    int64_t v = 1;
+    printf("try_send without a receiver: %d\n",
+           runtime_channel_try_send(ch, &v));
+    printf("send_timeout without a receiver: %d\n",
+           runtime_channel_send_timeout(ch, &v, 5 * 1000 * 1000));
+    printf("try_recv without a sender: %d\n",
+           runtime_channel_try_recv_into(ch, &v));
+
+    // The sender stays blocked until we receive
+    WaitGroup *wg = runtime_waitgroup_new();
+    spawn_tracked(wg, send_seven, NULL);
+    runtime_nanosleep(20 * 1000 * 1000);
+    printf("sent before the receive: %d\n", atomic_load(&sent));
+    v = 0;
+    runtime_channel_recv_into(ch, &v);
+    runtime_waitgroup_wait(wg);
+    printf("received %lld, sent %d\n", (long long)v, atomic_load(&sent));
+
+    // Each value goes to exactly one receiver
+    int64_t got[2] = {0, 0};
+    spawn_tracked(wg, recv_one, &got[0]);
+    spawn_tracked(wg, recv_one, &got[1]);
+    for (v = 1; v <= 2; v++) {
+        runtime_channel_send(ch, &v);
+    }
+    runtime_waitgroup_wait(wg);
+    printf("two receivers got %lld\n", (long long)(got[0] + got[1]));
+
+    // Round trips through two rendezvous
+    ping = runtime_channel_new(sizeof(int64_t), 0, 1);
+    pong = runtime_channel_new(sizeof(int64_t), 0, 1);
+    spawn_tracked(wg, echo, NULL);
+    int ok = 1;
+    for (int64_t i = 0; i < ROUNDS; i++) {
+        v = i;
+        runtime_channel_send(ping, &v);
+        runtime_channel_recv_into(pong, &v);
+        ok &= v == i + 1;
+    }
+    runtime_channel_close(ping);
+    runtime_waitgroup_wait(wg);
+    printf("%d round trips: %s\n", ROUNDS, ok ? "ok" : "FAIL");
+
+    // Closing releases a blocked sender and a blocked receiver
+    ch = runtime_channel_new(sizeof(int64_t), 0, 1);
+    atomic_store(&sent, 0);
+    spawn_tracked(wg, send_seven, NULL);
+    runtime_nanosleep(10 * 1000 * 1000);
+    runtime_channel_close(ch);
+    runtime_waitgroup_wait(wg);
+    printf("sender released by close: %d\n", atomic_load(&sent));
+
+    ch = runtime_channel_new(sizeof(int64_t), 0, 1);
+    got[0] = -1;
+    spawn_tracked(wg, recv_one, &got[0]);
+    runtime_nanosleep(10 * 1000 * 1000);
+    runtime_channel_close(ch);
+    runtime_waitgroup_wait(wg);
+    printf("receiver released by close with %lld\n", (long long)got[0]);
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
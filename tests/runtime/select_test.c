@@ -0,0 +1,118 @@
+// tests/runtime/select_test.c
+// runtime_select parks the selecting legion until a case is ready: a send
+// from another legion, a receiver making room, or a close wakes it
+
+#include "runtime.h"
+#include <stdio.h>
+
+static Channel *a;
+static Channel *b;
+static Channel *full;
+static Channel *done;
+
+static void select_recv(void *arg) {
+    (void)arg;
+    int64_t va = 0, vb = 0;
+    SelectCase cases[2] = {
+        {.channel = a, .elem = &va, .kind = SELECT_CASE_RECV},
+        {.channel = b, .elem = &vb, .kind = SELECT_CASE_RECV},
+    };
+    int64_t chosen = runtime_select(cases, 2, 1);
+    printf("recv: case %lld, received %d, value %lld\n", (long long)chosen,
+           cases[chosen].received, (long long)vb);
+
+    int64_t token = 1;
+    runtime_channel_send(done, &token);
+}
+
+static void send_later(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * 1000 * 1000);
+    int64_t v = 42;
+    runtime_channel_send(b, &v);
+}
+
+static void select_send(void *arg) {
+    (void)arg;
+    int64_t v = 2;
+    SelectCase cases[2] = {
+        {.channel = NULL, .elem = &v, .kind = SELECT_CASE_SEND},
+        {.channel = full, .elem = &v, .kind = SELECT_CASE_SEND},
+    };
+    int64_t chosen = runtime_select(cases, 2, 1);
+    printf("send: case %lld\n", (long long)chosen);
+
+    int64_t token = 1;
+    runtime_channel_send(done, &token);
+}
+
+static void drain_later(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * 1000 * 1000);
+    int64_t v = 0;
+    runtime_channel_recv_into(full, &v);
+    printf("drained %lld\n", (long long)v);
+}
+
+static void select_closed(void *arg) {
+    (void)arg;
+    int64_t v = -1;
+    SelectCase cases[1] = {
+        {.channel = a, .elem = &v, .kind = SELECT_CASE_RECV},
+    };
+    int64_t chosen = runtime_select(cases, 1, 1);
+    printf("closed: case %lld, received %d, value %lld\n", (long long)chosen,
+           cases[chosen].received, (long long)v);
+
+    int64_t token = 1;
+    runtime_channel_send(done, &token);
+}
+
+static void close_later(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * 1000 * 1000);
+    runtime_channel_close(a);
+}
+
+static void run(void (*waiter)(void *), void (*waker)(void *)) {
+    RuntimeStats before, after;
+    runtime_stats(&before);
+    runtime_legion_start(runtime_legion_spawn(waiter, NULL, 0));
+    runtime_legion_start(runtime_legion_spawn(waker, NULL, 0));
+    int64_t token = 0;
+    runtime_channel_recv_into(done, &token);
+    runtime_stats(&after);
+    printf("parked: %s\n", after.chan_parks > before.chan_parks ? "yes" : "no");
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    // One worker: the waker can only run while the selecting legion is parked
+    runtime_scheduler_set_workers(1);
+
+    a = runtime_channel_new(sizeof(int64_t), 0, 1);
+    b = runtime_channel_new(sizeof(int64_t), 1, 1);
+    full = runtime_channel_new(sizeof(int64_t), 1, 1);
+    done = runtime_channel_new(sizeof(int64_t), 1, 1);
+
+    int64_t v = 0;
+    SelectCase poll[2] = {
+        {.channel = a, .elem = &v, .kind = SELECT_CASE_RECV},
+        {.channel = b, .elem = &v, .kind = SELECT_CASE_RECV},
+    };
+    printf("poll: %lld\n", (long long)runtime_select(poll, 2, 0));
+
+    run(select_recv, send_later);
+
+    v = 1;
+    runtime_channel_send(full, &v);
+    run(select_send, drain_later);
+    runtime_channel_recv_into(full, &v);
+    printf("full now holds %lld\n", (long long)v);
+
+    run(select_closed, close_later);
+
+    runtime_scheduler_shutdown();
+    return 0;
+}
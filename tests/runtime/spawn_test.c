@@ -0,0 +1,76 @@
+// tests/runtime/spawn_test.c
+// Every spawned legion runs exactly once, however many are spawned at once:
+// from outside the workers (global queue), from one legion (its deque
+// overflowing into the global queue) and from a tree of legions (stealing)
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define FLAT 10000
+#define FAN_OUT 5000
+#define TREE_DEPTH 12
+
+static atomic_llong ran;
+static WaitGroup *wg;
+
+static void work(void *arg) {
+    (void)arg;
+    atomic_fetch_add(&ran, 1);
+}
+
+static void spawn_tracked(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+static void fan_out(void *arg) {
+    (void)arg;
+    for (int i = 0; i < FAN_OUT; i++) {
+        spawn_tracked(work, NULL);
+    }
+}
+
+static void tree(void *arg) {
+    intptr_t depth = (intptr_t)arg;
+    atomic_fetch_add(&ran, 1);
+    if (depth > 0) {
+        spawn_tracked(tree, (void *)(depth - 1));
+        spawn_tracked(tree, (void *)(depth - 1));
+    }
+}
+
+static void check(const char *name, long long want) {
+    runtime_waitgroup_wait(wg);
+    long long got = atomic_exchange(&ran, 0);
+    printf("%s: %lld of %lld ran\n", name, got, want);
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    runtime_scheduler_set_workers(4);
+    wg = runtime_waitgroup_new();
+
+    RuntimeStats before, after;
+    runtime_stats(&before);
+
+    for (int i = 0; i < FLAT; i++) {
+        spawn_tracked(work, NULL);
+    }
+    check("from main", FLAT);
+
+    spawn_tracked(fan_out, NULL);
+    check("from one legion", FAN_OUT);
+
+    spawn_tracked(tree, (void *)(intptr_t)TREE_DEPTH);
+    check("tree", (1LL << (TREE_DEPTH + 1)) - 1);
+
+    runtime_scheduler_shutdown();
+    runtime_stats(&after);
+    long long spawned = after.legions_spawned - before.legions_spawned;
+    long long completed = after.legions_completed - before.legions_completed;
+    printf("spawned %lld, completed %lld\n", spawned, completed);
+    return 0;
+}
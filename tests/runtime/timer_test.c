@@ -0,0 +1,126 @@
+// tests/runtime/timer_test.c
+// Sleeps and timeouts park only the calling legion and end at their
+// deadline: sleepers wake in deadline order, a timed-out select or channel
+// operation returns no earlier than asked, and one that completes in time
+// returns as soon as it does
+
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define MS (1000 * 1000)
+#define SLEEPERS 100
+
+static Channel *order;
+static Channel *empty;
+static Channel *late;
+static WaitGroup *wg;
+
+static void spawn_tracked(void (*fn)(void *), void *arg) {
+    Legion *l = runtime_legion_spawn(fn, arg, 0);
+    runtime_waitgroup_track(wg, l);
+    runtime_legion_start(l);
+}
+
+static void sleep_then_report(void *arg) {
+    int64_t ms = (int64_t)(intptr_t)arg;
+    runtime_nanosleep(ms * MS);
+    runtime_channel_send(order, &ms);
+}
+
+static void nap(void *arg) {
+    (void)arg;
+    runtime_nanosleep(50 * MS);
+}
+
+static void send_late(void *arg) {
+    (void)arg;
+    runtime_nanosleep(10 * MS);
+    int64_t v = 9;
+    runtime_channel_send(late, &v);
+}
+
+// The timed operations run in a legion, where they park on the scheduler's
+// timers rather than the thread
+static void timeouts(void *arg) {
+    (void)arg;
+    int64_t v = 0;
+    SelectCase cases[2] = {
+        {.channel = empty, .elem = &v, .kind = SELECT_CASE_RECV},
+        {.channel = late, .elem = &v, .kind = SELECT_CASE_RECV},
+    };
+
+    int64_t start = runtime_nanotime();
+    printf("select polling: %lld\n",
+           (long long)runtime_select_timeout(cases, 2, 0));
+    int64_t chosen = runtime_select_timeout(cases, 1, 20 * MS);
+    int64_t elapsed = runtime_nanotime() - start;
+    printf("select timed out: %lld, after 20ms: %s\n", (long long)chosen,
+           elapsed >= 20 * MS ? "yes" : "no");
+
+    spawn_tracked(send_late, NULL);
+    start = runtime_nanotime();
+    chosen = runtime_select_timeout(cases, 2, 1000 * MS);
+    elapsed = runtime_nanotime() - start;
+    printf("select got case %lld value %lld, well before 1s: %s\n",
+           (long long)chosen, (long long)v, elapsed < 500 * MS ? "yes" : "no");
+
+    start = runtime_nanotime();
+    int8_t got = runtime_channel_recv_into_timeout(empty, &v, 10 * MS);
+    elapsed = runtime_nanotime() - start;
+    printf("recv timed out: %d, after 10ms: %s\n", got,
+           elapsed >= 10 * MS ? "yes" : "no");
+
+    Channel *full = runtime_channel_new(sizeof(int64_t), 1, 1);
+    v = 1;
+    printf("send with room: %d\n",
+           runtime_channel_send_timeout(full, &v, 10 * MS));
+    start = runtime_nanotime();
+    got = runtime_channel_send_timeout(full, &v, 10 * MS);
+    elapsed = runtime_nanotime() - start;
+    printf("send timed out: %d, after 10ms: %s\n", got,
+           elapsed >= 10 * MS ? "yes" : "no");
+    printf("recv with a value: %d\n",
+           runtime_channel_recv_into_timeout(full, &v, 10 * MS));
+    runtime_channel_close(full);
+    printf("recv on closed: %d\n",
+           runtime_channel_recv_into_timeout(full, &v, 10 * MS));
+}
+
+int main(void) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    runtime_gc_init();
+    // One worker: anything that blocked the thread would serialize the sleeps
+    runtime_scheduler_set_workers(1);
+    wg = runtime_waitgroup_new();
+
+    order = runtime_channel_new(sizeof(int64_t), 3, 1);
+    spawn_tracked(sleep_then_report, (void *)(intptr_t)60);
+    spawn_tracked(sleep_then_report, (void *)(intptr_t)20);
+    spawn_tracked(sleep_then_report, (void *)(intptr_t)40);
+    runtime_waitgroup_wait(wg);
+    printf("woke in order:");
+    for (int i = 0; i < 3; i++) {
+        int64_t ms;
+        runtime_channel_recv_into(order, &ms);
+        printf(" %lldms", (long long)ms);
+    }
+    printf("\n");
+
+    int64_t start = runtime_nanotime();
+    for (int i = 0; i < SLEEPERS; i++) {
+        spawn_tracked(nap, NULL);
+    }
+    runtime_waitgroup_wait(wg);
+    int64_t elapsed = runtime_nanotime() - start;
+    printf("%d sleeps of 50ms overlapped: %s\n", SLEEPERS,
+           elapsed < 1000 * MS ? "yes" : "no");
+
+    empty = runtime_channel_new(sizeof(int64_t), 1, 1);
+    late = runtime_channel_new(sizeof(int64_t), 0, 1);
+    spawn_tracked(timeouts, NULL);
+    runtime_waitgroup_wait(wg);
+
+    runtime_scheduler_shutdown();
+    return 0;
+}